@@ -0,0 +1,130 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      cache_bench.c
+// Usage:       gcc -O2 -pthread -I.. -o cache_bench cache_bench.c cache_legacy.c ../cache.c ../cache_entry.c ../buffer.c ../pool.c ../disk_cache.c ../http.c ../metrics.c
+//              ./cache_bench [entries...]
+//              Microbenchmark of lookup and insert-with-eviction cost for the hashed
+//              cache against the original linear-scan cache, at 10, 1k and 1M entries
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+#include "cache_legacy.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define BENCH_MAX_OPS 1000000
+#define BENCH_LEGACY_WORK 50000000   // Bound on legacy entries scanned per phase
+#define BENCH_URL_SIZE 64
+
+static const char BENCH_RESPONSE[] = "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n";
+
+// Byte budget per entry, so the hashed cache holds about as many entries as the legacy one
+#define BENCH_ENTRY_CHARGE (sizeof(CacheEntry) + sizeof("http://bench.local/object/") + 7 + sizeof(BENCH_RESPONSE) - 1)
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+void make_url(char *url, long id) {
+    snprintf(url, BENCH_URL_SIZE, "http://bench.local/object/%ld", id);
+}
+
+void insert_hashed(Cache *cache, long id) {
+    char url[BENCH_URL_SIZE];
+    make_url(url, id);
+    size_t size = sizeof(BENCH_RESPONSE) - 1;
+    unsigned char *response = malloc(sizeof(BENCH_RESPONSE));
+    memcpy(response, BENCH_RESPONSE, sizeof(BENCH_RESPONSE));
+    cache_insert(cache, url, response, &size);
+}
+
+// Fill cache with n entries, then time random hits and
+// inserts of new URLs that each force an eviction
+void bench_hashed(int n, long ops) {
+    char url[BENCH_URL_SIZE];
+    Cache *cache = cache_create((size_t) n * BENCH_ENTRY_CHARGE, CACHE_POLICY_LRU, 100);
+    for(long i = 0; i < n; i++) {
+        insert_hashed(cache, i);
+    }
+
+    double start = now_seconds();
+    long hits = 0;
+    for(long i = 0; i < ops; i++) {
+        make_url(url, random() % n);
+        hits += cache_check(cache, url);
+    }
+    double lookup = (now_seconds() - start) / ops;
+
+    start = now_seconds();
+    for(long i = 0; i < ops; i++) {
+        insert_hashed(cache, n + i);
+    }
+    double insert = (now_seconds() - start) / ops;
+    printf("entries=%-8d impl=hashed  lookup_ns=%-10.0f insert_evict_ns=%-10.0f hit_ratio=%.2f\n",
+           n, lookup * 1e9, insert * 1e9, (double) hits / ops);
+    cache_free(cache);
+}
+
+void bench_legacy(int n, long ops) {
+    char url[BENCH_URL_SIZE];
+    LegacyCache *cache = legacy_cache_create(n);
+    for(long i = 0; i < n; i++) {
+        make_url(url, i);
+        legacy_cache_insert(cache, url);
+    }
+
+    double start = now_seconds();
+    long hits = 0;
+    for(long i = 0; i < ops; i++) {
+        make_url(url, random() % n);
+        hits += legacy_cache_check(cache, url);
+    }
+    double lookup = (now_seconds() - start) / ops;
+
+    start = now_seconds();
+    for(long i = 0; i < ops; i++) {
+        make_url(url, n + i);
+        legacy_cache_insert(cache, url);
+    }
+    double insert = (now_seconds() - start) / ops;
+    printf("entries=%-8d impl=legacy  lookup_ns=%-10.0f insert_evict_ns=%-10.0f hit_ratio=%.2f\n",
+           n, lookup * 1e9, insert * 1e9, (double) hits / ops);
+    legacy_cache_free(cache);
+}
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    int default_sizes[] = {10, 1000, 1000000};
+    int n_sizes = 3;
+    int *sizes = default_sizes;
+    if(argc > 1) {
+        n_sizes = argc - 1;
+        sizes = malloc(n_sizes * sizeof(int));
+        for(int i = 0; i < n_sizes; i++) {
+            sizes[i] = atoi(argv[i + 1]);
+        }
+    }
+    srandom(1);
+    for(int i = 0; i < n_sizes; i++) {
+        long legacy_ops = BENCH_LEGACY_WORK / sizes[i];
+        if(legacy_ops > BENCH_MAX_OPS) {
+            legacy_ops = BENCH_MAX_OPS;
+        }
+        if(legacy_ops < 10) {
+            legacy_ops = 10;
+        }
+        bench_legacy(sizes[i], legacy_ops);
+        bench_hashed(sizes[i], BENCH_MAX_OPS);
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,123 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      cache_legacy.c
+// Usage:       Original linear-scan cache, kept only as a baseline for cache_bench.c.
+//              Same algorithms as the first cache.c (strcmp scan for lookup, two full
+//              passes with clock_gettime for eviction, array shift on evict), with the
+//              fixed MAX_CACHE_SIZE array replaced by a capacity chosen at creation
+//*************************************************************************************************
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "cache_legacy.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define LEGACY_DEFAULT_MAX_AGE 60*60
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+static int legacy_get_age(LegacyEntry *entry) {
+    struct timespec time_current;
+    clock_gettime(CLOCK_REALTIME, &time_current);
+    long seconds = time_current.tv_sec - entry->time_added.tv_sec;
+    if(time_current.tv_nsec < entry->time_added.tv_nsec) {
+        seconds -= 1;
+    }
+    return (int) seconds;
+}
+
+static bool legacy_entry_valid(LegacyEntry *entry) {
+    return legacy_get_age(entry) < entry->max_age;
+}
+
+static bool legacy_is_older(struct timespec time1, struct timespec time2) {
+    return (time1.tv_sec < time2.tv_sec) ||
+           ((time1.tv_sec == time2.tv_sec) && (time1.tv_nsec < time2.tv_nsec));
+}
+
+LegacyCache *legacy_cache_create(int capacity) {
+    LegacyCache *cache = malloc(sizeof(LegacyCache));
+    cache->entries = calloc(capacity, sizeof(LegacyEntry *));
+    cache->size = 0;
+    cache->capacity = capacity;
+    return cache;
+}
+
+void legacy_cache_free(LegacyCache *cache) {
+    for(int i = 0; i < cache->size; i++) {
+        free(cache->entries[i]->url);
+        free(cache->entries[i]);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+int legacy_get_cache_entry_index(LegacyCache *cache, const char *url) {
+    for(int i = 0; i < cache->size; i++) {
+        if(strcmp(url, cache->entries[i]->url) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void legacy_evict(LegacyCache *cache, int index) {
+    free(cache->entries[index]->url);
+    free(cache->entries[index]);
+    for(int i = index; i < (cache->size - 1); i++) {
+        cache->entries[i] = cache->entries[i+1];
+    }
+    cache->size -= 1;
+}
+
+static void legacy_eviction_protocol(LegacyCache *cache) {
+    int eviction_index = -1;
+    for(int i = 0; i < cache->size; i++) {
+        if(!legacy_entry_valid(cache->entries[i])) {
+            eviction_index = i;
+        }
+    }
+    if(eviction_index < 0) {
+        eviction_index = 0;
+        struct timespec oldest_access_time = cache->entries[0]->time_accessed;
+        for(int i = 0; i < cache->size; i++) {
+            if(legacy_is_older(cache->entries[i]->time_accessed, oldest_access_time)) {
+                oldest_access_time = cache->entries[i]->time_accessed;
+                eviction_index = i;
+            }
+        }
+    }
+    legacy_evict(cache, eviction_index);
+}
+
+void legacy_cache_insert(LegacyCache *cache, const char *url) {
+    LegacyEntry *entry = malloc(sizeof(LegacyEntry));
+    entry->url = strdup(url);
+    entry->max_age = LEGACY_DEFAULT_MAX_AGE;
+    clock_gettime(CLOCK_REALTIME, &entry->time_added);
+    clock_gettime(CLOCK_REALTIME, &entry->time_accessed);
+    if(cache->size == cache->capacity) {
+        legacy_eviction_protocol(cache);
+    }
+    cache->entries[cache->size] = entry;
+    cache->size += 1;
+}
+
+// Lookup as done by cache_check followed by the access-time
+// update in cache_retrieval
+bool legacy_cache_check(LegacyCache *cache, const char *url) {
+    int index = legacy_get_cache_entry_index(cache, url);
+    if(index < 0) {
+        return false;
+    }
+    if(!legacy_entry_valid(cache->entries[index])) {
+        legacy_evict(cache, index);
+        return false;
+    }
+    clock_gettime(CLOCK_REALTIME, &cache->entries[index]->time_accessed);
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
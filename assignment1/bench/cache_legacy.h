@@ -0,0 +1,36 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      cache_legacy.h
+// Usage:       Header file for the original linear-scan cache used as a benchmark baseline
+//*************************************************************************************************
+#ifndef CACHE_LEGACY_H
+#define CACHE_LEGACY_H
+
+#include <stdbool.h>
+#include <time.h>
+
+// ----STRUCT--------------------------------------------------------------------------------------
+typedef struct LegacyEntry{
+    char *url;
+    struct timespec time_added;
+    struct timespec time_accessed;
+    int max_age;
+} LegacyEntry;
+
+typedef struct LegacyCache{
+    LegacyEntry **entries;
+    int size;
+    int capacity;
+} LegacyCache;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+LegacyCache *legacy_cache_create(int capacity);
+void legacy_cache_free(LegacyCache *cache);
+int legacy_get_cache_entry_index(LegacyCache *cache, const char *url);
+void legacy_cache_insert(LegacyCache *cache, const char *url);
+bool legacy_cache_check(LegacyCache *cache, const char *url);
+
+#endif
+//-------------------------------------------------------------------------------------------------
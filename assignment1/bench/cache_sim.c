@@ -0,0 +1,174 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      cache_sim.c
+// Usage:       gcc -O2 -pthread -I.. -o cache_sim cache_sim.c ../cache.c ../cache_entry.c ../buffer.c ../pool.c ../disk_cache.c ../http.c ../metrics.c -lm
+//              ./cache_sim [-m cache_bytes] [-O max_object_percent] [trace_file]
+//              ./cache_sim [-m cache_bytes] [-n requests] [-o objects] [-a zipf_alpha]
+//              Replays a trace of "<url> <size>" lines through cache.c once per
+//              replacement policy and reports object and byte hit ratios. Without a
+//              trace file, a synthetic trace with Zipf popularity and heavy-tailed
+//              object sizes is generated
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define SIM_URL_SIZE 2048
+#define SIM_MIN_OBJECT_SIZE 100
+#define SIM_MAX_OBJECT_SIZE 20*1024*1024
+
+static const char SIM_RESPONSE_HEADER[] = "HTTP/1.0 200 OK\r\n\r\n";
+
+typedef struct TraceRecord{
+    char *url;
+    size_t size;
+} TraceRecord;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+// Read "<url> <size>" lines from trace file. Return number of records read
+long load_trace(const char *path, TraceRecord **trace) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        perror("Error opening trace");
+        exit(EXIT_FAILURE);
+    }
+    long capacity = 1024, n = 0;
+    *trace = malloc(capacity * sizeof(TraceRecord));
+    char url[SIM_URL_SIZE];
+    size_t size;
+    while(fscanf(file, "%2047s %zu", url, &size) == 2) {
+        if(n == capacity) {
+            capacity *= 2;
+            *trace = realloc(*trace, capacity * sizeof(TraceRecord));
+        }
+        (*trace)[n].url = strdup(url);
+        (*trace)[n].size = size;
+        n++;
+    }
+    fclose(file);
+    return n;
+}
+
+// Generate trace of n_requests over n_objects with Zipf(alpha) popularity.
+// Object sizes follow a log-normal distribution around 16 KB, so a few
+// large objects carry much of the byte volume
+long generate_trace(long n_requests, long n_objects, double alpha, TraceRecord **trace) {
+    double *cdf = malloc(n_objects * sizeof(double));
+    double total = 0;
+    for(long i = 0; i < n_objects; i++) {
+        total += 1.0 / pow(i + 1, alpha);
+        cdf[i] = total;
+    }
+    size_t *sizes = malloc(n_objects * sizeof(size_t));
+    char **urls = malloc(n_objects * sizeof(char *));
+    srandom(42);
+    for(long i = 0; i < n_objects; i++) {
+        double u1 = (random() + 1.0) / ((double) RAND_MAX + 2.0);
+        double u2 = (random() + 1.0) / ((double) RAND_MAX + 2.0);
+        double normal = sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+        double size = exp(log(16 * 1024) + 1.5 * normal);
+        if(size < SIM_MIN_OBJECT_SIZE) {
+            size = SIM_MIN_OBJECT_SIZE;
+        }
+        if(size > SIM_MAX_OBJECT_SIZE) {
+            size = SIM_MAX_OBJECT_SIZE;
+        }
+        sizes[i] = (size_t) size;
+        char url[SIM_URL_SIZE];
+        snprintf(url, sizeof(url), "http://sim.local/object/%ld", i);
+        urls[i] = strdup(url);
+    }
+
+    *trace = malloc(n_requests * sizeof(TraceRecord));
+    for(long r = 0; r < n_requests; r++) {
+        double target = (random() / ((double) RAND_MAX + 1.0)) * total;
+        long low = 0, high = n_objects - 1;
+        while(low < high) {
+            long mid = (low + high) / 2;
+            if(cdf[mid] < target) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        (*trace)[r].url = urls[low];
+        (*trace)[r].size = sizes[low];
+    }
+    free(cdf);
+    free(sizes);
+    return n_requests;
+}
+
+// Replay trace through a cache with the given policy and print hit ratios
+void simulate(TraceRecord *trace, long n, size_t cache_bytes, CachePolicy policy, int max_object_percent) {
+    Cache *cache = cache_create(cache_bytes, policy, max_object_percent);
+    long hits = 0, bypassed = 0;
+    double bytes_hit = 0, bytes_total = 0;
+    for(long i = 0; i < n; i++) {
+        bytes_total += trace[i].size;
+        if(cache_check(cache, trace[i].url)) {
+            hits += 1;
+            bytes_hit += trace[i].size;
+            continue;
+        }
+        if(!cache_admissible(cache, trace[i].size)) {
+            bypassed += 1;
+            continue;
+        }
+        // Only the header is written. The rest of the object is left
+        // untouched so large objects cost no resident memory
+        size_t size = trace[i].size;
+        unsigned char *response = calloc(size + sizeof(SIM_RESPONSE_HEADER), 1);
+        memcpy(response, SIM_RESPONSE_HEADER, sizeof(SIM_RESPONSE_HEADER) - 1);
+        cache_insert(cache, trace[i].url, response, &size);
+    }
+    printf("policy=%-8s object_hit_ratio=%.4f byte_hit_ratio=%.4f bypassed=%ld\n",
+           cache_policy_name(policy), (double) hits / n, bytes_hit / bytes_total, bypassed);
+    cache_free(cache);
+}
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    size_t cache_bytes = 64 * 1024 * 1024;
+    int max_object_percent = DEFAULT_MAX_OBJECT_PERCENT;
+    long n_requests = 1000000;
+    long n_objects = 100000;
+    double alpha = 0.9;
+    int option;
+    while((option = getopt(argc, argv, "m:O:n:o:a:")) != -1) {
+        switch(option) {
+            case 'm': cache_bytes = strtoull(optarg, NULL, 10) * 1024 * 1024; break;
+            case 'O': max_object_percent = atoi(optarg); break;
+            case 'n': n_requests = atol(optarg); break;
+            case 'o': n_objects = atol(optarg); break;
+            case 'a': alpha = atof(optarg); break;
+            default:
+                printf("Usage: %s [-m cache_mb] [-O max_object_percent] [-n requests] [-o objects] [-a alpha] [trace_file]\n", argv[0]);
+                return -1;
+        }
+    }
+
+    TraceRecord *trace;
+    long n;
+    if(optind < argc) {
+        n = load_trace(argv[optind], &trace);
+        printf("trace=%s requests=%ld cache_mb=%zu\n", argv[optind], n, cache_bytes >> 20);
+    } else {
+        n = generate_trace(n_requests, n_objects, alpha, &trace);
+        printf("trace=zipf alpha=%.2f objects=%ld requests=%ld cache_mb=%zu\n",
+               alpha, n_objects, n, cache_bytes >> 20);
+    }
+    simulate(trace, n, cache_bytes, CACHE_POLICY_LRU, max_object_percent);
+    simulate(trace, n, cache_bytes, CACHE_POLICY_GDSF, max_object_percent);
+    simulate(trace, n, cache_bytes, CACHE_POLICY_TINYLFU, max_object_percent);
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,265 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      chaos.c
+// Usage:       gcc -O2 -o chaos chaos.c
+//              ./chaos [-p proxy_port] [-s slowloris] [-r opens_per_second] [-i interval_ms]
+//                      [-a impatient] [-w wait_ms] [-d seconds] <url>
+//              Misbehaving clients, for loading the proxy while well-behaved ones are
+//              measured with loadgen. Slowloris clients open up to <slowloris>
+//              connections, at most <opens_per_second> a second, and trickle a request
+//              header one byte every <interval_ms> without ever finishing it; any the
+//              proxy closes are opened again. Impatient clients each send a complete
+//              request for <url>, usually on an origin that has stalled, give up on it
+//              after <wait_ms> and send the next. A "%d" in the URL is replaced by a
+//              request number so that none are answered from cache. After <seconds>
+//              it reports how many slowloris connections the proxy closed and how
+//              the impatient requests ended
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define CHAOS_DEFAULT_PORT 9120
+#define CHAOS_REQUEST_MAX_SIZE 4096
+#define CHAOS_READ_SIZE 4096
+#define CHAOS_MAX_EVENTS 256
+#define CHAOS_POLL_MS 10
+#define CHAOS_CONNECT_TIMEOUT_MS 200
+#define CHAOS_TRICKLE "X-Slow: trickled one byte at a time\r\n"
+
+typedef enum ClientKind{
+    CLIENT_SLOWLORIS,
+    CLIENT_IMPATIENT
+} ClientKind;
+
+typedef struct Client{
+    ClientKind kind;
+    int fd;
+    double opened;
+    double next_byte;          // Slowloris only: when the next header byte is due
+    size_t trickled;
+} Client;
+
+struct sockaddr_in proxy_addr;
+const char *url;
+long request_number = 0;
+int slowloris_open = 0;
+int slowloris_peak = 0;
+long slowloris_opened = 0;
+long slowloris_closed = 0;     // Closed by the proxy
+long open_failures = 0;
+long impatient_sent = 0;
+long impatient_abandoned = 0;
+long impatient_shed = 0;       // Answered with a 503
+long impatient_answered = 0;   // Answered with anything else
+long impatient_closed = 0;     // Closed by the proxy without an answer
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Open a connection to the proxy for client and send the start of its
+// request: the request line alone for a slowloris client, all of it for
+// an impatient one. Return -1 if the connection could not be opened
+int open_client(int epoll_fd, Client *client, double now) {
+    char request[CHAOS_REQUEST_MAX_SIZE];
+    char target[CHAOS_REQUEST_MAX_SIZE / 2];
+    snprintf(target, sizeof(target), url, request_number++);
+    int length;
+    if(client->kind == CLIENT_SLOWLORIS) {
+        length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\n", target);
+    } else {
+        length = snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\n\r\n", target);
+    }
+
+    client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(client->fd < 0) {
+        open_failures++;
+        return -1;
+    }
+    // Connect blocking, so the request can be sent at once. The proxy is
+    // local, so this is only slow if its accept queue is full, and then the
+    // send timeout gives up on it rather than holding up every other client
+    struct timeval timeout = {0, CHAOS_CONNECT_TIMEOUT_MS * 1000};
+    setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if(connect(client->fd, (struct sockaddr *) &proxy_addr, sizeof(proxy_addr)) < 0 ||
+       send(client->fd, request, length, MSG_NOSIGNAL) < 0) {
+        close(client->fd);
+        client->fd = -1;
+        open_failures++;
+        return -1;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = client;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->fd, &event);
+    client->opened = now;
+    client->next_byte = now;
+    client->trickled = 0;
+    if(client->kind == CLIENT_SLOWLORIS) {
+        slowloris_open++;
+        slowloris_opened++;
+        if(slowloris_open > slowloris_peak) {
+            slowloris_peak = slowloris_open;
+        }
+    } else {
+        impatient_sent++;
+    }
+    return 0;
+}
+
+void close_client(Client *client) {
+    close(client->fd);
+    client->fd = -1;
+    if(client->kind == CLIENT_SLOWLORIS) {
+        slowloris_open--;
+    }
+}
+
+// The proxy has sent something or closed the connection. Slowloris
+// clients expect nothing but the close; impatient ones record how their
+// request ended
+void handle_client(Client *client) {
+    char data[CHAOS_READ_SIZE];
+    ssize_t received = recv(client->fd, data, sizeof(data) - 1, MSG_DONTWAIT);
+    if(received < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if(client->kind == CLIENT_SLOWLORIS) {
+        slowloris_closed++;
+    } else if(received <= 0) {
+        impatient_closed++;
+    } else {
+        data[received] = '\0';
+        if(strncmp(data, "HTTP/1.1 503", 12) == 0 || strncmp(data, "HTTP/1.0 503", 12) == 0) {
+            impatient_shed++;
+        } else {
+            impatient_answered++;
+        }
+    }
+    close_client(client);
+}
+
+int main(int argc, char *argv[]) {
+    int port = CHAOS_DEFAULT_PORT;
+    int n_slowloris = 1000;
+    double open_rate = 200;
+    int interval_ms = 1000;
+    int n_impatient = 0;
+    int wait_ms = 500;
+    double duration = 10;
+    int option;
+    while((option = getopt(argc, argv, "p:s:r:i:a:w:d:")) != -1) {
+        switch(option) {
+            case 'p': port = atoi(optarg); break;
+            case 's': n_slowloris = atoi(optarg); break;
+            case 'r': open_rate = atof(optarg); break;
+            case 'i': interval_ms = atoi(optarg); break;
+            case 'a': n_impatient = atoi(optarg); break;
+            case 'w': wait_ms = atoi(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if(optind != argc - 1 || n_slowloris < 0 || n_impatient < 0 || open_rate <= 0 ||
+       interval_ms < 1 || wait_ms < 1 || duration <= 0) {
+        printf("Usage: %s [-p proxy_port] [-s slowloris] [-r opens_per_second] [-i interval_ms]\n"
+               "       [-a impatient] [-w wait_ms] [-d seconds] <url>\n", argv[0]);
+        return -1;
+    }
+    url = argv[optind];
+
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    memset(&proxy_addr, 0, sizeof(proxy_addr));
+    proxy_addr.sin_family = AF_INET;
+    proxy_addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &proxy_addr.sin_addr);
+
+    int n_clients = n_slowloris + n_impatient;
+    Client *clients = calloc(n_clients > 0 ? n_clients : 1, sizeof(Client));
+    for(int i = 0; i < n_clients; i++) {
+        clients[i].kind = (i < n_slowloris) ? CLIENT_SLOWLORIS : CLIENT_IMPATIENT;
+        clients[i].fd = -1;
+    }
+    int epoll_fd = epoll_create1(0);
+    double start = now_seconds();
+    double opens_allowed = 0;      // Slowloris connections that may be opened by now
+    struct epoll_event events[CHAOS_MAX_EVENTS];
+    while(1) {
+        double now = now_seconds();
+        if(now - start >= duration) {
+            break;
+        }
+        opens_allowed = (now - start) * open_rate - slowloris_opened;
+        for(int i = 0; i < n_clients; i++) {
+            Client *client = &clients[i];
+            if(client->kind == CLIENT_SLOWLORIS) {
+                if(client->fd < 0) {
+                    if(opens_allowed >= 1 && open_client(epoll_fd, client, now) == 0) {
+                        opens_allowed -= 1;
+                    }
+                } else if(now >= client->next_byte) {
+                    const char *trickle = CHAOS_TRICKLE;
+                    char byte = trickle[client->trickled++ % strlen(trickle)];
+                    if(send(client->fd, &byte, 1, MSG_NOSIGNAL | MSG_DONTWAIT) < 0 && errno != EAGAIN) {
+                        slowloris_closed++;
+                        close_client(client);
+                        continue;
+                    }
+                    client->next_byte = now + interval_ms / 1000.0;
+                }
+            } else {
+                if(client->fd >= 0 && now - client->opened >= wait_ms / 1000.0) {
+                    impatient_abandoned++;
+                    close_client(client);
+                }
+                if(client->fd < 0) {
+                    open_client(epoll_fd, client, now);
+                }
+            }
+        }
+
+        int n_events = epoll_wait(epoll_fd, events, CHAOS_MAX_EVENTS, CHAOS_POLL_MS);
+        for(int i = 0; i < n_events; i++) {
+            Client *client = events[i].data.ptr;
+            if(client->fd >= 0) {
+                handle_client(client);
+            }
+        }
+    }
+
+    printf("slowloris_peak=%d slowloris_opened=%ld slowloris_closed=%ld slowloris_open=%d "
+           "open_failures=%ld impatient_sent=%ld abandoned=%ld shed=%ld answered=%ld closed=%ld\n",
+           slowloris_peak, slowloris_opened, slowloris_closed, slowloris_open, open_failures,
+           impatient_sent, impatient_abandoned, impatient_shed, impatient_answered, impatient_closed);
+    for(int i = 0; i < n_clients; i++) {
+        if(clients[i].fd >= 0) {
+            close(clients[i].fd);
+        }
+    }
+    free(clients);
+    close(epoll_fd);
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,166 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      fuzz_header.c
+// Usage:       clang -g -O1 -fsanitize=fuzzer,address,undefined -I.. -o fuzz_header fuzz_header.c ../http.c
+//              ./fuzz_header [corpus_dir]
+//              gcc -g -O1 -fsanitize=address,undefined -DFUZZ_STANDALONE -I.. -o fuzz_header fuzz_header.c ../http.c
+//              ./fuzz_header [-n iterations] [file...]
+//              Fuzz target for the response header parser. Each input is parsed and
+//              checked against the framing's rule for where the header ends, every
+//              indexed field must lie inside the header, and the result must not
+//              depend on alignment or on bytes past the header. Without libFuzzer,
+//              the given files are checked, or else mutations of built-in headers
+//*************************************************************************************************
+#define _GNU_SOURCE               // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "http.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define FUZZ_MAX_INPUT 4096
+#define FUZZ_DEFAULT_ITERATIONS 1000000
+
+static const char *SEEDS[] = {
+    "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nCache-Control: max-age=60, s-maxage=30\r\n\r\nhello",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\nETag: \"abc\"\r\nAge: 12\r\n\r\n",
+    "HTTP/1.0 404 Not Found\r\nConnection: keep-alive\r\nExpires: Thu, 01 Oct 2026 00:00:00 GMT\r\n"
+    "Date: Wed, 30 Sep 2026 23:00:00 GMT\r\n\r\n",
+    "HTTP/1.1 304 Not Modified\r\ncache-control: no-cache=\"Set-Cookie\", private, "
+    "stale-while-revalidate=\"30\"\r\nLast-Modified: Thu, 01 Oct 2026 00:00:00 GMT\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nX: a:b\nc\r\nAge:\r\n Folded: x\r\n:\r\nContent-Length: 99999999999999999999\r\n\r\n",
+};
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+static void check(int condition, const char *message) {
+    if(!condition) {
+        fprintf(stderr, "fuzz_header: %s\n", message);
+        abort();
+    }
+}
+
+static void check_field(HttpField field, size_t length, const char *message) {
+    check(field.length == 0 || (size_t) field.offset + field.length <= length, message);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if(size > FUZZ_MAX_INPUT) {
+        return 0;
+    }
+    HttpResponseHeader parsed;
+    int length = http_parse_response_header(data, size, &parsed);
+    check(length <= (int) size, "header longer than input");
+
+    // The header ends at the first "\r\n\r\n", exactly as the framing finds it
+    const uint8_t *terminator = (size >= 12) ? memmem(data, size, "\r\n\r\n", 4) : NULL;
+    if(length > 0) {
+        check(terminator != NULL && terminator + 4 - data == length, "header end differs from framing");
+        check(parsed.length == (size_t) length, "length not recorded");
+        check_field(parsed.etag, length, "ETag outside header");
+        check_field(parsed.last_modified, length, "Last-Modified outside header");
+        check_field(parsed.age_line, length - 2, "Age line outside header");
+        check(parsed.age_line.length == 0 || memcmp(data + parsed.age_line.offset, "\r\n", 2) == 0,
+              "Age line does not start at a line break");
+        check(parsed.content_length >= HTTP_UNSET, "negative Content-Length");
+    } else if(length == 0) {
+        check(terminator == NULL, "complete header reported incomplete");
+    }
+
+    // Alignment must not matter to the vector scan, and bytes past the
+    // header must not change the index
+    uint8_t *copy = malloc(size + 1);
+    memcpy(copy + 1, data, size);
+    HttpResponseHeader shifted;
+    int shifted_length = http_parse_response_header(copy + 1, (length > 0) ? (size_t) length : size, &shifted);
+    check(shifted_length == length, "result depends on alignment or trailing bytes");
+    if(length > 0) {
+        check(shifted.status == parsed.status && shifted.content_length == parsed.content_length &&
+              shifted.chunked == parsed.chunked && shifted.no_store == parsed.no_store &&
+              shifted.max_age == parsed.max_age && shifted.s_maxage == parsed.s_maxage &&
+              shifted.age == parsed.age && shifted.expires == parsed.expires &&
+              shifted.etag.offset == parsed.etag.offset && shifted.age_line.length == parsed.age_line.length,
+              "index depends on alignment or trailing bytes");
+
+        // Any prefix of the header is incomplete
+        check(http_parse_response_header(copy + 1, length - 1, &shifted) == 0, "prefix reported complete");
+    }
+    free(copy);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+// Given seed, copy it to data and overwrite, insert or delete a few random
+// bytes, drawing most from the characters the parser treats specially.
+// Sometimes cut the result short. Return its size
+static size_t mutate(uint8_t *data, const char *seed) {
+    static const char special[] = "\r\n:, =\"\t0123456789-aA";
+    size_t size = strlen(seed);
+    memcpy(data, seed, size);
+    int mutations = 1 + random() % 4;
+    for(int i = 0; i < mutations && size > 0; i++) {
+        size_t at = random() % size;
+        uint8_t byte = (random() % 4) ? special[random() % (sizeof(special) - 1)] : (uint8_t) random();
+        switch(random() % 3) {
+            case 0:
+                data[at] = byte;
+                break;
+            case 1:
+                if(size < FUZZ_MAX_INPUT) {
+                    memmove(data + at + 1, data + at, size - at);
+                    data[at] = byte;
+                    size++;
+                }
+                break;
+            case 2:
+                memmove(data + at, data + at + 1, size - at - 1);
+                size--;
+                break;
+        }
+    }
+    if(random() % 4 == 0) {
+        size = random() % (size + 1);
+    }
+    return size;
+}
+
+//----MAIN-----------------------------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+    long iterations = FUZZ_DEFAULT_ITERATIONS;
+    int first_file = 1;
+    if(argc > 2 && strcmp(argv[1], "-n") == 0) {
+        iterations = atol(argv[2]);
+        first_file = 3;
+    }
+    uint8_t *data = malloc(FUZZ_MAX_INPUT + 1);
+    if(first_file < argc) {
+        for(int i = first_file; i < argc; i++) {
+            FILE *file = fopen(argv[i], "rb");
+            if(file == NULL) {
+                perror(argv[i]);
+                return 1;
+            }
+            size_t size = fread(data, 1, FUZZ_MAX_INPUT, file);
+            fclose(file);
+            LLVMFuzzerTestOneInput(data, size);
+        }
+        printf("fuzz_header files=%d ok\n", argc - first_file);
+        return 0;
+    }
+
+    long complete = 0;
+    for(long i = 0; i < iterations; i++) {
+        size_t size = mutate(data, SEEDS[i % (sizeof(SEEDS) / sizeof(SEEDS[0]))]);
+        HttpResponseHeader parsed;
+        complete += (http_parse_response_header(data, size, &parsed) > 0);
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("fuzz_header iterations=%ld complete=%ld ok\n", iterations, complete);
+    free(data);
+    return 0;
+}
+#endif
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,507 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      loadgen.c
+// Usage:       ./loadgen [-p proxy_port] [-c concurrency] [-n requests] [-k depth] [-r rate]
+//                        [-z exponent] [-u objects] [-s seed] <url> [url...]
+//              Load generator. Keeps <concurrency> connections busy against the
+//              proxy and reports throughput, latency and time-to-first-byte
+//              percentiles. By default each request gets its own HTTP/1.0 connection;
+//              with -k connections are kept alive and each one keeps <depth> HTTP/1.1
+//              requests pipelined, which needs responses with a Content-Length.
+//              A "%d" in a URL is replaced by the request number to force misses,
+//              or with -z by an object number from 0 to <objects> - 1 drawn from a
+//              Zipf distribution with the given exponent. With -r the load is open
+//              loop: requests are due at <rate> per second whether or not earlier
+//              ones have been answered, and latency counts from when each was due,
+//              so time queued behind a slow proxy is not hidden
+//*************************************************************************************************
+#define _GNU_SOURCE               // strcasestr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define LOADGEN_DEFAULT_PORT 9120
+#define LOADGEN_REQUEST_MAX_SIZE 4096
+#define LOADGEN_READ_SIZE 65536
+#define LOADGEN_MAX_EVENTS 256
+#define LOADGEN_MAX_DEPTH 256
+#define LOADGEN_HEADER_MAX_SIZE 8192
+#define LOADGEN_DEFAULT_OBJECTS 10000
+
+typedef struct Client{
+    int fd;
+    char *request;             // Requests not yet fully written
+    size_t request_size;
+    size_t request_sent;
+    size_t bytes_received;
+    double start;
+    double first_byte;
+
+    // Keep-alive only: start times of the pipelined requests awaiting a
+    // response, oldest first, and the response currently being read
+    double starts[LOADGEN_MAX_DEPTH];
+    int outstanding;
+    int oldest;
+    char header[LOADGEN_HEADER_MAX_SIZE];
+    size_t header_size;
+    long body_remaining;       // -1 while the header is being read
+} Client;
+
+struct sockaddr_in proxy_addr;
+char **urls;
+int n_urls;
+long requests_started = 0;
+long total_requests = 10000;
+long requests_done = 0;
+long errors = 0;
+long bytes_total = 0;
+double *latencies;
+double *first_byte_latencies;
+int pipeline_depth = 0;        // 0 for a connection per request
+double request_rate = 0;       // Requests due per second, or 0 for a closed loop
+double load_start;
+long requests_due;             // Requests that may be started by now
+double *zipf_cdf = NULL;       // Cumulative popularity of each object, or NULL
+int n_objects = LOADGEN_DEFAULT_OBJECTS;
+unsigned short zipf_seed[3] = {0, 0, 1};
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Given Zipf exponent, fill zipf_cdf with the cumulative probability of
+// each of n_objects objects, object i being requested in proportion to
+// 1 / (i + 1)^exponent
+void zipf_init(double exponent) {
+    zipf_cdf = malloc(n_objects * sizeof(double));
+    double total = 0;
+    for(int i = 0; i < n_objects; i++) {
+        total += 1 / pow(i + 1, exponent);
+        zipf_cdf[i] = total;
+    }
+    for(int i = 0; i < n_objects; i++) {
+        zipf_cdf[i] /= total;
+    }
+}
+
+// Return an object number drawn from the Zipf distribution. The draws
+// depend only on the seed, so runs are repeatable
+int zipf_draw(void) {
+    double u = erand48(zipf_seed);
+    int low = 0;
+    int high = n_objects - 1;
+    while(low < high) {
+        int mid = (low + high) / 2;
+        if(zipf_cdf[mid] < u) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Return when the next request to start began: now in a closed loop, or
+// when it fell due in an open loop
+double request_start_time(void) {
+    if(request_rate > 0) {
+        return load_start + requests_started / request_rate;
+    }
+    return now_seconds();
+}
+
+// Open loop only: bring requests_due up to date and store the time until
+// the next request falls due in timeout. Return timeout, or NULL to wait
+// without one once every request is due. The wait is timed to the
+// nanosecond, as any lateness would count in the latencies
+struct timespec *update_due(struct timespec *timeout) {
+    if(request_rate <= 0) {
+        return NULL;
+    }
+    long due = (long)((now_seconds() - load_start) * request_rate) + 1;
+    requests_due = (due < total_requests) ? due : total_requests;
+    if(requests_due == total_requests) {
+        return NULL;
+    }
+    double wait = load_start + requests_due / request_rate - now_seconds();
+    long wait_ns = (wait > 0) ? (long)(wait * 1e9) : 0;
+    timeout->tv_sec = wait_ns / 1000000000;
+    timeout->tv_nsec = wait_ns % 1000000000;
+    return timeout;
+}
+
+// Append the next request to the client's unsent requests, using the
+// given HTTP version
+void queue_request(Client *client, const char *version) {
+    // Drop requests already written so the buffer never fills up
+    if(client->request_sent > 0) {
+        client->request_size -= client->request_sent;
+        memmove(client->request, client->request + client->request_sent, client->request_size);
+        client->request_sent = 0;
+    }
+    char url[LOADGEN_REQUEST_MAX_SIZE / 2];
+    int number = (zipf_cdf != NULL) ? zipf_draw() : (int) requests_started;
+    snprintf(url, sizeof(url), urls[requests_started % n_urls], number);
+    client->request_size += snprintf(client->request + client->request_size, LOADGEN_REQUEST_MAX_SIZE,
+                                     "GET %s %s\r\nUser-Agent: loadgen\r\n\r\n", url, version);
+    requests_started += 1;
+}
+
+// Write as much of the client's unsent requests as the socket accepts.
+// Return -1 if the connection has failed
+int send_requests(Client *client) {
+    while(client->request_sent < client->request_size) {
+        ssize_t n = write(client->fd, client->request + client->request_sent,
+                          client->request_size - client->request_sent);
+        if(n < 0) {
+            return (errno == EAGAIN) ? 0 : -1;
+        }
+        client->request_sent += n;
+    }
+    return 0;
+}
+
+// Keep-alive only: pipeline requests until depth are awaiting a response
+// or every request due has been started
+void fill_pipeline(Client *client) {
+    while(client->outstanding < pipeline_depth && requests_started < requests_due) {
+        client->starts[(client->oldest + client->outstanding) % LOADGEN_MAX_DEPTH] = request_start_time();
+        client->outstanding += 1;
+        queue_request(client, "HTTP/1.1");
+    }
+}
+
+// Open a new connection for the next request, or in keep-alive mode the
+// next pipeline of requests, and queue them so they are sent once the
+// connect completes
+int start_request(int epoll_fd, Client *client) {
+    client->request_size = 0;
+    client->request_sent = 0;
+    client->bytes_received = 0;
+    if(pipeline_depth > 0) {
+        client->outstanding = 0;
+        client->oldest = 0;
+        client->header_size = 0;
+        client->body_remaining = -1;
+        fill_pipeline(client);
+    } else {
+        client->start = request_start_time();
+        queue_request(client, "HTTP/1.0");
+    }
+
+    client->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(client->fd < 0) {
+        return -1;
+    }
+    if(connect(client->fd, (struct sockaddr *) &proxy_addr, sizeof(proxy_addr)) < 0 &&
+       errno != EINPROGRESS) {
+        close(client->fd);
+        client->fd = -1;
+        return -1;
+    }
+    // Edge triggered, so a connection with nothing left to send does not
+    // keep reporting that it is writable
+    struct epoll_event event;
+    event.events = EPOLLOUT | EPOLLIN | EPOLLET;
+    event.data.ptr = client;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->fd, &event);
+    return 0;
+}
+
+// Record outcome of the request on this client and close its connection
+void finish_request(Client *client, bool success) {
+    close(client->fd);
+    client->fd = -1;
+    if(success && client->bytes_received > 0) {
+        latencies[requests_done] = now_seconds() - client->start;
+        first_byte_latencies[requests_done] = client->first_byte - client->start;
+        requests_done += 1;
+        bytes_total += client->bytes_received;
+    } else {
+        errors += 1;
+    }
+}
+
+// Keep-alive only: given bytes read from the connection, find the end of
+// each response from its Content-Length and record it. Return -1 if a
+// response cannot be delimited
+int read_responses(Client *client, const char *data, size_t size) {
+    while(size > 0) {
+        if(client->body_remaining < 0) {
+            if(client->header_size == 0) {
+                client->first_byte = now_seconds();
+            }
+            // Copy the header a byte at a time, as it may be split across reads
+            while(size > 0 && client->body_remaining < 0) {
+                if(client->header_size == LOADGEN_HEADER_MAX_SIZE - 1) {
+                    return -1;
+                }
+                client->header[client->header_size++] = *data++;
+                size--;
+                if(client->header_size >= 4 &&
+                   memcmp(client->header + client->header_size - 4, "\r\n\r\n", 4) == 0) {
+                    client->header[client->header_size] = '\0';
+                    char *length = strcasestr(client->header, "\r\nContent-Length:");
+                    if(length == NULL) {
+                        return -1;
+                    }
+                    client->body_remaining = atol(length + 17);
+                    client->bytes_received += client->header_size;
+                }
+            }
+            if(client->body_remaining < 0) {
+                return 0;
+            }
+        }
+        long body = ((long) size < client->body_remaining) ? (long) size : client->body_remaining;
+        client->body_remaining -= body;
+        client->bytes_received += body;
+        data += body;
+        size -= body;
+        if(client->body_remaining == 0) {
+            double start = client->starts[client->oldest];
+            latencies[requests_done] = now_seconds() - start;
+            first_byte_latencies[requests_done] = client->first_byte - start;
+            requests_done += 1;
+            bytes_total += client->bytes_received;
+            client->bytes_received = 0;
+            client->header_size = 0;
+            client->body_remaining = -1;
+            client->oldest = (client->oldest + 1) % LOADGEN_MAX_DEPTH;
+            client->outstanding -= 1;
+        }
+    }
+    return 0;
+}
+
+// Keep-alive only: close a connection that has failed, counting the
+// requests still awaiting a response as errors
+void fail_connection(Client *client) {
+    close(client->fd);
+    client->fd = -1;
+    errors += client->outstanding;
+}
+
+// Advance pipelined requests on a kept-alive connection. Every response
+// read makes room for another request, and the connection closes once
+// all requests have been answered. In an open loop a connection waiting
+// for the next request to fall due stays open
+void handle_pipelined_client(Client *client) {
+    char buffer[LOADGEN_READ_SIZE];
+    while(1) {
+        ssize_t n = read(client->fd, buffer, sizeof(buffer));
+        if(n > 0) {
+            if(read_responses(client, buffer, n) < 0) {
+                fail_connection(client);
+                return;
+            }
+            continue;
+        }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        fail_connection(client);
+        return;
+    }
+    fill_pipeline(client);
+    if(client->outstanding == 0 && requests_started == total_requests) {
+        close(client->fd);
+        client->fd = -1;
+        return;
+    }
+    if(send_requests(client) < 0) {
+        fail_connection(client);
+    }
+}
+
+// Advance request on client socket: send remaining request bytes,
+// then read response until the proxy closes the connection
+void handle_client(Client *client, uint32_t events) {
+    if(pipeline_depth > 0) {
+        handle_pipelined_client(client);
+        return;
+    }
+    if((events & EPOLLOUT) && send_requests(client) < 0) {
+        finish_request(client, false);
+        return;
+    }
+    if(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        char buffer[LOADGEN_READ_SIZE];
+        while(1) {
+            ssize_t n = read(client->fd, buffer, sizeof(buffer));
+            if(n > 0) {
+                if(client->bytes_received == 0) {
+                    client->first_byte = now_seconds();
+                }
+                client->bytes_received += n;
+                continue;
+            }
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            finish_request(client, n == 0);
+            return;
+        }
+    }
+}
+
+// Hand requests that are due to the clients: a closed connection opens a
+// new one, and a kept-alive connection with room in its pipeline sends
+// more on it. Once every request has started, idle kept-alive connections
+// are closed. Return change in the number of open connections
+int dispatch_requests(int epoll_fd, Client *clients, int concurrency) {
+    int opened = 0;
+    for(int i = 0; i < concurrency; i++) {
+        Client *client = &clients[i];
+        if(client->fd < 0 && requests_started < requests_due) {
+            if(start_request(epoll_fd, client) == 0) {
+                opened += 1;
+            } else {
+                client->fd = -1;
+                errors += (pipeline_depth > 0) ? client->outstanding : 1;
+            }
+        } else if(client->fd >= 0 && pipeline_depth > 0 && client->outstanding < pipeline_depth) {
+            fill_pipeline(client);
+            if(client->outstanding == 0 && requests_started == total_requests) {
+                close(client->fd);
+                client->fd = -1;
+                opened -= 1;
+            } else if(send_requests(client) < 0) {
+                fail_connection(client);
+                opened -= 1;
+            }
+        }
+    }
+    return opened;
+}
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    int port = LOADGEN_DEFAULT_PORT;
+    int concurrency = 100;
+    double zipf_exponent = 0;
+    int option;
+    while((option = getopt(argc, argv, "p:c:n:k:r:z:u:s:")) != -1) {
+        switch(option) {
+            case 'p': port = atoi(optarg); break;
+            case 'c': concurrency = atoi(optarg); break;
+            case 'n': total_requests = atol(optarg); break;
+            case 'k': pipeline_depth = atoi(optarg); break;
+            case 'r': request_rate = atof(optarg); break;
+            case 'z': zipf_exponent = atof(optarg); break;
+            case 'u': n_objects = atoi(optarg); break;
+            case 's': zipf_seed[2] = (unsigned short) atoi(optarg); break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if(optind >= argc || pipeline_depth < 0 || pipeline_depth > LOADGEN_MAX_DEPTH || request_rate < 0 ||
+       zipf_exponent < 0 || n_objects < 1) {
+        printf("Usage: %s [-p proxy_port] [-c concurrency] [-n requests] [-k depth] [-r rate]\n"
+               "       [-z exponent] [-u objects] [-s seed] <url> [url...]\n", argv[0]);
+        return -1;
+    }
+    if(zipf_exponent > 0) {
+        zipf_init(zipf_exponent);
+    }
+    urls = argv + optind;
+    n_urls = argc - optind;
+    if(concurrency > total_requests) {
+        concurrency = total_requests;
+    }
+
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    memset(&proxy_addr, 0, sizeof(proxy_addr));
+    proxy_addr.sin_family = AF_INET;
+    proxy_addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &proxy_addr.sin_addr);
+
+    latencies = malloc(total_requests * sizeof(double));
+    first_byte_latencies = malloc(total_requests * sizeof(double));
+    Client *clients = calloc(concurrency, sizeof(Client));
+    size_t depth = (pipeline_depth > 0) ? pipeline_depth : 1;
+    for(int i = 0; i < concurrency; i++) {
+        clients[i].fd = -1;
+        clients[i].request = malloc(depth * LOADGEN_REQUEST_MAX_SIZE);
+    }
+    int epoll_fd = epoll_create1(0);
+    double start = now_seconds();
+    load_start = start;
+    requests_due = total_requests;
+    struct timespec next_due;
+    struct timespec *timeout = update_due(&next_due);
+
+    // Closed loop: every finished request immediately starts the next one.
+    // Open loop: requests are handed to free connections as they fall due,
+    // and wait for one if all are busy
+    int active = 0;
+    struct epoll_event events[LOADGEN_MAX_EVENTS];
+    while(1) {
+        active += dispatch_requests(epoll_fd, clients, concurrency);
+        if(active == 0 && requests_started == total_requests) {
+            break;
+        }
+        int n_events = epoll_pwait2(epoll_fd, events, LOADGEN_MAX_EVENTS, timeout, NULL);
+        for(int i = 0; i < n_events; i++) {
+            Client *client = events[i].data.ptr;
+            if(client->fd < 0) {
+                continue;
+            }
+            handle_client(client, events[i].events);
+            if(client->fd < 0) {
+                active -= 1;
+            }
+        }
+        timeout = update_due(&next_due);
+    }
+    double elapsed = now_seconds() - start;
+
+    qsort(latencies, requests_done, sizeof(double), compare_doubles);
+    double p50 = requests_done ? latencies[requests_done / 2] : 0;
+    double p99 = requests_done ? latencies[(long)(requests_done * 0.99)] : 0;
+    double p999 = requests_done ? latencies[(long)(requests_done * 0.999)] : 0;
+    double max = requests_done ? latencies[requests_done - 1] : 0;
+    qsort(first_byte_latencies, requests_done, sizeof(double), compare_doubles);
+    double ttfb_p50 = requests_done ? first_byte_latencies[requests_done / 2] : 0;
+    double ttfb_p99 = requests_done ? first_byte_latencies[(long)(requests_done * 0.99)] : 0;
+    printf("requests=%ld errors=%ld seconds=%.3f rps=%.0f MBps=%.1f p50_ms=%.2f p99_ms=%.2f p999_ms=%.2f "
+           "max_ms=%.2f ttfb_p50_ms=%.2f ttfb_p99_ms=%.2f\n",
+           requests_done, errors, elapsed, requests_done / elapsed, bytes_total / elapsed / 1e6,
+           p50 * 1000, p99 * 1000, p999 * 1000, max * 1000, ttfb_p50 * 1000, ttfb_p99 * 1000);
+    free(latencies);
+    free(first_byte_latencies);
+    free(zipf_cdf);
+    for(int i = 0; i < concurrency; i++) {
+        free(clients[i].request);
+    }
+    free(clients);
+    close(epoll_fd);
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
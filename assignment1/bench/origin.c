@@ -0,0 +1,403 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      origin.c
+// Usage:       ./origin [-p port] [-d delay_ms] [-m max_age] [-v version]
+//              Local origin server for benchmarks. Serves GET /size/<bytes>, optionally
+//              delayed with ?delay=<ms> and throttled to ?rate=<KB/s>, and ?stall=<ms>
+//              holds back the last write of the body for that long. One thread per
+//              connection, so slow responses never hold up other requests. GET /count
+//              returns how many /size/ requests have been served so far. HTTP/1.1
+//              connections are kept alive, and ?chunked=1 sends the body chunked.
+//              Responses carry an ETag and Last-Modified, unless ?validators=0, and
+//              a matching If-None-Match is answered 304. -v or ?version=<n> changes
+//              the ETag, ?maxage=<s> the max-age and ?swr=<s> adds stale-while-revalidate.
+//              ?nostore=1 and ?private=1 send responses a shared cache must not store.
+//              Byte i of a body is 'a' + i % 26, so parts of it can be checked, and a
+//              single Range of a body sent with a Content-Length is answered 206, or
+//              416 if it lies past the end. GET /bytes returns the body bytes sent.
+//              GET /page/<n>?assets=<k>&asize=<bytes> returns an HTML page linking to <k>
+//              /size/ assets of that size, through stylesheet links, scripts and images
+//              with quoted, unquoted and relative references, each passing on the delay
+//*************************************************************************************************
+#define _GNU_SOURCE               // strcasestr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define ORIGIN_DEFAULT_PORT 8080
+#define ORIGIN_REQUEST_MAX_SIZE 8192
+#define ORIGIN_WRITE_CHUNK 65536
+
+int default_delay_ms = 0;
+int default_max_age = 3600;
+int default_version = 0;
+long requests_served = 0;
+long bytes_served = 0;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+// Given request target, return integer value of query parameter
+// "name", or fallback if the parameter is not present
+long query_param(const char *target, const char *name, long fallback) {
+    const char *query = strchr(target, '?');
+    size_t name_length = strlen(name);
+    while(query != NULL) {
+        query += 1;
+        if(strncmp(query, name, name_length) == 0 && query[name_length] == '=') {
+            return atol(query + name_length + 1);
+        }
+        query = strchr(query, '&');
+    }
+    return fallback;
+}
+
+// Write entire buffer to socket, returning -1 if the peer goes away
+int write_all(int socket, const char *buffer, size_t size) {
+    size_t written = 0;
+    while(written < size) {
+        ssize_t n = write(socket, buffer + written, size - written);
+        if(n <= 0) {
+            return -1;
+        }
+        written += n;
+    }
+    return 0;
+}
+
+// Given request header and ETag of the object, return true if the request
+// carries an If-None-Match field naming that ETag
+bool etag_matches(const char *request, const char *etag) {
+    const char *field = strcasestr(request, "\r\nIf-None-Match:");
+    if(field == NULL) {
+        return false;
+    }
+    field += strlen("\r\nIf-None-Match:");
+    while(*field == ' ') {
+        field++;
+    }
+    return strncmp(field, etag, strlen(etag)) == 0 && field[strlen(etag)] == '\r';
+}
+
+// Given request header and size of the body, store the first and last
+// byte named by a single "Range: bytes=" field. Return 0 if there is no
+// such field, 1 if the range is stored and -1 if no byte of the body is in it
+int parse_range(const char *request, long size, long *first, long *last) {
+    const char *field = strcasestr(request, "\r\nRange:");
+    if(field == NULL) {
+        return 0;
+    }
+    field += strlen("\r\nRange:");
+    while(*field == ' ') {
+        field++;
+    }
+    const char *comma = strchr(field, ',');
+    if(strncmp(field, "bytes=", 6) != 0 || (comma != NULL && comma < strchr(field, '\r'))) {
+        return 0;
+    }
+    char *end;
+    field += 6;
+    if(*field == '-') {
+        long suffix = strtol(field + 1, &end, 10);
+        *first = (suffix < size) ? size - suffix : 0;
+        *last = size - 1;
+        return (suffix > 0 && size > 0) ? 1 : -1;
+    }
+    *first = strtol(field, &end, 10);
+    if(*end != '-') {
+        return 0;
+    }
+    *last = (end[1] == '\r') ? size - 1 : strtol(end + 1, NULL, 10);
+    if(*last >= size) {
+        *last = size - 1;
+    }
+    return (*first < size && *first <= *last) ? 1 : -1;
+}
+
+// Given path of a /page/ request, the response's HTTP version and
+// Connection value, wait for the delay and write an HTML page linking to
+// its assets. Each page links to its own assets, so every page is a miss
+int serve_page(int client_socket, const char *path, const char *version, const char *connection) {
+    long page = atol(path + 6);
+    long assets = query_param(path, "assets", 12);
+    long asset_size = query_param(path, "asize", 16384);
+    long delay_ms = query_param(path, "delay", default_delay_ms);
+    __atomic_fetch_add(&requests_served, 1, __ATOMIC_RELAXED);
+    if(assets < 0 || assets > 1000) {
+        return -1;
+    }
+    if(delay_ms > 0) {
+        usleep(delay_ms * 1000);
+    }
+    size_t capacity = 1024 + assets * 160;
+    char *body = malloc(capacity);
+    int body_size = snprintf(body, capacity, "<!DOCTYPE html>\n<html><head><title>Page %ld</title>\n", page);
+    for(long i = 0; i < assets; i++) {
+        // Relative references resolve against /page/, so climb out of it
+        const char *formats[3] = {
+            "<link rel=\"stylesheet\" href=\"/size/%ld?page=%ld&amp;asset=%ld&amp;delay=%ld\">\n",
+            "<script src='/size/%ld?page=%ld&amp;asset=%ld&amp;delay=%ld'></script>\n",
+            "<img src=../size/%ld?page=%ld&amp;asset=%ld&amp;delay=%ld alt=\"asset\">\n"
+        };
+        body_size += snprintf(body + body_size, capacity - body_size, formats[i % 3], asset_size, page, i, delay_ms);
+    }
+    body_size += snprintf(body + body_size, capacity - body_size,
+                          "</head><body>\n<!-- <img src=\"/size/1?page=%ld&amp;commented=1\"> -->\n"
+                          "<a href=\"/page/%ld\">Next</a>\n</body></html>\n", page, page + 1);
+    char header[256];
+    int header_size = snprintf(header, sizeof(header), "%s 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+                               "Cache-Control: max-age=%d\r\nContent-Length: %d\r\nConnection: %s\r\n\r\n",
+                               version, default_max_age, body_size, connection);
+    int result = (write_all(client_socket, header, header_size) < 0 ||
+                  write_all(client_socket, body, body_size) < 0) ? -1 : 0;
+    free(body);
+    return result;
+}
+
+// Given request and whether the connection stays open after it, wait for
+// the configured delay and write the response. Bodies are sent with a
+// Content-Length, or chunked if asked for with ?chunked=1. Requests whose
+// If-None-Match names the current ETag get a 304 without a body, and those
+// with a Range get just that part of it. Return -1 if the request is
+// malformed or the peer goes away
+int serve_request(int client_socket, const char *request, bool keep_alive) {
+    // Accept both origin-form and absolute-form request targets
+    char target[ORIGIN_REQUEST_MAX_SIZE];
+    int minor_version = 0;
+    if(sscanf(request, "GET %8191s HTTP/1.%d", target, &minor_version) < 1) {
+        return -1;
+    }
+    const char *version = (minor_version >= 1) ? "HTTP/1.1" : "HTTP/1.0";
+    const char *connection = keep_alive ? "keep-alive" : "close";
+    char *path = target;
+    if(strncmp(path, "http://", 7) == 0) {
+        path = strchr(path + 7, '/');
+        if(path == NULL) {
+            path = "/";
+        }
+    }
+
+    // Report the request or byte counter without counting the query itself
+    if(strcmp(path, "/count") == 0 || strcmp(path, "/bytes") == 0) {
+        long *counter = (path[1] == 'c') ? &requests_served : &bytes_served;
+        char body[32];
+        int body_size = snprintf(body, sizeof(body), "%ld\n", __atomic_load_n(counter, __ATOMIC_RELAXED));
+        char response[256];
+        int response_size = snprintf(response, sizeof(response),
+                                     "%s 200 OK\r\nCache-Control: no-store\r\nContent-Length: %d\r\n"
+                                     "Connection: %s\r\n\r\n%s", version, body_size, connection, body);
+        return write_all(client_socket, response, response_size);
+    }
+
+    if(strncmp(path, "/page/", 6) == 0) {
+        return serve_page(client_socket, path, version, connection);
+    }
+    long size = 0;
+    if(strncmp(path, "/size/", 6) == 0) {
+        size = atol(path + 6);
+        __atomic_fetch_add(&requests_served, 1, __ATOMIC_RELAXED);
+    }
+    long delay_ms = query_param(path, "delay", default_delay_ms);
+    long max_age = query_param(path, "maxage", default_max_age);
+    long stale_while_revalidate = query_param(path, "swr", 0);
+    long rate_kbps = query_param(path, "rate", 0);
+    long stall_ms = query_param(path, "stall", 0);
+    bool chunked = query_param(path, "chunked", 0) != 0 && minor_version >= 1;
+    bool validators = query_param(path, "validators", 1) != 0;
+    bool no_store = query_param(path, "nostore", 0) != 0;
+    bool is_private = query_param(path, "private", 0) != 0;
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%ld-%ld\"", size, query_param(path, "version", default_version));
+    if(delay_ms > 0) {
+        usleep(delay_ms * 1000);
+    }
+
+    bool not_modified = validators && etag_matches(request, etag);
+    long first = 0;
+    long last = size - 1;
+    int range = (not_modified || chunked) ? 0 : parse_range(request, size, &first, &last);
+    const char *status = not_modified ? "304 Not Modified" : "200 OK";
+    if(range != 0) {
+        status = (range > 0) ? "206 Partial Content" : "416 Range Not Satisfiable";
+    }
+    char header[512];
+    int header_size = snprintf(header, sizeof(header), "%s %s\r\n", version, status);
+    if(!not_modified) {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "Content-Type: application/octet-stream\r\n");
+    }
+    if(no_store || is_private) {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "Cache-Control: %s\r\n", no_store ? "no-store" : "private, max-age=60");
+    } else if(stale_while_revalidate > 0) {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "Cache-Control: max-age=%ld, stale-while-revalidate=%ld\r\n",
+                                max_age, stale_while_revalidate);
+    } else {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "Cache-Control: max-age=%ld\r\n", max_age);
+    }
+    if(validators) {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "ETag: %s\r\nLast-Modified: Thu, 01 Oct 2026 00:00:00 GMT\r\n", etag);
+    }
+    header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                            "Connection: %s\r\n", connection);
+    if(not_modified) {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size, "\r\n");
+        return write_all(client_socket, header, header_size);
+    }
+    if(range < 0) {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "Content-Range: bytes */%ld\r\nContent-Length: 0\r\n\r\n", size);
+        return write_all(client_socket, header, header_size);
+    }
+    if(range > 0) {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "Content-Range: bytes %ld-%ld/%ld\r\n", first, last, size);
+        size = last - first + 1;
+    }
+    if(chunked) {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "Transfer-Encoding: chunked\r\n\r\n");
+    } else {
+        header_size += snprintf(header + header_size, sizeof(header) - header_size,
+                                "Content-Length: %ld\r\n\r\n", size);
+    }
+    if(write_all(client_socket, header, header_size) < 0) {
+        return -1;
+    }
+    // Writes start part way into the alphabet so each byte lands at its offset
+    char body[ORIGIN_WRITE_CHUNK + 26];
+    for(size_t i = 0; i < sizeof(body); i++) {
+        body[i] = 'a' + i % 26;
+    }
+    long offset = first;
+    while(size > 0) {
+        size_t n = (size < ORIGIN_WRITE_CHUNK) ? (size_t) size : ORIGIN_WRITE_CHUNK;
+        if(n == (size_t) size && stall_ms > 0) {
+            usleep(stall_ms * 1000);
+        }
+        char chunk_size[32];
+        int chunk_size_length = snprintf(chunk_size, sizeof(chunk_size), "%zx\r\n", n);
+        if((chunked && write_all(client_socket, chunk_size, chunk_size_length) < 0) ||
+           write_all(client_socket, body + offset % 26, n) < 0 ||
+           (chunked && write_all(client_socket, "\r\n", 2) < 0)) {
+            return -1;
+        }
+        __atomic_fetch_add(&bytes_served, n, __ATOMIC_RELAXED);
+        size -= n;
+        offset += n;
+        // Throttled bodies trickle out one chunk at a time
+        if(rate_kbps > 0) {
+            long chunk_us = (long)((double) n * 1000000 / (rate_kbps * 1024));
+            struct timespec pause = {chunk_us / 1000000, (chunk_us % 1000000) * 1000};
+            nanosleep(&pause, NULL);
+        }
+    }
+    if(chunked && write_all(client_socket, "0\r\n\r\n", 5) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Serve requests on one connection. HTTP/1.1 connections stay open for
+// further requests unless the client asks for them to be closed
+void *serve_client(void *arg) {
+    int client_socket = (int)(long) arg;
+    char request[ORIGIN_REQUEST_MAX_SIZE + 1];
+    size_t request_size = 0;
+    while(1) {
+        char *header_end;
+        request[request_size] = '\0';
+        while((header_end = strstr(request, "\r\n\r\n")) == NULL) {
+            if(request_size == ORIGIN_REQUEST_MAX_SIZE) {
+                close(client_socket);
+                return NULL;
+            }
+            ssize_t n = read(client_socket, request + request_size, ORIGIN_REQUEST_MAX_SIZE - request_size);
+            if(n <= 0) {
+                close(client_socket);
+                return NULL;
+            }
+            request_size += n;
+            request[request_size] = '\0';
+        }
+        header_end += 4;
+        char saved = *header_end;
+        *header_end = '\0';
+        bool keep_alive = strstr(request, " HTTP/1.1\r\n") != NULL &&
+                          strcasestr(request, "\r\nConnection: close") == NULL;
+        *header_end = saved;
+        if(serve_request(client_socket, request, keep_alive) < 0 || !keep_alive) {
+            break;
+        }
+        // Keep any part of the next request that arrived with this one
+        request_size -= header_end - request;
+        memmove(request, header_end, request_size);
+    }
+    close(client_socket);
+    return NULL;
+}
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    int port = ORIGIN_DEFAULT_PORT;
+    int option;
+    while((option = getopt(argc, argv, "p:d:m:v:")) != -1) {
+        switch(option) {
+            case 'p': port = atoi(optarg); break;
+            case 'd': default_delay_ms = atoi(optarg); break;
+            case 'm': default_max_age = atoi(optarg); break;
+            case 'v': default_version = atoi(optarg); break;
+            default:
+                printf("Usage: %s [-p port] [-d delay_ms] [-m max_age] [-v version]\n", argv[0]);
+                return -1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int listening_socket = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(listening_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(bind(listening_socket, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("Error binding origin socket");
+        return -1;
+    }
+    listen(listening_socket, 4096);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+    while(1) {
+        int client_socket = accept(listening_socket, NULL, NULL);
+        if(client_socket < 0) {
+            continue;
+        }
+        // Headers and bodies go out in separate writes, which Nagle's
+        // algorithm would hold back on kept-alive connections
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        pthread_t thread;
+        if(pthread_create(&thread, &attr, serve_client, (void *)(long) client_socket) != 0) {
+            close(client_socket);
+        }
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
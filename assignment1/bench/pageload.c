@@ -0,0 +1,319 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      pageload.c
+// Usage:       gcc -O2 -pthread -o pageload pageload.c
+//              ./pageload [-p proxy_port] [-c connections] [-n pages] [-s first_page] <url>
+//              Page load benchmark. Loads <pages> HTML pages through the proxy one
+//              after another as a browser would: the page is fetched, the stylesheets,
+//              scripts and images it references are found, and then fetched over
+//              <connections> kept-alive connections in parallel. A "%d" in the URL is
+//              replaced by the page number. Reports page load time percentiles from
+//              asking for the page to the last asset arriving. Responses need a
+//              Content-Length
+//*************************************************************************************************
+#define _GNU_SOURCE               // strcasestr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define PAGELOAD_DEFAULT_PORT 9120
+#define PAGELOAD_MAX_CONNECTIONS 32
+#define PAGELOAD_MAX_ASSETS 256
+#define PAGELOAD_URL_MAX_SIZE 2048
+#define PAGELOAD_HEADER_MAX_SIZE 8192
+
+int proxy_port = PAGELOAD_DEFAULT_PORT;
+int sockets[PAGELOAD_MAX_CONNECTIONS];         // Kept alive from page to page, -1 if closed
+char *assets[PAGELOAD_MAX_ASSETS];
+int asset_count = 0;
+int next_asset = 0;
+int errors = 0;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double first = *(const double *) a;
+    double second = *(const double *) b;
+    return (first > second) - (first < second);
+}
+
+static int connect_proxy(void) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(proxy_port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return fd;
+}
+
+// Given connection slot and absolute URL, ask the proxy for it and read the
+// response, reconnecting once if a kept-alive connection was closed. Return
+// the body, or NULL on failure. The caller frees it
+static char *fetch_url(int slot, const char *url) {
+    if(strncmp(url, "http://", 7) != 0) {
+        return NULL;
+    }
+    const char *host = url + 7;
+    size_t host_length = strcspn(host, "/");
+    char request[PAGELOAD_URL_MAX_SIZE + 256];
+    int request_size = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %.*s\r\n\r\n",
+                                url, (int) host_length, host);
+    for(int attempt = 0; attempt < 2; attempt++) {
+        if(sockets[slot] < 0) {
+            sockets[slot] = connect_proxy();
+        }
+        int fd = sockets[slot];
+        if(fd < 0 || write(fd, request, request_size) != request_size) {
+            close(fd);
+            sockets[slot] = -1;
+            continue;
+        }
+        char header[PAGELOAD_HEADER_MAX_SIZE + 1];
+        size_t header_size = 0;
+        char *header_end = NULL;
+        while(header_end == NULL && header_size < PAGELOAD_HEADER_MAX_SIZE) {
+            ssize_t n = read(fd, header + header_size, PAGELOAD_HEADER_MAX_SIZE - header_size);
+            if(n <= 0) {
+                break;
+            }
+            header_size += n;
+            header[header_size] = '\0';
+            header_end = strstr(header, "\r\n\r\n");
+        }
+        const char *length_field = (header_end != NULL) ? strcasestr(header, "\r\nContent-Length:") : NULL;
+        if(length_field == NULL || length_field > header_end || strncmp(header, "HTTP/1.1 200", 12) != 0) {
+            close(fd);
+            sockets[slot] = -1;
+            if(header_size > 0) {
+                break;
+            }
+            continue;
+        }
+        size_t body_size = strtoul(length_field + 17, NULL, 10);
+        char *body = malloc(body_size + 1);
+        size_t received = header_size - (header_end + 4 - header);
+        if(received > body_size) {
+            received = body_size;
+        }
+        memcpy(body, header_end + 4, received);
+        while(received < body_size) {
+            ssize_t n = read(fd, body + received, body_size - received);
+            if(n <= 0) {
+                break;
+            }
+            received += n;
+        }
+        body[received] = '\0';
+        if(received == body_size) {
+            return body;
+        }
+        free(body);
+        close(fd);
+        sockets[slot] = -1;
+        break;
+    }
+    return NULL;
+}
+
+// Given page URL and a reference found in it, store the absolute URL of
+// the reference. Only absolute paths and ones relative to the page's
+// directory are resolved, which is all the local origin's pages use. A
+// URL too long to store is left empty, and fails when fetched
+static void resolve_reference(const char *page, const char *reference, size_t length, char *url) {
+    char decoded[PAGELOAD_URL_MAX_SIZE];
+    size_t decoded_length = 0;
+    for(size_t i = 0; i < length && decoded_length < sizeof(decoded) - 1; i++) {
+        decoded[decoded_length++] = reference[i];
+        if(strncmp(reference + i, "&amp;", 5) == 0) {
+            i += 4;
+        }
+    }
+    decoded[decoded_length] = '\0';
+    const char *path = strchr(page + 7, '/');
+    size_t origin_length = (path != NULL) ? (size_t)(path - page) : strlen(page);
+    if(strncmp(decoded, "http://", 7) == 0) {
+        snprintf(url, PAGELOAD_URL_MAX_SIZE, "%s", decoded);
+        return;
+    }
+    if(decoded[0] == '/') {
+        if(snprintf(url, PAGELOAD_URL_MAX_SIZE, "%.*s%s", (int) origin_length, page, decoded) >= PAGELOAD_URL_MAX_SIZE) {
+            url[0] = '\0';
+        }
+        return;
+    }
+    size_t base_length = strcspn(page, "?");
+    while(base_length > origin_length && page[base_length - 1] != '/') {
+        base_length--;
+    }
+    const char *relative = decoded;
+    while(strncmp(relative, "../", 3) == 0) {
+        relative += 3;
+        if(base_length > origin_length + 1) {
+            base_length--;
+            while(base_length > origin_length && page[base_length - 1] != '/') {
+                base_length--;
+            }
+        }
+    }
+    if(snprintf(url, PAGELOAD_URL_MAX_SIZE, "%.*s%s", (int) base_length, page, relative) >= PAGELOAD_URL_MAX_SIZE) {
+        url[0] = '\0';
+    }
+}
+
+// Given page URL and its HTML, store the URLs of the assets a browser would
+// load with it: the src of any tag and the href of link tags, outside comments
+static void find_assets(const char *page, const char *html) {
+    asset_count = 0;
+    const char *tag = html;
+    while((tag = strchr(tag, '<')) != NULL && asset_count < PAGELOAD_MAX_ASSETS) {
+        if(strncmp(tag, "<!--", 4) == 0) {
+            tag = strstr(tag, "-->");
+            if(tag == NULL) {
+                return;
+            }
+            continue;
+        }
+        const char *end = strchr(tag, '>');
+        if(end == NULL) {
+            return;
+        }
+        bool is_link = strncasecmp(tag, "<link", 5) == 0 && isspace((unsigned char) tag[5]);
+        for(const char *attribute = tag; attribute < end; attribute++) {
+            size_t name_length = 0;
+            if(strncasecmp(attribute, " src=", 5) == 0 || strncasecmp(attribute, "\nsrc=", 5) == 0) {
+                name_length = 5;
+            } else if(is_link && (strncasecmp(attribute, " href=", 6) == 0)) {
+                name_length = 6;
+            }
+            if(name_length == 0) {
+                continue;
+            }
+            const char *value = attribute + name_length;
+            size_t value_length;
+            if(*value == '"' || *value == '\'') {
+                const char *close = strchr(value + 1, *value);
+                value += 1;
+                value_length = (close != NULL && close < end) ? (size_t)(close - value) : 0;
+            } else {
+                value_length = strcspn(value, " \t\r\n>");
+            }
+            if(value_length > 0 && value_length < PAGELOAD_URL_MAX_SIZE) {
+                assets[asset_count] = malloc(PAGELOAD_URL_MAX_SIZE);
+                resolve_reference(page, value, value_length, assets[asset_count]);
+                asset_count += 1;
+            }
+            break;
+        }
+        tag = end + 1;
+    }
+}
+
+// Fetch assets on one connection until none are left
+static void *load_assets(void *arg) {
+    int slot = (int)(long) arg;
+    int index;
+    while((index = __atomic_fetch_add(&next_asset, 1, __ATOMIC_RELAXED)) < asset_count) {
+        char *body = fetch_url(slot, assets[index]);
+        if(body == NULL) {
+            __atomic_fetch_add(&errors, 1, __ATOMIC_RELAXED);
+        }
+        free(body);
+    }
+    return NULL;
+}
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    int connections = 6;
+    int pages = 50;
+    int first_page = 0;
+    int option;
+    signal(SIGPIPE, SIG_IGN);
+    while((option = getopt(argc, argv, "p:c:n:s:")) != -1) {
+        switch(option) {
+            case 'p': proxy_port = atoi(optarg); break;
+            case 'c': connections = atoi(optarg); break;
+            case 'n': pages = atoi(optarg); break;
+            case 's': first_page = atoi(optarg); break;
+            default: pages = 0; break;
+        }
+    }
+    if(optind != argc - 1 || pages < 1 || connections < 1 || connections > PAGELOAD_MAX_CONNECTIONS ||
+       strncmp(argv[optind], "http://", 7) != 0) {
+        printf("Usage: %s [-p proxy_port] [-c connections] [-n pages] [-s first_page] <url>\n", argv[0]);
+        return -1;
+    }
+    for(int i = 0; i < PAGELOAD_MAX_CONNECTIONS; i++) {
+        sockets[i] = -1;
+    }
+
+    double *load_times = malloc(pages * sizeof(double));
+    long total_assets = 0;
+    for(int p = 0; p < pages; p++) {
+        char page[PAGELOAD_URL_MAX_SIZE];
+        snprintf(page, sizeof(page), argv[optind], first_page + p);
+        double start = now_seconds();
+        char *html = fetch_url(0, page);
+        if(html == NULL) {
+            errors += 1;
+            load_times[p] = now_seconds() - start;
+            continue;
+        }
+        find_assets(page, html);
+        free(html);
+        next_asset = 0;
+        pthread_t threads[PAGELOAD_MAX_CONNECTIONS];
+        for(int i = 0; i < connections; i++) {
+            pthread_create(&threads[i], NULL, load_assets, (void *)(long) i);
+        }
+        for(int i = 0; i < connections; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        load_times[p] = now_seconds() - start;
+        total_assets += asset_count;
+        for(int i = 0; i < asset_count; i++) {
+            free(assets[i]);
+        }
+    }
+
+    double sum = 0;
+    for(int p = 0; p < pages; p++) {
+        sum += load_times[p];
+    }
+    qsort(load_times, pages, sizeof(double), compare_doubles);
+    printf("pages=%d assets=%ld errors=%d mean_ms=%.2f p50_ms=%.2f p99_ms=%.2f\n", pages, total_assets, errors,
+           sum / pages * 1000, load_times[pages / 2] * 1000, load_times[(int)(pages * 0.99)] * 1000);
+    free(load_times);
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
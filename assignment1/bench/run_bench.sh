@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# Benchmark suite that runs offline against the local origin, so results
+# can be compared from commit to commit. Each scenario starts a fresh
+# proxy and reports throughput, latency percentiles, the hit ratio from
+# the proxy's /metrics page and the proxy's peak resident memory:
+#   zipf_closed   kept-alive clients as fast as answered, Zipf popularity
+#   zipf_open     the same at a fixed arrival rate, latency from when due
+#   large_objects 256 KB objects with Zipf popularity
+#   slow_chunked  misses on a chunked origin taking 20 ms to answer
+#   uncacheable   no-store responses, so every request goes to the origin
+# Set RESULTS to a file to append the lines to it, tagged with the commit,
+# and BACKEND to uring to run the proxy's event loops on io_uring.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9140
+ORIGIN_PORT=8080
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+WORKERS=${WORKERS:-1}
+BACKEND=${BACKEND:-epoll}
+REQUESTS=${REQUESTS:-200000}
+RATE=${RATE:-20000}
+ZIPF=${ZIPF:-0.9}
+OBJECTS=${OBJECTS:-10000}
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+
+commit=$(git rev-parse --short HEAD 2> /dev/null || echo unknown)
+echo "commit=${commit} cores=$(nproc) workers=${WORKERS} backend=${BACKEND}"
+
+# Given scenario name and load generator arguments, run the load through a
+# fresh proxy and print one line of results
+run_scenario() {
+    name=$1
+    shift
+    ./a.out -w $WORKERS -E $BACKEND -m 1G -I 0 $PROXY_PORT > /dev/null &
+    proxy_pid=$!
+    sleep 1
+    result=$(./bench/loadgen -p $PROXY_PORT "$@")
+    metrics=$(curl -sS "http://127.0.0.1:${PROXY_PORT}/metrics")
+    hits=$(echo "$metrics" | awk '$1 == "proxy_cache_hits_total" { print $2 }')
+    misses=$(echo "$metrics" | awk '$1 == "proxy_cache_misses_total" { print $2 }')
+    peak_rss=$(awk '/^VmHWM:/ { print $2 }' /proc/$proxy_pid/status)
+    kill $proxy_pid
+    wait $proxy_pid 2> /dev/null
+
+    line=$(echo "$result" | awk -v name="$name" -v hits="$hits" -v misses="$misses" -v rss="$peak_rss" '
+        { for(i = 1; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] } }
+        END { printf("scenario=%s rps=%s p50_ms=%s p99_ms=%s p999_ms=%s errors=%s hit_ratio=%.3f peak_rss_kb=%s\n",
+                     name, v["rps"], v["p50_ms"], v["p99_ms"], v["p999_ms"], v["errors"],
+                     (hits + misses > 0) ? hits / (hits + misses) : 0, rss) }')
+    echo "$line"
+    if [ -n "$RESULTS" ]; then
+        echo "commit=${commit} workers=${WORKERS} backend=${BACKEND} ${line}" >> "$RESULTS"
+    fi
+}
+
+run_scenario zipf_closed -c 64 -k 1 -n $REQUESTS -z $ZIPF -u $OBJECTS "${ORIGIN}/size/4096?object=%d"
+run_scenario zipf_open -c 64 -k 1 -n $REQUESTS -r $RATE -z $ZIPF -u $OBJECTS "${ORIGIN}/size/4096?object=%d"
+run_scenario large_objects -c 16 -k 1 -n $((REQUESTS / 20)) -z $ZIPF -u 200 "${ORIGIN}/size/262144?object=%d"
+run_scenario slow_chunked -c 64 -n $((REQUESTS / 100)) "${ORIGIN}/size/16384?chunked=1&delay=20&object=%d"
+run_scenario uncacheable -c 64 -k 1 -n $((REQUESTS / 10)) -z $ZIPF -u $OBJECTS "${ORIGIN}/size/4096?nostore=1&object=%d"
+
+kill $origin_pid
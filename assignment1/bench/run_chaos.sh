@@ -0,0 +1,90 @@
+#!/bin/bash
+
+# Benchmark well-behaved clients while misbehaving ones load the proxy.
+# Slowloris clients hold connections open by trickling a request header a
+# byte at a time, and impatient clients ask a stalled origin for objects
+# and give up on them, leaving fetches that are never answered. Each run
+# measures cached hits and misses on a healthy origin first alone, then
+# during the chaos, and reports the proxy's open descriptors, resident
+# memory and timeout and shed counters at the end. The proxy runs once
+# with its deadlines and admission limits and once with them turned off,
+# under a descriptor limit of FD_LIMIT so the unprotected proxy runs out.
+# With protection, the p99 of well-behaved clients should barely move.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9160
+ORIGIN_PORT=9161
+STALLED_PORT=9162
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+STALLED="http://127.0.0.1:${STALLED_PORT}"
+BACKEND=${BACKEND:-epoll}
+FD_LIMIT=${FD_LIMIT:-2048}
+SLOWLORIS=${SLOWLORIS:-4000}
+IMPATIENT=${IMPATIENT:-64}
+PROTECTED="-T 2,1,10 -L 512,64M"
+UNPROTECTED="-T 0,0,0 -L 0,0"
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+# Launch the healthy origin and one that takes ten minutes to answer
+./bench/origin -p $ORIGIN_PORT > /dev/null &
+origin_pid=$!
+./bench/origin -p $STALLED_PORT -d 600000 > /dev/null &
+stalled_pid=$!
+
+# Given a label and load generator arguments, run the load and print its
+# latency, or note that it never finished
+measure() {
+    label=$1
+    shift
+    result=$(timeout 60 ./bench/loadgen -p $PROXY_PORT "$@")
+    if [ -z "$result" ]; then
+        echo "  ${label}: did not finish within 60s"
+        return
+    fi
+    echo "$result" | awk -v label="$label" '
+        { for(i = 1; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] } }
+        END { printf("  %s: rps=%s MBps=%s p50_ms=%s p99_ms=%s max_ms=%s errors=%s\n",
+                     label, v["rps"], v["MBps"], v["p50_ms"], v["p99_ms"], v["max_ms"], v["errors"]) }'
+}
+
+# Given a run name and proxy options, measure well-behaved clients through
+# a fresh proxy before and during the chaos
+run_mode() {
+    name=$1
+    shift
+    (ulimit -n $FD_LIMIT; exec ./a.out -E $BACKEND -m 256M -I 0 "$@" $PROXY_PORT > /dev/null 2>&1) &
+    proxy_pid=$!
+    sleep 1
+    curl -sS -x 127.0.0.1:$PROXY_PORT "${ORIGIN}/size/4096" -o /dev/null
+
+    echo "${name} ($*), alone:"
+    measure hits -c 32 -n 20000 "${ORIGIN}/size/4096"
+    measure misses -c 16 -n 2000 "${ORIGIN}/size/4096?object=quiet%d"
+
+    ./bench/chaos -p $PROXY_PORT -s $SLOWLORIS -r 500 -i 1000 -a $IMPATIENT -w 500 -d 30 \
+        "${STALLED}/size/4096?object=stalled%d" > /tmp/chaos_result &
+    chaos_pid=$!
+    sleep 8
+    echo "${name}, during chaos:"
+    measure hits -c 32 -n 20000 "${ORIGIN}/size/4096"
+    measure misses -c 16 -n 2000 "${ORIGIN}/size/4096?object=chaos%d"
+    fds=$(ls /proc/$proxy_pid/fd | wc -l)
+    rss=$(awk '/^VmRSS:/ { print $2 }' /proc/$proxy_pid/status)
+    metrics=$(timeout 5 curl -sS "http://127.0.0.1:${PROXY_PORT}/metrics")
+    wait $chaos_pid
+    echo "  proxy: open_fds=${fds} rss_kb=${rss} $(echo "$metrics" | awk '
+        $1 ~ /^proxy_timeouts_total/ { split($1, side, "\""); printf("%s_timeouts=%s ", side[2], $2) }
+        $1 == "proxy_requests_shed_total" { printf("shed=%s", $2) }')"
+    echo "  chaos: $(cat /tmp/chaos_result)"
+    kill $proxy_pid
+    wait $proxy_pid 2> /dev/null
+    sleep 1
+}
+
+run_mode protected $PROTECTED
+run_mode unprotected $UNPROTECTED
+
+kill $origin_pid $stalled_pid
@@ -0,0 +1,77 @@
+#!/bin/bash
+
+# Benchmark a cluster of proxies sharing their caches. 1, 3 and 5 proxies
+# run on localhost, listed in a cluster file, each with a cache too small
+# for the working set alone. A load generator per proxy sends it an equal
+# share of Zipf distributed requests, as a load balancer would. Each URL is
+# cached only by the proxy owning it, so capacity grows with the number of
+# proxies. The aggregate hit ratio counts every client request answered
+# without the origin, and the origin load is read from its /count counter.
+# Peer fetches are summed from each proxy's /metrics page. For contrast,
+# 3 and 5 proxies are also run independently, each missing on its own.
+
+cd "$(dirname "$0")/.." || exit 1
+
+FIRST_PORT=9180
+ORIGIN_PORT=9179
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+REQUESTS=${REQUESTS:-60000}
+OBJECTS=${OBJECTS:-20000}
+ZIPF=${ZIPF:-0.8}
+CACHE=${CACHE:-32M}
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT > /dev/null &
+origin_pid=$!
+sleep 1
+cluster_file=$(mktemp)
+
+for setup in 1:shared 3:independent 3:shared 5:independent 5:shared; do
+    nodes=${setup%:*}
+    mode=${setup#*:}
+    cluster=""
+    if [ $mode = shared ]; then
+        cluster="-C $cluster_file"
+    fi
+    : > "$cluster_file"
+    for i in $(seq 0 $((nodes - 1))); do
+        echo "127.0.0.1:$((FIRST_PORT + i))" >> "$cluster_file"
+    done
+    proxy_pids=""
+    for i in $(seq 0 $((nodes - 1))); do
+        ./a.out -m $CACHE -I 0 $cluster $((FIRST_PORT + i)) > /dev/null &
+        proxy_pids="$proxy_pids $!"
+    done
+    sleep 1
+
+    before=$(curl -sS "${ORIGIN}/count")
+    results=$(mktemp)
+    loadgen_pids=""
+    for i in $(seq 0 $((nodes - 1))); do
+        ./bench/loadgen -p $((FIRST_PORT + i)) -c 16 -k 1 -n $((REQUESTS / nodes)) -z $ZIPF -u $OBJECTS -s $i \
+            "${ORIGIN}/size/8192?object=%d" >> "$results" &
+        loadgen_pids="$loadgen_pids $!"
+    done
+    wait $loadgen_pids
+    origin_requests=$(($(curl -sS "${ORIGIN}/count") - before))
+    peer_fetches=0
+    for i in $(seq 0 $((nodes - 1))); do
+        count=$(curl -sS "http://127.0.0.1:$((FIRST_PORT + i))/metrics" |
+                awk '$1 == "proxy_peer_fetches_total" { print $2 }')
+        peer_fetches=$((peer_fetches + count))
+    done
+    kill $proxy_pids
+    wait $proxy_pids 2> /dev/null
+
+    awk -v nodes=$nodes -v mode=$mode -v origin=$origin_requests -v peer=$peer_fetches '
+        { for(i = 1; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] }
+          requests += v["requests"]; errors += v["errors"]; rps += v["rps"] }
+        END { printf("nodes=%d mode=%s requests=%d errors=%d rps=%d origin_requests=%d peer_fetches=%d hit_ratio=%.3f\n",
+                     nodes, mode, requests, errors, rps, origin, peer, 1 - origin / requests) }' "$results"
+    rm -f "$results"
+done
+
+rm -f "$cluster_file"
+kill $origin_pid
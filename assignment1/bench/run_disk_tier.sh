@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Benchmark the disk tier across a restart. Objects are fetched once through
+# a proxy with a cache directory, so each is a miss written through to disk,
+# then the proxy is stopped and started again. The time until the restarted
+# proxy serves its first hit is reported, then the same objects are fetched
+# twice more: first from disk, then from memory once promoted. The origin's
+# request count shows whether anything went back to it after the restart.
+# Run as root to drop the page cache before restarting, so disk hits are
+# read from the device rather than from memory.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+OBJECTS=${OBJECTS:-4000}
+SIZE=${SIZE:-20000}
+CACHE_DIR=$(mktemp -d)
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+# Origin responses are slowed down a little and stay fresh for an hour
+./bench/origin -p $ORIGIN_PORT -d 5 -m 3600 > /dev/null &
+origin_pid=$!
+sleep 1
+
+run() {
+    ./bench/loadgen -p $PROXY_PORT -c 16 -n $OBJECTS "${ORIGIN}/size/${SIZE}?n=%d" |
+        grep -o "rps=[0-9]* .*p50_ms=[0-9.]* p99_ms=[0-9.]*" | sed 's/MBps=[0-9.]* //'
+}
+
+./a.out -w 2 -m 256M -D "$CACHE_DIR" $PROXY_PORT > /dev/null &
+proxy_pid=$!
+sleep 1
+echo "miss ${OBJECTS} objects: $(run)"
+kill $proxy_pid
+wait $proxy_pid 2>/dev/null
+echo "on disk: $(du -sh "$CACHE_DIR" | cut -f1)"
+
+if [ -w /proc/sys/vm/drop_caches ]; then
+    sync
+    echo 3 > /proc/sys/vm/drop_caches
+fi
+fetched=$(curl -s "${ORIGIN}/count")
+
+start=$(date +%s%N)
+./a.out -w 2 -m 256M -D "$CACHE_DIR" $PROXY_PORT > /dev/null &
+proxy_pid=$!
+until curl -s -o /dev/null -x "127.0.0.1:${PROXY_PORT}" "${ORIGIN}/size/${SIZE}?n=0"; do
+    :
+done
+echo "restart to first hit: $(( ($(date +%s%N) - start) / 1000000 )) ms"
+
+echo "disk hit: $(run)"
+echo "memory hit: $(run)"
+echo "origin fetches since restart: $(( $(curl -s "${ORIGIN}/count") - fetched ))"
+
+kill $proxy_pid $origin_pid
+wait 2>/dev/null
+rm -rf "$CACHE_DIR"
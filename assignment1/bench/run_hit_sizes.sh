@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Benchmark cache hit throughput for 1 KB, 100 KB and 10 MB objects.
+# Each object is fetched once to warm the cache, then served as hits.
+# After each run the proxy's counters are read with SIGUSR1 to show
+# how many response bytes were copied while serving the hits.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+STATS=/tmp/hit_sizes_proxy_output
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+# Budget large enough that a 10 MB object is admitted
+./a.out -m 256M -O 50 $PROXY_PORT > $STATS &
+proxy_pid=$!
+sleep 1
+
+last_copied=0
+for size in 1024 102400 10485760; do
+    url="${ORIGIN}/size/${size}"
+    curl -sS -x 127.0.0.1:$PROXY_PORT "$url" -o /dev/null
+    requests=$((2000000000 / (size + 1000)))
+    if [ $requests -gt 50000 ]; then
+        requests=50000
+    fi
+    kill -USR1 $proxy_pid
+    sleep 0.2
+    before=$(grep -o "bytes_copied=[0-9]*" $STATS | tail -1 | cut -d= -f2)
+    result=$(./bench/loadgen -p $PROXY_PORT -c 32 -n $requests "$url")
+    kill -USR1 $proxy_pid
+    sleep 0.2
+    after=$(grep -o "bytes_copied=[0-9]*" $STATS | tail -1 | cut -d= -f2)
+    echo "object_bytes=${size} ${result} bytes_copied_during_hits=$((after - before))"
+done
+
+kill $proxy_pid $origin_pid
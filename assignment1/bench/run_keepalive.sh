@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Benchmark client keep-alive and pipelining. A small object is fetched
+# once to warm the cache, then served as hits over a new connection per
+# request, and over kept-alive connections with 1, 8 and 32 requests
+# pipelined on each.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+URL="http://127.0.0.1:${ORIGIN_PORT}/size/512"
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+./a.out $PROXY_PORT > /dev/null &
+proxy_pid=$!
+sleep 1
+./bench/loadgen -p $PROXY_PORT -c 1 -n 1 "$URL" > /dev/null
+
+for depth in 0 1 8 32; do
+    mode=$([ $depth -eq 0 ] && echo "connection_per_request" || echo "keepalive_depth=${depth}")
+    result=$(./bench/loadgen -p $PROXY_PORT -c 32 -n 200000 -k $depth "$URL" |
+             sed 's/^requests=[0-9]* //; s/seconds=[0-9.]* //; s/MBps=[0-9.]* //')
+    echo "${mode} ${result}"
+done
+
+kill $proxy_pid $origin_pid
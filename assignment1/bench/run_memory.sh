@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Benchmark memory use under sustained misses. Objects of mixed sizes are
+# fetched under unique URLs so every request is a miss that is cached and
+# later evicted, and the proxy's resident set size is sampled after each
+# round. With the cache budget fixed, RSS should level off rather than
+# keep growing. Allocator counters are printed at the end.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+CACHE_BYTES=${CACHE_BYTES:-32M}
+ROUNDS=${ROUNDS:-8}
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT > /dev/null &
+origin_pid=$!
+./a.out -w 2 -m $CACHE_BYTES $PROXY_PORT > proxy_memory.log &
+proxy_pid=$!
+sleep 1
+
+for round in $(seq 1 $ROUNDS); do
+    for size in 700 9000 30000 70000 200000; do
+        ./bench/loadgen -p $PROXY_PORT -c 16 -n 2000 \
+            "http://127.0.0.1:${ORIGIN_PORT}/size/${size}?round=${round}&n=%d" > /dev/null
+    done
+    rss=$(awk '/VmRSS/ {print $2}' /proc/$proxy_pid/status)
+    echo "round=${round} rss_kb=${rss}"
+done
+
+kill -USR1 $proxy_pid
+sleep 0.5
+grep -E "^(cache|pool) " proxy_memory.log
+kill $proxy_pid $origin_pid
+rm -f proxy_memory.log
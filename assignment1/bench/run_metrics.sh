@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Benchmark the cost of the metrics on the hit path. The proxy is built
+# with metrics and again with -DMETRICS_DISABLED, and a small cached object
+# is served as hits over kept-alive connections by each in turn for several
+# rounds. The load generator shares the machine, so throughput is noisy;
+# the overhead is taken from the median CPU time the proxy spends on each
+# request instead. A sample of the /metrics page and the metrics log line
+# is printed at the end.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9130
+ORIGIN_PORT=8080
+ROUNDS=7
+REQUESTS=500000
+URL="http://127.0.0.1:${ORIGIN_PORT}/size/512"
+
+# Build both proxies and benchmark tools
+make -s a.out tools bench/proxy_no_metrics || exit 1
+
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+
+# Given pid, print the CPU time it has used in clock ticks
+cpu_ticks() { awk '{ print $14 + $15 }' /proc/$1/stat; }
+
+# Given proxy binary, serve hits through it and print nanoseconds of proxy
+# CPU time per request, and requests per second
+run_round() {
+    $1 -I 0 $PROXY_PORT > /dev/null &
+    proxy_pid=$!
+    sleep 1
+    ./bench/loadgen -p $PROXY_PORT -c 1 -n 1 "$URL" > /dev/null
+    before=$(cpu_ticks $proxy_pid)
+    rps=$(./bench/loadgen -p $PROXY_PORT -c 32 -n $REQUESTS -k 1 "$URL" | sed 's/.*rps=\([0-9]*\).*/\1/')
+    after=$(cpu_ticks $proxy_pid)
+    echo $(( (after - before) * 1000000000 / $(getconf CLK_TCK) / REQUESTS )) $rps
+    kill $proxy_pid
+    wait $proxy_pid 2> /dev/null
+}
+
+# Alternate the builds so drift in the machine affects both alike
+enabled_ns=()
+enabled_rps=()
+disabled_ns=()
+disabled_rps=()
+for round in $(seq $ROUNDS); do
+    read ns rps < <(run_round ./a.out)
+    enabled_ns+=($ns)
+    enabled_rps+=($rps)
+    read ns rps < <(run_round ./bench/proxy_no_metrics)
+    disabled_ns+=($ns)
+    disabled_rps+=($rps)
+done
+median() { printf "%s\n" "$@" | sort -n | sed -n "$(( ($# + 1) / 2 ))p"; }
+enabled=$(median "${enabled_ns[@]}")
+disabled=$(median "${disabled_ns[@]}")
+echo "metrics_enabled cpu_ns_per_request=${enabled} rps=$(median "${enabled_rps[@]}") rounds=${enabled_ns[*]}"
+echo "metrics_disabled cpu_ns_per_request=${disabled} rps=$(median "${disabled_rps[@]}") rounds=${disabled_ns[*]}"
+awk -v a="$enabled" -v b="$disabled" 'BEGIN { printf "hit_path_overhead_percent=%.2f\n", (a - b) * 100 / b }'
+
+# Sample of what the proxy reports
+./a.out -I 1 $PROXY_PORT > /tmp/run_metrics_proxy.log &
+proxy_pid=$!
+sleep 1
+./bench/loadgen -p $PROXY_PORT -c 8 -n 20000 -k 1 "$URL" > /dev/null
+curl -s "http://127.0.0.1:${PROXY_PORT}/metrics" | grep -v "^#" | grep -v "_bucket"
+sleep 1
+grep "^metrics " /tmp/run_metrics_proxy.log | tail -1
+
+kill $proxy_pid $origin_pid
+rm -f bench/proxy_no_metrics
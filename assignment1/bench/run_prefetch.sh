@@ -0,0 +1,55 @@
+#!/bin/bash
+
+# Benchmark page loads with and without prefetching. Pages from the local
+# origin link to ASSETS stylesheets, scripts and images, and every response
+# takes DELAY ms. The page load client fetches each page, then its assets
+# over 6 kept-alive connections as a browser would, through a fresh proxy:
+#  off   assets are fetched when the client asks, so they take several rounds
+#        of origin delay behind the page
+#  on    the proxy scans each page as it is cached and fetches the assets at
+#        once, so the client's requests join fetches already under way
+# Every page is new, so each load misses. Prefetch accuracy is read from the
+# proxy's /metrics page: bytes used by a client against bytes fetched.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9195
+ORIGIN_PORT=9196
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+PAGES=${PAGES:-50}
+ASSETS=${ASSETS:-12}
+ASSET_SIZE=${ASSET_SIZE:-16384}
+DELAY=${DELAY:-50}
+BUDGET=${BUDGET:-16M}
+
+# Build proxy, origin and page load client
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT > /dev/null &
+origin_pid=$!
+sleep 1
+
+first_page=0
+for mode in off on; do
+    prefetch=""
+    if [ $mode = on ]; then
+        prefetch="-F $BUDGET"
+    fi
+    ./a.out -I 0 $prefetch $PROXY_PORT > /dev/null &
+    proxy_pid=$!
+    sleep 1
+    result=$(./bench/pageload -p $PROXY_PORT -n $PAGES -s $first_page \
+             "${ORIGIN}/page/%d?assets=${ASSETS}&asize=${ASSET_SIZE}&delay=${DELAY}")
+    metrics=$(curl -sS "http://127.0.0.1:${PROXY_PORT}/metrics" | awk '
+        $1 == "proxy_prefetches_total" { prefetches = $2 }
+        $1 == "proxy_prefetch_bytes_total{outcome=\"fetched\"}" { fetched = $2 }
+        $1 == "proxy_prefetch_bytes_total{outcome=\"used\"}" { used = $2 }
+        END { printf("prefetches=%d prefetch_bytes=%d used_bytes=%d accuracy=%.3f",
+                     prefetches, fetched, used, (fetched > 0) ? used / fetched : 0) }')
+    kill $proxy_pid
+    wait $proxy_pid 2> /dev/null
+    echo "prefetch=${mode} ${result} ${metrics}"
+    first_page=$((first_page + PAGES))
+done
+
+kill $origin_pid
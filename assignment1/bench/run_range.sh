@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# Benchmark byte-range requests for a large object, as a player seeking
+# through a 10 MB video makes them. SEEKS windows of 256 KB at random
+# offsets are asked for, twice over, through a fresh proxy whose largest
+# cached object is raised to fit the video whole. The origin
+# sends bodies at a limited rate, so bytes it is asked for cost time:
+#  ranges   only ranges are asked for, so the proxy fetches and caches the
+#           windows it has not seen, and the second pass is served from them
+#  whole    the object is fetched whole at the start of the first pass,
+#           and every window cut from it
+# Bytes the origin sent are read from its /bytes counter, and every window
+# is checked against the same range asked of the origin directly.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9170
+ORIGIN_PORT=9171
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+SIZE=${SIZE:-10485760}
+WINDOW=${WINDOW:-262144}
+SEEKS=${SEEKS:-20}
+
+# Build proxy and origin
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT > /dev/null &
+origin_pid=$!
+sleep 1
+
+offsets=$(awk -v n=$SEEKS -v max=$((SIZE - WINDOW)) 'BEGIN { srand(1); for(i = 0; i < n; i++) print int(rand() * max) }')
+origin_bytes() { curl -sS "${ORIGIN}/bytes"; }
+
+# Given mode, URL and pass, ask for every window through the proxy and
+# print one line of results
+run_pass() {
+    mode=$1
+    url=$2
+    pass=$3
+    before=$(origin_bytes)
+    start=$(date +%s%N)
+    mismatches=0
+    if [ $mode = whole ] && [ "$pass" = 1 ]; then
+        curl -sS -x "http://127.0.0.1:${PROXY_PORT}" "$url" > /dev/null
+    fi
+    for offset in $offsets; do
+        range="${offset}-$((offset + WINDOW - 1))"
+        sum=$(curl -sS -x "http://127.0.0.1:${PROXY_PORT}" -r "$range" "$url" | md5sum)
+        if [ "$pass" = 1 ] && [ "$sum" != "$(curl -sS -r "$range" "$url" | md5sum)" ]; then
+            mismatches=$((mismatches + 1))
+        fi
+    done
+    seconds=$(awk -v ns=$(($(date +%s%N) - start)) 'BEGIN { printf("%.3f", ns / 1e9) }')
+    # Checking against the origin adds its own bytes on the first pass
+    sent=$(($(origin_bytes) - before))
+    if [ "$pass" = 1 ]; then
+        sent=$((sent - SEEKS * WINDOW))
+    fi
+    echo "mode=${mode} pass=${pass} seeks=${SEEKS} origin_bytes=${sent} seconds=${seconds} mismatches=${mismatches}"
+}
+
+for mode in ranges whole; do
+    url="${ORIGIN}/size/${SIZE}?rate=50000&mode=${mode}"
+    ./a.out -m 1G -O 20 -I 0 $PROXY_PORT > /dev/null &
+    proxy_pid=$!
+    sleep 1
+    run_pass $mode "$url" 1
+    run_pass $mode "$url" 2
+    metrics=$(curl -sS "http://127.0.0.1:${PROXY_PORT}/metrics" | awk '/^proxy_range/ { printf("%s=%s ", $1, $2) }')
+    echo "mode=${mode} ${metrics}"
+    kill $proxy_pid
+    wait $proxy_pid 2> /dev/null
+done
+
+kill $origin_pid
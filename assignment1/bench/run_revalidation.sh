@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Benchmark requests for expired objects. Objects with a one second
+# max-age are fetched once, left to go stale, then fetched again. The
+# origin answers after 20 ms and sends bodies at a limited rate, so a full
+# transfer costs time a header-only 304 does not. Three cases are compared on the second pass:
+#  refetch      no validators, so stale objects are downloaded again
+#  revalidate   ETag and Last-Modified, so the origin answers 304
+#  swr          as revalidate, with stale-while-revalidate, so the stale
+#               copy is sent at once and refreshed in the background
+# Revalidation counters are read from the proxy's SIGUSR1 stats.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+OBJECTS=${OBJECTS:-500}
+SIZE=${SIZE:-100000}
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT > /dev/null &
+origin_pid=$!
+sleep 1
+
+for mode in refetch revalidate swr; do
+    case $mode in
+        refetch)    query="validators=0" ;;
+        revalidate) query="validators=1" ;;
+        swr)        query="validators=1&swr=60" ;;
+    esac
+    url="${ORIGIN}/size/${SIZE}?maxage=1&delay=20&rate=10000&${query}&n=%d"
+    stats=$(mktemp)
+    ./a.out -w 2 -m 1G $PROXY_PORT > "$stats" &
+    proxy_pid=$!
+    sleep 1
+    ./bench/loadgen -p $PROXY_PORT -c 16 -n $OBJECTS "$url" > /dev/null
+    sleep 2
+    result=$(./bench/loadgen -p $PROXY_PORT -c 16 -n $OBJECTS "$url" |
+             grep -o "rps=[0-9]* .*p50_ms=[0-9.]* p99_ms=[0-9.]*" | sed 's/MBps=[0-9.]* //')
+    sleep 1
+    kill -USR1 $proxy_pid
+    sleep 0.5
+    counters=$(grep -o "stale_served=[0-9]* revalidated_304=[0-9]* revalidated_200=[0-9]*" "$stats")
+    echo "${mode} ${result} ${counters}"
+    kill $proxy_pid
+    wait $proxy_pid 2>/dev/null
+    rm -f "$stats"
+done
+
+kill $origin_pid
@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Benchmark the proxy against a deliberately slow local origin.
+# Slow misses (2 second origin delay) run in the background while
+# a second load generator hammers a cached object. With the event
+# loop, the cached requests keep their throughput and p99 latency
+# instead of queueing behind the slow origin.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+# Launch origin and proxy in background
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+./a.out $PROXY_PORT > /dev/null &
+proxy_pid=$!
+sleep 1
+
+# Warm the cache with the fast object
+curl -sS -x 127.0.0.1:$PROXY_PORT "${ORIGIN}/size/1024" -o /dev/null
+
+echo "Cached object, idle origin:"
+./bench/loadgen -p $PROXY_PORT -c 100 -n 20000 "${ORIGIN}/size/1024"
+
+echo "Cached object while 50 clients wait on a 2s origin:"
+./bench/loadgen -p $PROXY_PORT -c 50 -n 100 "${ORIGIN}/size/1024?delay=2000&id=%d" > /tmp/slow_origin_misses &
+slow_pid=$!
+sleep 0.2
+./bench/loadgen -p $PROXY_PORT -c 100 -n 20000 "${ORIGIN}/size/1024"
+wait $slow_pid
+echo "Slow misses:"
+cat /tmp/slow_origin_misses
+
+echo "Cached object, 2000 concurrent connections:"
+./bench/loadgen -p $PROXY_PORT -c 2000 -n 40000 "${ORIGIN}/size/1024"
+
+# Stop proxy and origin
+kill $proxy_pid $origin_pid
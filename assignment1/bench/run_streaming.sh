@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Benchmark streaming of origin responses through the proxy.
+# A throttled origin trickles out large objects, so time-to-first-byte
+# shows whether the proxy forwards bytes as they arrive or only once the
+# whole response is in. Peak resident memory of the proxy is read from
+# /proc after relaying objects that are too large to cache, which must
+# not be buffered in full.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+# 16 MB budget: a 1 MB object is cached, a 100 MB object is not
+./a.out -m 16M $PROXY_PORT > /dev/null &
+proxy_pid=$!
+sleep 1
+
+# 8 MB/s origin, so a 1 MB object takes ~125 ms to arrive in full
+echo "time-to-first-byte, throttled origin"
+for size in 1048576 104857600; do
+    url="${ORIGIN}/size/${size}?rate=8192&id=%d"
+    result=$(./bench/loadgen -p $PROXY_PORT -c 4 -n 8 "$url" | grep -o "ttfb_p50_ms=[0-9.]* ttfb_p99_ms=[0-9.]*")
+    echo "object_bytes=${size} ${result}"
+done
+
+echo "peak proxy memory, unthrottled origin"
+for size in 104857600 524288000; do
+    ./bench/loadgen -p $PROXY_PORT -c 4 -n 8 "${ORIGIN}/size/${size}" > /dev/null
+    echo "object_bytes=${size} $(grep VmHWM /proc/$proxy_pid/status | tr -s ' \t' ' ')"
+done
+
+kill $proxy_pid $origin_pid
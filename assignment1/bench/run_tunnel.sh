@@ -0,0 +1,55 @@
+#!/bin/bash
+
+# Benchmark CONNECT tunnels. The proxy is built relaying with splice() and
+# again with -DTUNNEL_COPY, which relays with a plain read/write loop
+# through a buffer, and each streams bytes up to a sink origin and down
+# from a source origin run by tunnel_bench, with one tunnel and with
+# several at once. Throughput is reported in Gbit/s, and the CPU time the
+# proxy spends per GB relayed is taken from /proc, since the benchmark
+# shares the machine with it.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9160
+ORIGIN_PORT=9161
+MEGABYTES=${MEGABYTES:-4096}
+TUNNELS=${TUNNELS:-8}
+
+# Build both proxies and the benchmark
+make -s a.out tools bench/proxy_copy || exit 1
+
+# Given pid, print the CPU time it has used in clock ticks
+cpu_ticks() { awk '{ print $14 + $15 }' /proc/$1/stat; }
+
+# Given label, proxy binary and tunnel_bench arguments, relay through a
+# fresh proxy and print one line of results
+run_case() {
+    label=$1
+    proxy=$2
+    shift 2
+    $proxy -I 0 $PROXY_PORT > /dev/null &
+    proxy_pid=$!
+    sleep 1
+    before=$(cpu_ticks $proxy_pid)
+    result=$(./bench/tunnel_bench -p $PROXY_PORT -o $ORIGIN_PORT "$@")
+    after=$(cpu_ticks $proxy_pid)
+    kill $proxy_pid
+    wait $proxy_pid 2> /dev/null
+    echo "$result" | awk -v label="$label" -v ticks=$((after - before)) -v hz=$(getconf CLK_TCK) '
+        { for(i = 1; i <= NF; i++) { split($i, kv, "="); v[kv[1]] = kv[2] } }
+        END { printf("relay=%s tunnels=%s direction=%s gbit_per_s=%s proxy_cpu_s_per_gb=%.3f failures=%s\n",
+                     label, v["tunnels"], v["direction"], v["gbit_per_s"],
+                     (ticks / hz) / (v["bytes"] / 1e9), v["failures"]) }'
+}
+
+for relay in splice copy; do
+    proxy=./a.out
+    if [ $relay = copy ]; then
+        proxy=./bench/proxy_copy
+    fi
+    run_case $relay $proxy -c 1 -b $MEGABYTES
+    run_case $relay $proxy -c 1 -b $MEGABYTES -d
+    run_case $relay $proxy -c $TUNNELS -b $((MEGABYTES / TUNNELS))
+done
+
+rm -f bench/proxy_copy bench/tunnel_bench
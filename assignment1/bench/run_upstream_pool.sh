@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Benchmark persistent origin connections. Every request is for a
+# different small object, so each one is a miss that goes to the origin.
+# With -U 0 the proxy opens a new origin connection per miss; by default
+# it keeps connections alive and reuses them. The connection counters are
+# read from the proxy's SIGUSR1 stats.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+sleep 1
+
+for limit in 0 32; do
+    stats=$(mktemp)
+    ./a.out -U $limit $PROXY_PORT > "$stats" &
+    proxy_pid=$!
+    sleep 1
+    result=$(./bench/loadgen -p $PROXY_PORT -c 32 -n 20000 "${ORIGIN}/size/512?run=${limit}&id=%d" |
+             grep -o "rps=[0-9]* .*p50_ms=[0-9.]* p99_ms=[0-9.]*" | sed 's/MBps=[0-9.]* //')
+    kill -USR1 $proxy_pid
+    sleep 0.5
+    connections=$(grep -o "connections_opened=[0-9]* connections_reused=[0-9]*" "$stats")
+    echo "max_origin_connections=${limit} ${result} ${connections}"
+    kill $proxy_pid
+    wait $proxy_pid 2>/dev/null
+    rm -f "$stats"
+done
+
+kill $origin_pid
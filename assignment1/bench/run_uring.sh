@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Benchmark the io_uring backend against epoll. Cache hits are served over
+# a new connection per request and over kept-alive connections with 1 and
+# 8 requests pipelined on each, and misses over kept-alive connections.
+# Requests per second are measured on a plain proxy. System calls per
+# request are counted on a proxy run under syscount, over fewer requests
+# after a warm-up, since tracing every call slows the proxy down; with the
+# proxy slowed, more completions or events arrive per wait, so the waits
+# are counted a little low for both backends alike.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9197
+ORIGIN_PORT=9198
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+REQUESTS=${REQUESTS:-200000}
+COUNTED=${COUNTED:-20000}
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT > /dev/null &
+origin_pid=$!
+sleep 1
+
+# Given backend, pipelining depth, request count and URL, warm the cache
+# if the URL is a hit and run the load, printing the loadgen results
+run_load() {
+    if [ "${4#*miss}" = "$4" ]; then
+        ./bench/loadgen -p $PROXY_PORT -c 1 -n 1 "$4" > /dev/null
+    fi
+    ./bench/loadgen -p $PROXY_PORT -c 32 -k $2 -n $3 "$4"
+}
+
+for case in hit:0 hit:1 hit:8 miss:1; do
+    kind=${case%:*}
+    depth=${case#*:}
+    mode=$([ $depth -eq 0 ] && echo "connection_per_request" || echo "keepalive_depth=${depth}")
+    for backend in epoll uring; do
+        url="${ORIGIN}/size/512"
+        if [ $kind = miss ]; then
+            url="${ORIGIN}/size/512?miss=${backend}${depth}&n=%d"
+        fi
+        ./a.out -E $backend -I 0 $PROXY_PORT > /dev/null &
+        proxy_pid=$!
+        sleep 1
+        result=$(run_load $backend $depth $REQUESTS "$url" | sed 's/.*\(rps=[0-9]*\).*\(p99_ms=[0-9.]*\).*/\1 \2/')
+        kill $proxy_pid
+        wait $proxy_pid 2> /dev/null
+
+        # The second report covers only the counted run
+        report=$(mktemp)
+        url="${url/n=/counted&n=}"
+        ./bench/syscount ./a.out -E $backend -I 0 $PROXY_PORT > "$report" &
+        syscount_pid=$!
+        sleep 1
+        [ $kind = hit ] && run_load $backend $depth 1000 "$url" > /dev/null
+        kill -USR1 $syscount_pid
+        sleep 0.5
+        run_load $backend $depth $COUNTED "$url" > /dev/null
+        kill -USR1 $syscount_pid
+        sleep 0.5
+        pkill -P $syscount_pid
+        wait $syscount_pid 2> /dev/null
+        counts=$(grep '^syscalls=' "$report" | sed -n 2p)
+        rm -f "$report"
+        per_request=$(echo "$counts" | awk -v n=$COUNTED '{ split($1, kv, "="); printf("%.2f", kv[2] / n) }')
+        echo "${kind} ${mode} backend=${backend} ${result} syscalls_per_request=${per_request} ${counts#* }"
+    done
+done
+
+kill $origin_pid
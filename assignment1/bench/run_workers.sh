@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Benchmark cache hit throughput as the number of workers grows.
+# 64 small objects are cached first, then several load generator
+# processes request them in parallel. Reports the combined hit
+# throughput at 1, 2, 4 and 8 workers.
+
+cd "$(dirname "$0")/.." || exit 1
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+ORIGIN="http://127.0.0.1:${ORIGIN_PORT}"
+N_OBJECTS=64
+N_LOADGENS=${N_LOADGENS:-4}
+REQUESTS=${REQUESTS:-50000}
+
+# Build proxy and benchmark tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+
+urls=()
+for i in $(seq 1 $N_OBJECTS); do
+    urls+=("${ORIGIN}/size/1024?object=${i}")
+done
+
+echo "cores: $(nproc)"
+for workers in 1 2 4 8; do
+    ./a.out -w $workers $PROXY_PORT > /dev/null &
+    proxy_pid=$!
+    sleep 1
+
+    # Warm the cache so every request below is a hit
+    for url in "${urls[@]}"; do
+        curl -sS -x 127.0.0.1:$PROXY_PORT "$url" -o /dev/null
+    done
+
+    for i in $(seq 1 $N_LOADGENS); do
+        ./bench/loadgen -p $PROXY_PORT -c 64 -n $REQUESTS "${urls[@]}" > /tmp/workers_loadgen_$i &
+    done
+    wait $(jobs -p | grep -v "^$origin_pid$" | grep -v "^$proxy_pid$")
+
+    cat /tmp/workers_loadgen_* | awk -v w=$workers '
+        { for(i = 1; i <= NF; i++) { split($i, kv, "="); v[kv[1]] += kv[2]; if(kv[1] == "p99_ms" && kv[2] > p99) p99 = kv[2] } }
+        END { printf("workers=%d hit_rps=%.0f errors=%d worst_p99_ms=%.2f\n", w, v["rps"], v["errors"], p99) }'
+    rm -f /tmp/workers_loadgen_*
+
+    kill $proxy_pid
+    wait $proxy_pid 2>/dev/null
+done
+
+kill $origin_pid
@@ -0,0 +1,144 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      syscount.c
+// Usage:       gcc -O2 -o syscount syscount.c
+//              ./syscount <command> [argument...]
+//              System call counter. Runs the command under ptrace, following every
+//              thread and child it starts, and counts the system calls they make.
+//              SIGUSR1 prints the counts since the last report and starts counting
+//              afresh, so a benchmark can count only what a measured stretch of load
+//              costs; the counts left when the command exits are printed too. Each
+//              report is one line: the total, then the most frequent calls
+//*************************************************************************************************
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define SYSCOUNT_MAX_NR 1024
+#define SYSCOUNT_TOP 10
+
+// Names of the calls a proxy makes most, the rest are reported by number
+#define NAMED(call) [SYS_##call] = #call
+static const char *NAMES[SYSCOUNT_MAX_NR] = {
+    NAMED(read), NAMED(write), NAMED(readv), NAMED(writev), NAMED(close), NAMED(recvfrom),
+    NAMED(sendto), NAMED(recvmsg), NAMED(sendmsg), NAMED(accept), NAMED(accept4), NAMED(connect),
+    NAMED(socket), NAMED(setsockopt), NAMED(getsockopt), NAMED(fcntl), NAMED(epoll_wait),
+    NAMED(epoll_pwait), NAMED(epoll_ctl), NAMED(io_uring_enter), NAMED(futex), NAMED(splice),
+    NAMED(mmap), NAMED(munmap), NAMED(madvise), NAMED(timerfd_settime), NAMED(clock_nanosleep),
+};
+
+static long counts[SYSCOUNT_MAX_NR];
+static volatile sig_atomic_t report_asked = 0;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+static void ask_report(int signal_number) {
+    (void) signal_number;
+    report_asked = 1;
+}
+
+// Print the counts since the last report on one line and reset them
+static void report(void) {
+    long total = 0;
+    for(int i = 0; i < SYSCOUNT_MAX_NR; i++) {
+        total += counts[i];
+    }
+    printf("syscalls=%ld", total);
+    for(int shown = 0; shown < SYSCOUNT_TOP; shown++) {
+        int top = 0;
+        for(int i = 1; i < SYSCOUNT_MAX_NR; i++) {
+            if(counts[i] > counts[top]) {
+                top = i;
+            }
+        }
+        if(counts[top] == 0) {
+            break;
+        }
+        if(NAMES[top] != NULL) {
+            printf(" %s=%ld", NAMES[top], counts[top]);
+        } else {
+            printf(" sys_%d=%ld", top, counts[top]);
+        }
+        counts[top] = 0;
+    }
+    printf("\n");
+    fflush(stdout);
+    memset(counts, 0, sizeof(counts));
+}
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    if(argc < 2) {
+        printf("Usage: %s <command> [argument...]\n", argv[0]);
+        return -1;
+    }
+    pid_t child = fork();
+    if(child == 0) {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP);
+        execvp(argv[1], argv + 1);
+        perror("Error running command");
+        _exit(127);
+    }
+    // Reports are asked for between stops, so waiting must not restart
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = ask_report;
+    sigaction(SIGUSR1, &action, NULL);
+
+    int status;
+    if(child < 0 || waitpid(child, &status, 0) < 0 || !WIFSTOPPED(status)) {
+        perror("Error starting command");
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, child, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK |
+           PTRACE_O_TRACEVFORK | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, child, NULL, NULL);
+    int exit_code = 0;
+    while(1) {
+        pid_t pid = waitpid(-1, &status, __WALL);
+        if(report_asked) {
+            report_asked = 0;
+            report();
+        }
+        if(pid < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if(WIFEXITED(status) || WIFSIGNALED(status)) {
+            if(pid == child) {
+                exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+            continue;
+        }
+        int signal_number = WSTOPSIG(status);
+        int deliver = 0;
+        if(signal_number == (SIGTRAP | 0x80)) {
+            struct __ptrace_syscall_info info;
+            if(ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) > 0 && info.op == PTRACE_SYSCALL_INFO_ENTRY &&
+               info.entry.nr < SYSCOUNT_MAX_NR) {
+                counts[info.entry.nr] += 1;
+            }
+        } else if(signal_number != SIGTRAP && signal_number != SIGSTOP) {
+            // A signal for the command, not a stop of the tracing itself
+            deliver = signal_number;
+        }
+        ptrace(PTRACE_SYSCALL, pid, NULL, deliver);
+    }
+    report();
+    return exit_code;
+}
+
+//-------------------------------------------------------------------------------------------------
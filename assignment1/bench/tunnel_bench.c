@@ -0,0 +1,199 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      tunnel_bench.c
+// Usage:       gcc -O2 -pthread -o tunnel_bench tunnel_bench.c
+//              ./tunnel_bench [-p proxy_port] [-o origin_port] [-c tunnels] [-b megabytes] [-d]
+//              Tunnel throughput benchmark. Runs its own sink origin on <origin_port>,
+//              opens <tunnels> CONNECT tunnels to it through the proxy at once, and
+//              streams <megabytes> through each, then reports the total and Gbit/s
+//              measured from the first CONNECT to the last tunnel closing. The origin
+//              discards what it reads; with -d it is a source instead, sending the
+//              bytes down to the client, which discards them
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define TUNNEL_BENCH_DEFAULT_PROXY_PORT 9120
+#define TUNNEL_BENCH_DEFAULT_ORIGIN_PORT 9150
+#define TUNNEL_BENCH_CHUNK_SIZE (256*1024)
+#define TUNNEL_BENCH_MAX_TUNNELS 256
+
+int proxy_port = TUNNEL_BENCH_DEFAULT_PROXY_PORT;
+int origin_port = TUNNEL_BENCH_DEFAULT_ORIGIN_PORT;
+long long bytes_per_tunnel = 1024LL * 1024 * 1024;
+bool downstream = false;       // Origin sends, client reads
+long long bytes_received[TUNNEL_BENCH_MAX_TUNNELS];
+int failures = 0;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Given socket, write size bytes of filler. Return false on failure
+static bool send_bytes(int fd, long long size) {
+    static char chunk[TUNNEL_BENCH_CHUNK_SIZE];
+    while(size > 0) {
+        size_t length = (size < TUNNEL_BENCH_CHUNK_SIZE) ? (size_t) size : TUNNEL_BENCH_CHUNK_SIZE;
+        ssize_t n = write(fd, chunk, length);
+        if(n <= 0) {
+            return false;
+        }
+        size -= n;
+    }
+    return true;
+}
+
+// Given socket, read until the other side closes. Return bytes read
+static long long discard_bytes(int fd) {
+    char *chunk = malloc(TUNNEL_BENCH_CHUNK_SIZE);
+    long long total = 0;
+    ssize_t n;
+    while((n = read(fd, chunk, TUNNEL_BENCH_CHUNK_SIZE)) > 0) {
+        total += n;
+    }
+    free(chunk);
+    return total;
+}
+
+// Origin side of one tunnel: discard until the client shuts down, or as a
+// source send the bytes and close
+static void *serve_tunnel(void *arg) {
+    int fd = (int)(long) arg;
+    if(downstream) {
+        send_bytes(fd, bytes_per_tunnel);
+    } else {
+        discard_bytes(fd);
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *run_origin(void *arg) {
+    int listener = (int)(long) arg;
+    while(1) {
+        int fd = accept(listener, NULL, NULL);
+        if(fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        pthread_create(&thread, NULL, serve_tunnel, (void *)(long) fd);
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+// Client side of one tunnel: CONNECT through the proxy to the origin, then
+// stream the bytes up and wait for the tunnel to close, or read them down
+static void *run_client(void *arg) {
+    int index = (int)(long) arg;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(proxy_port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    char request[128];
+    int request_size = snprintf(request, sizeof(request), "CONNECT 127.0.0.1:%d HTTP/1.1\r\n"
+                                "Host: 127.0.0.1:%d\r\n\r\n", origin_port, origin_port);
+    // The reply is read a byte at a time so nothing after it is consumed
+    char reply[256];
+    size_t reply_size = 0;
+    bool sent = write(fd, request, request_size) == request_size;
+    while(sent && reply_size < sizeof(reply) - 1 &&
+          (reply_size < 4 || memcmp(reply + reply_size - 4, "\r\n\r\n", 4) != 0)) {
+        if(read(fd, reply + reply_size, 1) != 1) {
+            break;
+        }
+        reply_size++;
+    }
+    reply[reply_size] = '\0';
+    if(strncmp(reply, "HTTP/1.1 200", 12) != 0) {
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+        close(fd);
+        return NULL;
+    }
+    if(downstream) {
+        bytes_received[index] = discard_bytes(fd);
+    } else {
+        if(send_bytes(fd, bytes_per_tunnel)) {
+            bytes_received[index] = bytes_per_tunnel;
+        }
+        shutdown(fd, SHUT_WR);
+        discard_bytes(fd);
+    }
+    close(fd);
+    return NULL;
+}
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    int tunnels = 1;
+    int option;
+    signal(SIGPIPE, SIG_IGN);
+    while((option = getopt(argc, argv, "p:o:c:b:d")) != -1) {
+        switch(option) {
+            case 'p': proxy_port = atoi(optarg); break;
+            case 'o': origin_port = atoi(optarg); break;
+            case 'c': tunnels = atoi(optarg); break;
+            case 'b': bytes_per_tunnel = atoll(optarg) * 1024 * 1024; break;
+            case 'd': downstream = true; break;
+            default: tunnels = 0; break;
+        }
+    }
+    if(tunnels < 1 || tunnels > TUNNEL_BENCH_MAX_TUNNELS || bytes_per_tunnel <= 0) {
+        printf("Usage: %s [-p proxy_port] [-o origin_port] [-c tunnels] [-b megabytes] [-d]\n", argv[0]);
+        return -1;
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(origin_port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if(bind(listener, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listener, 256) < 0) {
+        perror("Error starting origin");
+        return -1;
+    }
+    pthread_t origin;
+    pthread_create(&origin, NULL, run_origin, (void *)(long) listener);
+
+    double start = now_seconds();
+    pthread_t clients[TUNNEL_BENCH_MAX_TUNNELS];
+    for(int i = 0; i < tunnels; i++) {
+        pthread_create(&clients[i], NULL, run_client, (void *)(long) i);
+    }
+    long long total = 0;
+    for(int i = 0; i < tunnels; i++) {
+        pthread_join(clients[i], NULL);
+        total += bytes_received[i];
+    }
+    double seconds = now_seconds() - start;
+    printf("tunnels=%d direction=%s bytes=%lld seconds=%.3f gbit_per_s=%.2f failures=%d\n", tunnels,
+           downstream ? "down" : "up", total, seconds, total * 8 / seconds / 1e9, failures);
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,179 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      buffer.c
+// Usage:       Implementation file for chunked response buffers
+//*************************************************************************************************
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "pool.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+// Initialize new empty buffer
+Buffer *buffer_create(void) {
+    return pool_calloc(sizeof(Buffer));
+}
+
+// Given data and capacity from pool_alloc, append a chunk holding it
+static BufferChunk *append_chunk(Buffer *buffer, unsigned char *data, size_t capacity) {
+    BufferChunk *chunk = pool_alloc(sizeof(BufferChunk));
+    chunk->next = NULL;
+    chunk->data = data;
+    chunk->size = 0;
+    chunk->capacity = capacity;
+    if(buffer->tail != NULL) {
+        buffer->tail->next = chunk;
+    } else {
+        buffer->head = chunk;
+    }
+    buffer->tail = chunk;
+    return chunk;
+}
+
+// Copy an existing malloc'd response into a new buffer and free the
+// original, so every buffer is made of pool blocks
+Buffer *buffer_adopt(unsigned char *data, size_t size) {
+    Buffer *buffer = buffer_create();
+    size_t copied = 0;
+    while(copied < size) {
+        size_t space;
+        unsigned char *free_space = buffer_reserve(buffer, &space);
+        size_t n = (size - copied < space) ? size - copied : space;
+        memcpy(free_space, data + copied, n);
+        buffer_commit(buffer, n);
+        copied += n;
+    }
+    free(data);
+    return buffer;
+}
+
+// Given data the buffer does not own, such as a mapped file, and a function
+// to call with context once the buffer is freed, wrap the data as a single
+// complete chunk
+Buffer *buffer_wrap(unsigned char *data, size_t size, void (*release)(void *context), void *context) {
+    Buffer *buffer = buffer_create();
+    BufferChunk *chunk = append_chunk(buffer, data, size);
+    chunk->size = size;
+    buffer->size = size;
+    buffer->release = release;
+    buffer->release_context = context;
+    return buffer;
+}
+
+static void chunk_free(Buffer *buffer, BufferChunk *chunk) {
+    if(buffer->release == NULL) {
+        pool_free(chunk->data, chunk->capacity);
+    }
+    pool_free(chunk, sizeof(BufferChunk));
+}
+
+void buffer_free(Buffer *buffer) {
+    if(buffer == NULL) {
+        return;
+    }
+    BufferChunk *chunk = buffer->head;
+    while(chunk != NULL) {
+        BufferChunk *next = chunk->next;
+        chunk_free(buffer, chunk);
+        chunk = next;
+    }
+    if(buffer->release != NULL) {
+        buffer->release(buffer->release_context);
+    }
+    pool_free(buffer, sizeof(Buffer));
+}
+
+// Return pointer to free space at the end of the buffer, adding a pool
+// block if the last chunk is full. Store amount of free space in space
+unsigned char *buffer_reserve(Buffer *buffer, size_t *space) {
+    BufferChunk *tail = buffer->tail;
+    if(tail == NULL || tail->size == tail->capacity) {
+        tail = append_chunk(buffer, pool_alloc(POOL_BLOCK_SIZE), POOL_BLOCK_SIZE);
+    }
+    *space = tail->capacity - tail->size;
+    return tail->data + tail->size;
+}
+
+// Mark size bytes written into the space returned by buffer_reserve as used
+void buffer_commit(Buffer *buffer, size_t size) {
+    buffer->tail->size += size;
+    buffer->size += size;
+}
+
+// Describe bytes [start, end) of the buffer as at most max_iov iovecs.
+// Return number of iovecs filled. start must not precede trimmed data
+int buffer_iovec(Buffer *buffer, size_t start, size_t end, struct iovec *iov, int max_iov) {
+    int count = 0;
+    size_t chunk_start = buffer->trimmed;
+    for(BufferChunk *chunk = buffer->head; chunk != NULL && count < max_iov && start < end; chunk = chunk->next) {
+        size_t chunk_end = chunk_start + chunk->size;
+        if(start < chunk_end) {
+            size_t stop = (end < chunk_end) ? end : chunk_end;
+            iov[count].iov_base = chunk->data + (start - chunk_start);
+            iov[count].iov_len = stop - start;
+            count += 1;
+            start = stop;
+        }
+        chunk_start = chunk_end;
+    }
+    return count;
+}
+
+// Free every chunk lying entirely before offset. The last chunk is kept
+// so appends can continue
+void buffer_trim(Buffer *buffer, size_t offset) {
+    while(buffer->head != buffer->tail && buffer->trimmed + buffer->head->size <= offset) {
+        BufferChunk *chunk = buffer->head;
+        buffer->trimmed += chunk->size;
+        buffer->head = chunk->next;
+        chunk_free(buffer, chunk);
+    }
+}
+
+// Move the last chunk into the smallest size class that holds its bytes.
+// Called once a response is complete, so a small cached object does not
+// pin a whole block
+void buffer_compact(Buffer *buffer) {
+    BufferChunk *tail = buffer->tail;
+    if(tail == NULL || buffer->release != NULL || pool_size(tail->size) >= pool_size(tail->capacity)) {
+        return;
+    }
+    unsigned char *data = pool_alloc(tail->size);
+    if(data == NULL) {
+        return;
+    }
+    memcpy(data, tail->data, tail->size);
+    pool_free(tail->data, tail->capacity);
+    tail->data = data;
+    tail->capacity = tail->size;
+}
+
+// Return bytes the buffer holds from the pool, including chunk headers
+// and space not yet filled. Wrapped data counts at its size, since it is
+// resident once written
+size_t buffer_footprint(Buffer *buffer) {
+    size_t footprint = pool_size(sizeof(Buffer));
+    for(BufferChunk *chunk = buffer->head; chunk != NULL; chunk = chunk->next) {
+        footprint += pool_size(sizeof(BufferChunk));
+        footprint += (buffer->release != NULL) ? chunk->capacity : pool_size(chunk->capacity);
+    }
+    return footprint;
+}
+
+// Return first contiguous run of bytes in the buffer, storing its length
+// in size. Response headers are parsed from here
+unsigned char *buffer_head(Buffer *buffer, size_t *size) {
+    if(buffer->head == NULL) {
+        *size = 0;
+        return NULL;
+    }
+    *size = buffer->head->size;
+    return buffer->head->data;
+}
+
+//-------------------------------------------------------------------------------------------------
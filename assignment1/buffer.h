@@ -0,0 +1,56 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      buffer.h
+// Usage:       Header file for chunked response buffers
+//*************************************************************************************************
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+
+// ----STRUCT--------------------------------------------------------------------------------------
+
+// Block of response bytes from the pool. Blocks never move once allocated,
+// so readers can keep writing from them while more data is appended
+typedef struct BufferChunk{
+    struct BufferChunk *next;
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} BufferChunk;
+
+// Append-only list of chunks holding a response as it arrives. Offsets are
+// absolute from the start of the response, even after the front of the
+// buffer has been trimmed away
+typedef struct Buffer{
+    BufferChunk *head;
+    BufferChunk *tail;
+    size_t size;       // Total bytes appended
+    size_t trimmed;    // Bytes freed from the front
+    void (*release)(void *context);    // Set when the data is not the pool's, and
+    void *release_context;             // called instead of freeing it
+} Buffer;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+Buffer *buffer_create(void);
+Buffer *buffer_adopt(unsigned char *data, size_t size);
+Buffer *buffer_wrap(unsigned char *data, size_t size, void (*release)(void *context), void *context);
+void buffer_free(Buffer *buffer);
+unsigned char *buffer_reserve(Buffer *buffer, size_t *space);
+void buffer_commit(Buffer *buffer, size_t size);
+int buffer_iovec(Buffer *buffer, size_t start, size_t end, struct iovec *iov, int max_iov);
+void buffer_trim(Buffer *buffer, size_t offset);
+void buffer_compact(Buffer *buffer);
+unsigned char *buffer_head(Buffer *buffer, size_t *size);
+size_t buffer_footprint(Buffer *buffer);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
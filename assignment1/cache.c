@@ -7,188 +7,703 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
 #include "cache.h"
+#include "disk_cache.h"
+#include "metrics.h"
+#include "pool.h"
 // #include "proxy.c"
 
 #define HTTP_HEADER_MAX_SIZE 2000 
 
 // ----GLOBAL VARIABLES----------------------------------------------------------------------------
-
+static const char *CACHE_POLICY_NAMES[] = {"lru", "gdsf", "tinylfu"};
 
 //----FUNCTIONS------------------------------------------------------------------------------------
-// Initialize new cache
-Cache *cache_create(void) {
+static void heap_init(CacheHeap *heap, CacheHeapType type) {
+    heap->type = type;
+    heap->entries = NULL;
+    heap->size = 0;
+    heap->capacity = 0;
+}
+
+// Initialize new cache with a total budget of capacity_bytes. Objects larger
+// than max_object_percent of a shard's budget are never cached
+Cache *cache_create(size_t capacity_bytes, CachePolicy policy, int max_object_percent) {
     Cache *cache = malloc(sizeof(Cache));
-    cache->size = 0;
-    cache->capacity = MAX_CACHE_SIZE;
-    for(int i = 0; i < cache->capacity; i++) {
-        cache->entries[i] = NULL;
+    cache->policy = policy;
+    cache->shard_count = 1;
+    while(cache->shard_count < CACHE_MAX_SHARDS &&
+          capacity_bytes / (cache->shard_count * 2) >= (size_t) CACHE_MIN_SHARD_BYTES) {
+        cache->shard_count *= 2;
+    }
+    size_t shard_bytes = capacity_bytes / cache->shard_count;
+    cache->max_object_size = shard_bytes / 100 * max_object_percent;
+
+    for(int s = 0; s < cache->shard_count; s++) {
+        CacheShard *shard = &cache->shards[s];
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->table = calloc(16, sizeof(CacheEntry *));
+        shard->table_mask = 15;
+        shard->lru_head = NULL;
+        shard->lru_tail = NULL;
+        heap_init(&shard->expiry_heap, CACHE_HEAP_EXPIRY);
+        heap_init(&shard->priority_heap, CACHE_HEAP_PRIORITY);
+        shard->inflation = 0;
+        shard->size = 0;
+        shard->bytes_used = 0;
+        shard->bytes_capacity = shard_bytes;
+    }
+
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    cache->disk = NULL;
+    cache->sketch = NULL;
+    if(policy == CACHE_POLICY_TINYLFU) {
+        cache->sketch = calloc(1, sizeof(CacheSketch));
+        cache->sketch->reset_interval = 10 * CACHE_SKETCH_WIDTH;
     }
     return cache;
 }
 
-// Given cache pointer and server response, create a 
-// new cache entry, add to cache, and update cache accordingly
-void cache_insert(Cache* cache, char* url, unsigned char *server_response, size_t *server_response_size) {
-    // Create cache entry
-    CacheEntry *cache_entry = CacheEntry_create(url, server_response, server_response_size);
-    // Check whether cache is full
-    bool cache_at_capacity = (cache->capacity == cache->size);
-    if(cache_at_capacity) {
-        cache_eviction_protocol(cache);
+void cache_free(Cache* cache) {
+    for(int s = 0; s < cache->shard_count; s++) {
+        CacheShard *shard = &cache->shards[s];
+        CacheEntry *cache_entry = shard->lru_head;
+        while(cache_entry != NULL) {
+            CacheEntry *next = cache_entry->lru_next;
+            CacheEntry_release(cache_entry);
+            cache_entry = next;
+        }
+        free(shard->table);
+        free(shard->expiry_heap.entries);
+        free(shard->priority_heap.entries);
+        pthread_rwlock_destroy(&shard->lock);
     }
-    // Insert cache entry into cache
-    cache->entries[cache->size] = cache_entry;
-    cache->size += 1;
-}
-
-// Identify node to be evicted and evict
-void cache_eviction_protocol(Cache* cache){
-    // Evict any stale item
-    int cache_entry_eviction_index = -1;
-    for(int i = 0; i < cache->size; i++) {
-        if(!cache_entry_valid(cache->entries[i])) {
-            cache_entry_eviction_index = i;
-        }
-    }
-
-    // If no items are stale, remove the least-recently accessed
-    // cache entry
-    if(cache_entry_eviction_index < 0) {
-        int cache_entry_oldest_access_time_index = 0;
-        struct timespec oldest_access_time = cache->entries[0]->time_accessed;
-        struct timespec current_access_time;
-        for(int i = 0; i < cache->size; i++) {
-            current_access_time = cache->entries[i]->time_accessed;
-            if(is_older(current_access_time, oldest_access_time)) {
-                oldest_access_time = current_access_time;
-                cache_entry_oldest_access_time_index = i;
+    free(cache->sketch);
+    free(cache);
+}
+
+// Given disk tier, write every response added to the cache through to it
+// and look there for URLs missing from memory
+void cache_attach_disk(Cache *cache, struct DiskCache *disk) {
+    cache->disk = disk;
+}
+
+// Print cache counters and current occupancy on a single line
+void cache_print_stats(Cache *cache) {
+    size_t entries = 0, bytes_used = 0, bytes_capacity = 0;
+    for(int s = 0; s < cache->shard_count; s++) {
+        CacheShard *shard = &cache->shards[s];
+        pthread_rwlock_rdlock(&shard->lock);
+        entries += shard->size;
+        bytes_used += shard->bytes_used;
+        bytes_capacity += shard->bytes_capacity;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    printf("cache hits=%lu misses=%lu stale_served=%lu revalidated_304=%lu revalidated_200=%lu "
+           "bytes_copied=%lu entries=%zu bytes_used=%zu bytes_capacity=%zu\n",
+           __atomic_load_n(&cache->stats.hits, __ATOMIC_RELAXED),
+           __atomic_load_n(&cache->stats.misses, __ATOMIC_RELAXED),
+           __atomic_load_n(&cache->stats.stale_served, __ATOMIC_RELAXED),
+           __atomic_load_n(&cache->stats.revalidated_304, __ATOMIC_RELAXED),
+           __atomic_load_n(&cache->stats.revalidated_200, __ATOMIC_RELAXED),
+           __atomic_load_n(&cache->stats.bytes_copied, __ATOMIC_RELAXED),
+           entries, bytes_used, bytes_capacity);
+    fflush(stdout);
+}
+
+// Given policy name, store matching policy. Return -1 if name is unknown
+int cache_policy_from_name(const char *name, CachePolicy *policy) {
+    for(int i = 0; i <= CACHE_POLICY_TINYLFU; i++) {
+        if(strcasecmp(name, CACHE_POLICY_NAMES[i]) == 0) {
+            *policy = (CachePolicy) i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *cache_policy_name(CachePolicy policy) {
+    return CACHE_POLICY_NAMES[policy];
+}
+
+// Given URL, return 64-bit FNV-1a hash of it
+uint64_t url_hash(const char *url) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(const unsigned char *c = (const unsigned char *) url; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Given cache and the hash of a url, return the shard responsible for the
+// url. The top bits pick the shard; the low bits index the shard's table
+CacheShard *cache_shard(Cache *cache, uint64_t hash) {
+    return &cache->shards[(hash >> 60) & (cache->shard_count - 1)];
+}
+
+// Return true if a response of the given size may be cached at all
+bool cache_admissible(Cache *cache, size_t server_response_size) {
+    return server_response_size <= cache->max_object_size;
+}
+
+//----HASH TABLE-----------------------------------------------------------------------------------
+// Given shard, url and hash of url, return matching entry or NULL.
+// Caller holds the shard lock
+CacheEntry *cache_lookup(CacheShard* shard, char *url, uint64_t hash) {
+    size_t slot = hash & shard->table_mask;
+    while(shard->table[slot] != NULL) {
+        CacheEntry *cache_entry = shard->table[slot];
+        if(cache_entry->url_hash == hash && strcmp(cache_entry->url, url) == 0) {
+            return cache_entry;
+        }
+        slot = (slot + 1) & shard->table_mask;
+    }
+    return NULL;
+}
+
+// Insert entry into the first free slot of its probe sequence
+static void table_place(CacheEntry **table, size_t table_mask, CacheEntry *cache_entry) {
+    size_t slot = cache_entry->url_hash & table_mask;
+    while(table[slot] != NULL) {
+        slot = (slot + 1) & table_mask;
+    }
+    table[slot] = cache_entry;
+}
+
+// Insert entry, doubling the table first if it would become more than
+// half full so probe sequences stay short
+static void table_insert(CacheShard *shard, CacheEntry *cache_entry) {
+    size_t table_size = shard->table_mask + 1;
+    if((shard->size + 1) * 2 > table_size) {
+        size_t new_mask = table_size * 2 - 1;
+        CacheEntry **new_table = calloc(table_size * 2, sizeof(CacheEntry *));
+        for(size_t i = 0; i < table_size; i++) {
+            if(shard->table[i] != NULL) {
+                table_place(new_table, new_mask, shard->table[i]);
             }
         }
-        cache_entry_eviction_index = cache_entry_oldest_access_time_index;
+        free(shard->table);
+        shard->table = new_table;
+        shard->table_mask = new_mask;
     }
+    table_place(shard->table, shard->table_mask, cache_entry);
+}
 
-    // Evict cache entry identified by eviction protocol
-    evict(cache, cache_entry_eviction_index);
+// Remove entry from table. Later entries in the same probe run are
+// shifted back into the hole so lookups never need tombstones
+static void table_remove(CacheShard *shard, CacheEntry *cache_entry) {
+    size_t hole = cache_entry->url_hash & shard->table_mask;
+    while(shard->table[hole] != cache_entry) {
+        hole = (hole + 1) & shard->table_mask;
+    }
+    size_t slot = hole;
+    while(1) {
+        slot = (slot + 1) & shard->table_mask;
+        CacheEntry *candidate = shard->table[slot];
+        if(candidate == NULL) {
+            break;
+        }
+        // Move candidate only if its home slot does not lie
+        // cyclically in (hole, slot]
+        size_t home = candidate->url_hash & shard->table_mask;
+        if(((slot - home) & shard->table_mask) >= ((slot - hole) & shard->table_mask)) {
+            shard->table[hole] = candidate;
+            hole = slot;
+        }
+    }
+    shard->table[hole] = NULL;
 }
 
-// Return true if time1 is older than time2, else return false
-bool is_older(struct timespec time1, struct timespec time2){
-    if((time1.tv_sec < time2.tv_sec) || 
-       ((time1.tv_sec == time2.tv_sec) && (time1.tv_nsec < time2.tv_nsec))) {
-        return true;
+//----LRU LIST-------------------------------------------------------------------------------------
+static void lru_push_front(CacheShard *shard, CacheEntry *cache_entry) {
+    cache_entry->lru_prev = NULL;
+    cache_entry->lru_next = shard->lru_head;
+    if(shard->lru_head != NULL) {
+        shard->lru_head->lru_prev = cache_entry;
     } else {
-        return false;
+        shard->lru_tail = cache_entry;
     }
+    shard->lru_head = cache_entry;
 }
 
+static void lru_remove(CacheShard *shard, CacheEntry *cache_entry) {
+    if(cache_entry->lru_prev != NULL) {
+        cache_entry->lru_prev->lru_next = cache_entry->lru_next;
+    } else {
+        shard->lru_head = cache_entry->lru_next;
+    }
+    if(cache_entry->lru_next != NULL) {
+        cache_entry->lru_next->lru_prev = cache_entry->lru_prev;
+    } else {
+        shard->lru_tail = cache_entry->lru_prev;
+    }
+    cache_entry->lru_prev = NULL;
+    cache_entry->lru_next = NULL;
+}
 
-void cache_free(Cache* cache) {
-    for(int i = 0; i < cache->size; i++) {
-        free(cache->entries[i]);
+//----HEAPS----------------------------------------------------------------------------------------
+static double heap_key(CacheHeap *heap, CacheEntry *cache_entry) {
+    if(heap->type == CACHE_HEAP_EXPIRY) {
+        return (double) cache_entry_expiry(cache_entry);
     }
-    free(cache);
+    return cache_entry->priority;
+}
+
+static void heap_swap(CacheHeap *heap, size_t i, size_t j) {
+    CacheEntry *temp = heap->entries[i];
+    heap->entries[i] = heap->entries[j];
+    heap->entries[j] = temp;
+    heap->entries[i]->heap_index[heap->type] = i;
+    heap->entries[j]->heap_index[heap->type] = j;
 }
 
-// Given cache and url, determine whether matching
-// cache entry exists in cache. If so, return index
-// of matching entry. Else, return -1
-int get_cache_entry_index(Cache* cache, char *url) {
-    int cache_entry_index = -1;
-    for(int i = 0; i < cache->size; i++) {
-        char *cached_url = cache->entries[i]->url;
-        if(strcmp(url, cached_url) == 0) {
-            cache_entry_index = i;
-            return cache_entry_index;
+static void heap_sift_up(CacheHeap *heap, size_t i) {
+    while(i > 0) {
+        size_t parent = (i - 1) / 2;
+        if(heap_key(heap, heap->entries[parent]) <= heap_key(heap, heap->entries[i])) {
+            break;
         }
+        heap_swap(heap, i, parent);
+        i = parent;
     }
-    return cache_entry_index;
 }
 
-// Determine whether request is present in cache.
-// If request is present and valid, return true.
-// If request is present and stale, evict and return false. 
-// If request is not present, return false.
-bool cache_check(Cache* cache, char *url) {
-    int cache_entry_index = get_cache_entry_index(cache, url);
-    if(cache_entry_index < 0) {
+// Restore heap order below i, considering only the first n heap slots
+static void heap_sift_down(CacheHeap *heap, size_t i, size_t n) {
+    while(1) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = 2 * i + 2;
+        if(left < n && heap_key(heap, heap->entries[left]) < heap_key(heap, heap->entries[smallest])) {
+            smallest = left;
+        }
+        if(right < n && heap_key(heap, heap->entries[right]) < heap_key(heap, heap->entries[smallest])) {
+            smallest = right;
+        }
+        if(smallest == i) {
+            break;
+        }
+        heap_swap(heap, i, smallest);
+        i = smallest;
+    }
+}
+
+static void heap_push(CacheHeap *heap, CacheEntry *cache_entry) {
+    if(heap->size == heap->capacity) {
+        heap->capacity = (heap->capacity == 0) ? 16 : heap->capacity * 2;
+        heap->entries = realloc(heap->entries, heap->capacity * sizeof(CacheEntry *));
+    }
+    size_t i = heap->size;
+    heap->entries[i] = cache_entry;
+    cache_entry->heap_index[heap->type] = i;
+    heap->size += 1;
+    heap_sift_up(heap, i);
+}
+
+static void heap_remove(CacheHeap *heap, CacheEntry *cache_entry) {
+    size_t i = cache_entry->heap_index[heap->type];
+    size_t last = heap->size - 1;
+    if(i != last) {
+        heap_swap(heap, i, last);
+        heap_sift_down(heap, i, last);
+        heap_sift_up(heap, i);
+    }
+    heap->size -= 1;
+}
+
+//----FREQUENCY SKETCH-----------------------------------------------------------------------------
+// Given row of sketch and URL hash, return counter index for that row
+static size_t sketch_index(int row, uint64_t hash) {
+    uint64_t mixed = hash * (0x9E3779B97F4A7C15ULL + 2 * row);
+    return (mixed >> 32) & (CACHE_SKETCH_WIDTH - 1);
+}
+
+// Return estimated number of recent requests for URL hash
+static int sketch_estimate(CacheSketch *sketch, uint64_t hash) {
+    int estimate = CACHE_SKETCH_MAX_COUNT;
+    for(int row = 0; row < CACHE_SKETCH_DEPTH; row++) {
+        int count = __atomic_load_n(&sketch->counters[row][sketch_index(row, hash)], __ATOMIC_RELAXED);
+        if(count < estimate) {
+            estimate = count;
+        }
+    }
+    return estimate;
+}
+
+// Record request for URL hash. Lost updates between racing workers only
+// make the estimate slightly low, so relaxed atomics are sufficient
+static void sketch_record(CacheSketch *sketch, uint64_t hash) {
+    for(int row = 0; row < CACHE_SKETCH_DEPTH; row++) {
+        uint8_t *counter = &sketch->counters[row][sketch_index(row, hash)];
+        if(__atomic_load_n(counter, __ATOMIC_RELAXED) < CACHE_SKETCH_MAX_COUNT) {
+            __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+        }
+    }
+    uint64_t samples = __atomic_add_fetch(&sketch->samples, 1, __ATOMIC_RELAXED);
+    if(samples % sketch->reset_interval == 0) {
+        for(int row = 0; row < CACHE_SKETCH_DEPTH; row++) {
+            for(int i = 0; i < CACHE_SKETCH_WIDTH; i++) {
+                sketch->counters[row][i] /= 2;
+            }
+        }
+    }
+}
+
+//----CACHE OPERATIONS-----------------------------------------------------------------------------
+// Given shard and entry, compute GDSF priority from the entry's
+// current frequency and the shard's inflation value
+static void update_priority(CacheShard *shard, CacheEntry *cache_entry) {
+    cache_entry->priority_frequency = __atomic_load_n(&cache_entry->frequency, __ATOMIC_RELAXED);
+    cache_entry->priority = shard->inflation + (double) cache_entry->priority_frequency / cache_entry->charge;
+}
+
+// Given cache pointer and server response, create a 
+// new cache entry, add to cache, and update cache accordingly.
+// The cache takes ownership of server_response, freeing it if the
+// response is not admitted. Return true if the response was cached
+bool cache_insert(Cache* cache, char* url, unsigned char *server_response, size_t *server_response_size) {
+    // Objects too large for the budget bypass the cache entirely
+    if(!cache_admissible(cache, *server_response_size)) {
+        free(server_response);
         return false;
-    } 
-    CacheEntry *cache_entry = cache->entries[cache_entry_index];
-    bool is_valid = cache_entry_valid(cache_entry);
-    if(!is_valid) {
-        evict(cache, cache_entry_index);
+    }
+    CacheEntry *cache_entry = CacheEntry_create(url, buffer_adopt(server_response, *server_response_size), NULL);
+    bool cached = cache_add(cache, cache_entry);
+    CacheEntry_release(cache_entry);
+    return cached;
+}
+
+// Given cache pointer and a complete cache entry, add entry to cache and
+// update cache accordingly. An existing entry for the same URL is replaced.
+// The cache takes its own reference, so the caller keeps theirs either way.
+// Entries not read from the disk tier are queued to be written to it, even
+// if memory turns them away. Return true if the entry was cached in memory
+bool cache_add(Cache *cache, CacheEntry *cache_entry) {
+    char *url = cache_entry->url;
+    cache_entry->url_hash = url_hash(url);
+    // Partial entries are only held in memory
+    if(cache->disk != NULL && !cache_entry->on_disk && cache_entry->segments == NULL) {
+        cache_entry->on_disk = true;
+        disk_cache_store(cache->disk, cache_entry);
+    }
+    if(!cache_admissible(cache, cache_entry->server_response_size)) {
         return false;
     }
+    // Charge what the entry holds from the pool, so the budget bounds memory
+    // actually in use rather than the bytes of the response alone
+    cache_entry->charge = pool_size(sizeof(CacheEntry)) + pool_size(strlen(url) + 1) +
+                          buffer_footprint(cache_entry->server_response);
+    if(cache_entry->segments != NULL) {
+        cache_entry->charge += pool_size(CACHE_MAX_SEGMENTS * sizeof(CacheSegment *));
+    }
+    for(int i = 0; i < cache_entry->segment_count; i++) {
+        cache_entry->charge += buffer_footprint(cache_entry->segments[i]->response);
+    }
+    cache_entry->frequency = 1;
+    CacheShard *shard = cache_shard(cache, cache_entry->url_hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    CacheEntry *existing = cache_lookup(shard, url, cache_entry->url_hash);
+    if(existing != NULL) {
+        cache_entry->frequency += existing->frequency;
+        evict(shard, existing);
+    }
 
+    // Make room. Under TinyLFU the new entry must be more popular
+    // than each victim it displaces, otherwise it is rejected
+    while(shard->bytes_used + cache_entry->charge > shard->bytes_capacity) {
+        CacheEntry *victim = (shard->size > 0) ? cache_eviction_protocol(cache, shard) : NULL;
+        if(victim == NULL ||
+           (cache->sketch != NULL && cache_entry_valid(victim) &&
+            sketch_estimate(cache->sketch, cache_entry->url_hash) <= sketch_estimate(cache->sketch, victim->url_hash))) {
+            pthread_rwlock_unlock(&shard->lock);
+            return false;
+        }
+        metrics_add(cache_entry_valid(victim) ? METRIC_EVICTIONS_CAPACITY : METRIC_EVICTIONS_STALE, 1);
+        evict(shard, victim);
+    }
+
+    // Insert cache entry into cache
+    CacheEntry_acquire(cache_entry);
+    table_insert(shard, cache_entry);
+    lru_push_front(shard, cache_entry);
+    heap_push(&shard->expiry_heap, cache_entry);
+    if(cache->policy == CACHE_POLICY_GDSF) {
+        update_priority(shard, cache_entry);
+        heap_push(&shard->priority_heap, cache_entry);
+    }
+    shard->size += 1;
+    shard->bytes_used += cache_entry->charge;
+    pthread_rwlock_unlock(&shard->lock);
     return true;
 }
 
-// Given cache and index of entry to evict, 
-// evict entry and update cache accordingly
-void evict(Cache* cache, int cache_entry_index) {
-    free(cache->entries[cache_entry_index]);
-    for(int i = cache_entry_index; i < (cache->size - 1); i++) {
-        cache->entries[i] = cache->entries[i+1];
+// Identify entry to be evicted and return it. Shard must not be empty.
+// Caller holds the shard lock exclusively
+CacheEntry *cache_eviction_protocol(Cache *cache, CacheShard* shard){
+    // Evict the entry closest to expiry if it is already stale
+    CacheEntry *soonest_expiry = shard->expiry_heap.entries[0];
+    if(!cache_entry_valid(soonest_expiry)) {
+        return soonest_expiry;
     }
-    cache->size -= 1;
-}
 
+    // Under GDSF, evict the lowest priority entry. Priorities of entries hit
+    // since they were computed are refreshed first, then the aging value
+    // rises to the evicted priority so long-idle entries eventually lose out
+    if(cache->policy == CACHE_POLICY_GDSF) {
+        CacheHeap *heap = &shard->priority_heap;
+        CacheEntry *cache_entry = heap->entries[0];
+        while(cache_entry->priority_frequency != __atomic_load_n(&cache_entry->frequency, __ATOMIC_RELAXED)) {
+            update_priority(shard, cache_entry);
+            heap_sift_down(heap, 0, heap->size);
+            cache_entry = heap->entries[0];
+        }
+        shard->inflation = cache_entry->priority;
+        return cache_entry;
+    }
 
-// Given a cache and the URL of a cache entry known to exist in the cache, 
-// return a copy of the response stored in the cache entry with the age field
-// added to the header. Update the retrieval field and assign the size of the 
-// server response to the server_response_size pointer passed in
-unsigned char *cache_retrieval(Cache *cache, char *url, size_t *server_response_size){
-    // Retrieve the cached entry and update time last accessed
-    int n = get_cache_entry_index(cache, url);
-    if(n < 0) {
-        printf("Error, cached item should exist, but is missing. Exitting...\n");
-        exit(EXIT_FAILURE);
+    // Otherwise remove the least-recently used entry.
+    // Entries hit since they last reached the tail get a second chance
+    CacheEntry *cache_entry = shard->lru_tail;
+    while(__atomic_exchange_n(&cache_entry->referenced, false, __ATOMIC_RELAXED)) {
+        lru_remove(shard, cache_entry);
+        lru_push_front(shard, cache_entry);
+        cache_entry = shard->lru_tail;
     }
-    CacheEntry *cached_entry = cache->entries[n];
-    clock_gettime(CLOCK_REALTIME, &(cached_entry->time_accessed));
+    return cache_entry;
+}
 
-    // Modify response to incorporate age
-    unsigned char *server_response_with_age = add_age_header(cached_entry, server_response_size);
+// Determine whether request is present in cache.
+// If request is present and valid, mark it as used and return true.
+// If request is present and stale, return false, evicting it unless it
+// can be revalidated or served while refreshed.
+// If request is not present, return false.
+bool cache_check(Cache* cache, char *url) {
+    uint64_t hash = url_hash(url);
+    CacheShard *shard = cache_shard(cache, hash);
+    if(cache->sketch != NULL) {
+        sketch_record(cache->sketch, hash);
+    }
+    pthread_rwlock_rdlock(&shard->lock);
+    CacheEntry *cache_entry = cache_lookup(shard, url, hash);
+    bool is_valid = (cache_entry != NULL) && cache_entry_valid(cache_entry);
+    bool kept = (cache_entry != NULL) && !is_valid && cache_entry_keep_stale(cache_entry);
+    if(is_valid) {
+        // Readers share the lock, so use is recorded with atomic updates
+        // instead of moving the entry in the LRU list or priority heap
+        __atomic_store_n(&cache_entry->referenced, true, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&cache_entry->frequency, 1, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    if(cache_entry != NULL && !is_valid && !kept) {
+        // Retake lock exclusively to evict. Another worker may have
+        // replaced or evicted the entry in between, so look it up again
+        pthread_rwlock_wrlock(&shard->lock);
+        cache_entry = cache_lookup(shard, url, hash);
+        if(cache_entry != NULL && !cache_entry_valid(cache_entry)) {
+            metrics_add(METRIC_EVICTIONS_STALE, 1);
+            evict(shard, cache_entry);
+        }
+        pthread_rwlock_unlock(&shard->lock);
+    }
 
-    // Return response (with age) and modified response size
-    return server_response_with_age;
+    // Fresh copies found on disk are brought back into memory. A stale
+    // copy kept in memory is at least as new as the one on disk
+    if(!is_valid && !kept && cache->disk != NULL) {
+        cache_entry = disk_cache_lookup(cache->disk, url, hash);
+        if(cache_entry != NULL) {
+            cache_add(cache, cache_entry);
+            CacheEntry_release(cache_entry);
+            is_valid = true;
+        }
+    }
+    __atomic_fetch_add(is_valid ? &cache->stats.hits : &cache->stats.misses, 1, __ATOMIC_RELAXED);
+    metrics_add(is_valid ? METRIC_CACHE_HITS : METRIC_CACHE_MISSES, 1);
+    return is_valid;
 }
 
-// Given cached entry, return copy of cached response 
-// with "Age" field incorporated
-unsigned char *add_age_header(CacheEntry *cached_entry, size_t *server_response_size) {
-    // Get age
-    int age = get_age(cached_entry);
-    
-    // Create age header
-    char *age_header = malloc(20);
-    sprintf(age_header, "\r\nAge: %d", age);
+// Given cache shard and entry to evict, remove entry from every index of
+// the shard and drop the cache's reference. Connections still writing the
+// entry keep it alive until they release it
+void evict(CacheShard* shard, CacheEntry *cache_entry) {
+    table_remove(shard, cache_entry);
+    lru_remove(shard, cache_entry);
+    heap_remove(&shard->expiry_heap, cache_entry);
+    if(shard->priority_heap.size > 0) {
+        heap_remove(&shard->priority_heap, cache_entry);
+    }
+    shard->size -= 1;
+    shard->bytes_used -= cache_entry->charge;
+    CacheEntry_release(cache_entry);
+}
 
-    // Locate the end of the HTTP headers marked by "\r\n\r\n"
-    unsigned char *server_response = cached_entry->server_response;
-    unsigned char *server_response_header_end = (unsigned char *)strstr((const char *)server_response, "\r\n\r\n");
 
-    // Copy contents of original server response into new buffer with
-    // age header added
-    size_t header_length = server_response_header_end - server_response;
-    size_t body_length   = cached_entry->server_response_size - header_length;
+// Given a cache and the URL of a cache entry, return the entry with a
+// reference held so it stays valid after the shard lock is dropped, even if
+// it is evicted while the response is being written. Caller releases it
+// with CacheEntry_release. Entries missing from memory, such as those it
+// turned away, are served from the disk tier. Another worker may evict the
+// entry after cache_check, in which case NULL is returned and the caller misses
+CacheEntry *cache_retrieval(Cache *cache, char *url) {
+    // Retrieve the cached entry
+    uint64_t hash = url_hash(url);
+    CacheShard *shard = cache_shard(cache, hash);
+    pthread_rwlock_rdlock(&shard->lock);
+    CacheEntry *cached_entry = cache_lookup(shard, url, hash);
+    if(cached_entry != NULL) {
+        CacheEntry_acquire(cached_entry);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    if(cached_entry == NULL && cache->disk != NULL) {
+        cached_entry = disk_cache_lookup(cache->disk, url, hash);
+    }
+    return cached_entry;
+}
 
-    unsigned char *server_response_with_age = malloc(cached_entry->server_response_size + strlen(age_header));
-    
-    memcpy(server_response_with_age, server_response, header_length);
-    memcpy(server_response_with_age + header_length, age_header, strlen(age_header));
-    memcpy(server_response_with_age + header_length + strlen(age_header), server_response_header_end, body_length);
+// Given cache entry the origin has confirmed unchanged and the indexed
+// header of its 304 response, restart the entry's freshness lifetime and move it
+// back to its place in the expiry heap. An entry evicted while it was
+// being revalidated is added again, unless a newer response replaced it
+void cache_refresh(Cache *cache, CacheEntry *cache_entry, const HttpResponseHeader *header) {
+    CacheShard *shard = cache_shard(cache, cache_entry->url_hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    cache_entry_refresh(cache_entry, header);
+    CacheEntry *cached_entry = cache_lookup(shard, cache_entry->url, cache_entry->url_hash);
+    if(cached_entry == cache_entry) {
+        size_t i = cache_entry->heap_index[CACHE_HEAP_EXPIRY];
+        heap_sift_down(&shard->expiry_heap, i, shard->expiry_heap.size);
+        heap_sift_up(&shard->expiry_heap, i);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    if(cached_entry == NULL) {
+        cache_add(cache, cache_entry);
+    }
+    if(cache->disk != NULL && cache_entry->on_disk) {
+        disk_cache_refresh(cache->disk, cache_entry->url_hash, cache_entry->time_added.tv_sec,
+                           cache_entry->max_age);
+    }
+}
 
-    // Return new buffer with age header added
-    *server_response_size = cached_entry->server_response_size + strlen(age_header);
-    return server_response_with_age;
+// Given URL, return the key its partial entry is cached under. Caller frees it
+static char *partial_key(const char *url) {
+    size_t size = strlen(CACHE_PARTIAL_PREFIX) + strlen(url) + 1;
+    char *key = malloc(size);
+    snprintf(key, size, "%s%s", CACHE_PARTIAL_PREFIX, url);
+    return key;
 }
 
+// Given cache and URL, return the fresh partial entry holding parts of the
+// URL's body, with a reference held, or NULL. Use is recorded as for a hit
+CacheEntry *cache_partial_retrieval(Cache *cache, const char *url) {
+    char *key = partial_key(url);
+    uint64_t hash = url_hash(key);
+    CacheShard *shard = cache_shard(cache, hash);
+    pthread_rwlock_rdlock(&shard->lock);
+    CacheEntry *cache_entry = cache_lookup(shard, key, hash);
+    if(cache_entry != NULL && cache_entry_valid(cache_entry)) {
+        __atomic_store_n(&cache_entry->referenced, true, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&cache_entry->frequency, 1, __ATOMIC_RELAXED);
+        CacheEntry_acquire(cache_entry);
+    } else {
+        cache_entry = NULL;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    free(key);
+    return cache_entry;
+}
 
+// Given a stored validator, or NULL, and the same field of a response
+// header, return true if they are the same
+static bool same_validator(const char *stored, const unsigned char *head, HttpField field) {
+    if(stored == NULL || field.length == 0) {
+        return stored == NULL && field.length == 0;
+    }
+    return strlen(stored) == field.length && memcmp(stored, head + field.offset, field.length) == 0;
+}
 
+// Given cache, URL and a complete 206 response for part of its body,
+// create a partial entry holding the part along with those already cached
+// for the URL, unless they belong to another version of the object. Parts
+// the new one covers are dropped. Once CACHE_MAX_SEGMENTS are held, or the
+// parts would outgrow the largest object cached, the entry starts again
+// from the new part. Entries are replaced rather than changed, so two
+// parts arriving together may lose one of them. The entry takes ownership
+// of the response, and the caller holds its first reference and adds it
+// with cache_add. Return NULL, leaving the response to the caller, if it
+// does not hold a single range of the body
+CacheEntry *cache_partial_create(Cache *cache, const char *url, Buffer *response, const HttpResponseHeader *header) {
+    size_t head_size;
+    unsigned char *head = buffer_head(response, &head_size);
+    if(head == NULL || head_size < header->length) {
+        return NULL;
+    }
+    CacheSegment *segment = cache_segment_create(response, header);
+    if(segment == NULL) {
+        return NULL;
+    }
+    CacheSegment **segments = pool_alloc(CACHE_MAX_SEGMENTS * sizeof(CacheSegment *));
+    int count = 0;
+    CacheEntry *existing = cache_partial_retrieval(cache, url);
+    if(existing != NULL && existing->object_size == header->range_total &&
+       same_validator(existing->etag, head, header->etag) &&
+       same_validator(existing->last_modified, head, header->last_modified)) {
+        size_t held = segment->last - segment->first + 1;
+        for(int i = 0; i < existing->segment_count; i++) {
+            CacheSegment *kept = existing->segments[i];
+            if(kept->first < segment->first || kept->last > segment->last) {
+                held += kept->last - kept->first + 1;
+                if(count < CACHE_MAX_SEGMENTS - 1) {
+                    segments[count] = kept;
+                }
+                count += 1;
+            }
+        }
+        if(count > CACHE_MAX_SEGMENTS - 1 || !cache_admissible(cache, held)) {
+            count = 0;
+        }
+        for(int i = 0; i < count; i++) {
+            cache_segment_acquire(segments[i]);
+        }
+    }
+    if(existing != NULL) {
+        CacheEntry_release(existing);
+    }
+    int i = count;
+    while(i > 0 && segments[i - 1]->first > segment->first) {
+        segments[i] = segments[i - 1];
+        i--;
+    }
+    segments[i] = segment;
+    count += 1;
+
+    // The entry's own response is a copy of the header, which hits rewrite
+    unsigned char *copy = malloc(header->length);
+    memcpy(copy, head, header->length);
+    char *key = partial_key(url);
+    CacheEntry *cache_entry = CacheEntry_create(key, buffer_adopt(copy, header->length), header);
+    free(key);
+    cache_entry->object_size = header->range_total;
+    cache_entry->segments = segments;
+    cache_entry->segment_count = count;
+    return cache_entry;
+}
+
+// Given cached entry and a small caller-owned buffer for the "Age" field,
+// format the field so it can be written in place of the origin's Age
+// line, or between the stored header and the stored "\r\n\r\n" plus body.
+// The age includes any the origin reported. Nothing scales with the size
+// of the response. Return length of the field, or 0 if the entry has no header
+int add_age_header(CacheEntry *cached_entry, char *age_header, size_t age_header_size) {
+    // Responses without a header terminator are served unchanged
+    if(cached_entry->header_length == cached_entry->server_response_size) {
+        return 0;
+    }
 
+    // Create age header
+    int age = get_age(cached_entry);
+    return snprintf(age_header, age_header_size, "\r\nAge: %d", age);
+}
 
 //-------------------------------------------------------------------------------------------------
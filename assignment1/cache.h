@@ -9,30 +9,125 @@
 
 #include "cache_entry.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
 
 // ----GLOBAL VARIABLES----------------------------------------------------------------------------
-#define MAX_CACHE_SIZE 10
+#define DEFAULT_CACHE_BYTES 64*1024*1024      // Total byte budget across all shards
+#define DEFAULT_MAX_OBJECT_PERCENT 10         // Larger objects bypass the cache
+#define CACHE_MAX_SHARDS 16                   // Must be a power of two
+#define CACHE_MIN_SHARD_BYTES 16*1024*1024    // Small caches use fewer shards so
+                                              // uneven hashing does not waste budget
+#define CACHE_SKETCH_DEPTH 4
+#define CACHE_SKETCH_WIDTH 65536              // Counters per sketch row, power of two
+#define CACHE_SKETCH_MAX_COUNT 15
+#define CACHE_PARTIAL_PREFIX "partial "      // Keys partial entries apart from whole objects
 
 // ----STRUCT--------------------------------------------------------------------------------------
+struct DiskCache;
+
+// Replacement policy applied when a shard exceeds its byte budget.
+//  LRU:     evict least-recently used, second chance for referenced entries
+//  GDSF:    Greedy-Dual-Size-Frequency, evict lowest frequency/size priority
+//  TINYLFU: LRU, but a new object is only admitted if a frequency sketch says
+//           it is more popular than the entry it would displace
+typedef enum CachePolicy{
+    CACHE_POLICY_LRU,
+    CACHE_POLICY_GDSF,
+    CACHE_POLICY_TINYLFU
+} CachePolicy;
+
+typedef enum CacheHeapType{
+    CACHE_HEAP_EXPIRY,
+    CACHE_HEAP_PRIORITY
+} CacheHeapType;
+
+// Binary min-heap of entries. Each entry records its own position so it
+// can be removed or reordered in O(log n)
+typedef struct CacheHeap{
+    CacheHeapType type;
+    CacheEntry **entries;
+    size_t size;
+    size_t capacity;
+} CacheHeap;
+
+// URLs are hash-partitioned across shards, each guarded by its own lock,
+// so workers only contend when they touch URLs in the same shard. Lookups
+// take the lock shared; inserts and evictions take it exclusive.
+//
+// Within a shard, entries are indexed four ways:
+//  - an open-addressing hash table keyed by the precomputed URL hash
+//  - an intrusive doubly-linked LRU list, most recently inserted first
+//  - a min-heap ordered by expiry time
+//  - a min-heap ordered by GDSF priority (GDSF policy only)
+// Hits only set the entry's referenced bit and bump its frequency, so they
+// never need the exclusive lock. Eviction gives referenced entries at the
+// LRU tail a second chance, and recomputes stale GDSF priorities lazily
+typedef struct CacheShard{
+    pthread_rwlock_t lock;
+    CacheEntry **table;
+    size_t table_mask;
+    CacheEntry *lru_head;
+    CacheEntry *lru_tail;
+    CacheHeap expiry_heap;
+    CacheHeap priority_heap;
+    double inflation;          // GDSF aging value L
+    size_t size;
+    size_t bytes_used;
+    size_t bytes_capacity;
+} CacheShard;
+
+// Count-min sketch of recent request frequency, used by TinyLFU admission.
+// Counters are halved every sketch_reset_interval samples so old
+// popularity fades
+typedef struct CacheSketch{
+    uint8_t counters[CACHE_SKETCH_DEPTH][CACHE_SKETCH_WIDTH];
+    uint64_t samples;
+    uint64_t reset_interval;
+} CacheSketch;
+
+// Counters shared by every worker, updated with relaxed atomics
+typedef struct CacheStats{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stale_served;     // Stale hits served while refreshed in the background
+    uint64_t revalidated_304;  // Conditional requests the origin answered unchanged
+    uint64_t revalidated_200;  // and those it answered with a new response
+    uint64_t bytes_copied;     // Response bytes memcpy'd while serving requests
+} CacheStats;
 
 typedef struct Cache{
-    CacheEntry *entries[MAX_CACHE_SIZE];
-    int size;
-    int capacity;
+    CacheShard shards[CACHE_MAX_SHARDS];
+    int shard_count;
+    CachePolicy policy;
+    size_t max_object_size;
+    CacheSketch *sketch;
+    CacheStats stats;
+    struct DiskCache *disk;    // Tier beneath, or NULL
 } Cache;
 
 //----FUNCTIONS------------------------------------------------------------------------------------
 
-Cache *cache_create(void);
+Cache *cache_create(size_t capacity_bytes, CachePolicy policy, int max_object_percent);
 void cache_free(Cache* cache);
-void cache_insert(Cache* cache, char* url, unsigned char *server_response, size_t *server_response_size);
+void cache_attach_disk(Cache *cache, struct DiskCache *disk);
+void cache_print_stats(Cache *cache);
+bool cache_insert(Cache* cache, char* url, unsigned char *server_response, size_t *server_response_size);
+bool cache_add(Cache *cache, CacheEntry *cache_entry);
 bool cache_check(Cache* cache, char *url);
-int get_cache_entry_index(Cache* cache, char *url);
-unsigned char *cache_retrieval(Cache *cache, char *url, size_t *server_response_size);
-unsigned char *add_age_header(CacheEntry *cached_entry, size_t *server_response_size);
-void evict(Cache* cache, int cache_entry_index);
-void cache_eviction_protocol(Cache* cache);
-bool is_older(struct timespec time1, struct timespec time2);
+bool cache_admissible(Cache *cache, size_t server_response_size);
+int cache_policy_from_name(const char *name, CachePolicy *policy);
+const char *cache_policy_name(CachePolicy policy);
+uint64_t url_hash(const char *url);
+CacheShard *cache_shard(Cache *cache, uint64_t hash);
+CacheEntry *cache_lookup(CacheShard* shard, char *url, uint64_t hash);
+CacheEntry *cache_retrieval(Cache *cache, char *url);
+void cache_refresh(Cache *cache, CacheEntry *cache_entry, const HttpResponseHeader *header);
+CacheEntry *cache_partial_retrieval(Cache *cache, const char *url);
+CacheEntry *cache_partial_create(Cache *cache, const char *url, Buffer *response, const HttpResponseHeader *header);
+int add_age_header(CacheEntry *cached_entry, char *age_header, size_t age_header_size);
+void evict(CacheShard* shard, CacheEntry *cache_entry);
+CacheEntry *cache_eviction_protocol(Cache *cache, CacheShard* shard);
 
 //----MAIN-----------------------------------------------------------------------------------------
 
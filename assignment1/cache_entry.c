@@ -4,9 +4,11 @@
 // Script:      cache_entry.c
 // Usage:       Implementation file for cache entry
 //*************************************************************************************************
+#define _GNU_SOURCE               // POSIX clock_gettime for CLOCK_REALTIME
 #include "cache_entry.h"
+#include "http.h"
+#include "pool.h"
 
-#define _POSIX_C_SOURCE 199309L   // POSIX compliance for CLOK_REALTIME
 #define DEFAULT_MAX_AGE 60*60     // Set max-age to 1 hour by default
 
 #include <time.h>
@@ -14,50 +16,159 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <limits.h>
 
 // ----GLOBAL VARIABLES----------------------------------------------------------------------------
-
+static CacheEntryFreeHandler free_handler = NULL;
 
 //----FUNCTIONS------------------------------------------------------------------------------------
+// Given indexed response header, return its freshness lifetime in
+// seconds, or fallback if it gives none. A shared cache takes s-maxage
+// over max-age, and either over Expires, which counts from the origin's
+// Date. Responses that must be revalidated on every use are stale at once
+static int freshness_lifetime(const HttpResponseHeader *header, int fallback) {
+    if(header->no_cache) {
+        return 0;
+    }
+    if(header->s_maxage != HTTP_UNSET) {
+        return header->s_maxage;
+    }
+    if(header->max_age != HTTP_UNSET) {
+        return header->max_age;
+    }
+    if(header->has_expires) {
+        time_t date = header->has_date ? header->date : time(NULL);
+        time_t lifetime = header->expires - date;
+        return (lifetime <= 0) ? 0 : (lifetime > INT_MAX) ? INT_MAX : (int) lifetime;
+    }
+    return fallback;
+}
+
+// Given response header and one of its indexed fields, return a copy of
+// the field's value from the pool, or NULL if it is not present
+static char *field_copy(const unsigned char *header, HttpField field) {
+    if(field.length == 0) {
+        return NULL;
+    }
+    char *copy = pool_alloc(field.length + 1);
+    memcpy(copy, header + field.offset, field.length);
+    copy[field.length] = '\0';
+    return copy;
+}
+
+// Given time a response was received and its indexed header, set when the
+// entry's age counts from. An Age field means the response was already
+// that old when it arrived
+static void set_time_added(CacheEntry *cache_entry, struct timespec now, const HttpResponseHeader *header) {
+    if(header != NULL && header->age > 0) {
+        now.tv_sec -= header->age;
+    }
+    __atomic_store_n(&cache_entry->time_added.tv_sec, now.tv_sec, __ATOMIC_RELAXED);
+    __atomic_store_n(&cache_entry->time_added.tv_nsec, now.tv_nsec, __ATOMIC_RELAXED);
+}
+
 // Given pointer to server response, create CacheEntry
-// with fields populated appropriately. Return pointer
-// to populated CacheEntry to caller
-CacheEntry *CacheEntry_create(char* url, unsigned char* server_response, size_t *server_response_size) {
-    CacheEntry *cache_entry = malloc(sizeof(CacheEntry));
-    strcpy(cache_entry->url, url);
+// with fields populated appropriately. The entry takes ownership
+// of the response buffer. Header is the response's header as indexed
+// while it was read, or NULL to index it here. Return pointer to populated
+// CacheEntry to caller, who holds the entry's first reference
+CacheEntry *CacheEntry_create(char* url, Buffer *server_response, const HttpResponseHeader *header) {
+    CacheEntry *cache_entry = pool_calloc(sizeof(CacheEntry));
+    cache_entry->url = pool_strdup(url);
     cache_entry->server_response = server_response;
-    cache_entry->server_response_size = *server_response_size;
-    cache_entry->max_age = get_max_age(server_response);
-    clock_gettime(CLOCK_REALTIME, &(cache_entry->time_added));
-    clock_gettime(CLOCK_REALTIME, &(cache_entry->time_accessed));
+    cache_entry->server_response_size = server_response->size;
+    cache_entry->refcount = 1;
+    cache_entry->object_size = HTTP_UNSET;
+
+    // Record what hits need from the header once, so they never rescan
+    // the response. The header must fit in the first chunk of the buffer
+    size_t head_size;
+    unsigned char *head = buffer_head(server_response, &head_size);
+    HttpResponseHeader parsed;
+    if(header == NULL || header->length == 0 || header->length > head_size) {
+        header = &parsed;
+        if(head == NULL || http_parse_response_header(head, head_size, &parsed) <= 0) {
+            parsed.length = 0;
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if(header->length > 0) {
+        cache_entry->header_length = header->length - 4;
+        cache_entry->age_line = header->age_line;
+        cache_entry->delimited = (http_response_body(header) != HTTP_BODY_CLOSE);
+        cache_entry->etag = field_copy(head, header->etag);
+        cache_entry->last_modified = field_copy(head, header->last_modified);
+        cache_entry->max_age = freshness_lifetime(header, DEFAULT_MAX_AGE);
+        if(header->stale_while_revalidate > 0 && !header->must_revalidate) {
+            cache_entry->stale_while_revalidate = header->stale_while_revalidate;
+        }
+        set_time_added(cache_entry, now, header);
+        // Ranges are cut from a whole body stored as sent, not chunked
+        if(header->status == 200 && !header->chunked && header->content_length != HTTP_UNSET &&
+           cache_entry->server_response_size == header->length + (size_t) header->content_length) {
+            cache_entry->object_size = header->content_length;
+        }
+    } else {
+        cache_entry->header_length = cache_entry->server_response_size;
+        cache_entry->max_age = DEFAULT_MAX_AGE;
+        set_time_added(cache_entry, now, NULL);
+    }
     return cache_entry;
 }
 
-// Given server response, return max-age of present in
-// header, else return DEFAULT_MAX_AGE
-int get_max_age(unsigned char *server_response) {
-    // Search for Cache-Control in response header.
-    // If not present, return default
-    const char *char_control = strstr(server_response, "cache-control");
-    if(char_control == NULL) {
-        return DEFAULT_MAX_AGE;
+// Given handler to run on each entry freed from now on, register it.
+// Called before workers start
+void cache_entry_on_free(CacheEntryFreeHandler handler) {
+    free_handler = handler;
+}
+
+// Free cache entry along with the response it owns
+void CacheEntry_free(CacheEntry *cache_entry) {
+    if(free_handler != NULL) {
+        free_handler(cache_entry);
+    }
+    pool_free_string(cache_entry->url);
+    if(cache_entry->etag != NULL) {
+        pool_free_string(cache_entry->etag);
+    }
+    if(cache_entry->last_modified != NULL) {
+        pool_free_string(cache_entry->last_modified);
     }
-    const char *max_age = strstr(char_control, "max-age=");
-    if(max_age == NULL) {
-        return DEFAULT_MAX_AGE;
+    buffer_free(cache_entry->server_response);
+    for(int i = 0; i < cache_entry->segment_count; i++) {
+        cache_segment_release(cache_entry->segments[i]);
     }
+    if(cache_entry->segments != NULL) {
+        pool_free(cache_entry->segments, CACHE_MAX_SEGMENTS * sizeof(CacheSegment *));
+    }
+    pool_free(cache_entry, sizeof(CacheEntry));
+}
+
+// Take an additional reference to cache entry
+void CacheEntry_acquire(CacheEntry *cache_entry) {
+    __atomic_fetch_add(&cache_entry->refcount, 1, __ATOMIC_RELAXED);
+}
+
+// Drop a reference to cache entry, freeing it when the last one goes
+void CacheEntry_release(CacheEntry *cache_entry) {
+    if(__atomic_sub_fetch(&cache_entry->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        CacheEntry_free(cache_entry);
+    }
+}
 
-    // If present, convert to int and return
-    max_age += strlen("max_age=");
-    int max_age_value = atoi(max_age);
-    return(max_age_value);
+// Given cache entry, return time in seconds at which it goes stale
+time_t cache_entry_expiry(CacheEntry *cache_entry) {
+    return __atomic_load_n(&cache_entry->time_added.tv_sec, __ATOMIC_RELAXED) +
+           __atomic_load_n(&cache_entry->max_age, __ATOMIC_RELAXED);
 }
 
 // Given cache and index of cache_entry, return
 // true if valid and false if stale
 bool cache_entry_valid(CacheEntry* cache_entry) {
     int age = get_age(cache_entry);
-    int max_age = cache_entry->max_age;
+    int max_age = __atomic_load_n(&cache_entry->max_age, __ATOMIC_RELAXED);
     if(age >= max_age) {
         return false;
     } else {
@@ -65,6 +176,32 @@ bool cache_entry_valid(CacheEntry* cache_entry) {
     }
 }
 
+// Given stale cache entry, return true if it is worth keeping: the origin
+// can be asked whether it changed, or it may be served while refetched
+bool cache_entry_keep_stale(CacheEntry *cache_entry) {
+    return cache_entry->etag != NULL || cache_entry->last_modified != NULL ||
+           cache_entry->stale_while_revalidate > 0;
+}
+
+// Given stale cache entry, return true if it is still within the
+// stale-while-revalidate window the origin allowed for it
+bool cache_entry_serve_stale(CacheEntry *cache_entry) {
+    return get_age(cache_entry) < __atomic_load_n(&cache_entry->max_age, __ATOMIC_RELAXED) +
+                                  cache_entry->stale_while_revalidate;
+}
+
+// Given cache entry the origin has confirmed unchanged, and the indexed
+// header of its 304 response, restart the entry's freshness lifetime,
+// taking a new one from the header if it gives one. Workers serving the
+// entry read these fields without a lock
+void cache_entry_refresh(CacheEntry *cache_entry, const HttpResponseHeader *header) {
+    int max_age = freshness_lifetime(header, cache_entry->max_age);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    set_time_added(cache_entry, now, header);
+    __atomic_store_n(&cache_entry->max_age, max_age, __ATOMIC_RELAXED);
+}
+
 // Given two timespec structures, store the difference in timespec diff
 void timespec_diff(struct timespec start, struct timespec end, struct timespec *diff) {
     if ((end.tv_nsec - start.tv_nsec) < 0) {
@@ -79,7 +216,9 @@ void timespec_diff(struct timespec start, struct timespec end, struct timespec *
 // Given cached entry, return current age in seconds as integer
 int get_age(CacheEntry *cached_entry) {
     // Calculate age
-    struct timespec time_added = cached_entry->time_added;
+    struct timespec time_added;
+    time_added.tv_sec = __atomic_load_n(&cached_entry->time_added.tv_sec, __ATOMIC_RELAXED);
+    time_added.tv_nsec = __atomic_load_n(&cached_entry->time_added.tv_nsec, __ATOMIC_RELAXED);
     struct timespec time_current;
     struct timespec time_diff;
     // Calculate time difference
@@ -89,6 +228,105 @@ int get_age(CacheEntry *cached_entry) {
     return(age);
 }
 
+// Given a complete 206 response whose body is exactly the range its
+// Content-Range names, create a segment holding it, taking ownership of
+// the response. Return NULL, leaving the response to the caller, if it
+// is not one
+CacheSegment *cache_segment_create(Buffer *response, const HttpResponseHeader *header) {
+    if(header->status != 206 || header->range_total == HTTP_UNSET || header->chunked ||
+       header->content_length != header->range_last - header->range_first + 1 ||
+       response->size != header->length + (size_t) header->content_length) {
+        return NULL;
+    }
+    CacheSegment *segment = pool_calloc(sizeof(CacheSegment));
+    segment->first = header->range_first;
+    segment->last = header->range_last;
+    segment->response = response;
+    segment->body_offset = header->length;
+    segment->refcount = 1;
+    return segment;
+}
+
+void cache_segment_acquire(CacheSegment *segment) {
+    __atomic_fetch_add(&segment->refcount, 1, __ATOMIC_RELAXED);
+}
+
+// Drop a reference to segment, freeing it with its response when the last one goes
+void cache_segment_release(CacheSegment *segment) {
+    if(__atomic_sub_fetch(&segment->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        buffer_free(segment->response);
+        pool_free(segment, sizeof(CacheSegment));
+    }
+}
+
+// Given cache entry and the value of a client's If-Range field, return
+// true if it names the entry's ETag or Last-Modified date, so the range
+// may be cut from it. Weak ETags never match
+bool cache_entry_if_range(CacheEntry *cache_entry, const char *value, size_t length) {
+    if(length >= 2 && strncmp(value, "W/", 2) == 0) {
+        return false;
+    }
+    const char *validator = (value[0] == '"') ? cache_entry->etag : cache_entry->last_modified;
+    return validator != NULL && strlen(validator) == length && strncmp(validator, value, length) == 0;
+}
+
+// Given cache entry and the first and last byte of a range of its body,
+// narrow the range to run from the first byte the entry does not hold to
+// the last. Return false if the entry holds the whole range
+bool cache_entry_missing(CacheEntry *cache_entry, int64_t *first, int64_t *last) {
+    if(cache_entry->segments == NULL) {
+        return false;
+    }
+    // Segments are ordered by first byte but may overlap, so each one
+    // either extends the run held from the start of the range or ends it
+    int64_t held = *first;
+    for(int i = 0; i < cache_entry->segment_count && held <= *last; i++) {
+        CacheSegment *segment = cache_entry->segments[i];
+        if(segment->first <= held && segment->last >= held) {
+            held = segment->last + 1;
+        }
+    }
+    if(held > *last) {
+        return false;
+    }
+    *first = held;
+    int64_t held_from = *last + 1;
+    for(int i = cache_entry->segment_count - 1; i >= 0 && held_from > *first; i--) {
+        CacheSegment *segment = cache_entry->segments[i];
+        if(segment->first < held_from && segment->last >= held_from - 1) {
+            held_from = segment->first;
+        }
+    }
+    *last = held_from - 1;
+    return true;
+}
+
+// Given cache entry holding bytes [start, end) of its body, describe them
+// as at most max_iov iovecs, cut from the stored body or from the
+// segments holding them. Return number of iovecs filled
+int cache_entry_range_iovec(CacheEntry *cache_entry, int64_t start, int64_t end, struct iovec *iov, int max_iov) {
+    if(cache_entry->segments == NULL) {
+        size_t body = cache_entry->header_length + 4;
+        return buffer_iovec(cache_entry->server_response, body + start, body + end, iov, max_iov);
+    }
+    int count = 0;
+    for(int i = 0; i < cache_entry->segment_count && count < max_iov && start < end; i++) {
+        CacheSegment *segment = cache_entry->segments[i];
+        if(segment->first > start || segment->last < start) {
+            continue;
+        }
+        int64_t stop = (segment->last + 1 < end) ? segment->last + 1 : end;
+        size_t offset = segment->body_offset + (start - segment->first);
+        int filled = buffer_iovec(segment->response, offset, offset + (stop - start), iov + count,
+                                  max_iov - count);
+        count += filled;
+        if(count == max_iov) {
+            break;
+        }
+        start = stop;
+    }
+    return count;
+}
 
 //----MAIN-----------------------------------------------------------------------------------------
 
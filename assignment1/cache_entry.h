@@ -9,27 +9,86 @@
 
 #include <time.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "buffer.h"
+#include "http.h"
 
-#define URL_MAX_CHARACTERS 100                // Max size 100 characters
 #define HTTP_RESPONSE_MAX_SIZE 10*1024*1024   // Max size 10 MB
+#define CACHE_MAX_SEGMENTS 32                 // Parts of one object a partial entry holds
 
 // ----GLOBAL VARIABLES----------------------------------------------------------------------------
+
+// Bytes first to last of an object's body, kept in the 206 response they
+// arrived in so they are served without copying. A partial entry built
+// from an earlier one shares its segments rather than copying them
+typedef struct CacheSegment{
+    int64_t first;
+    int64_t last;
+    Buffer *response;
+    size_t body_offset;           // Where the first byte sits in the response
+    int refcount;                 // Held by each partial entry listing it
+} CacheSegment;
+
 typedef struct CacheEntry{
-    char url[URL_MAX_CHARACTERS+1];
-    unsigned char *server_response;
+    char *url;
+    uint64_t url_hash;
+    Buffer *server_response;
     size_t server_response_size;
-    struct timespec time_added;
-    struct timespec time_accessed;
-    int max_age;
+    size_t header_length;         // Offset of the "\r\n\r\n" ending the header
+    HttpField age_line;           // Origin's Age line, replaced when served
+    bool delimited;               // Header gives the body length, so the client
+                                  // connection can stay open after it
+    struct timespec time_added;   // When the response was generated, restarted in place
+    int max_age;                  // when the origin confirms it unchanged, so read atomically
+    int stale_while_revalidate;   // Seconds past max-age it may be served while refreshed
+    char *etag;                   // Validators for a conditional request, or NULL
+    char *last_modified;
+    int refcount;                 // Held by the cache and each connection serving it
+    bool on_disk;                 // Written to, or read from, the disk tier
+    bool prefetched;              // Prefetched and not yet asked for, so its bytes are
+                                  // settled as used or wasted, read atomically
+    int64_t object_size;          // Length of the whole body when byte ranges can be
+                                  // cut from the entry, else HTTP_UNSET
+    CacheSegment **segments;      // Partial entries only: the parts of the body held,
+    int segment_count;            // by first byte. The response is then just the header
+
+    // Replacement state, owned by the cache shard holding the entry
+    struct CacheEntry *lru_prev;
+    struct CacheEntry *lru_next;
+    size_t heap_index[2];         // Position in expiry and priority heaps
+    size_t charge;                // Bytes counted against the shard budget
+    uint32_t frequency;           // Hits since insertion, plus one
+    uint32_t priority_frequency;  // Frequency when priority was last computed
+    double priority;              // GDSF priority
+    bool referenced;
 } CacheEntry;
 
+// Called with each entry about to be freed, for whoever counts its bytes
+typedef void (*CacheEntryFreeHandler)(CacheEntry *cache_entry);
+
 //----FUNCTIONS------------------------------------------------------------------------------------
 
-CacheEntry *CacheEntry_create(char* url, unsigned char* server_response, size_t *server_response_size);
-int get_max_age(unsigned char *server_response);
+CacheEntry *CacheEntry_create(char* url, Buffer *server_response, const HttpResponseHeader *header);
+void CacheEntry_free(CacheEntry *cache_entry);
+void cache_entry_on_free(CacheEntryFreeHandler handler);
+void CacheEntry_acquire(CacheEntry *cache_entry);
+void CacheEntry_release(CacheEntry *cache_entry);
+time_t cache_entry_expiry(CacheEntry *cache_entry);
 int get_age(CacheEntry *cached_entry);
 bool cache_entry_valid(CacheEntry* cache_entry);
+bool cache_entry_keep_stale(CacheEntry *cache_entry);
+bool cache_entry_serve_stale(CacheEntry *cache_entry);
+void cache_entry_refresh(CacheEntry *cache_entry, const HttpResponseHeader *header);
 void timespec_diff(struct timespec start, struct timespec end, struct timespec *diff);
+CacheSegment *cache_segment_create(Buffer *response, const HttpResponseHeader *header);
+void cache_segment_acquire(CacheSegment *segment);
+void cache_segment_release(CacheSegment *segment);
+bool cache_entry_if_range(CacheEntry *cache_entry, const char *value, size_t length);
+bool cache_entry_missing(CacheEntry *cache_entry, int64_t *first, int64_t *last);
+int cache_entry_range_iovec(CacheEntry *cache_entry, int64_t start, int64_t end, struct iovec *iov, int max_iov);
 
 //----MAIN-----------------------------------------------------------------------------------------
 
@@ -0,0 +1,184 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      cluster.c
+// Usage:       Implementation file for consistent-hash ownership of URLs among cooperating proxies
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include "cluster.h"
+#include "cache.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+// Given key, return its place on the ring. The URL hash is mixed further
+// so that keys differing only in their last characters, as the points of
+// one peer do, still spread over the whole ring
+static uint64_t ring_hash(const char *key) {
+    uint64_t hash = url_hash(key);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Given "host:port", store the peer it names with the host in lower case.
+// Return false if it is malformed
+static bool parse_peer(const char *text, ClusterPeer *peer) {
+    const char *colon = strrchr(text, ':');
+    if(colon == NULL || colon == text || (size_t)(colon - text) >= CLUSTER_HOSTNAME_MAX_SIZE) {
+        return false;
+    }
+    char *end;
+    long port = strtol(colon + 1, &end, 10);
+    if(*end != '\0' || port <= 0 || port > 65535) {
+        return false;
+    }
+    for(size_t i = 0; i < (size_t)(colon - text); i++) {
+        peer->hostname[i] = tolower((unsigned char) text[i]);
+    }
+    peer->hostname[colon - text] = '\0';
+    peer->port = (int) port;
+    return true;
+}
+
+// Look up the IPv4 addresses of peer's host, which its connections to
+// this proxy come from. A host that cannot be resolved is still owner of
+// its URLs, but requests it passes on are treated as any client's
+static void resolve_peer(ClusterPeer *peer) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *results;
+    int status = getaddrinfo(peer->hostname, NULL, &hints, &results);
+    if(status != 0) {
+        printf("Cannot resolve cluster member %s: %s\n", peer->hostname, gai_strerror(status));
+        return;
+    }
+    for(struct addrinfo *result = results; result != NULL && peer->address_count < CLUSTER_MAX_ADDRESSES;
+        result = result->ai_next) {
+        peer->addresses[peer->address_count++] = ((struct sockaddr_in *) result->ai_addr)->sin_addr;
+    }
+    freeaddrinfo(results);
+}
+
+static int compare_points(const void *a, const void *b) {
+    uint64_t first = ((const ClusterPoint *) a)->hash;
+    uint64_t second = ((const ClusterPoint *) b)->hash;
+    return (first > second) - (first < second);
+}
+
+// Given path of a config file listing one peer per line as "host:port",
+// with "#" starting a comment, and this proxy's own "host:port", which
+// must be among them, return the cluster with its ring built. Return NULL
+// if the file cannot be read or names no such peer
+Cluster *cluster_load(const char *path, const char *self) {
+    ClusterPeer self_peer;
+    if(!parse_peer(self, &self_peer)) {
+        printf("Cluster member %s is not host:port\n", self);
+        return NULL;
+    }
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        perror("Error opening cluster file");
+        return NULL;
+    }
+    Cluster *cluster = calloc(1, sizeof(Cluster));
+    cluster->self = -1;
+    char line[1024];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        char *comment = strchr(line, '#');
+        if(comment != NULL) {
+            *comment = '\0';
+        }
+        char *save;
+        char *text = strtok_r(line, " \t\r\n", &save);
+        if(text == NULL) {
+            continue;
+        }
+        ClusterPeer *peer = &cluster->peers[cluster->peer_count];
+        if(cluster->peer_count == CLUSTER_MAX_PEERS || !parse_peer(text, peer)) {
+            printf("Skipping cluster member %s\n", text);
+            continue;
+        }
+        if(peer->port == self_peer.port && strcmp(peer->hostname, self_peer.hostname) == 0) {
+            cluster->self = cluster->peer_count;
+        }
+        resolve_peer(peer);
+        cluster->peer_count += 1;
+    }
+    fclose(file);
+    if(cluster->self < 0) {
+        printf("Cluster file %s does not list %s\n", path, self);
+        free(cluster);
+        return NULL;
+    }
+
+    // Every peer's points are named after it, so each proxy builds the same ring
+    cluster->ring_size = cluster->peer_count * CLUSTER_VIRTUAL_NODES;
+    cluster->ring = malloc(cluster->ring_size * sizeof(ClusterPoint));
+    for(int p = 0; p < cluster->peer_count; p++) {
+        for(int v = 0; v < CLUSTER_VIRTUAL_NODES; v++) {
+            char key[CLUSTER_HOSTNAME_MAX_SIZE + 32];
+            snprintf(key, sizeof(key), "%s:%d#%d", cluster->peers[p].hostname, cluster->peers[p].port, v);
+            ClusterPoint *point = &cluster->ring[p * CLUSTER_VIRTUAL_NODES + v];
+            point->hash = ring_hash(key);
+            point->peer = p;
+        }
+    }
+    qsort(cluster->ring, cluster->ring_size, sizeof(ClusterPoint), compare_points);
+    return cluster;
+}
+
+void cluster_free(Cluster *cluster) {
+    free(cluster->ring);
+    free(cluster);
+}
+
+// Given cluster and URL, return the peer owning it, or NULL if this proxy does
+const ClusterPeer *cluster_owner(const Cluster *cluster, const char *url) {
+    uint64_t hash = ring_hash(url);
+    int low = 0;
+    int high = cluster->ring_size;
+    while(low < high) {
+        int middle = low + (high - low) / 2;
+        if(cluster->ring[middle].hash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    int peer = cluster->ring[(low == cluster->ring_size) ? 0 : low].peer;
+    return (peer == cluster->self) ? NULL : &cluster->peers[peer];
+}
+
+// Given cluster and the address a client connected from, return true if it
+// is one of the other peers, whose mark on a request it passes on is trusted
+bool cluster_is_peer(const Cluster *cluster, const struct sockaddr_in *address) {
+    for(int p = 0; p < cluster->peer_count; p++) {
+        const ClusterPeer *peer = &cluster->peers[p];
+        if(p == cluster->self) {
+            continue;
+        }
+        for(int a = 0; a < peer->address_count; a++) {
+            if(peer->addresses[a].s_addr == address->sin_addr.s_addr) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,58 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      cluster.h
+// Usage:       Header file for consistent-hash ownership of URLs among cooperating proxies
+//*************************************************************************************************
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define CLUSTER_MAX_PEERS 64
+#define CLUSTER_VIRTUAL_NODES 160             // Points on the ring per peer
+#define CLUSTER_HOSTNAME_MAX_SIZE 256
+#define CLUSTER_MAX_ADDRESSES 8               // Addresses kept per peer, to recognise its connections
+
+// ----STRUCT--------------------------------------------------------------------------------------
+
+typedef struct ClusterPeer{
+    char hostname[CLUSTER_HOSTNAME_MAX_SIZE];
+    int port;
+    struct in_addr addresses[CLUSTER_MAX_ADDRESSES];
+    int address_count;
+} ClusterPeer;
+
+typedef struct ClusterPoint{
+    uint64_t hash;
+    int peer;
+} ClusterPoint;
+
+// Proxies sharing their caches, listed in a static config file. Each URL
+// is owned by one peer: the first whose point follows the URL's hash on a
+// ring where every peer has CLUSTER_VIRTUAL_NODES points, so a peer
+// joining or leaving only moves the URLs next to its own points. Read only
+// once loaded, so shared by every worker without locking
+typedef struct Cluster{
+    ClusterPeer peers[CLUSTER_MAX_PEERS];
+    int peer_count;
+    int self;                  // This proxy's index among the peers
+    ClusterPoint *ring;        // Sorted by hash
+    int ring_size;
+} Cluster;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+Cluster *cluster_load(const char *path, const char *self);
+void cluster_free(Cluster *cluster);
+const ClusterPeer *cluster_owner(const Cluster *cluster, const char *url);
+bool cluster_is_peer(const Cluster *cluster, const struct sockaddr_in *address);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
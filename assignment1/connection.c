@@ -0,0 +1,865 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      connection.c
+// Usage:       Implementation file for per-connection proxy state machine
+//*************************************************************************************************
+#define _GNU_SOURCE               // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "connection.h"
+#include "http.h"
+#include "metrics.h"
+#include "prefetch.h"
+#include "tunnel.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define METRICS_RESPONSE_HEADER "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n" \
+                                "Cache-Control: no-store\r\nContent-Length: %zu\r\n\r\n"
+#define RANGE_NOT_SATISFIABLE "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\n" \
+                              "Content-Length: 0\r\n\r\n"
+#define RANGE_HEADER_EXTRA 256    // Room for the 206 status line and the fields added to the stored header
+
+static unsigned int read_timeout_ms = DEFAULT_READ_TIMEOUT_MS;          // 0 leaves only the idle timeout
+static unsigned int request_timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS;    // 0 disables
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+static void handle_client_event(EventSource *source, uint32_t events);
+static void receive_client_bytes(EventSource *source, const char *data, ssize_t size);
+static void client_sent(EventSource *source, ssize_t result);
+static void read_request(Connection *conn);
+static void process_request(Connection *conn);
+static void write_response(Connection *conn);
+static void write_fetched_response(Connection *conn);
+static void finish_response(Connection *conn, bool delimited);
+static void fetch_response(Connection *conn, const char *range);
+static void fetch_range(Connection *conn);
+static void deadline_passed(Timer *timer);
+
+// Given how long a client may take to finish sending a request it has
+// started, and to be sent the whole response to it, set the deadlines.
+// Called before workers start
+void connection_configure(unsigned int read_timeout, unsigned int request_timeout) {
+    read_timeout_ms = read_timeout;
+    request_timeout_ms = request_timeout;
+}
+
+// Given connection waiting for a request, give the client the idle timeout
+// to start it, or the read timeout to finish one part of which has arrived
+static void await_request(Connection *conn) {
+    conn->request_begun = (conn->request_size > 0);
+    unsigned int timeout = (conn->request_begun && read_timeout_ms > 0) ? read_timeout_ms
+                                                                         : CONNECTION_IDLE_TIMEOUT * 1000;
+    timer_set(&conn->worker->timers, &conn->deadline, timeout);
+}
+
+// Given worker and freshly accepted client socket, create connection in
+// the READING_REQUEST state and register it with the worker's loop
+Connection *connection_create(Worker *worker, int client_socket) {
+    Connection *conn = calloc(1, sizeof(Connection));
+    conn->state = CONN_READING_REQUEST;
+    conn->worker = worker;
+    conn->loop = worker->loop;
+    conn->cache = worker->cache;
+
+    conn->client.fd = client_socket;
+    conn->client.handler = handle_client_event;
+    conn->client.receive = receive_client_bytes;
+    conn->client.sent = client_sent;
+    conn->client.context = conn;
+
+    conn->request_capacity = (size_t) INITIAL_REQUEST_BUFFER_SIZE;
+    conn->request = malloc(conn->request_capacity);
+    conn->url_capacity = (size_t) INITIAL_URL_SIZE;
+    conn->url = malloc(conn->url_capacity);
+
+    // Responses are written whole, so Nagle's algorithm would only hold
+    // back the next pipelined response until the client's delayed ACK
+    int opt = 1;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    // Peers pass on requests for the URLs this proxy owns, marked so they
+    // are not passed on again, and are told apart from clients by address
+    const Cluster *cluster = worker->fetches->cluster;
+    struct sockaddr_in address;
+    socklen_t address_length = sizeof(address);
+    if(cluster != NULL && getpeername(client_socket, (struct sockaddr *) &address, &address_length) == 0) {
+        conn->from_peer = cluster_is_peer(cluster, &address);
+    }
+    if(event_loop_add(conn->loop, &conn->client, EPOLLIN | EPOLLRDHUP) < 0) {
+        perror("Error registering client socket");
+        close(client_socket);
+        free(conn->request);
+        free(conn->url);
+        free(conn);
+        return NULL;
+    }
+    timer_init(&conn->deadline, deadline_passed, conn);
+    await_request(conn);
+    return conn;
+}
+
+// Release what the connection holds for its response, which a send in
+// flight may still be reading, and free the connection once the loop has
+// finished dispatching the current batch of events
+static void release_connection(Connection *conn) {
+    if(conn->fetch != NULL) {
+        worker_remove_waiting(conn->worker, conn);
+        fetch_unsubscribe(conn->fetch, &conn->reader);
+        conn->fetch = NULL;
+    }
+    if(conn->cache_entry != NULL) {
+        CacheEntry_release(conn->cache_entry);
+        conn->cache_entry = NULL;
+    }
+    if(conn->local_response != NULL) {
+        buffer_free(conn->local_response);
+        conn->local_response = NULL;
+    }
+    free(conn->range_header);
+    conn->range_header = NULL;
+    conn->response = NULL;
+    event_loop_defer_free(conn->loop, conn);
+}
+
+// Close client socket and release connection. A fetch the connection was
+// reading carries on for its other readers and the cache. The struct itself
+// is freed once the loop has finished dispatching the current batch of
+// events, or once a send the loop has in flight for it completes
+void connection_close(Connection *conn) {
+    if(conn->state == CONN_CLOSED) {
+        return;
+    }
+    conn->state = CONN_CLOSED;
+    timer_cancel(&conn->deadline);
+    if(conn->client.fd >= 0) {
+        event_loop_close(conn->loop, &conn->client);
+        conn->client.fd = -1;
+    }
+    free(conn->request);
+    conn->request = NULL;
+    free(conn->url);
+    conn->url = NULL;
+    if(!conn->sending) {
+        release_connection(conn);
+    }
+}
+
+// The client has taken too long to send its request, or to be sent the
+// response to it, so close the connection. A kept-alive connection that
+// stays idle is closed too, but that is no timeout of a request
+static void deadline_passed(Timer *timer) {
+    Connection *conn = timer->context;
+    if(conn->state != CONN_READING_REQUEST || conn->request_begun) {
+        metrics_add(METRIC_CLIENT_TIMEOUTS, 1);
+    }
+    connection_close(conn);
+}
+
+// Change the events watched on the client socket, skipping the system
+// call when they are already being watched
+static void watch_client(Connection *conn, uint32_t events) {
+    if(conn->client.events != events) {
+        event_loop_modify(conn->loop, &conn->client, events);
+    }
+}
+
+// Events watched while a response waits on its fetch: the client ending
+// its stream, until it has, and errors and hangups, which are always reported
+static uint32_t relay_events(Connection *conn) {
+    return conn->received_all ? 0 : EPOLLRDHUP;
+}
+
+// Dispatch readiness of the client socket to the current state. A response
+// that finishes hands a kept-alive connection back to READING_REQUEST,
+// where requests the client has pipelined are read straight away
+static void handle_client_event(EventSource *source, uint32_t events) {
+    Connection *conn = source->context;
+    if(conn->state == CONN_CLOSED) {
+        return;
+    }
+    if(conn->state == CONN_WRITING_RESPONSE) {
+        write_response(conn);
+    } else if(conn->state == CONN_RELAYING && (events & EPOLLOUT)) {
+        write_fetched_response(conn);
+    } else if(conn->state == CONN_RELAYING && (events & (EPOLLERR | EPOLLHUP))) {
+        // Client went away while the response was on its way
+        connection_close(conn);
+        return;
+    } else if(conn->state == CONN_RELAYING && (events & EPOLLRDHUP)) {
+        // A client that has only stopped sending still gets its response,
+        // and the connection closes once it has been written
+        conn->received_all = true;
+        watch_client(conn, relay_events(conn));
+        return;
+    }
+    if(conn->state == CONN_READING_REQUEST) {
+        read_request(conn);
+    }
+}
+
+// Given bytes the loop has received from the client, add them to the
+// request buffer, and read the request if one is being waited for. The
+// end of the stream only closes the connection once the requests already
+// received have been served
+static void receive_client_bytes(EventSource *source, const char *data, ssize_t size) {
+    Connection *conn = source->context;
+    if(conn->state == CONN_CLOSED) {
+        return;
+    }
+    if(size < 0) {
+        errno = (int) -size;
+        perror("Error reading from connection socket");
+        connection_close(conn);
+        return;
+    }
+    if(size == 0) {
+        conn->received_all = true;
+        if(conn->state == CONN_READING_REQUEST) {
+            read_request(conn);
+        } else if(conn->state == CONN_RELAYING) {
+            watch_client(conn, relay_events(conn));
+        }
+        return;
+    }
+    while(conn->request_capacity - conn->request_size < (size_t) size) {
+        conn->request_capacity *= BUFFER_INCREMENT_FACTOR;
+        conn->request = realloc(conn->request, conn->request_capacity);
+    }
+    memcpy(conn->request + conn->request_size, data, size);
+    conn->request_size += size;
+    if(conn->state == CONN_READING_REQUEST) {
+        read_request(conn);
+    }
+}
+
+// The loop has finished sending part of the response. Carry on writing
+// it from where the send left off, or finish closing the connection
+static void client_sent(EventSource *source, ssize_t result) {
+    Connection *conn = source->context;
+    conn->sending = false;
+    conn->reader.sending = false;
+    if(conn->state == CONN_CLOSED) {
+        release_connection(conn);
+        return;
+    }
+    conn->send_complete = true;
+    conn->send_result = result;
+    if(conn->state == CONN_WRITING_RESPONSE) {
+        write_response(conn);
+    } else if(conn->state == CONN_RELAYING) {
+        write_fetched_response(conn);
+    }
+    if(conn->state == CONN_READING_REQUEST) {
+        read_request(conn);
+    }
+}
+
+// Write whatever the connection's fetch has received since it last ran.
+// Called by the worker when a fetch signals progress
+void connection_fetch_progress(Connection *conn) {
+    if(conn->state == CONN_RELAYING) {
+        write_fetched_response(conn);
+        if(conn->state == CONN_READING_REQUEST) {
+            read_request(conn);
+        }
+    }
+}
+
+// Return true once the request buffer holds a complete request header,
+// recording its length. Lines are indexed as they arrive, so a request
+// arriving a few bytes at a time is only scanned once. A malformed or
+// oversized request closes the connection
+static bool request_complete(Connection *conn) {
+    int length = http_parse_request(&conn->parsed, conn->request, conn->request_size);
+    if(length == HTTP_REQUEST_TOO_LARGE) {
+        printf("Request exceeds maximum size, closing connection\n");
+    }
+    if(length < 0) {
+        connection_close(conn);
+        return false;
+    }
+    conn->request_length = length;
+    return length > 0;
+}
+
+// Read requests as they arrive. Each complete request is processed in
+// turn, and requests answered straight from the cache leave the connection
+// ready for the next one, so a pipelined batch of hits is served without
+// going back to the event loop
+static void read_request(Connection *conn) {
+    while(conn->state == CONN_READING_REQUEST) {
+        if(request_complete(conn)) {
+            process_request(conn);
+            continue;
+        }
+        if(conn->state == CONN_CLOSED) {
+            return;
+        }
+        if(!conn->request_begun && conn->request_size > 0) {
+            await_request(conn);
+        }
+        // The loop reads for the connection itself on io_uring
+        if(event_loop_receives(conn->loop, &conn->client)) {
+            if(conn->received_all) {
+                connection_close(conn);
+            }
+            return;
+        }
+        // The parser limits the header, so the buffer stays small
+        if(conn->request_size == conn->request_capacity) {
+            conn->request_capacity *= BUFFER_INCREMENT_FACTOR;
+            conn->request = realloc(conn->request, conn->request_capacity);
+        }
+        ssize_t bytes_read = read(conn->client.fd, conn->request + conn->request_size,
+                                  conn->request_capacity - conn->request_size);
+        if(bytes_read < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            perror("Error reading from connection socket");
+            connection_close(conn);
+            return;
+        }
+        if(bytes_read == 0) {
+            connection_close(conn);
+            return;
+        }
+        conn->request_size += bytes_read;
+    }
+}
+
+// Given a line of a stored header, return true if it is the named field
+static bool line_named(const char *line, size_t length, const char *name) {
+    size_t name_length = strlen(name);
+    return length > name_length && line[name_length] == ':' && strncasecmp(line, name, name_length) == 0;
+}
+
+// Write the byte range the client asked for as a 206 response, or a 416
+// if the object has none of its bytes. The header is the stored one with
+// the fields describing the whole body replaced, and the body is cut from
+// the stored body, or the cached parts of it, without copying
+static void serve_range(Connection *conn) {
+    CacheEntry *cache_entry = conn->cache_entry;
+    size_t capacity = cache_entry->header_length + RANGE_HEADER_EXTRA;
+    char *header = malloc(capacity);
+    size_t length;
+    int64_t first, last;
+    if(!http_range_resolve(&conn->range, cache_entry->object_size, &first, &last)) {
+        length = snprintf(header, capacity, RANGE_NOT_SATISFIABLE, (long long) cache_entry->object_size);
+        first = 0;
+        last = -1;
+    } else {
+        // Copy the stored fields after the status line, which the stored
+        // header holds in its first chunk
+        size_t head_size;
+        const char *head = (const char *) buffer_head(cache_entry->server_response, &head_size);
+        const char *end = head + cache_entry->header_length;
+        length = snprintf(header, capacity, "HTTP/1.1 206 Partial Content");
+        const char *line = memmem(head, end - head, "\r\n", 2);
+        while(line != NULL) {
+            line += 2;
+            const char *next = memmem(line, end - line, "\r\n", 2);
+            size_t line_length = ((next != NULL) ? next : end) - line;
+            if(!line_named(line, line_length, "Content-Length") && !line_named(line, line_length, "Content-Range") &&
+               !line_named(line, line_length, "Age")) {
+                memcpy(header + length, "\r\n", 2);
+                memcpy(header + length + 2, line, line_length);
+                length += line_length + 2;
+            }
+            line = next;
+        }
+        length += snprintf(header + length, capacity - length,
+                           "\r\nAge: %d\r\nContent-Range: bytes %lld-%lld/%lld\r\nContent-Length: %lld\r\n\r\n",
+                           get_age(cache_entry), (long long) first, (long long) last,
+                           (long long) cache_entry->object_size, (long long) (last - first + 1));
+        metrics_add(METRIC_RANGES_SERVED, 1);
+    }
+    conn->range_header = header;
+    conn->range_header_length = length;
+    conn->range_start = first;
+    conn->range_end = last + 1;
+    conn->state = CONN_WRITING_RESPONSE;
+    write_response(conn);
+}
+
+// Return true if the range the client asked for is to be cut from cache
+// entry: the entry knows the length of the object, and the client's
+// If-Range, if any, names the entry's version of it
+static bool range_applies(Connection *conn, CacheEntry *cache_entry) {
+    HttpRequest *request = &conn->parsed;
+    if(!conn->range_asked || cache_entry->object_size == HTTP_UNSET) {
+        return false;
+    }
+    return request->if_range.length == 0 ||
+           cache_entry_if_range(cache_entry, conn->request + request->if_range.offset, request->if_range.length);
+}
+
+// Write the response held by the connection's cache entry, with an Age
+// line reflecting how long it has been cached
+static void serve_cached_response(Connection *conn) {
+    prefetch_settle(conn->cache_entry, true);
+    if(range_applies(conn, conn->cache_entry)) {
+        serve_range(conn);
+        return;
+    }
+    conn->response = conn->cache_entry->server_response;
+    conn->age_length = add_age_header(conn->cache_entry, conn->age_header, sizeof(conn->age_header));
+    conn->state = CONN_WRITING_RESPONSE;
+    write_response(conn);
+}
+
+// Return true if the request asks the proxy itself for its metrics: an
+// origin-form target, as sent to a server rather than a proxy, of METRICS_PATH
+static bool is_metrics_request(Connection *conn) {
+    HttpRequest *request = &conn->parsed;
+    return request->path.offset == request->target.offset &&
+           request->path.length == strlen(METRICS_PATH) &&
+           memcmp(conn->request + request->path.offset, METRICS_PATH, strlen(METRICS_PATH)) == 0;
+}
+
+// Write the metrics of every thread in Prometheus text format. The
+// response is made fresh for each request and never cached
+static void serve_metrics(Connection *conn) {
+    size_t body_size;
+    char *body = metrics_prometheus(&body_size);
+    char header[128];
+    int header_size = snprintf(header, sizeof(header), METRICS_RESPONSE_HEADER, body_size);
+    unsigned char *response = malloc(header_size + body_size);
+    memcpy(response, header, header_size);
+    memcpy(response + header_size, body, body_size);
+    free(body);
+    conn->local_response = buffer_adopt(response, header_size + body_size);
+    conn->response = conn->local_response;
+    conn->state = CONN_WRITING_RESPONSE;
+    write_response(conn);
+}
+
+// Given complete request at the front of the buffer, either serve the
+// response from cache or start fetching it from the origin server
+static void process_request(Connection *conn) {
+    if(request_timeout_ms > 0) {
+        timer_set(&conn->worker->timers, &conn->deadline, request_timeout_ms);
+    } else {
+        timer_cancel(&conn->deadline);
+    }
+    // CONNECT hands the client's socket to a tunnel, with any bytes the
+    // client has already sent after the request
+    HttpRequest *request = &conn->parsed;
+    if(request->connect) {
+        int client_socket = conn->client.fd;
+        event_loop_remove(conn->loop, &conn->client);
+        conn->client.fd = -1;
+        tunnel_create(conn->worker, client_socket, conn->request + request->host.offset, request->host.length,
+                      request->port, conn->request + conn->request_length,
+                      conn->request_size - conn->request_length);
+        connection_close(conn);
+        return;
+    }
+    // Otherwise confirm request is GET request (as per project specs)
+    if(request->method.length != 3 || memcmp(conn->request + request->method.offset, "GET", 3) != 0) {
+        perror("Proxy server only accepts 'GET' requests");
+        connection_close(conn);
+        return;
+    }
+    conn->keep_alive = http_request_keep_alive(request);
+    conn->range_asked = request->range.length > 0 &&
+                        http_parse_range(conn->request + request->range.offset, request->range.length, &conn->range);
+    if(is_metrics_request(conn)) {
+        serve_metrics(conn);
+        return;
+    }
+    metrics_add(METRIC_REQUESTS, 1);
+    conn->request_started = metrics_now();
+
+    // Normalized URL the response is cached under
+    size_t url_length = http_request_url(request, conn->request, conn->url, conn->url_capacity);
+    if(url_length + 1 > conn->url_capacity) {
+        conn->url_capacity = url_length + 1;
+        conn->url = realloc(conn->url, conn->url_capacity);
+        http_request_url(request, conn->request, conn->url, conn->url_capacity);
+    }
+
+    // Check whether request is present in cache. Return true if present
+    // and fresh. If present and stale, return false, keeping the entry if
+    // it can be revalidated. If not present, return false
+    // The lookup is timed from when the request was taken up, as each
+    // clock read costs a measurable share of a hit
+    bool cache_hit = cache_check(conn->cache, conn->url);
+    metrics_record(METRIC_CACHE_LOOKUP, conn->request_started);
+    conn->cache_entry = cache_retrieval(conn->cache, conn->url);
+    if(conn->cache_entry != NULL && !cache_hit && !cache_entry_valid(conn->cache_entry)) {
+        // A stale entry the origin lets us serve while it is refreshed is
+        // sent straight away, and refreshed in the background
+        if(cache_entry_serve_stale(conn->cache_entry)) {
+            __atomic_fetch_add(&conn->cache->stats.stale_served, 1, __ATOMIC_RELAXED);
+            metrics_add(METRIC_STALE_SERVED, 1);
+            fetch_revalidate(conn->worker->fetches, conn->worker, conn->url, conn->request,
+                             conn->request_length);
+        } else {
+            CacheEntry_release(conn->cache_entry);
+            conn->cache_entry = NULL;
+        }
+    }
+    if(conn->cache_entry != NULL) {
+        serve_cached_response(conn);
+        return;
+    }
+    if(conn->range_asked) {
+        fetch_range(conn);
+        return;
+    }
+    fetch_response(conn, NULL);
+}
+
+// Answer the request with a 503 and close the connection, as the proxy
+// has as many fetches in flight, or as much of their responses held, as
+// it is allowed. The client is told to try again in a second
+static void shed_request(Connection *conn) {
+    metrics_add(METRIC_REQUESTS_SHED, 1);
+    size_t size = strlen(SERVICE_UNAVAILABLE);
+    unsigned char *response = malloc(size);
+    memcpy(response, SERVICE_UNAVAILABLE, size);
+    conn->local_response = buffer_adopt(response, size);
+    conn->response = conn->local_response;
+    conn->keep_alive = false;
+    conn->state = CONN_WRITING_RESPONSE;
+    write_response(conn);
+}
+
+// Read the response from the fetch already in flight for the URL and byte
+// range, or start one, revalidating a stale entry. A fetch for the whole
+// response that finished in between has cached it. A new fetch the proxy
+// has no room for sheds the request
+static void fetch_response(Connection *conn, const char *range) {
+    // Only a peer's mark on its request is trusted. A client marking its
+    // own would have the proxy ask the origin for a URL another peer owns
+    size_t length;
+    conn->reader.peer = conn->from_peer &&
+                        http_header_value(conn->request, conn->request_length, HTTP_PEER_FIELD, &length) != NULL;
+    conn->fetch = fetch_subscribe(conn->worker->fetches, conn->worker, conn->url, range,
+                                  conn->request, conn->request_length, &conn->reader,
+                                  &conn->cache_entry);
+    if(conn->fetch == NULL && conn->cache_entry == NULL) {
+        shed_request(conn);
+        return;
+    }
+    if(conn->fetch == NULL) {
+        serve_cached_response(conn);
+        return;
+    }
+    conn->missed = true;
+    conn->state = CONN_RELAYING;
+    worker_add_waiting(conn->worker, conn);
+    write_fetched_response(conn);
+}
+
+// Given connection whose client asked for a byte range of an object not
+// cached whole, serve it from the parts of the object cached so far. The
+// part missing from them is fetched and cached first, once per request.
+// Without any cached parts the origin is asked for the client's range,
+// and its answer relayed and cached. A client's If-Range naming another
+// version than the parts cached, or any version when none are, gets the
+// whole object
+static void fetch_range(Connection *conn) {
+    HttpRequest *request = &conn->parsed;
+    CacheEntry *partial = cache_partial_retrieval(conn->cache, conn->url);
+    if(request->if_range.length > 0 && (partial == NULL || !range_applies(conn, partial))) {
+        if(partial != NULL) {
+            CacheEntry_release(partial);
+        }
+        conn->range_asked = false;
+        fetch_response(conn, NULL);
+        return;
+    }
+    char range[64];
+    if(partial != NULL) {
+        int64_t first, last;
+        if(!http_range_resolve(&conn->range, partial->object_size, &first, &last) ||
+           !cache_entry_missing(partial, &first, &last)) {
+            conn->cache_entry = partial;
+            serve_range(conn);
+            return;
+        }
+        CacheEntry_release(partial);
+        if(!conn->range_filled) {
+            snprintf(range, sizeof(range), "bytes=%lld-%lld", (long long) first, (long long) last);
+            conn->range_filling = true;
+            fetch_response(conn, range);
+            return;
+        }
+    }
+    if(conn->range.first == HTTP_UNSET) {
+        snprintf(range, sizeof(range), "bytes=-%lld", (long long) conn->range.last);
+    } else if(conn->range.last == HTTP_UNSET) {
+        snprintf(range, sizeof(range), "bytes=%lld-", (long long) conn->range.first);
+    } else {
+        snprintf(range, sizeof(range), "bytes=%lld-%lld", (long long) conn->range.first, (long long) conn->range.last);
+    }
+    fetch_response(conn, range);
+}
+
+// Once the fetch of the part of a range missing from the cache has
+// finished, serve the range from the cache, whether the origin sent the
+// part or the whole object. Nothing of the fetch is written to the client,
+// so the bytes it receives are marked written straight away and never
+// hold back the origin
+static void finish_range_fill(Connection *conn) {
+    size_t available;
+    FetchState state;
+    fetch_describe(conn->fetch, 0, NULL, 0, &available, &state);
+    fetch_advance(conn->fetch, &conn->reader, available);
+    if(state != FETCH_COMPLETE && state != FETCH_FAILED) {
+        watch_client(conn, relay_events(conn));
+        return;
+    }
+    worker_remove_waiting(conn->worker, conn);
+    fetch_unsubscribe(conn->fetch, &conn->reader);
+    conn->fetch = NULL;
+    conn->range_filling = false;
+    conn->range_filled = true;
+    conn->cache_entry = cache_retrieval(conn->cache, conn->url);
+    if(conn->cache_entry != NULL && cache_entry_valid(conn->cache_entry)) {
+        serve_cached_response(conn);
+        return;
+    }
+    if(conn->cache_entry != NULL) {
+        CacheEntry_release(conn->cache_entry);
+        conn->cache_entry = NULL;
+    }
+    fetch_range(conn);
+}
+
+// The response to the current request has been written in full. Close the
+// connection unless the client wants it kept open and the response said
+// where it ended. Otherwise drop the request, keeping any the client has
+// pipelined after it, and wait for the next one
+static void finish_response(Connection *conn, bool delimited) {
+    if(conn->local_response == NULL) {
+        metrics_record(conn->missed ? METRIC_CLIENT_MISS : METRIC_CLIENT_HIT, conn->request_started);
+    }
+    if(!conn->keep_alive || !delimited) {
+        connection_close(conn);
+        return;
+    }
+    if(conn->fetch != NULL) {
+        worker_remove_waiting(conn->worker, conn);
+        fetch_unsubscribe(conn->fetch, &conn->reader);
+        conn->fetch = NULL;
+    }
+    if(conn->cache_entry != NULL) {
+        CacheEntry_release(conn->cache_entry);
+        conn->cache_entry = NULL;
+    }
+    if(conn->local_response != NULL) {
+        buffer_free(conn->local_response);
+        conn->local_response = NULL;
+    }
+    free(conn->range_header);
+    conn->range_header = NULL;
+    conn->response = NULL;
+    conn->response_sent = 0;
+    conn->age_length = 0;
+    conn->missed = false;
+    conn->range_asked = false;
+    conn->range_filled = false;
+
+    conn->request_size -= conn->request_length;
+    memmove(conn->request, conn->request + conn->request_length, conn->request_size);
+    conn->request_length = 0;
+    http_request_init(&conn->parsed);
+    conn->state = CONN_READING_REQUEST;
+    await_request(conn);
+    watch_client(conn, EPOLLIN | EPOLLRDHUP);
+}
+
+// Given connection serving a cache hit, return the range of the stored
+// response written in place of the proxy's Age line: the origin's own Age
+// line if it sent one, else nothing, just before the "\r\n\r\n". A
+// response made by the proxy has no Age line
+static HttpField replaced_age_line(Connection *conn) {
+    CacheEntry *cache_entry = conn->cache_entry;
+    if(conn->age_length == 0) {
+        return (HttpField){(uint32_t) conn->response->size, 0};
+    }
+    if(cache_entry->age_line.length > 0) {
+        return cache_entry->age_line;
+    }
+    return (HttpField){(uint32_t) cache_entry->header_length, 0};
+}
+
+// Given connection serving a cache hit, return size of the response as written
+static size_t response_total(Connection *conn) {
+    if(conn->range_header != NULL) {
+        return conn->range_header_length + (conn->range_end - conn->range_start);
+    }
+    return conn->response->size - replaced_age_line(conn).length + conn->age_length;
+}
+
+// Describe the unsent part of the response as at most max_iov iovecs. The
+// Age line of a cache hit replaces the origin's, or else sits between the
+// stored header and the stored "\r\n\r\n" plus body. A byte range is
+// its own header followed by the range of the body. Return number of
+// iovecs filled
+static int response_iovec(Connection *conn, struct iovec *iov, int max_iov) {
+    if(conn->range_header != NULL) {
+        size_t skip = conn->response_sent;
+        int count = 0;
+        if(skip < conn->range_header_length) {
+            iov[0].iov_base = conn->range_header + skip;
+            iov[0].iov_len = conn->range_header_length - skip;
+            count = 1;
+            skip = 0;
+        } else {
+            skip -= conn->range_header_length;
+        }
+        return count + cache_entry_range_iovec(conn->cache_entry, conn->range_start + skip, conn->range_end,
+                                               iov + count, max_iov - count);
+    }
+    Buffer *response = conn->response;
+    HttpField cut = replaced_age_line(conn);
+    size_t pieces[2][2] = {{0, cut.offset}, {cut.offset + cut.length, response->size}};
+    size_t skip = conn->response_sent;
+    int count = 0;
+    for(int i = 0; i < 2 && count < max_iov; i++) {
+        size_t piece_size = pieces[i][1] - pieces[i][0];
+        if(skip < piece_size) {
+            count += buffer_iovec(response, pieces[i][0] + skip, pieces[i][1], iov + count, max_iov - count);
+            skip = 0;
+        } else {
+            skip -= piece_size;
+        }
+        if(i == 0 && count < max_iov) {
+            if(skip < conn->age_length) {
+                iov[count].iov_base = conn->age_header + skip;
+                iov[count].iov_len = conn->age_length - skip;
+                count += 1;
+                skip = 0;
+            } else {
+                skip -= conn->age_length;
+            }
+        }
+    }
+    return count;
+}
+
+// Given the unsent part of the response, write what the client socket
+// accepts. On io_uring the bytes are handed to the loop to send instead,
+// and the write fails with EINPROGRESS until the send completes; the write
+// of the same bytes is then made again, and returns what the send sent
+static ssize_t write_client(Connection *conn, struct iovec *iov, int iov_count) {
+    if(conn->send_complete) {
+        conn->send_complete = false;
+        if(conn->send_result < 0) {
+            errno = (int) -conn->send_result;
+            return -1;
+        }
+        return conn->send_result;
+    }
+    if(conn->sending) {
+        errno = EINPROGRESS;
+        return -1;
+    }
+    if(event_loop_sends(conn->loop, &conn->client)) {
+        memcpy(conn->send_iov, iov, iov_count * sizeof(struct iovec));
+        memset(&conn->send_message, 0, sizeof(conn->send_message));
+        conn->send_message.msg_iov = conn->send_iov;
+        conn->send_message.msg_iovlen = iov_count;
+        if(event_loop_send(conn->loop, &conn->client, &conn->send_message) == 0) {
+            conn->sending = true;
+            conn->reader.sending = (conn->fetch != NULL);
+            errno = EINPROGRESS;
+            return -1;
+        }
+    }
+    return writev(conn->client.fd, iov, iov_count);
+}
+
+// Write as much of a cached or proxy-made response to the client as the socket accepts,
+// finishing the request once the whole response has been written
+static void write_response(Connection *conn) {
+    size_t response_size = response_total(conn);
+    while(conn->response_sent < response_size) {
+        struct iovec iov[RESPONSE_MAX_IOV];
+        int iov_count = response_iovec(conn, iov, RESPONSE_MAX_IOV);
+        ssize_t bytes_written = write_client(conn, iov, iov_count);
+        if(bytes_written < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                watch_client(conn, EPOLLOUT);
+                return;
+            }
+            if(errno == EINPROGRESS) {
+                return;
+            }
+            connection_close(conn);
+            return;
+        }
+        conn->response_sent += bytes_written;
+        if(conn->local_response == NULL) {
+            metrics_add(METRIC_BYTES_SERVED, bytes_written);
+        }
+    }
+    finish_response(conn, conn->cache_entry == NULL || conn->range_header != NULL || conn->cache_entry->delimited);
+}
+
+// Write as much of the response as the fetch has received and the socket
+// accepts. Wait for the fetch to signal more once everything received so
+// far has been written, and finish the request once the fetch is complete
+// and the whole response has been written
+static void write_fetched_response(Connection *conn) {
+    if(conn->range_filling) {
+        finish_range_fill(conn);
+        return;
+    }
+    size_t available;
+    FetchState state;
+    while(1) {
+        struct iovec iov[RESPONSE_MAX_IOV];
+        int iov_count = fetch_describe(conn->fetch, conn->response_sent, iov, RESPONSE_MAX_IOV,
+                                       &available, &state);
+        if(iov_count == 0) {
+            watch_client(conn, relay_events(conn));
+            break;
+        }
+        ssize_t bytes_written = write_client(conn, iov, iov_count);
+        if(bytes_written < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                watch_client(conn, EPOLLOUT);
+                break;
+            }
+            if(errno == EINPROGRESS) {
+                break;
+            }
+            connection_close(conn);
+            return;
+        }
+        conn->response_sent += bytes_written;
+        metrics_add(METRIC_BYTES_SERVED, bytes_written);
+    }
+    fetch_advance(conn->fetch, &conn->reader, conn->response_sent);
+    if(state == FETCH_COMPLETE && conn->fetch->not_modified) {
+        // Nothing of the 304 was written; serve the refreshed cached copy
+        conn->cache_entry = conn->fetch->cache_entry;
+        CacheEntry_acquire(conn->cache_entry);
+        worker_remove_waiting(conn->worker, conn);
+        fetch_unsubscribe(conn->fetch, &conn->reader);
+        conn->fetch = NULL;
+        serve_cached_response(conn);
+    } else if(state == FETCH_FAILED) {
+        connection_close(conn);
+    } else if(state == FETCH_COMPLETE && conn->response_sent == available) {
+        finish_response(conn, conn->fetch->delimited);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
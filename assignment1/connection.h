@@ -0,0 +1,126 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      connection.h
+// Usage:       Header file for per-connection proxy state machine
+//*************************************************************************************************
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "cache.h"
+#include "event_loop.h"
+#include "fetch.h"
+#include "timer.h"
+#include "worker.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define INITIAL_REQUEST_BUFFER_SIZE 8*1024
+#define INITIAL_URL_SIZE 256
+#define BUFFER_INCREMENT_FACTOR 4
+#define RESPONSE_MAX_IOV 16
+#define CONNECTION_IDLE_TIMEOUT 30           // Seconds a client may take to start its next request
+#define DEFAULT_REQUEST_TIMEOUT_MS 300000    // From a complete request to its whole response written
+#define SERVICE_UNAVAILABLE "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\n" \
+                            "Connection: close\r\n\r\n"
+
+// ----STRUCT--------------------------------------------------------------------------------------
+
+// Each request on a client connection moves through these states in order.
+// A cache hit goes from READING_REQUEST to WRITING_RESPONSE, a miss to
+// RELAYING, where the response is written to the client as its fetch
+// receives it. A byte range waits in RELAYING for any part of it missing
+// from the cache, then goes on to WRITING_RESPONSE. Kept-alive connections then go back to READING_REQUEST for
+// the next request, which may already be in the request buffer if the
+// client pipelined it
+typedef enum ConnectionState{
+    CONN_READING_REQUEST,
+    CONN_RELAYING,
+    CONN_WRITING_RESPONSE,
+    CONN_CLOSED
+} ConnectionState;
+
+typedef struct Connection{
+    ConnectionState state;
+    Worker *worker;
+    EventLoop *loop;
+    Cache *cache;
+    EventSource client;
+
+    // Requests received from client. The request being served takes the
+    // first request_length bytes; any pipelined after it follow. Its header
+    // is indexed in place as it arrives, and only its cache key is copied
+    char *request;
+    size_t request_size;
+    size_t request_capacity;
+    size_t request_length;
+    HttpRequest parsed;
+    char *url;
+    size_t url_capacity;
+    bool keep_alive;                   // Client wants another request after this one
+    bool received_all;                 // Client has ended its stream, after the requests buffered
+    bool request_begun;                // Part of the next request has arrived
+    bool from_peer;                    // Client connected from another proxy of the cluster
+
+    // Whichever deadline the state has: the idle timeout until a request
+    // begins, the read timeout until it is complete, then the request
+    // timeout until its response is written
+    Timer deadline;
+
+    // On a miss the response is read from the origin fetch for the URL,
+    // which may be shared with other clients missing at the same time.
+    // On a hit it belongs to the cache entry, with only the Age line built
+    // per request and written between the stored header and body
+    Fetch *fetch;
+    FetchReader reader;
+    struct Connection *waiting_prev;
+    struct Connection *waiting_next;
+    Buffer *response;
+    size_t response_sent;
+    CacheEntry *cache_entry;
+    char age_header[32];
+    size_t age_length;
+    Buffer *local_response;            // Response made by the proxy itself, such as its metrics
+
+    // On io_uring the response is sent by the loop, a send at a time, and
+    // the result of each is handed back through the same write path. The
+    // memory being sent is kept until the send completes, even if the
+    // connection is closed meanwhile
+    struct iovec send_iov[RESPONSE_MAX_IOV];
+    struct msghdr send_message;
+    bool sending;
+    bool send_complete;
+    ssize_t send_result;
+
+    // A single byte range the client asked for is cut from the cached
+    // object, or from the parts of it cached so far, with its header built
+    // per request. A part missing from the cache is fetched first, once
+    HttpRange range;
+    bool range_asked;
+    bool range_filling;                // Waiting for a fetch of the missing part to be cached
+    bool range_filled;
+    char *range_header;
+    size_t range_header_length;
+    int64_t range_start;               // Bytes [start, end) of the body follow the header
+    int64_t range_end;
+    uint64_t request_started;          // When the request was complete, for its latency
+    bool missed;                       // Response was fetched rather than served from cache
+} Connection;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+Connection *connection_create(Worker *worker, int client_socket);
+void connection_close(Connection *conn);
+void connection_fetch_progress(Connection *conn);
+void connection_configure(unsigned int read_timeout, unsigned int request_timeout);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,581 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      disk_cache.c
+// Usage:       Implementation file for the disk tier beneath the in-memory cache
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "disk_cache.h"
+#include "pool.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define DISK_PATH_MAX_SIZE 4096
+#define DISK_WRITE_MAX_IOV 64
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+static void *writer_main(void *arg);
+
+// Given record, return hash of its fields before the check itself
+static uint32_t record_check(const DiskRecord *record) {
+    uint32_t hash = 2166136261u;
+    const unsigned char *byte = (const unsigned char *) record;
+    for(size_t i = 0; i < offsetof(DiskRecord, check); i++) {
+        hash = (hash ^ byte[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Return total size of a record in its segment
+static size_t record_size(const DiskRecord *record) {
+    return sizeof(DiskRecord) + record->url_length + record->response_length;
+}
+
+// Given record found at offset of a segment holding size bytes, return
+// true if it is whole and was written by this version of the proxy
+static bool record_valid(const DiskRecord *record, uint64_t offset, size_t size) {
+    return record->magic == DISK_RECORD_MAGIC && record->check == record_check(record) &&
+           offset + sizeof(DiskRecord) <= size &&
+           record->url_length + record->response_length <= size - offset - sizeof(DiskRecord);
+}
+
+static void segment_path(DiskCache *disk, uint32_t id, const char *extension, char *path) {
+    snprintf(path, DISK_PATH_MAX_SIZE, "%s/%08u.%s", disk->directory, id, extension);
+}
+
+// Given id, open the segment file, creating it if it does not exist, and
+// map it whole. Return NULL on error
+static DiskSegment *segment_open(DiskCache *disk, uint32_t id) {
+    char path[DISK_PATH_MAX_SIZE];
+    segment_path(disk, id, "seg", path);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0) {
+        perror("Error opening disk cache segment");
+        if(fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    // Pages past the end of the file are never touched, since only whole
+    // records are indexed
+    unsigned char *map = mmap(NULL, DISK_SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        perror("Error mapping disk cache segment");
+        close(fd);
+        return NULL;
+    }
+    DiskSegment *segment = calloc(1, sizeof(DiskSegment));
+    segment->id = id;
+    segment->fd = fd;
+    segment->map = map;
+    segment->size = st.st_size;
+    segment->refcount = 1;
+    return segment;
+}
+
+// Drop a reference to segment, unmapping it once the last one goes
+static void segment_release(void *context) {
+    DiskSegment *segment = context;
+    if(__atomic_sub_fetch(&segment->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        munmap(segment->map, DISK_SEGMENT_SIZE);
+        close(segment->fd);
+        free(segment);
+    }
+}
+
+// Append segment as the newest. Caller holds the lock
+static void segment_append(DiskCache *disk, DiskSegment *segment) {
+    if(disk->newest != NULL) {
+        disk->newest->next = segment;
+    } else {
+        disk->oldest = segment;
+    }
+    disk->newest = segment;
+    disk->bytes_used += segment->size;
+}
+
+//----INDEX----------------------------------------------------------------------------------------
+// Return link to the entry for hash, or to the end of its bucket chain.
+// Caller holds the lock
+static DiskEntry **index_find(DiskCache *disk, uint64_t hash) {
+    DiskEntry **link = &disk->buckets[hash & (DISK_TABLE_SIZE - 1)];
+    while(*link != NULL && (*link)->url_hash != hash) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static void index_remove(DiskCache *disk, DiskEntry **link) {
+    DiskEntry *entry = *link;
+    *link = entry->next;
+    pool_free(entry, sizeof(DiskEntry));
+    disk->entries -= 1;
+}
+
+// Record that the newest copy of the URL with the given hash is the record
+// at offset of segment. Caller holds the lock
+static void index_put(DiskCache *disk, const DiskRecord *record, DiskSegment *segment, uint64_t offset) {
+    DiskEntry **link = index_find(disk, record->url_hash);
+    DiskEntry *entry = *link;
+    if(entry == NULL) {
+        entry = pool_alloc(sizeof(DiskEntry));
+        entry->next = NULL;
+        entry->url_hash = record->url_hash;
+        *link = entry;
+        disk->entries += 1;
+    }
+    entry->segment = segment;
+    entry->offset = offset;
+    entry->expires = record->time_added + record->max_age;
+    entry->max_age = record->max_age;
+}
+
+// Forget every entry pointing into segment. Caller holds the lock
+static void index_drop_segment(DiskCache *disk, DiskSegment *segment) {
+    for(int i = 0; i < DISK_TABLE_SIZE; i++) {
+        DiskEntry **link = &disk->buckets[i];
+        while(*link != NULL) {
+            if((*link)->segment == segment) {
+                index_remove(disk, link);
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+}
+
+//----SEGMENT FILES--------------------------------------------------------------------------------
+// Given segment and the index of its records, write the index file beside
+// it. Written under a temporary name and renamed, so a crash never leaves
+// a partial index behind
+static void write_index(DiskCache *disk, DiskSegment *segment, DiskIndexRecord *records, size_t count) {
+    char path[DISK_PATH_MAX_SIZE], temporary[DISK_PATH_MAX_SIZE];
+    segment_path(disk, segment->id, "idx", path);
+    segment_path(disk, segment->id, "idx.tmp", temporary);
+    FILE *file = fopen(temporary, "wb");
+    if(file == NULL) {
+        perror("Error writing disk cache index");
+        return;
+    }
+    size_t written = fwrite(records, sizeof(DiskIndexRecord), count, file);
+    if(fclose(file) != 0 || written != count || rename(temporary, path) < 0) {
+        perror("Error writing disk cache index");
+        unlink(temporary);
+    }
+}
+
+// Given segment found at startup, add its fresh records to the index from
+// its index file. A segment without one was being written when the proxy
+// stopped, so its records are read instead, it is cut back to the last
+// whole record, and its index file is written for next time. Return number
+// of records indexed
+static size_t load_segment(DiskCache *disk, DiskSegment *segment, time_t now) {
+    char path[DISK_PATH_MAX_SIZE];
+    segment_path(disk, segment->id, "idx", path);
+    DiskIndexRecord *records = NULL;
+    size_t count = 0;
+    FILE *file = fopen(path, "rb");
+    if(file != NULL) {
+        struct stat st;
+        fstat(fileno(file), &st);
+        records = malloc(st.st_size + 1);
+        count = fread(records, sizeof(DiskIndexRecord), st.st_size / sizeof(DiskIndexRecord), file);
+        fclose(file);
+    } else {
+        size_t capacity = 0;
+        uint64_t offset = 0;
+        while(segment->size - offset >= sizeof(DiskRecord) &&
+              record_valid((DiskRecord *) (segment->map + offset), offset, segment->size)) {
+            if(count == capacity) {
+                capacity = (capacity == 0) ? 256 : capacity * 2;
+                records = realloc(records, capacity * sizeof(DiskIndexRecord));
+            }
+            records[count].record = *(DiskRecord *) (segment->map + offset);
+            records[count].offset = offset;
+            offset += record_size(&records[count].record);
+            count += 1;
+        }
+        if(offset < segment->size && ftruncate(segment->fd, offset) == 0) {
+            segment->size = offset;
+        }
+        write_index(disk, segment, records, count);
+    }
+
+    size_t indexed = 0;
+    for(size_t i = 0; i < count; i++) {
+        DiskRecord *record = &records[i].record;
+        if(record_valid(record, records[i].offset, segment->size) &&
+           record->time_added + record->max_age > now) {
+            index_put(disk, record, segment, records[i].offset);
+            indexed += 1;
+        }
+    }
+    free(records);
+    return indexed;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Remove the oldest segments until the tier fits its capacity. The
+// segment being written is never removed. Caller holds the lock
+static void enforce_capacity(DiskCache *disk) {
+    while(disk->bytes_used > disk->capacity && disk->oldest != disk->newest) {
+        DiskSegment *segment = disk->oldest;
+        char path[DISK_PATH_MAX_SIZE];
+        index_drop_segment(disk, segment);
+        segment_path(disk, segment->id, "seg", path);
+        unlink(path);
+        segment_path(disk, segment->id, "idx", path);
+        unlink(path);
+        disk->oldest = segment->next;
+        disk->bytes_used -= segment->size;
+        segment_release(segment);
+    }
+}
+
+//----PUBLIC---------------------------------------------------------------------------------------
+// Given directory and the most bytes its segments may take, open the disk
+// tier, creating the directory if needed. Records already there are
+// indexed so the proxy starts with a warm cache. Return NULL on error
+DiskCache *disk_cache_open(const char *directory, size_t capacity) {
+    if(mkdir(directory, 0755) < 0 && errno != EEXIST) {
+        perror("Error creating disk cache directory");
+        return NULL;
+    }
+    DIR *dir = opendir(directory);
+    if(dir == NULL) {
+        perror("Error opening disk cache directory");
+        return NULL;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    DiskCache *disk = calloc(1, sizeof(DiskCache));
+    pthread_mutex_init(&disk->lock, NULL);
+    pthread_cond_init(&disk->work, NULL);
+    disk->directory = strdup(directory);
+    disk->capacity = capacity;
+
+    // Segments are loaded oldest first, so newer copies of a URL win
+    uint32_t *ids = NULL;
+    size_t n_ids = 0, ids_capacity = 0;
+    struct dirent *file;
+    while((file = readdir(dir)) != NULL) {
+        uint32_t id;
+        char extension[8];
+        if(sscanf(file->d_name, "%8u.%7s", &id, extension) == 2 && strcmp(extension, "seg") == 0) {
+            if(n_ids == ids_capacity) {
+                ids_capacity = (ids_capacity == 0) ? 64 : ids_capacity * 2;
+                ids = realloc(ids, ids_capacity * sizeof(uint32_t));
+            }
+            ids[n_ids++] = id;
+        }
+    }
+    closedir(dir);
+    qsort(ids, n_ids, sizeof(uint32_t), compare_ids);
+    time_t now = time(NULL);
+    size_t indexed = 0, loaded = 0;
+    for(size_t i = 0; i < n_ids; i++) {
+        DiskSegment *segment = segment_open(disk, ids[i]);
+        if(segment == NULL) {
+            continue;
+        }
+        indexed += load_segment(disk, segment, now);
+        if(segment->size > 0) {
+            segment_append(disk, segment);
+            loaded += 1;
+            continue;
+        }
+        // Nothing was written to it before the proxy stopped
+        char path[DISK_PATH_MAX_SIZE];
+        segment_path(disk, segment->id, "seg", path);
+        unlink(path);
+        segment_path(disk, segment->id, "idx", path);
+        unlink(path);
+        segment_release(segment);
+    }
+
+    // New records go to a fresh segment
+    DiskSegment *segment = segment_open(disk, (n_ids > 0) ? ids[n_ids - 1] + 1 : 0);
+    free(ids);
+    if(segment == NULL) {
+        return NULL;
+    }
+    segment_append(disk, segment);
+    enforce_capacity(disk);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Disk cache %s: %zu objects from %zu segments indexed in %.1f ms\n", directory, indexed,
+           loaded, (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    pthread_create(&disk->writer, NULL, writer_main, disk);
+    return disk;
+}
+
+// Write out queued responses, stop the writer and index the segment it
+// was writing, so the next start finds everything. Only called when the
+// proxy stops
+void disk_cache_close(DiskCache *disk) {
+    pthread_mutex_lock(&disk->lock);
+    disk->stopping = true;
+    pthread_cond_signal(&disk->work);
+    pthread_mutex_unlock(&disk->lock);
+    pthread_join(disk->writer, NULL);
+    write_index(disk, disk->newest, disk->segment_index, disk->segment_index_size);
+}
+
+// Given complete cache entry, queue it to be written to disk. Responses
+// are dropped rather than queued once the writer has fallen too far behind
+void disk_cache_store(DiskCache *disk, CacheEntry *cache_entry) {
+    size_t size = sizeof(DiskRecord) + strlen(cache_entry->url) + cache_entry->server_response_size;
+    pthread_mutex_lock(&disk->lock);
+    if(size > (size_t) DISK_SEGMENT_SIZE || disk->queue_bytes + size > (size_t) DISK_QUEUE_MAX_BYTES) {
+        pthread_mutex_unlock(&disk->lock);
+        __atomic_fetch_add(&disk->stats.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if(disk->queue_size == disk->queue_capacity) {
+        // Grow the ring, unrolling it so the head is back at the start
+        size_t capacity = (disk->queue_capacity == 0) ? 64 : disk->queue_capacity * 2;
+        CacheEntry **queue = malloc(capacity * sizeof(CacheEntry *));
+        for(size_t i = 0; i < disk->queue_size; i++) {
+            queue[i] = disk->queue[(disk->queue_head + i) % disk->queue_capacity];
+        }
+        free(disk->queue);
+        disk->queue = queue;
+        disk->queue_head = 0;
+        disk->queue_capacity = capacity;
+    }
+    CacheEntry_acquire(cache_entry);
+    disk->queue[(disk->queue_head + disk->queue_size) % disk->queue_capacity] = cache_entry;
+    disk->queue_size += 1;
+    disk->queue_bytes += size;
+    pthread_cond_signal(&disk->work);
+    pthread_mutex_unlock(&disk->lock);
+}
+
+// Write buffer of iovecs in full at offset of file. Return -1 on error
+static int write_all(int fd, struct iovec *iov, int count, off_t offset) {
+    while(count > 0) {
+        ssize_t n = pwritev(fd, iov, count, offset);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        offset += n;
+        while(count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// Start a new segment once the one being written is full, indexing the
+// full one. Only called from the writer. Return -1 if no segment could be
+// created
+static int rotate(DiskCache *disk) {
+    DiskSegment *full = disk->newest;
+    write_index(disk, full, disk->segment_index, disk->segment_index_size);
+    disk->segment_index_size = 0;
+    DiskSegment *segment = segment_open(disk, full->id + 1);
+    if(segment == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&disk->lock);
+    segment_append(disk, segment);
+    pthread_mutex_unlock(&disk->lock);
+    return 0;
+}
+
+// Append cache entry to the newest segment and index it. Only called from
+// the writer, which alone writes segments
+static void write_record(DiskCache *disk, CacheEntry *cache_entry) {
+    DiskRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = DISK_RECORD_MAGIC;
+    record.url_length = strlen(cache_entry->url);
+    record.url_hash = cache_entry->url_hash;
+    record.response_length = cache_entry->server_response_size;
+    record.time_added = __atomic_load_n(&cache_entry->time_added.tv_sec, __ATOMIC_RELAXED);
+    record.max_age = __atomic_load_n(&cache_entry->max_age, __ATOMIC_RELAXED);
+    record.check = record_check(&record);
+    size_t size = record_size(&record);
+    if(disk->newest->size + size > (size_t) DISK_SEGMENT_SIZE && rotate(disk) < 0) {
+        return;
+    }
+
+    DiskSegment *segment = disk->newest;
+    uint64_t offset = segment->size;
+    struct iovec iov[DISK_WRITE_MAX_IOV];
+    iov[0].iov_base = &record;
+    iov[0].iov_len = sizeof(record);
+    iov[1].iov_base = cache_entry->url;
+    iov[1].iov_len = record.url_length;
+    int count = 2;
+    off_t position = offset;
+    size_t start = 0;
+    Buffer *response = cache_entry->server_response;
+    do {
+        count += buffer_iovec(response, start, response->size, iov + count, DISK_WRITE_MAX_IOV - count);
+        size_t length = 0;
+        for(int i = 0; i < count; i++) {
+            length += iov[i].iov_len;
+        }
+        if(write_all(segment->fd, iov, count, position) < 0) {
+            perror("Error writing disk cache segment");
+            ftruncate(segment->fd, offset);
+            return;
+        }
+        position += length;
+        start = position - offset - sizeof(record) - record.url_length;
+        count = 0;
+    } while(start < response->size);
+
+    if(disk->segment_index_size == disk->segment_index_capacity) {
+        disk->segment_index_capacity = (disk->segment_index_capacity == 0) ? 256 : disk->segment_index_capacity * 2;
+        disk->segment_index = realloc(disk->segment_index, disk->segment_index_capacity * sizeof(DiskIndexRecord));
+    }
+    disk->segment_index[disk->segment_index_size].record = record;
+    disk->segment_index[disk->segment_index_size].offset = offset;
+    disk->segment_index_size += 1;
+
+    pthread_mutex_lock(&disk->lock);
+    segment->size += size;
+    disk->bytes_used += size;
+    index_put(disk, &record, segment, offset);
+    enforce_capacity(disk);
+    pthread_mutex_unlock(&disk->lock);
+    __atomic_fetch_add(&disk->stats.writes, 1, __ATOMIC_RELAXED);
+}
+
+// Write queued entries until the tier is closed and the queue is empty
+static void *writer_main(void *arg) {
+    DiskCache *disk = arg;
+    pthread_mutex_lock(&disk->lock);
+    while(1) {
+        while(disk->queue_size == 0 && !disk->stopping) {
+            pthread_cond_wait(&disk->work, &disk->lock);
+        }
+        if(disk->queue_size == 0) {
+            break;
+        }
+        CacheEntry *cache_entry = disk->queue[disk->queue_head];
+        disk->queue_head = (disk->queue_head + 1) % disk->queue_capacity;
+        disk->queue_size -= 1;
+        pthread_mutex_unlock(&disk->lock);
+
+        write_record(disk, cache_entry);
+        size_t size = sizeof(DiskRecord) + strlen(cache_entry->url) + cache_entry->server_response_size;
+        CacheEntry_release(cache_entry);
+
+        pthread_mutex_lock(&disk->lock);
+        disk->queue_bytes -= size;
+    }
+    pthread_mutex_unlock(&disk->lock);
+    return NULL;
+}
+
+// Given URL and its hash, return a cache entry for the newest fresh copy
+// on disk with its first reference held, or NULL. The response is mapped
+// from its segment rather than read, and keeps the segment mapped until
+// the entry is freed
+CacheEntry *disk_cache_lookup(DiskCache *disk, const char *url, uint64_t hash) {
+    pthread_mutex_lock(&disk->lock);
+    DiskEntry **link = index_find(disk, hash);
+    DiskEntry *entry = *link;
+    if(entry != NULL && entry->expires <= time(NULL)) {
+        index_remove(disk, link);
+        entry = NULL;
+    }
+    DiskSegment *segment = NULL;
+    uint64_t offset = 0;
+    time_t time_added = 0;
+    int max_age = 0;
+    if(entry != NULL) {
+        segment = entry->segment;
+        offset = entry->offset;
+        time_added = entry->expires - entry->max_age;
+        max_age = entry->max_age;
+        __atomic_fetch_add(&segment->refcount, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&disk->lock);
+    if(segment == NULL) {
+        __atomic_fetch_add(&disk->stats.misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    // The URL is checked outside the lock, since reading it may have to
+    // wait for the disk
+    const DiskRecord *record = (const DiskRecord *) (segment->map + offset);
+    const char *stored_url = (const char *) (record + 1);
+    if(record->url_length != strlen(url) || memcmp(stored_url, url, record->url_length) != 0) {
+        segment_release(segment);
+        __atomic_fetch_add(&disk->stats.misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    unsigned char *response = (unsigned char *) stored_url + record->url_length;
+    Buffer *buffer = buffer_wrap(response, record->response_length, segment_release, segment);
+    CacheEntry *cache_entry = CacheEntry_create((char *) url, buffer, NULL);
+    cache_entry->time_added.tv_sec = time_added;
+    cache_entry->time_added.tv_nsec = 0;
+    cache_entry->max_age = max_age;
+    cache_entry->on_disk = true;
+    __atomic_fetch_add(&disk->stats.hits, 1, __ATOMIC_RELAXED);
+    return cache_entry;
+}
+
+// Given URL hash of an object the origin has confirmed unchanged, and its
+// new freshness lifetime, keep serving the copy on disk for that long.
+// Only held in memory: after a restart the lifetime written with the
+// record applies again
+void disk_cache_refresh(DiskCache *disk, uint64_t hash, time_t time_added, int max_age) {
+    pthread_mutex_lock(&disk->lock);
+    DiskEntry *entry = *index_find(disk, hash);
+    if(entry != NULL) {
+        entry->expires = time_added + max_age;
+        entry->max_age = max_age;
+    }
+    pthread_mutex_unlock(&disk->lock);
+}
+
+// Print disk tier counters and occupancy on a single line
+void disk_cache_print_stats(DiskCache *disk) {
+    pthread_mutex_lock(&disk->lock);
+    size_t entries = disk->entries, bytes_used = disk->bytes_used, queue_bytes = disk->queue_bytes;
+    int segments = 0;
+    for(DiskSegment *segment = disk->oldest; segment != NULL; segment = segment->next) {
+        segments += 1;
+    }
+    pthread_mutex_unlock(&disk->lock);
+    printf("disk hits=%lu misses=%lu writes=%lu dropped=%lu entries=%zu segments=%d bytes_used=%zu "
+           "bytes_capacity=%zu queue_bytes=%zu\n",
+           (unsigned long) __atomic_load_n(&disk->stats.hits, __ATOMIC_RELAXED),
+           (unsigned long) __atomic_load_n(&disk->stats.misses, __ATOMIC_RELAXED),
+           (unsigned long) __atomic_load_n(&disk->stats.writes, __ATOMIC_RELAXED),
+           (unsigned long) __atomic_load_n(&disk->stats.dropped, __ATOMIC_RELAXED),
+           entries, segments, bytes_used, disk->capacity, queue_bytes);
+    fflush(stdout);
+}
+
+//-------------------------------------------------------------------------------------------------
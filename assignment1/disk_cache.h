@@ -0,0 +1,121 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      disk_cache.h
+// Usage:       Header file for the disk tier beneath the in-memory cache
+//*************************************************************************************************
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "cache_entry.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define DEFAULT_DISK_BYTES 1024*1024*1024UL   // Total size of the segment files
+#define DISK_SEGMENT_SIZE (64*1024*1024)      // Largest segment file, and largest object
+#define DISK_TABLE_SIZE 65536                 // Index buckets, power of two
+#define DISK_QUEUE_MAX_BYTES 64*1024*1024     // Responses waiting to be written, beyond
+                                              // which new ones are not written
+#define DISK_RECORD_MAGIC 0x31524b44          // "DKR1"
+
+// ----STRUCT--------------------------------------------------------------------------------------
+
+// Written before each object in a segment: the URL follows, then the
+// response exactly as cached
+typedef struct DiskRecord{
+    uint32_t magic;
+    uint32_t url_length;
+    uint64_t url_hash;
+    uint64_t response_length;
+    int64_t time_added;
+    int32_t max_age;
+    uint32_t check;            // Hash of the fields above, to spot a torn write
+} DiskRecord;
+
+// Entry of a segment's index file, written once the segment is full, so
+// startup can rebuild the index without reading the objects themselves
+typedef struct DiskIndexRecord{
+    DiskRecord record;
+    uint64_t offset;
+} DiskIndexRecord;
+
+// An append-only file of records, mapped whole so hits are written to
+// clients straight from the page cache. Removed once the oldest segment
+// must make room, but only unmapped when no response served from it is
+// still being written
+typedef struct DiskSegment{
+    struct DiskSegment *next;  // Oldest first
+    uint32_t id;
+    int fd;
+    unsigned char *map;
+    size_t size;               // Bytes written
+    int refcount;              // Held by the tier while listed, and by each entry served from it
+} DiskSegment;
+
+// Where the newest record for a URL hash lives
+typedef struct DiskEntry{
+    struct DiskEntry *next;    // Bucket chain
+    uint64_t url_hash;
+    DiskSegment *segment;
+    uint64_t offset;
+    time_t expires;
+    int max_age;               // Differs from the record's once revalidated
+} DiskEntry;
+
+// Counters updated with relaxed atomics
+typedef struct DiskStats{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writes;
+    uint64_t dropped;          // Not written because the queue was full
+} DiskStats;
+
+// Objects added to the memory cache are queued and appended to the newest
+// segment by a writer thread, so a restart or crash finds them on disk.
+// Workers look up the index under the lock and map hits into cache
+// entries without copying them. Space is reclaimed a segment at a time,
+// oldest first
+typedef struct DiskCache{
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    char *directory;
+    size_t capacity;
+    size_t bytes_used;
+    DiskEntry *buckets[DISK_TABLE_SIZE];
+    size_t entries;
+    DiskSegment *oldest;
+    DiskSegment *newest;       // Being appended to
+
+    // Writer queue and the index of the segment being written
+    CacheEntry **queue;
+    size_t queue_head;
+    size_t queue_size;
+    size_t queue_capacity;
+    size_t queue_bytes;
+    bool stopping;
+    pthread_t writer;
+    DiskIndexRecord *segment_index;
+    size_t segment_index_size;
+    size_t segment_index_capacity;
+
+    DiskStats stats;
+} DiskCache;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+DiskCache *disk_cache_open(const char *directory, size_t capacity);
+void disk_cache_close(DiskCache *disk);
+void disk_cache_store(DiskCache *disk, CacheEntry *cache_entry);
+CacheEntry *disk_cache_lookup(DiskCache *disk, const char *url, uint64_t hash);
+void disk_cache_refresh(DiskCache *disk, uint64_t hash, time_t time_added, int max_age);
+void disk_cache_print_stats(DiskCache *disk);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
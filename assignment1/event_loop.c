@@ -0,0 +1,283 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      event_loop.c
+// Usage:       Implementation file for the event loop, backed by epoll or io_uring
+//*************************************************************************************************
+#define _GNU_SOURCE               // accept4
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "event_loop.h"
+#include "uring.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+static const char *BACKEND_NAMES[] = {"epoll", "uring"};
+static EventLoopBackend configured_backend = EVENT_LOOP_EPOLL;
+static pthread_mutex_t reserve_lock = PTHREAD_MUTEX_INITIALIZER;
+static int reserve_fd = -1;      // Held back so clients can be refused once the rest run out
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+// Choose the backend of the loops created from now on. Falls back to
+// epoll if the kernel does not offer io_uring
+void event_loop_configure(EventLoopBackend backend) {
+    if(backend == EVENT_LOOP_URING && !uring_available()) {
+        printf("io_uring is not available, using epoll\n");
+        backend = EVENT_LOOP_EPOLL;
+    }
+    configured_backend = backend;
+}
+
+// Given backend name, store matching backend. Return -1 if name is unknown
+int event_loop_backend_from_name(const char *name, EventLoopBackend *backend) {
+    for(int i = 0; i <= EVENT_LOOP_URING; i++) {
+        if(strcasecmp(name, BACKEND_NAMES[i]) == 0) {
+            *backend = (EventLoopBackend) i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Initialize new event loop backed by an io_uring instance if configured,
+// else, or if the ring cannot be set up, by an epoll instance
+EventLoop *event_loop_create(void) {
+    pthread_mutex_lock(&reserve_lock);
+    if(reserve_fd < 0) {
+        reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    pthread_mutex_unlock(&reserve_lock);
+    EventLoop *loop = malloc(sizeof(EventLoop));
+    loop->epoll_fd = -1;
+    loop->ring = NULL;
+    if(configured_backend == EVENT_LOOP_URING) {
+        loop->ring = uring_create();
+        if(loop->ring == NULL) {
+            perror("Error creating io_uring instance, using epoll");
+        }
+    }
+    if(loop->ring == NULL) {
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if(loop->epoll_fd < 0) {
+            perror("Error creating epoll instance");
+            free(loop);
+            return NULL;
+        }
+    }
+    loop->running = false;
+    loop->garbage = NULL;
+    loop->garbage_size = 0;
+    loop->garbage_capacity = 0;
+    return loop;
+}
+
+// Free the objects released while the last batch was dispatched
+static void collect_garbage(EventLoop *loop) {
+    for(int i = 0; i < loop->garbage_size; i++) {
+        free(loop->garbage[i]);
+    }
+    loop->garbage_size = 0;
+}
+
+void event_loop_free(EventLoop *loop) {
+    collect_garbage(loop);
+    free(loop->garbage);
+    if(loop->ring != NULL) {
+        uring_free(loop->ring);
+    } else {
+        close(loop->epoll_fd);
+    }
+    free(loop);
+}
+
+// Free object after the current batch of events has been dispatched, so
+// that events already returned by epoll_wait never point at freed memory
+void event_loop_defer_free(EventLoop *loop, void *object) {
+    if(loop->garbage_size == loop->garbage_capacity) {
+        loop->garbage_capacity = (loop->garbage_capacity == 0) ? 64 : loop->garbage_capacity * 2;
+        loop->garbage = realloc(loop->garbage, loop->garbage_capacity * sizeof(void *));
+    }
+    loop->garbage[loop->garbage_size] = object;
+    loop->garbage_size += 1;
+}
+
+// Register event source with the loop for the given event mask
+int event_loop_add(EventLoop *loop, EventSource *source, uint32_t events) {
+    source->events = events;
+    if(loop->ring != NULL) {
+        uring_add(loop->ring, source);
+        return 0;
+    }
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = source;
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, source->fd, &event);
+}
+
+// Change the event mask of a registered source. Skips the syscall
+// when the mask is unchanged
+int event_loop_modify(EventLoop *loop, EventSource *source, uint32_t events) {
+    if(source->events == events) {
+        return 0;
+    }
+    source->events = events;
+    if(loop->ring != NULL) {
+        if(source->slot == 0) {
+            errno = ENOENT;
+            return -1;
+        }
+        uring_modify(loop->ring, source);
+        return 0;
+    }
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = source;
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, source->fd, &event);
+}
+
+// Deregister event source. Must be called before the descriptor is closed
+void event_loop_remove(EventLoop *loop, EventSource *source) {
+    if(loop->ring != NULL) {
+        if(source->slot != 0) {
+            uring_remove(loop->ring, source, false);
+        }
+    } else {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    }
+    source->events = 0;
+}
+
+// Deregister event source and close its descriptor. On io_uring the close
+// is queued behind the cancellation of the source's requests
+void event_loop_close(EventLoop *loop, EventSource *source) {
+    if(loop->ring != NULL && source->slot != 0) {
+        uring_remove(loop->ring, source, true);
+    } else {
+        if(loop->ring == NULL) {
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+        }
+        close(source->fd);
+    }
+    source->events = 0;
+}
+
+// Return true if input on source is handed to its receive handler rather
+// than read by the handler of its events
+bool event_loop_receives(EventLoop *loop, EventSource *source) {
+    return loop->ring != NULL && source->receive != NULL;
+}
+
+// Return true if output on source can be handed to the loop to send
+bool event_loop_sends(EventLoop *loop, EventSource *source) {
+    return loop->ring != NULL && source->sent != NULL && source->slot != 0;
+}
+
+// Hand message to the loop to send on source, reporting the result to the
+// source's send handler. The memory the message points to must be kept
+// until then. Return -1 if the send could not be queued
+int event_loop_send(EventLoop *loop, EventSource *source, const struct msghdr *message) {
+    if(!event_loop_sends(loop, source) || !uring_send(loop->ring, source, message)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Accept every pending connection request on listening source and hand
+// each new client socket to its accept handler
+static void accept_pending(EventSource *source) {
+    while(1) {
+        int client_socket = accept4(source->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(client_socket < 0) {
+            if(errno == EMFILE || errno == ENFILE) {
+                event_loop_refuse_pending(source);
+            } else if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                // An aborted handshake only affects this client, so keep
+                // serving everyone else
+                perror("Error accepting connection");
+            }
+            return;
+        }
+        source->accepted(source, client_socket);
+    }
+}
+
+// Wait for ready descriptors and dispatch them to their handlers
+// until the loop is stopped
+void event_loop_run(EventLoop *loop) {
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    loop->running = true;
+    while(loop->running) {
+        if(loop->ring != NULL) {
+            if(uring_wait(loop->ring) < 0) {
+                return;
+            }
+            collect_garbage(loop);
+            continue;
+        }
+        int n_events = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, -1);
+        if(n_events < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("Error waiting for events");
+            return;
+        }
+        for(int i = 0; i < n_events; i++) {
+            EventSource *source = events[i].data.ptr;
+            if(source->accepted != NULL) {
+                accept_pending(source);
+            } else {
+                source->handler(source, events[i].events);
+            }
+        }
+        collect_garbage(loop);
+    }
+}
+
+// The process has run out of descriptors, so the clients waiting on
+// listening source cannot be accepted. Rather than leave them queued in
+// the backlog, with the listener reporting them ready over and over, give
+// up the reserve descriptor to accept each in turn, send it the refusal
+// and close it at once
+void event_loop_refuse_pending(EventSource *source) {
+    pthread_mutex_lock(&reserve_lock);
+    if(reserve_fd < 0) {
+        reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    while(reserve_fd >= 0) {
+        close(reserve_fd);
+        int client_socket = accept4(source->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(client_socket >= 0) {
+            if(source->refusal != NULL) {
+                (void) send(client_socket, source->refusal, strlen(source->refusal), MSG_NOSIGNAL);
+            }
+            close(client_socket);
+        }
+        // Another thread may have taken the descriptor meanwhile, in which
+        // case the next listener to run out tries to get one back
+        reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if(client_socket < 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&reserve_lock);
+}
+
+// Put file descriptor into non-blocking mode
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if(flags < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+//-------------------------------------------------------------------------------------------------
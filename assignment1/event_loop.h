@@ -0,0 +1,85 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      event_loop.h
+// Usage:       Header file for the event loop, backed by epoll or io_uring
+//*************************************************************************************************
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define EVENT_LOOP_MAX_EVENTS 256
+
+// ----STRUCT--------------------------------------------------------------------------------------
+struct EventSource;
+struct Uring;
+typedef void (*EventHandler)(struct EventSource *source, uint32_t events);
+typedef void (*AcceptHandler)(struct EventSource *source, int fd);
+typedef void (*ReceiveHandler)(struct EventSource *source, const char *data, ssize_t size);
+typedef void (*SendHandler)(struct EventSource *source, ssize_t result);
+
+typedef enum EventLoopBackend{
+    EVENT_LOOP_EPOLL,
+    EVENT_LOOP_URING
+} EventLoopBackend;
+
+// A file descriptor registered with the loop. The handler is invoked with
+// the epoll event mask whenever the descriptor becomes ready. A listening
+// socket with an accept handler has it invoked with each new non-blocking
+// client socket instead. On io_uring, a source with a receive handler has
+// its input read by the ring and handed over as it arrives rather than
+// reported as EPOLLIN: a size of 0 is the end of the stream, a negative
+// size an error as -errno. A source with a send handler may have its
+// output sent by the ring too, and is handed the bytes sent or -errno.
+// Clients a listener cannot accept for want of descriptors are sent its
+// refusal, if it has one, and closed
+typedef struct EventSource{
+    int fd;
+    uint32_t events;
+    EventHandler handler;
+    AcceptHandler accepted;
+    ReceiveHandler receive;
+    SendHandler sent;
+    const char *refusal;
+    void *context;
+    int slot;                   // Index in the io_uring backend's table, 0 if not registered
+} EventSource;
+
+// Objects released while events are being dispatched are parked on
+// the garbage list and freed once the current batch has been handled
+typedef struct EventLoop{
+    int epoll_fd;
+    struct Uring *ring;         // NULL when backed by epoll
+    bool running;
+    void **garbage;
+    int garbage_size;
+    int garbage_capacity;
+} EventLoop;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+void event_loop_configure(EventLoopBackend backend);
+int event_loop_backend_from_name(const char *name, EventLoopBackend *backend);
+EventLoop *event_loop_create(void);
+void event_loop_free(EventLoop *loop);
+int event_loop_add(EventLoop *loop, EventSource *source, uint32_t events);
+int event_loop_modify(EventLoop *loop, EventSource *source, uint32_t events);
+void event_loop_remove(EventLoop *loop, EventSource *source);
+void event_loop_close(EventLoop *loop, EventSource *source);
+bool event_loop_receives(EventLoop *loop, EventSource *source);
+bool event_loop_sends(EventLoop *loop, EventSource *source);
+int event_loop_send(EventLoop *loop, EventSource *source, const struct msghdr *message);
+void event_loop_run(EventLoop *loop);
+void event_loop_defer_free(EventLoop *loop, void *object);
+int set_nonblocking(int fd);
+void event_loop_refuse_pending(EventSource *source);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
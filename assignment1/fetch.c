@@ -0,0 +1,922 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      fetch.c
+// Usage:       Implementation file for origin fetches shared by concurrent misses
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "fetch.h"
+#include "metrics.h"
+#include "pool.h"
+#include "prefetch.h"
+#include "worker.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+static void launch_fetch(Fetch *fetch);
+static void start_fetch(Fetch *fetch);
+static void finish_connecting(Fetch *fetch);
+static void send_request(Fetch *fetch);
+static void relay_response(Fetch *fetch);
+static void finish_fetch(Fetch *fetch, FetchState state);
+static void deadline_passed(Timer *timer);
+static void wait_for_origin(Fetch *fetch, unsigned int timeout);
+static int request_connection(Fetch *fetch);
+
+// Given limit on connections each worker keeps to an origin and the
+// cluster of peers, if any, create empty table
+FetchTable *fetch_table_create(int max_origin_connections, const Cluster *cluster) {
+    FetchTable *table = calloc(1, sizeof(FetchTable));
+    table->max_origin_connections = max_origin_connections;
+    table->cluster = cluster;
+    table->connect_timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS;
+    table->read_timeout_ms = DEFAULT_READ_TIMEOUT_MS;
+    table->max_fetches = DEFAULT_MAX_FETCHES;
+    table->max_buffered = (size_t) DEFAULT_MAX_BUFFERED_BYTES;
+    pthread_mutex_init(&table->lock, NULL);
+    return table;
+}
+
+// Given how long each attempt to connect to an origin may take, how long
+// an origin may go without sending more of a response, and how many
+// fetches, holding how many response bytes, may be in flight before misses
+// are shed, set the table's limits. 0 disables any of them. Called before
+// workers start
+void fetch_table_configure(FetchTable *table, unsigned int connect_timeout, unsigned int read_timeout,
+                           int max_fetches, size_t max_buffered) {
+    table->connect_timeout_ms = connect_timeout;
+    table->read_timeout_ms = read_timeout;
+    table->max_fetches = max_fetches;
+    table->max_buffered = max_buffered;
+}
+
+// Only called once every worker has stopped
+void fetch_table_free(FetchTable *table) {
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
+
+void fetch_table_print_stats(FetchTable *table) {
+    printf("fetch origin_requests=%lu coalesced=%lu connections_opened=%lu connections_reused=%lu "
+           "in_flight=%d buffered=%ld\n",
+           (unsigned long) __atomic_load_n(&table->fetches, __ATOMIC_RELAXED),
+           (unsigned long) __atomic_load_n(&table->coalesced, __ATOMIC_RELAXED),
+           (unsigned long) __atomic_load_n(&table->connections_opened, __ATOMIC_RELAXED),
+           (unsigned long) __atomic_load_n(&table->connections_reused, __ATOMIC_RELAXED),
+           __atomic_load_n(&table->in_flight, __ATOMIC_RELAXED),
+           (long) __atomic_load_n(&table->buffered, __ATOMIC_RELAXED));
+    fflush(stdout);
+}
+
+// Add reader to the fetch. Caller holds the fetch lock
+static void add_reader(Fetch *fetch, FetchReader *reader, struct Worker *worker) {
+    reader->worker = worker;
+    reader->sent = 0;
+    reader->prev = NULL;
+    reader->next = fetch->readers;
+    if(fetch->readers != NULL) {
+        fetch->readers->prev = reader;
+    }
+    fetch->readers = reader;
+    fetch->refcount += 1;
+}
+
+// Bring the table's count of response bytes held by fetches in flight up to
+// date with fetch, whose response has grown or been trimmed. A finished
+// fetch counts for nothing, as its response now belongs to the cache or
+// to readers finishing with it. Caller holds the fetch lock
+static void account_buffered(Fetch *fetch) {
+    size_t held = 0;
+    if(fetch->state != FETCH_COMPLETE && fetch->state != FETCH_FAILED) {
+        held = fetch->response->size - fetch->response->trimmed;
+    }
+    __atomic_fetch_add(&fetch->table->buffered, (int64_t) held - (int64_t) fetch->buffered, __ATOMIC_RELAXED);
+    fetch->buffered = held;
+}
+
+// Return true if another fetch may start: fewer are in flight, and their
+// responses hold fewer bytes, than the limits. Caller holds the table lock
+static bool admissible(FetchTable *table) {
+    return (table->max_fetches == 0 || table->in_flight < table->max_fetches) &&
+           (table->max_buffered == 0 ||
+            __atomic_load_n(&table->buffered, __ATOMIC_RELAXED) < (int64_t) table->max_buffered);
+}
+
+// Drop one reference, freeing the fetch once nobody uses it. A cached
+// response belongs to its cache entry, otherwise it is freed here
+static void fetch_release(Fetch *fetch) {
+    pthread_mutex_lock(&fetch->lock);
+    fetch->refcount -= 1;
+    bool unused = (fetch->refcount == 0);
+    pthread_mutex_unlock(&fetch->lock);
+    if(!unused) {
+        return;
+    }
+    if(fetch->cache_entry != NULL) {
+        CacheEntry_release(fetch->cache_entry);
+    }
+    if(fetch->cache_entry == NULL || fetch->not_modified) {
+        buffer_free(fetch->response);
+    }
+    if(fetch->stale_entry != NULL) {
+        CacheEntry_release(fetch->stale_entry);
+    }
+    pthread_mutex_destroy(&fetch->lock);
+    pool_free_string(fetch->url);
+    if(fetch->range != NULL) {
+        pool_free_string(fetch->range);
+    }
+    free(fetch->request);
+    pool_free(fetch, sizeof(Fetch));
+}
+
+// Given table, worker, URL and its hash, the byte range to ask for or NULL,
+// the client's request and any stale cached copy of the URL, create a
+// fetch and add it to the in-flight table.
+// A stale copy with validators is revalidated rather than fetched again,
+// and the fetch keeps the caller's reference to it. Caller holds the table
+// lock, and starts the fetch with launch_fetch once it is dropped
+static Fetch *create_fetch(FetchTable *table, struct Worker *worker, char *url, uint64_t hash, const char *range,
+                           char *request, size_t request_size, CacheEntry *stale_entry) {
+    Fetch *fetch = pool_calloc(sizeof(Fetch));
+    pthread_mutex_init(&fetch->lock, NULL);
+    fetch->table = table;
+    fetch->worker = worker;
+    fetch->refcount = 1;        // Held by the origin side until it finishes
+    timer_init(&fetch->deadline, deadline_passed, fetch);
+    fetch->url = pool_strdup(url);
+    fetch->url_hash = hash;
+    if(range != NULL) {
+        fetch->range = pool_strdup(range);
+        metrics_add(METRIC_RANGE_FILLS, 1);
+    }
+    fetch->request = malloc(request_size);
+    memcpy(fetch->request, request, request_size);
+    fetch->request_size = request_size;
+    fetch->response = buffer_create();
+    fetch->cacheable = true;
+    if(stale_entry != NULL && (stale_entry->etag != NULL || stale_entry->last_modified != NULL)) {
+        fetch->stale_entry = stale_entry;
+        fetch->held = true;
+    } else if(stale_entry != NULL) {
+        CacheEntry_release(stale_entry);
+    }
+    size_t bucket = hash & (FETCH_TABLE_SIZE - 1);
+    fetch->next = table->buckets[bucket];
+    table->buckets[bucket] = fetch;
+    table->in_flight += 1;
+    return fetch;
+}
+
+// Start a fetch made by create_fetch on the event loop of its worker
+static void launch_fetch(Fetch *fetch) {
+    struct Worker *worker = fetch->worker;
+    __atomic_fetch_add(&fetch->table->fetches, 1, __ATOMIC_RELAXED);
+
+    // Owned fetches are checked for resume requests when the worker is woken
+    fetch->worker_next = worker->fetches_owned;
+    if(worker->fetches_owned != NULL) {
+        worker->fetches_owned->worker_prev = fetch;
+    }
+    worker->fetches_owned = fetch;
+    start_fetch(fetch);
+}
+
+// Return true if fetch is for the given URL and byte range, or whole
+// response if range is NULL
+static bool fetch_matches(Fetch *fetch, const char *url, uint64_t hash, const char *range) {
+    if(fetch->url_hash != hash || strcmp(fetch->url, url) != 0) {
+        return false;
+    }
+    return (range == NULL) ? fetch->range == NULL : fetch->range != NULL && strcmp(fetch->range, range) == 0;
+}
+
+// Given table, worker, URL and the client's request, attach reader to the
+// fetch already in flight for the URL, or start a new one on the worker's
+// event loop. A fetch that completed after the caller missed has already
+// cached its response, so in that case NULL is returned and the entry is
+// stored in cache_entry with a reference held. Readers of a revalidation
+// the origin answers with 304 are served the refreshed cached copy instead.
+// Given a byte range, the fetch asks the origin for just that range, and
+// is only shared with readers wanting the same one. A new fetch past the
+// table's limits is not started, and NULL is returned with no entry
+Fetch *fetch_subscribe(FetchTable *table, struct Worker *worker, char *url, const char *range, char *request,
+                       size_t request_size, FetchReader *reader, CacheEntry **cache_entry) {
+    uint64_t hash = url_hash(url);
+    size_t bucket = hash & (FETCH_TABLE_SIZE - 1);
+    *cache_entry = NULL;
+
+    pthread_mutex_lock(&table->lock);
+    for(Fetch *fetch = table->buckets[bucket]; fetch != NULL; fetch = fetch->next) {
+        if(!fetch_matches(fetch, url, hash, range)) {
+            continue;
+        }
+        // Readers can only join while the start of the response is still held
+        pthread_mutex_lock(&fetch->lock);
+        bool joinable = (fetch->state != FETCH_FAILED && fetch->response->trimmed == 0);
+        if(joinable) {
+            add_reader(fetch, reader, worker);
+        }
+        pthread_mutex_unlock(&fetch->lock);
+        if(joinable) {
+            pthread_mutex_unlock(&table->lock);
+            __atomic_fetch_add(&table->coalesced, 1, __ATOMIC_RELAXED);
+            return fetch;
+        }
+    }
+
+    // Nothing in flight. Completed fetches cache their response before they
+    // leave the table, so look in the cache once more. Ranges are left to
+    // the caller, which looked for them in the cache already
+    CacheEntry *cached_entry = (range == NULL) ? cache_retrieval(worker->cache, url) : NULL;
+    if(cached_entry != NULL && cache_entry_valid(cached_entry)) {
+        pthread_mutex_unlock(&table->lock);
+        *cache_entry = cached_entry;
+        return NULL;
+    }
+    if(!admissible(table)) {
+        pthread_mutex_unlock(&table->lock);
+        if(cached_entry != NULL) {
+            CacheEntry_release(cached_entry);
+        }
+        return NULL;
+    }
+    Fetch *fetch = create_fetch(table, worker, url, hash, range, request, request_size, cached_entry);
+    fetch->for_peer = reader->peer;
+    add_reader(fetch, reader, worker);
+    pthread_mutex_unlock(&table->lock);
+    launch_fetch(fetch);
+    return fetch;
+}
+
+// Given table, worker, URL and a client's request for it, refresh the
+// stale cached copy of the URL in the background, unless a fetch for it is
+// already in flight or the table is at its limits. The fetch has no
+// readers and only updates the cache
+void fetch_revalidate(FetchTable *table, struct Worker *worker, char *url, char *request,
+                      size_t request_size) {
+    uint64_t hash = url_hash(url);
+    size_t bucket = hash & (FETCH_TABLE_SIZE - 1);
+    pthread_mutex_lock(&table->lock);
+    if(!admissible(table)) {
+        pthread_mutex_unlock(&table->lock);
+        return;
+    }
+    for(Fetch *fetch = table->buckets[bucket]; fetch != NULL; fetch = fetch->next) {
+        if(fetch_matches(fetch, url, hash, NULL)) {
+            pthread_mutex_unlock(&table->lock);
+            return;
+        }
+    }
+    // Another revalidation may have finished since the caller looked
+    CacheEntry *cached_entry = cache_retrieval(worker->cache, url);
+    if(cached_entry != NULL && cache_entry_valid(cached_entry)) {
+        pthread_mutex_unlock(&table->lock);
+        CacheEntry_release(cached_entry);
+        return;
+    }
+    Fetch *fetch = create_fetch(table, worker, url, hash, NULL, request, request_size, cached_entry);
+    pthread_mutex_unlock(&table->lock);
+    launch_fetch(fetch);
+}
+
+// Given table, worker, URL of a link found in a cached page and the page's
+// upstream request as a template, fetch the URL into the cache with no
+// reader, as fetch_revalidate does. A stale copy is revalidated. Return
+// false, starting nothing, if the URL is cached fresh, already in flight
+// or owned by another peer, which caches it when a client asks for it, or
+// if the table is at its limits
+bool fetch_prefetch(FetchTable *table, struct Worker *worker, char *url, char *request, size_t request_size) {
+    if(table->cluster != NULL && cluster_owner(table->cluster, url) != NULL) {
+        return false;
+    }
+    uint64_t hash = url_hash(url);
+    pthread_mutex_lock(&table->lock);
+    if(!admissible(table)) {
+        pthread_mutex_unlock(&table->lock);
+        return false;
+    }
+    for(Fetch *fetch = table->buckets[hash & (FETCH_TABLE_SIZE - 1)]; fetch != NULL; fetch = fetch->next) {
+        if(fetch_matches(fetch, url, hash, NULL)) {
+            pthread_mutex_unlock(&table->lock);
+            return false;
+        }
+    }
+    CacheEntry *cached_entry = cache_retrieval(worker->cache, url);
+    if(cached_entry != NULL && cache_entry_valid(cached_entry)) {
+        pthread_mutex_unlock(&table->lock);
+        CacheEntry_release(cached_entry);
+        return false;
+    }
+    Fetch *fetch = create_fetch(table, worker, url, hash, NULL, request, request_size, cached_entry);
+    fetch->prefetch = true;
+    pthread_mutex_unlock(&table->lock);
+    launch_fetch(fetch);
+    return true;
+}
+
+// Return smallest amount written by any reader. Caller holds the fetch lock
+static size_t slowest_reader(Fetch *fetch) {
+    size_t sent = fetch->response->size;
+    for(FetchReader *reader = fetch->readers; reader != NULL; reader = reader->next) {
+        if(reader->sent < sent) {
+            sent = reader->sent;
+        }
+    }
+    return sent;
+}
+
+// Once a response is too large to cache, free what every reader has
+// written, and ask for the origin to be resumed when the slowest reader has
+// caught up. Return true if the origin should be resumed. Caller holds the
+// fetch lock
+static bool release_written(Fetch *fetch) {
+    if(fetch->cacheable) {
+        return false;
+    }
+    size_t sent = slowest_reader(fetch);
+    buffer_trim(fetch->response, sent);
+    account_buffered(fetch);
+    if(fetch->paused && !fetch->resume_requested &&
+       fetch->response->size - sent <= (size_t) FETCH_HIGH_WATER_MARK) {
+        fetch->resume_requested = true;
+        return true;
+    }
+    return false;
+}
+
+// Ask the worker running the fetch to start reading from the origin again
+static void request_resume(Fetch *fetch, FetchReader *reader) {
+    if(reader != NULL && reader->worker == fetch->worker) {
+        fetch_resume_requested(fetch);
+    } else {
+        worker_notify(fetch->worker);
+    }
+}
+
+// Detach reader from fetch, dropping its reference
+void fetch_unsubscribe(Fetch *fetch, FetchReader *reader) {
+    pthread_mutex_lock(&fetch->lock);
+    if(reader->prev != NULL) {
+        reader->prev->next = reader->next;
+    } else {
+        fetch->readers = reader->next;
+    }
+    if(reader->next != NULL) {
+        reader->next->prev = reader->prev;
+    }
+    bool resume = release_written(fetch);
+    pthread_mutex_unlock(&fetch->lock);
+    if(resume) {
+        request_resume(fetch, reader);
+    }
+    fetch_release(fetch);
+}
+
+// Describe response bytes from start onwards as at most max_iov iovecs,
+// storing the bytes received so far in available and the fetch state in
+// state. The described bytes stay in place until the reader reports them
+// written with fetch_advance. Return number of iovecs filled
+int fetch_describe(Fetch *fetch, size_t start, struct iovec *iov, int max_iov,
+                   size_t *available, FetchState *state) {
+    pthread_mutex_lock(&fetch->lock);
+    *available = fetch->held ? 0 : fetch->response->size;
+    *state = fetch->state;
+    int count = buffer_iovec(fetch->response, start, *available, iov, max_iov);
+    pthread_mutex_unlock(&fetch->lock);
+    return count;
+}
+
+// Record that reader has written sent bytes of the response
+void fetch_advance(Fetch *fetch, FetchReader *reader, size_t sent) {
+    pthread_mutex_lock(&fetch->lock);
+    reader->sent = sent;
+    bool resume = release_written(fetch);
+    pthread_mutex_unlock(&fetch->lock);
+    if(resume) {
+        request_resume(fetch, reader);
+    }
+}
+
+// Resume reading from the origin if a reader has asked for it. Only called
+// on the worker running the fetch
+void fetch_resume_requested(Fetch *fetch) {
+    pthread_mutex_lock(&fetch->lock);
+    bool resume = fetch->resume_requested;
+    fetch->resume_requested = false;
+    if(resume) {
+        fetch->paused = false;
+    }
+    pthread_mutex_unlock(&fetch->lock);
+    if(resume && fetch->upstream != NULL) {
+        if(event_loop_add(fetch->worker->loop, &fetch->upstream->source, EPOLLIN) < 0) {
+            perror("Error registering server socket");
+            finish_fetch(fetch, FETCH_FAILED);
+            return;
+        }
+        wait_for_origin(fetch, fetch->table->read_timeout_ms);
+    }
+}
+
+// Give the origin timeout milliseconds from now to connect, or to take or
+// send more bytes. 0 leaves the fetch without a deadline
+static void wait_for_origin(Fetch *fetch, unsigned int timeout) {
+    fetch->last_progress = fetch->worker->timers.now;
+    if(timeout > 0) {
+        timer_set(&fetch->worker->timers, &fetch->deadline, timeout);
+    } else {
+        timer_cancel(&fetch->deadline);
+    }
+}
+
+// Move fetch to the given state. Only the worker running the fetch changes
+// its state, but readers on other workers look at it under the lock
+static void set_state(Fetch *fetch, FetchState state) {
+    pthread_mutex_lock(&fetch->lock);
+    fetch->state = state;
+    pthread_mutex_unlock(&fetch->lock);
+}
+
+// Wake every worker with a reader of the fetch. Readers on the worker
+// running the fetch are served straight away
+static void notify_readers(Fetch *fetch) {
+    uint64_t workers = 0;
+    pthread_mutex_lock(&fetch->lock);
+    for(FetchReader *reader = fetch->readers; reader != NULL; reader = reader->next) {
+        workers |= (uint64_t) 1 << reader->worker->id;
+    }
+    pthread_mutex_unlock(&fetch->lock);
+    for(int id = 0; workers != 0; id++, workers >>= 1) {
+        if((workers & 1) == 0) {
+            continue;
+        }
+        struct Worker *worker = fetch->table->workers[id];
+        if(worker == fetch->worker) {
+            worker_process_waiting(worker);
+        } else {
+            worker_notify(worker);
+        }
+    }
+}
+
+// Dispatch readiness of the origin connection to the current state
+void fetch_handle_upstream_event(Fetch *fetch, uint32_t events) {
+    (void) events;
+    if(fetch->state == FETCH_CONNECTING) {
+        finish_connecting(fetch);
+    } else if(fetch->state == FETCH_SENDING_REQUEST) {
+        send_request(fetch);
+    } else if(fetch->state == FETCH_RELAYING) {
+        relay_response(fetch);
+    }
+}
+
+// Given fetch, return the peer owning its URL that the response should be
+// asked of, or NULL to ask the origin. Requests from a peer always go to
+// the origin, so a request is passed on at most once even while peers
+// disagree about the members. A background refresh has no client to pass
+// the peer's copy on to, so refreshes the local copy from the origin
+static const ClusterPeer *fetch_peer(Fetch *fetch) {
+    const Cluster *cluster = fetch->table->cluster;
+    if(cluster == NULL || fetch->peer_failed || fetch->readers == NULL || fetch->for_peer) {
+        return NULL;
+    }
+    return cluster_owner(cluster, fetch->url);
+}
+
+// Work out the origin from the URL, rewrite the client's request for it
+// and ask the worker's pool for a connection. A URL a peer owns is asked
+// of the peer over the pool's connections to it, and its response is
+// left to the peer to cache
+static void start_fetch(Fetch *fetch) {
+    // The URL is a cache key, so already normalized
+    HttpField host;
+    HttpField path;
+    if(!http_split_url(fetch->url, &host, &fetch->server_port, &path) ||
+       host.length >= FETCH_HOSTNAME_MAX_SIZE) {
+        finish_fetch(fetch, FETCH_FAILED);
+        return;
+    }
+    memcpy(fetch->hostname, fetch->url + host.offset, host.length);
+    fetch->hostname[host.length] = '\0';
+    fetch->peer = fetch_peer(fetch);
+
+    UpstreamPool *pool = fetch->worker->upstream;
+    size_t request_size;
+    CacheEntry *stale_entry = fetch->stale_entry;
+    char *request = http_upstream_request(fetch->request, fetch->request_size,
+                                          (fetch->peer != NULL) ? fetch->url : fetch->url + path.offset,
+                                          fetch->hostname, fetch->server_port, pool->max_connections > 0,
+                                          fetch->peer != NULL,
+                                          (stale_entry != NULL) ? stale_entry->etag : NULL,
+                                          (stale_entry != NULL) ? stale_entry->last_modified : NULL,
+                                          fetch->range, &request_size);
+    if(request == NULL) {
+        finish_fetch(fetch, FETCH_FAILED);
+        return;
+    }
+    free(fetch->request);
+    fetch->request = request;
+    fetch->request_size = request_size;
+    if(fetch->peer != NULL) {
+        strcpy(fetch->hostname, fetch->peer->hostname);
+        fetch->server_port = fetch->peer->port;
+        fetch->cacheable = false;
+        metrics_add(METRIC_PEER_FETCHES, 1);
+    }
+
+    if(request_connection(fetch) < 0) {
+        finish_fetch(fetch, FETCH_FAILED);
+    }
+}
+
+// Ask the worker's pool for a connection to the fetch's origin. The
+// connect timeout covers waiting for the pool to look the origin up or
+// free a connection as well as the connect itself. Return -1 if a
+// connection could not be opened
+static int request_connection(Fetch *fetch) {
+    set_state(fetch, FETCH_QUEUED);
+    wait_for_origin(fetch, fetch->table->connect_timeout_ms);
+    return upstream_acquire(fetch->worker->upstream, fetch);
+}
+
+// Given connection to the origin, send the request on it straight away
+// if it is already open, otherwise once the connect completes
+void fetch_attach(Fetch *fetch, UpstreamConnection *conn) {
+    fetch->upstream = conn;
+    fetch->request_sent = 0;
+    http_framing_init(&fetch->framing);
+    if(conn->connected) {
+        set_state(fetch, FETCH_SENDING_REQUEST);
+        wait_for_origin(fetch, fetch->table->read_timeout_ms);
+        send_request(fetch);
+    } else {
+        set_state(fetch, FETCH_CONNECTING);
+    }
+}
+
+// A fetch queued for a connection that could not be opened
+void fetch_fail(Fetch *fetch) {
+    finish_fetch(fetch, FETCH_FAILED);
+}
+
+// A pooled connection may have been closed by the origin just as the
+// request was sent on it. Return true if nothing has been received yet,
+// in which case the request is retried on another connection
+static bool retry_on_new_connection(Fetch *fetch) {
+    UpstreamConnection *conn = fetch->upstream;
+    if(conn->requests == 0 || fetch->framing.header_length > 0) {
+        return false;
+    }
+    fetch->upstream = NULL;
+    upstream_release(fetch->worker->upstream, conn, false);
+    if(request_connection(fetch) < 0) {
+        finish_fetch(fetch, FETCH_FAILED);
+    }
+    return true;
+}
+
+// A peer that could not be reached, or closed the connection before
+// answering, leaves the fetch to the origin. Return true if the fetch has
+// been restarted that way
+static bool fall_back_to_origin(Fetch *fetch) {
+    if(fetch->peer == NULL || fetch->response->size > 0) {
+        return false;
+    }
+    if(fetch->upstream != NULL) {
+        UpstreamConnection *conn = fetch->upstream;
+        fetch->upstream = NULL;
+        upstream_release(fetch->worker->upstream, conn, false);
+    }
+    fetch->peer = NULL;
+    fetch->peer_failed = true;
+    fetch->connect_failures = 0;
+    fetch->cacheable = true;
+    metrics_add(METRIC_PEER_FALLBACKS, 1);
+    start_fetch(fetch);
+    return true;
+}
+
+// Given error a connect to the origin failed with, try again or fail the
+// fetch. New connections go to the origin's addresses in turn, so trying
+// again moves on to the next one. A peer is given up on at once
+static void connect_failed(Fetch *fetch, int error) {
+    errno = error;
+    perror("Unable to connect to server");
+    fetch->connect_failures += 1;
+    if(fetch->peer == NULL && fetch->connect_failures < FETCH_CONNECT_ATTEMPTS) {
+        UpstreamConnection *conn = fetch->upstream;
+        fetch->upstream = NULL;
+        upstream_release(fetch->worker->upstream, conn, false);
+        if(request_connection(fetch) == 0) {
+            return;
+        }
+    }
+    finish_fetch(fetch, FETCH_FAILED);
+}
+
+// Check outcome of the non-blocking connect and start sending the request
+static void finish_connecting(Fetch *fetch) {
+    int error = 0;
+    socklen_t error_size = sizeof(error);
+    getsockopt(fetch->upstream->source.fd, SOL_SOCKET, SO_ERROR, &error, &error_size);
+    if(error != 0) {
+        connect_failed(fetch, error);
+        return;
+    }
+    fetch->upstream->connected = true;
+    metrics_record(METRIC_ORIGIN_CONNECT, fetch->upstream->connect_started);
+    set_state(fetch, FETCH_SENDING_REQUEST);
+    wait_for_origin(fetch, fetch->table->read_timeout_ms);
+    send_request(fetch);
+}
+
+// The fetch has not got a connection to the origin in time, or the origin
+// has gone the read timeout without taking or sending any bytes, so the
+// attempt is given up on. Progress only records its tick, and the deadline
+// is moved on when it comes round, so reading a response never has to
+// touch the wheel
+static void deadline_passed(Timer *timer) {
+    Fetch *fetch = timer->context;
+    if(fetch->state == FETCH_QUEUED) {
+        metrics_add(METRIC_ORIGIN_TIMEOUTS, 1);
+        upstream_cancel(fetch->worker->upstream, fetch);
+        finish_fetch(fetch, FETCH_FAILED);
+        return;
+    }
+    if(fetch->state == FETCH_CONNECTING) {
+        metrics_add(METRIC_ORIGIN_TIMEOUTS, 1);
+        connect_failed(fetch, ETIMEDOUT);
+        return;
+    }
+    if(fetch->state != FETCH_SENDING_REQUEST && fetch->state != FETCH_RELAYING) {
+        return;
+    }
+    TimerWheel *timers = &fetch->worker->timers;
+    uint64_t allowed = timer_ticks(fetch->table->read_timeout_ms);
+    uint64_t quiet = timers->now - fetch->last_progress;
+    if(quiet < allowed) {
+        timer_set(timers, timer, (allowed - quiet) * TIMER_TICK_MS);
+        return;
+    }
+    metrics_add(METRIC_ORIGIN_TIMEOUTS, 1);
+    finish_fetch(fetch, FETCH_FAILED);
+}
+
+// Write client request to server
+static void send_request(Fetch *fetch) {
+    EventSource *server = &fetch->upstream->source;
+    while(fetch->request_sent < fetch->request_size) {
+        ssize_t bytes_written = write(server->fd, fetch->request + fetch->request_sent,
+                                      fetch->request_size - fetch->request_sent);
+        if(bytes_written < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                if(server->events != EPOLLOUT) {
+                    event_loop_modify(fetch->worker->loop, server, EPOLLOUT);
+                }
+                return;
+            }
+            if(retry_on_new_connection(fetch)) {
+                return;
+            }
+            perror("Error writing request to server");
+            finish_fetch(fetch, FETCH_FAILED);
+            return;
+        }
+        fetch->request_sent += bytes_written;
+        fetch->last_progress = fetch->worker->timers.now;
+    }
+    fetch->request_sent_at = metrics_now();
+    set_state(fetch, FETCH_RELAYING);
+    event_loop_modify(fetch->worker->loop, server, EPOLLIN);
+}
+
+// Given bytes just read into the response buffer, commit those that
+// belong to the response, parsing its header once it is complete. Return
+// number of bytes committed; anything beyond them was sent past the end
+// of the response. Called on the fetch's worker with the lock held
+static size_t commit_response(Fetch *fetch, unsigned char *data, size_t size) {
+    HttpFraming *framing = &fetch->framing;
+    size_t used = 0;
+    while(used < size && framing->state != HTTP_FRAMING_COMPLETE) {
+        size_t n = http_framing_feed(framing, data + used, size - used);
+        buffer_commit(fetch->response, n);
+        used += n;
+        if(framing->state == HTTP_FRAMING_HEADER_END) {
+            // Headers larger than a chunk cannot be parsed in place. The
+            // response is still relayed, ending when the origin closes, but
+            // with neither its status nor its freshness known it is not cached
+            size_t head_size;
+            unsigned char *head = buffer_head(fetch->response, &head_size);
+            if(head_size < framing->header_length ||
+               http_framing_parse_header(framing, head, framing->header_length, &fetch->header) < 0) {
+                framing->state = HTTP_FRAMING_BODY;
+                framing->body = HTTP_BODY_CLOSE;
+                framing->keep_alive = false;
+                fetch->cacheable = false;
+            }
+            // Responses the origin does not let a shared cache store are
+            // only relayed. A 206 answering a range is kept as part of its
+            // object, and a 304 refreshes the stale copy. Any answer to a
+            // conditional request but 304 goes to the readers
+            fetch->not_modified = (fetch->stale_entry != NULL && framing->status == 304);
+            bool partial = (fetch->range != NULL && fetch->header.status == 206);
+            if(fetch->header.no_store || fetch->header.is_private ||
+               !(partial || fetch->not_modified || http_response_storable(&fetch->header))) {
+                fetch->cacheable = false;
+            }
+            fetch->held = fetch->not_modified;
+        }
+    }
+    return used;
+}
+
+// Read response from server as it arrives and wake the readers after each
+// piece. The response ends where its framing says, leaving the connection
+// free for the next request, or when the origin closes the connection.
+// Responses that grow too large to cache are freed as every reader
+// writes them, and reading pauses while the slowest reader falls behind.
+// Nobody is left to serve a response that will not be cached once every
+// reader has gone, so the fetch is abandoned
+static void relay_response(Fetch *fetch) {
+    EventSource *server = &fetch->upstream->source;
+    while(fetch->state == FETCH_RELAYING && !fetch->paused) {
+        // Appending may link a new chunk, which readers must not see half done.
+        // Bytes past the committed size are never described, so the read
+        // itself happens without the lock
+        size_t space;
+        pthread_mutex_lock(&fetch->lock);
+        unsigned char *data = buffer_reserve(fetch->response, &space);
+        pthread_mutex_unlock(&fetch->lock);
+        ssize_t bytes_read = read(server->fd, data, space);
+        if(bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if(bytes_read <= 0) {
+            if(retry_on_new_connection(fetch)) {
+                return;
+            }
+            if(bytes_read < 0) {
+                perror("Error reading response from server");
+            }
+            finish_fetch(fetch, http_framing_eof(&fetch->framing) ? FETCH_COMPLETE : FETCH_FAILED);
+            return;
+        }
+
+        if(fetch->framing.header_length == 0) {
+            metrics_record(METRIC_ORIGIN_FIRST_BYTE, fetch->request_sent_at);
+        }
+        fetch->last_progress = fetch->worker->timers.now;
+        metrics_add(METRIC_ORIGIN_BYTES, bytes_read);
+
+        pthread_mutex_lock(&fetch->lock);
+        size_t used = commit_response(fetch, data, bytes_read);
+        if(used < (size_t) bytes_read) {
+            fetch->framing.keep_alive = false;
+        }
+        bool complete = (fetch->framing.state == HTTP_FRAMING_COMPLETE);
+        if(fetch->cacheable && !cache_admissible(fetch->worker->cache, fetch->response->size)) {
+            fetch->cacheable = false;
+        }
+        bool abandoned = !fetch->cacheable && fetch->readers == NULL;
+        if(!fetch->cacheable) {
+            size_t sent = slowest_reader(fetch);
+            buffer_trim(fetch->response, sent);
+            fetch->paused = !complete && (fetch->response->size - sent > (size_t) FETCH_HIGH_WATER_MARK);
+        }
+        account_buffered(fetch);
+        pthread_mutex_unlock(&fetch->lock);
+        if(complete) {
+            finish_fetch(fetch, FETCH_COMPLETE);
+            return;
+        }
+        if(abandoned) {
+            finish_fetch(fetch, FETCH_FAILED);
+            return;
+        }
+        if(fetch->paused) {
+            // The origin is not late while the proxy is not reading it
+            event_loop_remove(fetch->worker->loop, server);
+            timer_cancel(&fetch->deadline);
+        }
+        notify_readers(fetch);
+    }
+}
+
+// Close the origin side of the fetch and take it out of the in-flight table.
+// A complete response is handed to a new cache entry without copying it
+// before the fetch leaves the table, so later misses find it in the cache
+static void finish_fetch(Fetch *fetch, FetchState state) {
+    timer_cancel(&fetch->deadline);
+    if(fall_back_to_origin(fetch)) {
+        return;
+    }
+    // The connection goes back to the pool only if the response ended
+    // cleanly where its framing said and the origin will take another request
+    if(fetch->upstream != NULL) {
+        UpstreamConnection *conn = fetch->upstream;
+        bool reusable = (state == FETCH_COMPLETE && fetch->framing.keep_alive &&
+                         fetch->framing.state == HTTP_FRAMING_COMPLETE);
+        fetch->upstream = NULL;
+        if(conn->source.events == 0) {
+            event_loop_add(fetch->worker->loop, &conn->source, EPOLLIN);
+        }
+        upstream_release(fetch->worker->upstream, conn, reusable);
+    }
+
+    // A stale copy confirmed unchanged is refreshed before readers are told,
+    // so they serve it with its new age
+    Cache *cache = fetch->worker->cache;
+    if(state == FETCH_COMPLETE && fetch->not_modified) {
+        cache_refresh(cache, fetch->stale_entry, &fetch->header);
+        __atomic_fetch_add(&cache->stats.revalidated_304, 1, __ATOMIC_RELAXED);
+    } else if(state == FETCH_COMPLETE && fetch->stale_entry != NULL) {
+        __atomic_fetch_add(&cache->stats.revalidated_200, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&fetch->lock);
+    if(state == FETCH_COMPLETE && fetch->response->size == 0) {
+        state = FETCH_FAILED;
+    }
+    if(state == FETCH_COMPLETE && fetch->not_modified) {
+        CacheEntry_acquire(fetch->stale_entry);
+        fetch->cache_entry = fetch->stale_entry;
+    } else if(state == FETCH_COMPLETE && fetch->cacheable) {
+        // Shrinking the last chunk moves it, which is only safe when no
+        // reader could be writing from it right now: none on another
+        // worker, and none here with a send from it still in flight
+        bool shared = false;
+        for(FetchReader *reader = fetch->readers; reader != NULL; reader = reader->next) {
+            shared |= (reader->worker != fetch->worker || reader->sending);
+        }
+        if(!shared) {
+            buffer_compact(fetch->response);
+        }
+        // A range the origin answered with the whole response is cached
+        // as the whole object. Any other answer to a range is not cached
+        if(fetch->range == NULL || fetch->header.status == 200) {
+            fetch->cache_entry = CacheEntry_create(fetch->url, fetch->response, &fetch->header);
+            if(fetch->prefetch) {
+                prefetch_cached(fetch->cache_entry, fetch->readers != NULL);
+            }
+        } else if(fetch->header.status == 206) {
+            fetch->cache_entry = cache_partial_create(cache, fetch->url, fetch->response, &fetch->header);
+        }
+    }
+    fetch->delimited = (state == FETCH_COMPLETE && fetch->framing.body != HTTP_BODY_CLOSE);
+    fetch->state = state;
+    account_buffered(fetch);
+    pthread_mutex_unlock(&fetch->lock);
+    if(state == FETCH_COMPLETE) {
+        metrics_add(METRIC_ORIGIN_RESPONSES, 1);
+        metrics_record(METRIC_ORIGIN_RESPONSE, fetch->request_sent_at);
+    } else {
+        metrics_add(METRIC_ORIGIN_FAILURES, 1);
+    }
+    if(fetch->cache_entry != NULL && !fetch->not_modified) {
+        cache_add(cache, fetch->cache_entry);
+    }
+
+    FetchTable *table = fetch->table;
+    pthread_mutex_lock(&table->lock);
+    Fetch **link = &table->buckets[fetch->url_hash & (FETCH_TABLE_SIZE - 1)];
+    while(*link != NULL && *link != fetch) {
+        link = &(*link)->next;
+    }
+    if(*link != NULL) {
+        *link = fetch->next;
+        table->in_flight -= 1;
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    struct Worker *worker = fetch->worker;
+    if(fetch->worker_prev != NULL) {
+        fetch->worker_prev->worker_next = fetch->worker_next;
+    } else {
+        worker->fetches_owned = fetch->worker_next;
+    }
+    if(fetch->worker_next != NULL) {
+        fetch->worker_next->worker_prev = fetch->worker_prev;
+    }
+
+    notify_readers(fetch);
+    // Pages are scanned for links once cached, and each prefetch that
+    // finishes frees a slot for the next
+    if(fetch->prefetch) {
+        prefetch_finished(worker);
+    } else if(fetch->cache_entry != NULL && !fetch->not_modified) {
+        prefetch_scan(fetch);
+    }
+    fetch_release(fetch);
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,162 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      fetch.h
+// Usage:       Header file for origin fetches shared by concurrent misses
+//*************************************************************************************************
+#ifndef FETCH_H
+#define FETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "buffer.h"
+#include "cache.h"
+#include "cluster.h"
+#include "event_loop.h"
+#include "http.h"
+#include "timer.h"
+#include "upstream.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define FETCH_TABLE_SIZE 1024                 // Buckets in the in-flight table, power of two
+#define FETCH_MAX_WORKERS 64                  // Workers are tracked in a 64-bit mask
+#define FETCH_HIGH_WATER_MARK 1024*1024       // Unsent bytes at which reading from an
+                                              // origin whose response is not cached pauses
+#define FETCH_HOSTNAME_MAX_SIZE 256           // Longest DNS name, plus the NUL
+#define FETCH_CONNECT_ATTEMPTS 3              // Addresses of an origin tried before failing
+#define DEFAULT_CONNECT_TIMEOUT_MS 5000       // For each attempt to connect to an origin
+#define DEFAULT_READ_TIMEOUT_MS 10000         // For an origin to send more of a response, and a
+                                              // client to finish sending a request it has begun
+#define DEFAULT_MAX_FETCHES 4096              // In flight at once, beyond which misses are shed
+#define DEFAULT_MAX_BUFFERED_BYTES 256*1024*1024 // Response bytes held by fetches in flight,
+                                                 // beyond which misses are shed
+
+// ----STRUCT--------------------------------------------------------------------------------------
+struct Worker;
+
+// A fetch talks to the origin through these states in order. Fetches
+// given an idle pooled connection skip straight to sending the request
+typedef enum FetchState{
+    FETCH_QUEUED,              // Waiting for a connection to the origin
+    FETCH_CONNECTING,
+    FETCH_SENDING_REQUEST,
+    FETCH_RELAYING,
+    FETCH_COMPLETE,
+    FETCH_FAILED
+} FetchState;
+
+// One client reading a fetch, embedded in its connection. Readers record
+// how much of the response they have written so that data every reader
+// has written can be freed, and so the origin is paused for the slowest one
+typedef struct FetchReader{
+    struct FetchReader *prev;
+    struct FetchReader *next;
+    struct Worker *worker;
+    size_t sent;
+    bool peer;                 // Reader is a cluster peer passing on its client's request
+    bool sending;              // A send from the response is in flight, on io_uring
+} FetchReader;
+
+// A single request to the origin, shared by every client that misses on
+// the same URL while it is in flight. The fetch runs on the event loop of
+// the worker that created it; readers on other workers are woken through
+// their worker's notify descriptor as data arrives. The response buffer
+// only ever grows while readers hold the lock to describe it, so they can
+// write from it after dropping the lock. Freed once the origin side and
+// every reader have let go of it
+typedef struct Fetch{
+    pthread_mutex_t lock;
+    struct Fetch *next;        // In-flight table bucket chain
+    struct Fetch *worker_prev; // Fetches owned by the same worker
+    struct Fetch *worker_next;
+    struct FetchTable *table;
+    struct Worker *worker;
+    int refcount;
+
+    FetchState state;
+    char *url;
+    uint64_t url_hash;
+    char *range;               // Byte range asked of the origin, such as "bytes=0-99",
+                               // or NULL for the whole response
+    char hostname[FETCH_HOSTNAME_MAX_SIZE];
+    int server_port;
+    const ClusterPeer *peer;   // Peer owning the URL the response is asked of, or NULL
+    bool peer_failed;          // Peer could not be reached, so the origin is asked instead
+    UpstreamConnection *upstream;
+    struct Fetch *queue_next;  // Fetches waiting for a connection to the origin
+    int connect_failures;
+    char *request;
+    size_t request_size;
+    size_t request_sent;
+    uint64_t request_sent_at;  // When the request was written in full, for the origin latency
+    Timer deadline;            // Connect timeout from asking for a connection, then read timeout
+    uint64_t last_progress;    // Tick the origin last took or sent bytes
+
+    Buffer *response;
+    HttpFraming framing;       // Finds the end of the response on the connection
+    HttpResponseHeader header; // Index of the response header once it is complete
+    bool delimited;            // Complete response says where its body ends
+    CacheEntry *cache_entry;   // Set once a complete response has been cached
+    CacheEntry *stale_entry;   // Cached copy whose validators were sent, or NULL
+    bool held;                 // Response withheld from readers until its status is known
+    bool not_modified;         // Origin answered 304, so readers are served the
+                               // refreshed stale entry, now in cache_entry
+    bool cacheable;
+    bool prefetch;             // Asked for a link in a cached page, not by a client
+    bool for_peer;             // Asked by a cluster peer, so only ever of the origin
+    bool paused;
+    bool resume_requested;
+    size_t buffered;           // Response bytes counted in the table's total
+    FetchReader *readers;
+} Fetch;
+
+// URLs currently being fetched, shared by every worker
+typedef struct FetchTable{
+    pthread_mutex_t lock;
+    Fetch *buckets[FETCH_TABLE_SIZE];
+    struct Worker *workers[FETCH_MAX_WORKERS];
+    uint64_t fetches;          // Requests sent to origins
+    uint64_t coalesced;        // Misses served by a fetch already in flight
+    uint64_t connections_opened;
+    uint64_t connections_reused;
+    int max_origin_connections;
+    const Cluster *cluster;    // Peers sharing their caches, or NULL
+
+    // Deadlines of every fetch, and the limits past which no new fetch is
+    // started, each 0 if there is none
+    unsigned int connect_timeout_ms;
+    unsigned int read_timeout_ms;
+    int max_fetches;
+    size_t max_buffered;
+    int in_flight;             // Fetches in the table, under its lock
+    int64_t buffered;          // Response bytes held by fetches in flight
+} FetchTable;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+FetchTable *fetch_table_create(int max_origin_connections, const Cluster *cluster);
+void fetch_table_free(FetchTable *table);
+void fetch_table_configure(FetchTable *table, unsigned int connect_timeout, unsigned int read_timeout,
+                           int max_fetches, size_t max_buffered);
+void fetch_table_print_stats(FetchTable *table);
+Fetch *fetch_subscribe(FetchTable *table, struct Worker *worker, char *url, const char *range, char *request,
+                       size_t request_size, FetchReader *reader, CacheEntry **cache_entry);
+void fetch_revalidate(FetchTable *table, struct Worker *worker, char *url, char *request,
+                      size_t request_size);
+bool fetch_prefetch(FetchTable *table, struct Worker *worker, char *url, char *request, size_t request_size);
+void fetch_unsubscribe(Fetch *fetch, FetchReader *reader);
+int fetch_describe(Fetch *fetch, size_t start, struct iovec *iov, int max_iov,
+                   size_t *available, FetchState *state);
+void fetch_advance(Fetch *fetch, FetchReader *reader, size_t sent);
+void fetch_resume_requested(Fetch *fetch);
+void fetch_attach(Fetch *fetch, UpstreamConnection *conn);
+void fetch_handle_upstream_event(Fetch *fetch, uint32_t events);
+void fetch_fail(Fetch *fetch);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
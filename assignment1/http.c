@@ -0,0 +1,1002 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      http.c
+// Usage:       Implementation file for HTTP message framing and rewriting
+//*************************************************************************************************
+#define _GNU_SOURCE               // memmem, strncasecmp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "http.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define HTTP_CONNECTION_FIELDS_MAX 8  // Connection fields whose listed names are dropped
+#define HTTP_DATE_LENGTH 29       // "Sun, 06 Nov 1994 08:49:37 GMT"
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+void http_framing_init(HttpFraming *framing) {
+    memset(framing, 0, sizeof(HttpFraming));
+    framing->state = HTTP_FRAMING_HEADER;
+}
+
+// Given header block and field name, return pointer to the field's value
+// with surrounding whitespace removed, storing its length in length.
+// Return NULL if the field is not present
+const char *http_header_value(const char *header, size_t size, const char *name, size_t *length) {
+    size_t name_length = strlen(name);
+    const char *end = header + size;
+    // Skip the request or status line
+    const char *line = memchr(header, '\n', size);
+    while(line != NULL && line + 1 < end) {
+        line += 1;
+        const char *line_end = memchr(line, '\n', end - line);
+        if(line_end == NULL) {
+            line_end = end;
+        }
+        if((size_t)(line_end - line) > name_length && line[name_length] == ':' &&
+           strncasecmp(line, name, name_length) == 0) {
+            const char *value = line + name_length + 1;
+            const char *value_end = line_end;
+            while(value < value_end && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            while(value_end > value && isspace((unsigned char) value_end[-1])) {
+                value_end--;
+            }
+            *length = value_end - value;
+            return value;
+        }
+        line = (line_end < end) ? line_end : NULL;
+    }
+    return NULL;
+}
+
+// Return true if comma-separated field value contains the token of the
+// given length, ignoring case
+static bool value_has_token_length(const char *value, size_t length, const char *token, size_t token_length) {
+    const char *end = value + length;
+    while(value < end) {
+        while(value < end && (*value == ' ' || *value == ',')) {
+            value++;
+        }
+        const char *token_end = value;
+        while(token_end < end && *token_end != ',' && *token_end != ' ' && *token_end != ';') {
+            token_end++;
+        }
+        if((size_t)(token_end - value) == token_length && strncasecmp(value, token, token_length) == 0) {
+            return true;
+        }
+        value = token_end;
+        while(value < end && *value != ',') {
+            value++;
+        }
+    }
+    return false;
+}
+
+// Return true if comma-separated field value contains token, ignoring case
+static bool value_has_token(const char *value, size_t length, const char *token) {
+    return value_has_token_length(value, length, token, strlen(token));
+}
+
+// Given range of bytes, return pointer to the first one equal to a or b,
+// or end if there is none. With SSE2 sixteen bytes are compared at a time
+static const unsigned char *find_either(const unsigned char *p, const unsigned char *end,
+                                        unsigned char a, unsigned char b) {
+#ifdef __SSE2__
+    __m128i match_a = _mm_set1_epi8((char) a);
+    __m128i match_b = _mm_set1_epi8((char) b);
+    while(end - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, match_a),
+                                                  _mm_cmpeq_epi8(block, match_b)));
+        if(mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while(p < end && *p != a && *p != b) {
+        p++;
+    }
+    return p;
+}
+
+// Given start of a line, return pointer to the "\r\n" ending it, or NULL
+// if the line is not complete. A bare "\n" does not end a line, just as
+// it does not end the header for the framing
+static const unsigned char *find_line_end(const unsigned char *line, const unsigned char *end) {
+    const unsigned char *p = line;
+    while((p = find_either(p, end, '\n', '\n')) < end) {
+        if(p > line && p[-1] == '\r') {
+            return p - 1;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+// Given field value, return it as a count of seconds capped at INT_MAX,
+// or HTTP_UNSET if it is not a non-negative integer
+static int parse_seconds(const char *value, size_t length) {
+    if(length == 0) {
+        return HTTP_UNSET;
+    }
+    long long seconds = 0;
+    for(size_t i = 0; i < length; i++) {
+        if(!isdigit((unsigned char) value[i])) {
+            return HTTP_UNSET;
+        }
+        seconds = seconds * 10 + (value[i] - '0');
+        if(seconds > INT_MAX) {
+            seconds = INT_MAX;
+        }
+    }
+    return (int) seconds;
+}
+
+// Given pointer into a field value and its end, read a byte offset of at
+// most 18 digits and advance past it. Return HTTP_UNSET if there is none
+static int64_t parse_offset(const char **value, const char *end) {
+    const char *start = *value;
+    int64_t offset = 0;
+    while(*value < end && isdigit((unsigned char) **value) && *value - start < 18) {
+        offset = offset * 10 + (*(*value)++ - '0');
+    }
+    return (*value > start && (*value == end || !isdigit((unsigned char) **value))) ? offset : HTTP_UNSET;
+}
+
+// Given the value of a Content-Range field, such as "bytes 0-99/1000",
+// record the range and the length of the whole. Anything else, including
+// an unknown length, leaves them HTTP_UNSET
+static void index_content_range(HttpResponseHeader *parsed, const char *value, size_t length) {
+    const char *end = value + length;
+    if(length < 6 || strncasecmp(value, "bytes ", 6) != 0) {
+        return;
+    }
+    value += 6;
+    int64_t first = parse_offset(&value, end);
+    if(first == HTTP_UNSET || value == end || *value++ != '-') {
+        return;
+    }
+    int64_t last = parse_offset(&value, end);
+    if(last == HTTP_UNSET || value == end || *value++ != '/') {
+        return;
+    }
+    int64_t total = parse_offset(&value, end);
+    if(total == HTTP_UNSET || value != end || first > last || last >= total) {
+        return;
+    }
+    parsed->range_first = first;
+    parsed->range_last = last;
+    parsed->range_total = total;
+}
+
+// Given two characters, return the number they spell, or -1
+static int two_digits(const char *p) {
+    if(!isdigit((unsigned char) p[0]) || !isdigit((unsigned char) p[1])) {
+        return -1;
+    }
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+// Given an HTTP date, store it as seconds since the epoch in result.
+// Only the IMF-fixdate form servers are required to send is understood.
+// Return false if the value is not one
+static bool parse_http_date(const char *value, size_t length, time_t *result) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    if(length != HTTP_DATE_LENGTH || value[3] != ',' || value[4] != ' ' || value[7] != ' ' ||
+       value[11] != ' ' || value[16] != ' ' || value[19] != ':' || value[22] != ':' ||
+       memcmp(value + 25, " GMT", 4) != 0) {
+        return false;
+    }
+    int month = 0;
+    while(month < 12 && memcmp(value + 8, months + month * 3, 3) != 0) {
+        month++;
+    }
+    int day = two_digits(value + 5);
+    int century = two_digits(value + 12);
+    int year = two_digits(value + 14);
+    int hour = two_digits(value + 17);
+    int minute = two_digits(value + 20);
+    int second = two_digits(value + 23);
+    if(month == 12 || day < 1 || day > 31 || century < 0 || year < 0 || hour < 0 || hour > 23 ||
+       minute < 0 || minute > 59 || second < 0 || second > 60) {
+        return false;
+    }
+
+    // Days since the epoch of a Gregorian date, counting years from March
+    // so the leap day falls at the end
+    long y = century * 100 + year - (month < 2);
+    long era = y / 400;
+    long year_of_era = y - era * 400;
+    long day_of_year = (153 * ((month + 10) % 12) + 2) / 5 + day - 1;
+    long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    long days = era * 146097 + day_of_era - 719468;
+    *result = (time_t) days * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+// Given Cache-Control value, record each directive the cache acts on.
+// Where a directive is repeated the first one counts. Field names given
+// to no-cache and private are ignored, making them apply to the whole
+// response
+static void index_cache_control(HttpResponseHeader *parsed, const char *value, size_t length) {
+    const char *end = value + length;
+    while(value < end) {
+        while(value < end && (*value == ' ' || *value == '\t' || *value == ',')) {
+            value++;
+        }
+        const char *name = value;
+        while(value < end && *value != '=' && *value != ',' && *value != ' ' && *value != '\t') {
+            value++;
+        }
+        size_t name_length = value - name;
+        const char *argument = value;
+        size_t argument_length = 0;
+        if(value < end && *value == '=') {
+            bool quoted = (++value < end && *value == '"');
+            argument = value + quoted;
+            value = argument;
+            while(value < end && (quoted ? *value != '"' : (*value != ',' && *value != ' ' && *value != '\t'))) {
+                value++;
+            }
+            argument_length = value - argument;
+        }
+        while(value < end && *value != ',') {
+            value++;
+        }
+
+        int *seconds = NULL;
+        if(name_length == 8 && strncasecmp(name, "no-store", 8) == 0) {
+            parsed->no_store = true;
+        } else if(name_length == 8 && strncasecmp(name, "no-cache", 8) == 0) {
+            parsed->no_cache = true;
+        } else if(name_length == 7 && strncasecmp(name, "private", 7) == 0) {
+            parsed->is_private = true;
+        } else if((name_length == 15 && strncasecmp(name, "must-revalidate", 15) == 0) ||
+                  (name_length == 16 && strncasecmp(name, "proxy-revalidate", 16) == 0)) {
+            parsed->must_revalidate = true;
+        } else if(name_length == 7 && strncasecmp(name, "max-age", 7) == 0) {
+            seconds = &parsed->max_age;
+        } else if(name_length == 8 && strncasecmp(name, "s-maxage", 8) == 0) {
+            seconds = &parsed->s_maxage;
+        } else if(name_length == 22 && strncasecmp(name, "stale-while-revalidate", 22) == 0) {
+            seconds = &parsed->stale_while_revalidate;
+        }
+        if(seconds != NULL && *seconds == HTTP_UNSET) {
+            *seconds = parse_seconds(argument, argument_length);
+        }
+    }
+}
+
+// Given a field of the header, record it in the index if it is one the
+// proxy acts on. Line points at the start of the field's line and
+// line_end at the "\r\n" ending it
+static void index_field(HttpResponseHeader *parsed, const unsigned char *header, const char *name,
+                        size_t name_length, const char *value, size_t length,
+                        const unsigned char *line, const unsigned char *line_end) {
+    HttpField field = {(uint32_t)((const unsigned char *) value - header), (uint32_t) length};
+    switch(name_length) {
+        case 3:
+            if(strncasecmp(name, "Age", 3) == 0 && parsed->age_line.length == 0) {
+                parsed->age = parse_seconds(value, length);
+                parsed->age_line.offset = (uint32_t)(line - 2 - header);
+                parsed->age_line.length = (uint32_t)(line_end - (line - 2));
+            }
+            break;
+        case 4:
+            if(strncasecmp(name, "Date", 4) == 0 && !parsed->has_date) {
+                parsed->has_date = parse_http_date(value, length, &parsed->date);
+            } else if(strncasecmp(name, "ETag", 4) == 0 && parsed->etag.length == 0) {
+                parsed->etag = field;
+            }
+            break;
+        case 7:
+            if(strncasecmp(name, "Expires", 7) == 0 && !parsed->has_expires) {
+                parsed->has_expires = true;
+                if(!parse_http_date(value, length, &parsed->expires)) {
+                    parsed->expires = 0;
+                }
+            }
+            break;
+        case 10:
+            if(strncasecmp(name, "Connection", 10) == 0) {
+                parsed->connection_close |= value_has_token(value, length, "close");
+                parsed->connection_keep_alive |= value_has_token(value, length, "keep-alive");
+            }
+            break;
+        case 13:
+            if(strncasecmp(name, "Cache-Control", 13) == 0) {
+                index_cache_control(parsed, value, length);
+            } else if(strncasecmp(name, "Last-Modified", 13) == 0 && parsed->last_modified.length == 0) {
+                parsed->last_modified = field;
+            } else if(strncasecmp(name, "Content-Range", 13) == 0 && parsed->range_total == HTTP_UNSET) {
+                index_content_range(parsed, value, length);
+            }
+            break;
+        case 14:
+            if(strncasecmp(name, "Content-Length", 14) == 0 && parsed->content_length == HTTP_UNSET &&
+               length > 0 && length <= 18) {
+                int64_t content_length = 0;
+                size_t i = 0;
+                while(i < length && isdigit((unsigned char) value[i])) {
+                    content_length = content_length * 10 + (value[i++] - '0');
+                }
+                parsed->content_length = (i == length) ? content_length : HTTP_UNSET;
+            }
+            break;
+        case 17:
+            if(strncasecmp(name, "Transfer-Encoding", 17) == 0) {
+                parsed->chunked |= value_has_token(value, length, "chunked");
+            }
+            break;
+    }
+}
+
+// Given the first size bytes of a response, index its header in a single
+// pass that never reads past size. The delimiters of each line are found
+// together: the first ':' splits name from value and "\r\n" ends it.
+// Return length of the header including its blank line, 0 if the header
+// does not end within size, or -1 if the status line is malformed
+int http_parse_response_header(const unsigned char *header, size_t size, HttpResponseHeader *parsed) {
+    memset(parsed, 0, sizeof(HttpResponseHeader));
+    parsed->content_length = HTTP_UNSET;
+    parsed->max_age = HTTP_UNSET;
+    parsed->s_maxage = HTTP_UNSET;
+    parsed->stale_while_revalidate = HTTP_UNSET;
+    parsed->age = HTTP_UNSET;
+    parsed->range_first = HTTP_UNSET;
+    parsed->range_last = HTTP_UNSET;
+    parsed->range_total = HTTP_UNSET;
+
+    const char *text = (const char *) header;
+    if(size < 12 || memcmp(text, "HTTP/1.", 7) != 0 || !isdigit((unsigned char) text[7]) ||
+       text[8] != ' ' || !isdigit((unsigned char) text[9]) || !isdigit((unsigned char) text[10]) ||
+       !isdigit((unsigned char) text[11])) {
+        return -1;
+    }
+    parsed->minor_version = text[7] - '0';
+    parsed->status = (text[9] - '0') * 100 + (text[10] - '0') * 10 + (text[11] - '0');
+
+    const unsigned char *end = header + size;
+    const unsigned char *line_end = find_line_end(header + 12, end);
+    while(line_end != NULL) {
+        const unsigned char *line = line_end + 2;
+        if(end - line >= 2 && line[0] == '\r' && line[1] == '\n') {
+            parsed->length = line + 2 - header;
+            return (int) parsed->length;
+        }
+        const unsigned char *colon = find_either(line, end, ':', '\n');
+        line_end = find_line_end((colon < end && *colon == ':') ? colon + 1 : line, end);
+        if(line_end == NULL || colon > line_end || *colon != ':') {
+            continue;
+        }
+
+        // Field name and value, without the whitespace allowed around them
+        const char *name = (const char *) line;
+        const char *name_end = (const char *) colon;
+        while(name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t')) {
+            name_end--;
+        }
+        const char *value = (const char *) colon + 1;
+        const char *value_end = (const char *) line_end;
+        while(value < value_end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        while(value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            value_end--;
+        }
+        index_field(parsed, header, name, name_end - name, value, value_end - value, line, line_end);
+    }
+    return 0;
+}
+
+// Given indexed response header, return how the end of its body is found
+HttpBodyType http_response_body(const HttpResponseHeader *parsed) {
+    if((parsed->status >= 100 && parsed->status < 200) || parsed->status == 204 || parsed->status == 304) {
+        return HTTP_BODY_NONE;
+    }
+    if(parsed->chunked) {
+        return HTTP_BODY_CHUNKED;
+    }
+    if(parsed->content_length != HTTP_UNSET) {
+        return HTTP_BODY_LENGTH;
+    }
+    return HTTP_BODY_CLOSE;
+}
+
+// Given indexed response header, return true if its status lets a shared
+// cache store it. Statuses cacheable by default may be kept for a default
+// lifetime; any other only when the origin says how long it stays fresh
+bool http_response_storable(const HttpResponseHeader *parsed) {
+    switch(parsed->status) {
+        case 200: case 203: case 204: case 300: case 301: case 404: case 410:
+            return true;
+        default:
+            return parsed->s_maxage != HTTP_UNSET || parsed->max_age != HTTP_UNSET || parsed->has_expires;
+    }
+}
+
+// Given complete response header, index it into parsed, then work out how
+// the body is framed and whether the connection can be reused afterwards.
+// Return -1 if the status line is malformed
+int http_framing_parse_header(HttpFraming *framing, const unsigned char *header, size_t size,
+                              HttpResponseHeader *parsed) {
+    if(http_parse_response_header(header, size, parsed) <= 0) {
+        framing->keep_alive = false;
+        return -1;
+    }
+    framing->status = parsed->status;
+
+    // HTTP/1.1 connections persist unless closed, HTTP/1.0 ones only on request
+    if(parsed->minor_version >= 1) {
+        framing->keep_alive = !parsed->connection_close;
+    } else {
+        framing->keep_alive = parsed->connection_keep_alive;
+    }
+
+    framing->body = http_response_body(parsed);
+    if(framing->body == HTTP_BODY_CHUNKED) {
+        framing->chunk_state = HTTP_CHUNK_SIZE;
+        framing->remaining = 0;
+    } else if(framing->body == HTTP_BODY_LENGTH) {
+        framing->remaining = parsed->content_length;
+    } else if(framing->body == HTTP_BODY_CLOSE) {
+        framing->keep_alive = false;
+    }
+
+    bool empty = (framing->body == HTTP_BODY_NONE) ||
+                 (framing->body == HTTP_BODY_LENGTH && framing->remaining == 0);
+    framing->state = empty ? HTTP_FRAMING_COMPLETE : HTTP_FRAMING_BODY;
+    return 0;
+}
+
+void http_request_init(HttpRequest *request) {
+    memset(request, 0, sizeof(HttpRequest));
+}
+
+// Given authority such as "Example.com:8080" or "[::1]:8080" within the
+// buffer starting at base, store views of the host and the port, which is
+// HTTP_DEFAULT_PORT if not given. Return false if it is malformed
+static bool split_authority(const char *base, const char *authority, const char *end, HttpField *host,
+                            int *port) {
+    const char *host_end = end;
+    if(authority < end && *authority == '[') {
+        host_end = memchr(authority, ']', end - authority);
+        if(host_end == NULL) {
+            return false;
+        }
+        host_end += 1;
+    } else {
+        const char *colon = memchr(authority, ':', end - authority);
+        host_end = (colon != NULL) ? colon : end;
+    }
+    if(host_end == authority || memchr(authority, '@', host_end - authority) != NULL) {
+        return false;
+    }
+    host->offset = (uint32_t)(authority - base);
+    host->length = (uint32_t)(host_end - authority);
+
+    *port = HTTP_DEFAULT_PORT;
+    if(host_end < end) {
+        if(*host_end != ':' || end - host_end > 6) {
+            return false;
+        }
+        int value = 0;
+        for(const char *digit = host_end + 1; digit < end; digit++) {
+            if(!isdigit((unsigned char) *digit)) {
+                return false;
+            }
+            value = value * 10 + (*digit - '0');
+        }
+        if(end - host_end > 1) {
+            if(value == 0 || value > 65535) {
+                return false;
+            }
+            *port = value;
+        }
+    }
+    return true;
+}
+
+// Given the request line, index its method and target. An absolute-form
+// target gives the origin, an origin-form one leaves it to the Host field.
+// CONNECT takes only an authority-form target, which must give the port.
+// Any fragment is dropped from the path. Return false if it is malformed
+static bool index_request_line(HttpRequest *request, const char *base, const char *line, const char *end) {
+    const char *method_end = memchr(line, ' ', end - line);
+    if(method_end == NULL || method_end == line) {
+        return false;
+    }
+    const char *target = method_end + 1;
+    const char *target_end = memchr(target, ' ', end - target);
+    if(target_end == NULL || target_end == target || end - target_end != 9 ||
+       memcmp(target_end + 1, "HTTP/1.", 7) != 0 || !isdigit((unsigned char) target_end[8])) {
+        return false;
+    }
+    request->method = (HttpField){(uint32_t)(line - base), (uint32_t)(method_end - line)};
+    request->target = (HttpField){(uint32_t)(target - base), (uint32_t)(target_end - target)};
+    request->minor_version = target_end[8] - '0';
+
+    const char *path = target;
+    if(method_end - line == 7 && memcmp(line, "CONNECT", 7) == 0) {
+        const char *colon = target_end;
+        while(colon > target && colon[-1] != ':' && colon[-1] != ']') {
+            colon--;
+        }
+        request->connect = true;
+        request->path = (HttpField){(uint32_t)(target_end - base), 0};
+        return colon > target && colon[-1] == ':' && colon < target_end &&
+               split_authority(base, target, target_end, &request->host, &request->port);
+    } else if(target_end - target >= 7 && strncasecmp(target, "http://", 7) == 0) {
+        const char *authority = target + 7;
+        path = authority;
+        while(path < target_end && *path != '/' && *path != '?' && *path != '#') {
+            path++;
+        }
+        if(!split_authority(base, authority, path, &request->host, &request->port)) {
+            return false;
+        }
+    } else if(*target != '/') {
+        return false;
+    }
+    const char *fragment = memchr(path, '#', target_end - path);
+    request->path = (HttpField){(uint32_t)(path - base), (uint32_t)(((fragment != NULL) ? fragment : target_end) - path)};
+    return true;
+}
+
+// Given a field of the request header, record it in the index if it is
+// one the proxy acts on
+static void index_request_field(HttpRequest *request, const char *base, const char *name, size_t name_length,
+                                const char *value, size_t length) {
+    if(name_length == 4 && strncasecmp(name, "Host", 4) == 0) {
+        request->host_field = (HttpField){(uint32_t)(value - base), (uint32_t) length};
+    } else if((name_length == 10 && strncasecmp(name, "Connection", 10) == 0) ||
+              (name_length == 16 && strncasecmp(name, "Proxy-Connection", 16) == 0)) {
+        request->connection_close |= value_has_token(value, length, "close");
+        request->connection_keep_alive |= value_has_token(value, length, "keep-alive");
+    } else if(name_length == 14 && strncasecmp(name, "Content-Length", 14) == 0) {
+        request->has_body |= !(length == 1 && *value == '0');
+    } else if(name_length == 17 && strncasecmp(name, "Transfer-Encoding", 17) == 0) {
+        request->has_body = true;
+    } else if(name_length == 5 && strncasecmp(name, "Range", 5) == 0) {
+        request->range = (HttpField){(uint32_t)(value - base), (uint32_t) length};
+    } else if(name_length == 8 && strncasecmp(name, "If-Range", 8) == 0) {
+        request->if_range = (HttpField){(uint32_t)(value - base), (uint32_t) length};
+    }
+}
+
+// Given request being read into data, of which size bytes have arrived,
+// index the lines completed since the last call. Nothing is copied: the
+// index holds offsets, so data may move between calls. Empty lines before
+// the request line are skipped. Return length of the header including its
+// blank line once it is complete, 0 if more is needed, HTTP_REQUEST_MALFORMED
+// or HTTP_REQUEST_TOO_LARGE
+int http_parse_request(HttpRequest *request, const char *data, size_t size) {
+    const unsigned char *base = (const unsigned char *) data;
+    const unsigned char *end = base + size;
+    while(1) {
+        const unsigned char *line = base + request->scanned;
+        const unsigned char *line_end = find_line_end(line, end);
+        if(line_end == NULL) {
+            return (size >= HTTP_REQUEST_HEADER_MAX_SIZE) ? HTTP_REQUEST_TOO_LARGE : 0;
+        }
+        request->scanned = line_end + 2 - base;
+        if(request->scanned > HTTP_REQUEST_HEADER_MAX_SIZE) {
+            return HTTP_REQUEST_TOO_LARGE;
+        }
+        if(request->method.length == 0) {
+            if(line_end > line && !index_request_line(request, data, (const char *) line, (const char *) line_end)) {
+                return HTTP_REQUEST_MALFORMED;
+            }
+            continue;
+        }
+
+        // A request for an origin-form target names its origin in Host
+        if(line_end == line) {
+            request->length = request->scanned;
+            if(request->host.length == 0 &&
+               (request->host_field.length == 0 ||
+                !split_authority(data, data + request->host_field.offset,
+                                 data + request->host_field.offset + request->host_field.length,
+                                 &request->host, &request->port))) {
+                return HTTP_REQUEST_MALFORMED;
+            }
+            return (int) request->length;
+        }
+
+        const unsigned char *colon = memchr(line, ':', line_end - line);
+        if(colon == NULL) {
+            continue;
+        }
+        const char *name = (const char *) line;
+        const char *name_end = (const char *) colon;
+        while(name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t')) {
+            name_end--;
+        }
+        const char *value = (const char *) colon + 1;
+        const char *value_end = (const char *) line_end;
+        while(value < value_end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        while(value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            value_end--;
+        }
+        index_request_field(request, data, name, name_end - name, value, value_end - value);
+    }
+}
+
+// Given complete request index and the buffer it was parsed from, write
+// the request's cache key to url if it fits in capacity bytes: the
+// absolute URL with the host in lower case, no default port, no fragment,
+// and "/" for an empty path. Return length of the key, not counting the
+// NUL, so a caller can grow url and try again
+size_t http_request_url(const HttpRequest *request, const char *data, char *url, size_t capacity) {
+    char port[8] = "";
+    if(request->port != HTTP_DEFAULT_PORT) {
+        snprintf(port, sizeof(port), ":%d", request->port);
+    }
+    size_t port_length = strlen(port);
+    size_t path_length = (request->path.length > 0) ? request->path.length : 1;
+    size_t length = 7 + request->host.length + port_length + path_length;
+    if(length + 1 > capacity) {
+        return length;
+    }
+
+    char *out = url;
+    memcpy(out, "http://", 7);
+    out += 7;
+    const char *host = data + request->host.offset;
+    for(uint32_t i = 0; i < request->host.length; i++) {
+        *out++ = tolower((unsigned char) host[i]);
+    }
+    memcpy(out, port, port_length);
+    out += port_length;
+    if(request->path.length > 0) {
+        memcpy(out, data + request->path.offset, request->path.length);
+    } else {
+        *out = '/';
+    }
+    url[length] = '\0';
+    return length;
+}
+
+// Given complete request index, return true if the client wants the
+// connection kept open for another request afterwards. HTTP/1.1 clients
+// do unless they ask for it to be closed, HTTP/1.0 ones only on request.
+// A request with a body cannot be followed by another, since the proxy
+// does not read request bodies
+bool http_request_keep_alive(const HttpRequest *request) {
+    if(request->has_body) {
+        return false;
+    }
+    if(request->minor_version >= 1) {
+        return !request->connection_close;
+    }
+    return request->connection_keep_alive;
+}
+
+// Given a cache key as built by http_request_url, store views of its host
+// and its path, and its port. Return false if it is not an http URL
+bool http_split_url(const char *url, HttpField *host, int *port, HttpField *path) {
+    if(strncmp(url, "http://", 7) != 0) {
+        return false;
+    }
+    const char *authority = url + 7;
+    const char *path_start = authority + strcspn(authority, "/?");
+    if(!split_authority(url, authority, path_start, host, port)) {
+        return false;
+    }
+    path->offset = (uint32_t)(path_start - url);
+    path->length = (uint32_t) strlen(path_start);
+    return true;
+}
+
+// Given the value of a Range field, store its range if it asks for a
+// single range of bytes, such as "bytes=0-99", "bytes=100-" or
+// "bytes=-100". Return false for anything else, including several ranges,
+// which is answered with the whole object as if no range had been asked
+bool http_parse_range(const char *value, size_t length, HttpRange *range) {
+    const char *end = value + length;
+    if(length < 6 || strncasecmp(value, "bytes=", 6) != 0) {
+        return false;
+    }
+    value += 6;
+    while(value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    range->first = (value < end && *value == '-') ? HTTP_UNSET : parse_offset(&value, end);
+    if((range->first == HTTP_UNSET && value < end && *value != '-') || value == end || *value++ != '-') {
+        return false;
+    }
+    range->last = (value < end) ? parse_offset(&value, end) : HTTP_UNSET;
+    while(value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    if(value != end || (range->first == HTTP_UNSET && range->last == HTTP_UNSET) ||
+       (range->first != HTTP_UNSET && range->last != HTTP_UNSET && range->first > range->last)) {
+        return false;
+    }
+    return true;
+}
+
+// Given range and the length of the object, store the first and last
+// byte it covers, with a last byte past the end cut back to it. Return
+// false if no byte of the object is covered, which is answered with 416
+bool http_range_resolve(const HttpRange *range, int64_t size, int64_t *first, int64_t *last) {
+    if(range->first == HTTP_UNSET) {
+        *first = (range->last < size) ? size - range->last : 0;
+        *last = size - 1;
+        return range->last > 0 && size > 0;
+    }
+    *first = range->first;
+    *last = (range->last == HTTP_UNSET || range->last >= size) ? size - 1 : range->last;
+    return range->first < size;
+}
+
+// Advance chunked decoder over data, returning number of bytes that
+// belong to the response. Malformed framing falls back to reading until
+// the origin closes the connection
+static size_t feed_chunked(HttpFraming *framing, const unsigned char *data, size_t size) {
+    size_t i = 0;
+    while(i < size && framing->state == HTTP_FRAMING_BODY) {
+        unsigned char c = data[i];
+        switch(framing->chunk_state) {
+            case HTTP_CHUNK_SIZE:
+                if(isxdigit(c)) {
+                    if(framing->remaining > (SIZE_MAX >> 4)) {
+                        framing->body = HTTP_BODY_CLOSE;
+                        framing->keep_alive = false;
+                        return size;
+                    }
+                    int digit = isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10);
+                    framing->remaining = framing->remaining * 16 + digit;
+                } else if(c == ';' || c == ' ' || c == '\t') {
+                    framing->chunk_state = HTTP_CHUNK_EXTENSION;
+                } else if(c == '\r') {
+                    framing->chunk_state = HTTP_CHUNK_SIZE_LF;
+                } else {
+                    framing->body = HTTP_BODY_CLOSE;
+                    framing->keep_alive = false;
+                    return size;
+                }
+                i++;
+                break;
+            case HTTP_CHUNK_EXTENSION:
+                if(c == '\r') {
+                    framing->chunk_state = HTTP_CHUNK_SIZE_LF;
+                }
+                i++;
+                break;
+            case HTTP_CHUNK_SIZE_LF:
+                framing->chunk_state = (framing->remaining == 0) ? HTTP_CHUNK_TRAILER_START : HTTP_CHUNK_DATA;
+                i++;
+                break;
+            case HTTP_CHUNK_DATA: {
+                // Chunk data is skipped in one step rather than byte by byte
+                size_t skip = size - i;
+                if(skip > framing->remaining) {
+                    skip = framing->remaining;
+                }
+                framing->remaining -= skip;
+                i += skip;
+                if(framing->remaining == 0) {
+                    framing->chunk_state = HTTP_CHUNK_DATA_CR;
+                }
+                break;
+            }
+            case HTTP_CHUNK_DATA_CR:
+                framing->chunk_state = HTTP_CHUNK_DATA_LF;
+                i++;
+                break;
+            case HTTP_CHUNK_DATA_LF:
+                framing->chunk_state = HTTP_CHUNK_SIZE;
+                i++;
+                break;
+            case HTTP_CHUNK_TRAILER_START:
+                framing->chunk_state = (c == '\r') ? HTTP_CHUNK_END_LF : HTTP_CHUNK_TRAILER;
+                i++;
+                break;
+            case HTTP_CHUNK_TRAILER:
+                if(c == '\r') {
+                    framing->chunk_state = HTTP_CHUNK_TRAILER_LF;
+                }
+                i++;
+                break;
+            case HTTP_CHUNK_TRAILER_LF:
+                framing->chunk_state = HTTP_CHUNK_TRAILER_START;
+                i++;
+                break;
+            case HTTP_CHUNK_END_LF:
+                framing->state = HTTP_FRAMING_COMPLETE;
+                i++;
+                break;
+        }
+    }
+    return i;
+}
+
+// Given the next size bytes of a response, return how many of them belong
+// to it. Stops early once the header is complete, leaving the framing in
+// HTTP_FRAMING_HEADER_END until http_framing_parse_header has been called,
+// and once the response is complete. Any bytes left over after completion
+// were sent beyond the end of the response
+size_t http_framing_feed(HttpFraming *framing, const unsigned char *data, size_t size) {
+    static const char terminator[] = "\r\n\r\n";
+    size_t i = 0;
+    if(framing->state == HTTP_FRAMING_HEADER) {
+        while(i < size) {
+            unsigned char c = data[i++];
+            if(c == terminator[framing->header_match]) {
+                framing->header_match += 1;
+            } else {
+                framing->header_match = (c == '\r') ? 1 : 0;
+            }
+            framing->header_length += 1;
+            if(framing->header_match == 4) {
+                framing->state = HTTP_FRAMING_HEADER_END;
+                break;
+            }
+        }
+        return i;
+    }
+    if(framing->state != HTTP_FRAMING_BODY) {
+        return 0;
+    }
+    switch(framing->body) {
+        case HTTP_BODY_LENGTH:
+            if(size >= framing->remaining) {
+                size = framing->remaining;
+                framing->state = HTTP_FRAMING_COMPLETE;
+            }
+            framing->remaining -= size;
+            return size;
+        case HTTP_BODY_CHUNKED:
+            return feed_chunked(framing, data, size);
+        default:
+            return size;
+    }
+}
+
+// The origin has closed the connection. Return true if that completes the
+// response rather than cutting it short
+bool http_framing_eof(HttpFraming *framing) {
+    if(framing->state == HTTP_FRAMING_BODY && framing->body == HTTP_BODY_CLOSE) {
+        framing->state = HTTP_FRAMING_COMPLETE;
+    }
+    return framing->state == HTTP_FRAMING_COMPLETE;
+}
+
+// Given field name, return true if it is only meaningful on one hop, or
+// names something the proxy does itself, so it is not forwarded. Fields
+// the client lists in Connection are hop-by-hop too. The proxy neither
+// forwards request bodies nor passes on the client's conditions or
+// ranges, since it caches whole responses or the ranges it asks for
+// itself. The mark of a request from a peer is only for the proxy it is sent to
+static bool request_field_dropped(const char *name, size_t length, const char **connection,
+                                  const size_t *connection_lengths, int connections) {
+    static const char *dropped[] = {"Connection", "Proxy-Connection", "Keep-Alive", "TE", "Trailer",
+                                    "Transfer-Encoding", "Upgrade", "Proxy-Authorization",
+                                    "Proxy-Authenticate", "Content-Length", "Host", "If-None-Match",
+                                    "If-Modified-Since", "Range", "If-Range", HTTP_PEER_FIELD};
+    for(size_t i = 0; i < sizeof(dropped) / sizeof(dropped[0]); i++) {
+        if(strlen(dropped[i]) == length && strncasecmp(name, dropped[i], length) == 0) {
+            return true;
+        }
+    }
+    for(int i = 0; i < connections; i++) {
+        if(value_has_token_length(connection[i], connection_lengths[i], name, length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Given client request, the origin-form path to ask for, and hostname and
+// port of the origin, return a newly allocated request to send upstream,
+// storing its size in upstream_size. The request line names only the path
+// and is sent as HTTP/1.1, with Host naming the origin and asking for the
+// connection to be kept alive or closed. A request to a peer in the
+// cluster names the absolute URL instead, and is marked as from a peer. Hop-by-hop fields are dropped,
+// and the validators of a stale cached copy, if given, are sent instead of
+// the client's own, as is the range, such as "bytes=0-99", if one is given.
+// Empty lines before the request and anything after the header are
+// dropped. Return NULL if the request is malformed
+char *http_upstream_request(const char *request, size_t request_size, const char *path,
+                            const char *hostname, int port, bool keep_alive, bool to_peer, const char *etag,
+                            const char *last_modified, const char *range, size_t *upstream_size) {
+    while(request_size >= 2 && request[0] == '\r' && request[1] == '\n') {
+        request += 2;
+        request_size -= 2;
+    }
+    const char *header_end = memmem(request, request_size, "\r\n\r\n", 4);
+    const char *line_end = memchr(request, '\n', request_size);
+    const char *method_end = memchr(request, ' ', request_size);
+    if(header_end == NULL || line_end == NULL || method_end == NULL || method_end > line_end) {
+        return NULL;
+    }
+    const char *end = header_end + 2;
+
+    // Connection fields name further fields to drop
+    const char *connection[HTTP_CONNECTION_FIELDS_MAX];
+    size_t connection_lengths[HTTP_CONNECTION_FIELDS_MAX];
+    int connections = 0;
+    for(const char *line = line_end + 1; line < end; ) {
+        const char *next = memchr(line, '\n', end - line) + 1;
+        const char *colon = memchr(line, ':', next - line);
+        if(colon != NULL && connections < HTTP_CONNECTION_FIELDS_MAX &&
+           ((colon - line == 10 && strncasecmp(line, "Connection", 10) == 0) ||
+            (colon - line == 16 && strncasecmp(line, "Proxy-Connection", 16) == 0))) {
+            const char *value_end = next;
+            while(value_end > colon + 1 && isspace((unsigned char) value_end[-1])) {
+                value_end--;
+            }
+            connection[connections] = colon + 1;
+            connection_lengths[connections++] = value_end - colon - 1;
+        }
+        line = next;
+    }
+
+    size_t capacity = (end - request) + strlen(path) + strlen(hostname) + 128;
+    if(etag != NULL) {
+        capacity += strlen(etag) + 32;
+    }
+    if(last_modified != NULL) {
+        capacity += strlen(last_modified) + 32;
+    }
+    if(range != NULL) {
+        capacity += strlen(range) + 16;
+    }
+    char *upstream = malloc(capacity);
+    size_t size = method_end - request;
+    memcpy(upstream, request, size);
+    size += sprintf(upstream + size, " %s HTTP/1.1\r\n", path);
+    if(port == HTTP_DEFAULT_PORT) {
+        size += sprintf(upstream + size, "Host: %s\r\n", hostname);
+    } else {
+        size += sprintf(upstream + size, "Host: %s:%d\r\n", hostname, port);
+    }
+
+    // Header fields
+    for(const char *line = line_end + 1; line < end; ) {
+        const char *next = memchr(line, '\n', end - line) + 1;
+        const char *colon = memchr(line, ':', next - line);
+        const char *name_end = colon;
+        while(name_end != NULL && name_end > line && (name_end[-1] == ' ' || name_end[-1] == '\t')) {
+            name_end--;
+        }
+        if(colon == NULL || !request_field_dropped(line, name_end - line, connection, connection_lengths,
+                                                   connections)) {
+            memcpy(upstream + size, line, next - line);
+            size += next - line;
+        }
+        line = next;
+    }
+    if(etag != NULL) {
+        size += sprintf(upstream + size, "If-None-Match: %s\r\n", etag);
+    }
+    if(last_modified != NULL) {
+        size += sprintf(upstream + size, "If-Modified-Since: %s\r\n", last_modified);
+    }
+    if(range != NULL) {
+        size += sprintf(upstream + size, "Range: %s\r\n", range);
+    }
+    if(to_peer) {
+        size += sprintf(upstream + size, HTTP_PEER_FIELD ": 1\r\n");
+    }
+    size += sprintf(upstream + size, "Connection: %s\r\n\r\n", keep_alive ? "keep-alive" : "close");
+    *upstream_size = size;
+    return upstream;
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,163 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      http.h
+// Usage:       Header file for HTTP message framing and rewriting
+//*************************************************************************************************
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define HTTP_UNSET -1              // Numeric field or directive not given
+#define HTTP_DEFAULT_PORT 80
+#define HTTP_REQUEST_HEADER_MAX_SIZE 64*1024  // Largest request header accepted
+#define HTTP_REQUEST_MALFORMED -1
+#define HTTP_REQUEST_TOO_LARGE -2
+#define HTTP_PEER_FIELD "X-Proxy-Peer"        // Marks requests one proxy of a cluster passes to another
+
+// ----STRUCT--------------------------------------------------------------------------------------
+
+// How the end of a response body is found
+typedef enum HttpBodyType{
+    HTTP_BODY_NONE,            // 1xx, 204 and 304 responses
+    HTTP_BODY_LENGTH,          // Content-Length bytes
+    HTTP_BODY_CHUNKED,         // Transfer-Encoding: chunked
+    HTTP_BODY_CLOSE            // Everything until the origin closes the connection
+} HttpBodyType;
+
+typedef enum HttpFramingState{
+    HTTP_FRAMING_HEADER,       // Looking for the blank line ending the header
+    HTTP_FRAMING_HEADER_END,   // Header complete, waiting for http_framing_parse_header
+    HTTP_FRAMING_BODY,
+    HTTP_FRAMING_COMPLETE
+} HttpFramingState;
+
+typedef enum HttpChunkState{
+    HTTP_CHUNK_SIZE,
+    HTTP_CHUNK_EXTENSION,
+    HTTP_CHUNK_SIZE_LF,
+    HTTP_CHUNK_DATA,
+    HTTP_CHUNK_DATA_CR,
+    HTTP_CHUNK_DATA_LF,
+    HTTP_CHUNK_TRAILER_START,
+    HTTP_CHUNK_TRAILER,
+    HTTP_CHUNK_TRAILER_LF,
+    HTTP_CHUNK_END_LF
+} HttpChunkState;
+
+// Tracks a response as it streams in, so its end can be found without
+// the origin closing the connection. Bytes are only inspected, never
+// copied or changed, and may arrive split at any point
+typedef struct HttpFraming{
+    HttpFramingState state;
+    int header_match;          // Characters of "\r\n\r\n" matched so far
+    size_t header_length;      // Bytes up to and including the blank line
+    int status;
+    HttpBodyType body;
+    size_t remaining;          // Bytes left in the body or current chunk
+    HttpChunkState chunk_state;
+    bool keep_alive;           // Origin allows another request on the connection
+} HttpFraming;
+
+// Where a field value sits in the header it was parsed from, with
+// surrounding whitespace removed. Length is 0 if the field is absent
+typedef struct HttpField{
+    uint32_t offset;
+    uint32_t length;
+} HttpField;
+
+// Index of what the proxy needs from a response header, built in one pass
+// so framing, caching and Age rewriting never scan the header again.
+// Names are matched ignoring case and values point into the header
+typedef struct HttpResponseHeader{
+    size_t length;             // Bytes up to and including the blank line
+    int minor_version;
+    int status;
+    int64_t content_length;    // HTTP_UNSET if absent or malformed
+    bool chunked;              // Transfer-Encoding includes chunked
+    bool connection_close;
+    bool connection_keep_alive;
+
+    // Cache-Control directives, seconds HTTP_UNSET where not given
+    bool no_store;
+    bool no_cache;
+    bool is_private;
+    bool must_revalidate;
+    int max_age;
+    int s_maxage;
+    int stale_while_revalidate;
+
+    int age;                   // Age field, HTTP_UNSET if absent
+    bool has_date;
+    time_t date;
+    bool has_expires;          // A malformed Expires counts, as already expired
+    time_t expires;
+    HttpField etag;
+    HttpField last_modified;
+    HttpField age_line;        // From the "\r\n" before the Age field to the end
+                               // of its value, so it can be cut when rewritten
+    int64_t range_first;       // Content-Range of a 206, HTTP_UNSET if absent or
+    int64_t range_last;        // malformed, or if the length of the whole is unknown
+    int64_t range_total;
+} HttpResponseHeader;
+
+// A single range of a Range field, before the length of the object is
+// known. A suffix range has first HTTP_UNSET and last the number of bytes
+// at the end; an open-ended one has last HTTP_UNSET
+typedef struct HttpRange{
+    int64_t first;
+    int64_t last;
+} HttpRange;
+
+// Index of a client request header, built line by line as it arrives.
+// Fields are offsets into the receive buffer rather than copies, so the
+// buffer may grow and move between reads
+typedef struct HttpRequest{
+    size_t scanned;            // Bytes of complete lines already indexed
+    size_t length;             // Bytes up to and including the blank line, once complete
+    int minor_version;
+    HttpField method;
+    HttpField target;          // Request target as sent
+    bool connect;              // CONNECT naming its tunnel's host and port in authority-form
+    HttpField host;            // From an absolute-form or authority-form target, else from Host
+    int port;
+    HttpField path;            // Path and query in origin-form, without any fragment
+    HttpField host_field;
+    HttpField range;
+    HttpField if_range;
+    bool has_body;             // Content-Length or Transfer-Encoding given
+    bool connection_close;     // From Connection or Proxy-Connection
+    bool connection_keep_alive;
+} HttpRequest;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+void http_framing_init(HttpFraming *framing);
+size_t http_framing_feed(HttpFraming *framing, const unsigned char *data, size_t size);
+int http_framing_parse_header(HttpFraming *framing, const unsigned char *header, size_t size,
+                              HttpResponseHeader *parsed);
+int http_parse_response_header(const unsigned char *header, size_t size, HttpResponseHeader *parsed);
+HttpBodyType http_response_body(const HttpResponseHeader *parsed);
+bool http_response_storable(const HttpResponseHeader *parsed);
+bool http_framing_eof(HttpFraming *framing);
+void http_request_init(HttpRequest *request);
+int http_parse_request(HttpRequest *request, const char *data, size_t size);
+size_t http_request_url(const HttpRequest *request, const char *data, char *url, size_t capacity);
+bool http_request_keep_alive(const HttpRequest *request);
+bool http_split_url(const char *url, HttpField *host, int *port, HttpField *path);
+bool http_parse_range(const char *value, size_t length, HttpRange *range);
+bool http_range_resolve(const HttpRange *range, int64_t size, int64_t *first, int64_t *last);
+const char *http_header_value(const char *header, size_t size, const char *name, size_t *length);
+char *http_upstream_request(const char *request, size_t request_size, const char *path,
+                            const char *hostname, int port, bool keep_alive, bool to_peer, const char *etag,
+                            const char *last_modified, const char *range, size_t *upstream_size);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
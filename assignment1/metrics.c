@@ -0,0 +1,295 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      metrics.c
+// Usage:       Implementation file for per-thread counters and latency histograms
+//*************************************************************************************************
+#define _GNU_SOURCE               // open_memstream
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "metrics.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+// Counters sharing a name are exported as one metric with different labels
+static const struct {
+    const char *name;
+    const char *labels;
+    const char *help;
+} COUNTERS[METRIC_COUNTERS] = {
+    [METRIC_REQUESTS]           = {"proxy_requests_total", "", "Client requests received"},
+    [METRIC_CACHE_HITS]         = {"proxy_cache_hits_total", "", "Requests served fresh from the cache"},
+    [METRIC_CACHE_MISSES]       = {"proxy_cache_misses_total", "", "Requests not fresh in the cache"},
+    [METRIC_STALE_SERVED]       = {"proxy_cache_stale_served_total", "",
+                                   "Stale responses served while they are revalidated"},
+    [METRIC_EVICTIONS_STALE]    = {"proxy_cache_evictions_total", "reason=\"stale\"",
+                                   "Entries removed from the cache"},
+    [METRIC_EVICTIONS_CAPACITY] = {"proxy_cache_evictions_total", "reason=\"capacity\"",
+                                   "Entries removed from the cache"},
+    [METRIC_BYTES_SERVED]       = {"proxy_bytes_served_total", "", "Response bytes written to clients"},
+    [METRIC_ORIGIN_RESPONSES]   = {"proxy_origin_responses_total", "", "Responses received from origins"},
+    [METRIC_ORIGIN_FAILURES]    = {"proxy_origin_failures_total", "", "Origin fetches that failed"},
+    [METRIC_ORIGIN_BYTES]       = {"proxy_origin_bytes_total", "", "Response bytes read from origins"},
+    [METRIC_DNS_LOOKUPS]        = {"proxy_dns_lookups_total", "", "Hostnames looked up with a nameserver"},
+    [METRIC_TUNNELS]            = {"proxy_tunnels_total", "", "CONNECT tunnels opened to an origin"},
+    [METRIC_TUNNEL_BYTES_UP]    = {"proxy_tunnel_bytes_total", "direction=\"up\"",
+                                   "Bytes relayed through CONNECT tunnels"},
+    [METRIC_TUNNEL_BYTES_DOWN]  = {"proxy_tunnel_bytes_total", "direction=\"down\"",
+                                   "Bytes relayed through CONNECT tunnels"},
+    [METRIC_RANGES_SERVED]      = {"proxy_ranges_served_total", "",
+                                   "Byte ranges cut from cached objects or cached parts of them"},
+    [METRIC_RANGE_FILLS]        = {"proxy_range_fills_total", "", "Byte ranges asked of origins"},
+    [METRIC_PEER_FETCHES]       = {"proxy_peer_fetches_total", "", "Misses asked of the peer owning the URL"},
+    [METRIC_PEER_FALLBACKS]     = {"proxy_peer_fallbacks_total", "",
+                                   "Misses sent to the origin as the owning peer could not be reached"},
+    [METRIC_PREFETCHES]         = {"proxy_prefetches_total", "",
+                                   "Links in cached pages fetched before being asked for"},
+    [METRIC_PREFETCH_FETCHED]   = {"proxy_prefetch_bytes_total", "outcome=\"fetched\"",
+                                   "Bytes of prefetched responses cached, and whether a client used them"},
+    [METRIC_PREFETCH_USED]      = {"proxy_prefetch_bytes_total", "outcome=\"used\"",
+                                   "Bytes of prefetched responses cached, and whether a client used them"},
+    [METRIC_PREFETCH_WASTED]    = {"proxy_prefetch_bytes_total", "outcome=\"wasted\"",
+                                   "Bytes of prefetched responses cached, and whether a client used them"},
+    [METRIC_CLIENT_TIMEOUTS]    = {"proxy_timeouts_total", "side=\"client\"",
+                                   "Requests that passed their deadline, on the client or origin side"},
+    [METRIC_ORIGIN_TIMEOUTS]    = {"proxy_timeouts_total", "side=\"origin\"",
+                                   "Requests that passed their deadline, on the client or origin side"},
+    [METRIC_REQUESTS_SHED]      = {"proxy_requests_shed_total", "",
+                                   "Misses answered 503 as the proxy was at its fetch or memory limit"},
+};
+
+static const struct {
+    const char *name;
+    const char *labels;
+    const char *help;
+    const char *log_name;
+} HISTOGRAMS[METRIC_HISTOGRAMS] = {
+    [METRIC_CACHE_LOOKUP]      = {"proxy_cache_lookup_seconds", "", "Time to look a request up in the cache",
+                                  "lookup"},
+    [METRIC_ORIGIN_CONNECT]    = {"proxy_origin_connect_seconds", "", "Time to connect to an origin",
+                                  "connect"},
+    [METRIC_ORIGIN_FIRST_BYTE] = {"proxy_origin_first_byte_seconds", "",
+                                  "Time from sending a request to an origin to its first response byte",
+                                  "first_byte"},
+    [METRIC_ORIGIN_RESPONSE]   = {"proxy_origin_response_seconds", "",
+                                  "Time from sending a request to an origin to the end of its response",
+                                  "origin"},
+    [METRIC_CLIENT_HIT]        = {"proxy_client_response_seconds", "cache=\"hit\"",
+                                  "Time from receiving a request to writing its whole response", "hit"},
+    [METRIC_CLIENT_MISS]       = {"proxy_client_response_seconds", "cache=\"miss\"",
+                                  "Time from receiving a request to writing its whole response", "miss"},
+    [METRIC_DNS_LOOKUP]        = {"proxy_dns_lookup_seconds", "", "Time to look a hostname up with a nameserver",
+                                  "dns"},
+};
+
+// Bucket bounds of the exported histograms, in seconds
+static const double EXPORT_BOUNDS[] = {1e-6, 2.5e-6, 1e-5, 2.5e-5, 1e-4, 2.5e-4, 1e-3, 2.5e-3,
+                                       1e-2, 2.5e-2, 0.1, 0.25, 1, 2.5, 10};
+#define EXPORT_BUCKETS (sizeof(EXPORT_BOUNDS) / sizeof(EXPORT_BOUNDS[0]))
+
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static MetricsThread *threads = NULL;
+#ifndef METRICS_DISABLED
+static __thread MetricsThread *thread_metrics = NULL;
+#endif
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+// Given histogram bucket, return the smallest value it holds
+static uint64_t bucket_lower(int index) {
+    if(index < METRICS_SUB_BUCKETS) {
+        return index;
+    }
+    int shift = index / METRICS_SUB_BUCKETS - 1;
+    return (uint64_t)(METRICS_SUB_BUCKETS + index % METRICS_SUB_BUCKETS) << shift;
+}
+
+// Given histogram bucket, return the smallest value beyond it
+static uint64_t bucket_upper(int index) {
+    if(index < METRICS_SUB_BUCKETS) {
+        return index + 1;
+    }
+    return bucket_lower(index) + ((uint64_t) 1 << (index / METRICS_SUB_BUCKETS - 1));
+}
+
+#ifndef METRICS_DISABLED
+// Return the calling thread's metrics, creating them on first use. Threads
+// recording metrics live as long as the proxy, so they are never torn down
+static MetricsThread *get_thread_metrics(void) {
+    if(thread_metrics == NULL) {
+        thread_metrics = calloc(1, sizeof(MetricsThread));
+        pthread_mutex_lock(&threads_lock);
+        thread_metrics->next = threads;
+        threads = thread_metrics;
+        pthread_mutex_unlock(&threads_lock);
+    }
+    return thread_metrics;
+}
+
+// Given value in nanoseconds, return index of the histogram bucket holding it
+static int bucket_index(uint64_t value) {
+    if(value < METRICS_SUB_BUCKETS) {
+        return (int) value;
+    }
+    int shift = 63 - __builtin_clzll(value) - METRICS_SUB_BITS;
+    int index = (shift + 1) * METRICS_SUB_BUCKETS + (int)((value >> shift) & (METRICS_SUB_BUCKETS - 1));
+    return (index < METRICS_BUCKETS) ? index : METRICS_BUCKETS - 1;
+}
+
+// Return monotonic time in nanoseconds, the start of an interval to record
+uint64_t metrics_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Given counter, add value to the calling thread's copy
+void metrics_add(MetricsCounter counter, uint64_t value) {
+    MetricsThread *metrics = get_thread_metrics();
+    __atomic_store_n(&metrics->counters[counter], metrics->counters[counter] + value, __ATOMIC_RELAXED);
+}
+
+// Given histogram and time an interval started, record the interval
+// until now in the calling thread's copy
+void metrics_record(MetricsHistogram histogram, uint64_t start_ns) {
+    uint64_t now = metrics_now();
+    uint64_t value = (now > start_ns) ? now - start_ns : 0;
+    MetricsHistogramData *data = &get_thread_metrics()->histograms[histogram];
+    int index = bucket_index(value);
+    __atomic_store_n(&data->buckets[index], data->buckets[index] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&data->count, data->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&data->sum_ns, data->sum_ns + value, __ATOMIC_RELAXED);
+}
+#endif
+
+// Return every thread's metrics summed into a newly allocated MetricsThread
+static MetricsThread *metrics_sum(void) {
+    MetricsThread *sum = calloc(1, sizeof(MetricsThread));
+    pthread_mutex_lock(&threads_lock);
+    for(MetricsThread *metrics = threads; metrics != NULL; metrics = metrics->next) {
+        for(int i = 0; i < METRIC_COUNTERS; i++) {
+            sum->counters[i] += __atomic_load_n(&metrics->counters[i], __ATOMIC_RELAXED);
+        }
+        for(int i = 0; i < METRIC_HISTOGRAMS; i++) {
+            MetricsHistogramData *from = &metrics->histograms[i];
+            MetricsHistogramData *to = &sum->histograms[i];
+            to->sum_ns += __atomic_load_n(&from->sum_ns, __ATOMIC_RELAXED);
+            for(int j = 0; j < METRICS_BUCKETS; j++) {
+                uint64_t count = __atomic_load_n(&from->buckets[j], __ATOMIC_RELAXED);
+                to->buckets[j] += count;
+                to->count += count;
+            }
+        }
+    }
+    pthread_mutex_unlock(&threads_lock);
+    return sum;
+}
+
+// Given histogram and quantile between 0 and 1, return the value below
+// which that share of recorded values fall, in nanoseconds
+static double histogram_quantile(const MetricsHistogramData *histogram, double quantile) {
+    if(histogram->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(quantile * (histogram->count - 1)) + 1;
+    uint64_t seen = 0;
+    for(int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if(seen >= rank) {
+            return (bucket_lower(i) + bucket_upper(i)) / 2.0;
+        }
+    }
+    return bucket_lower(METRICS_BUCKETS - 1);
+}
+
+// Return every metric in the Prometheus text format as a newly allocated
+// string, storing its length in size. Histogram buckets are the sums of
+// the finer recorded buckets that lie wholly below each bound
+char *metrics_prometheus(size_t *size) {
+    MetricsThread *sum = metrics_sum();
+    char *text = NULL;
+    FILE *out = open_memstream(&text, size);
+
+    for(int i = 0; i < METRIC_COUNTERS; i++) {
+        if(i == 0 || strcmp(COUNTERS[i].name, COUNTERS[i - 1].name) != 0) {
+            fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", COUNTERS[i].name, COUNTERS[i].help,
+                    COUNTERS[i].name);
+        }
+        fprintf(out, COUNTERS[i].labels[0] != '\0' ? "%s{%s} %lu\n" : "%s%s %lu\n", COUNTERS[i].name,
+                COUNTERS[i].labels, (unsigned long) sum->counters[i]);
+    }
+
+    for(int i = 0; i < METRIC_HISTOGRAMS; i++) {
+        const char *name = HISTOGRAMS[i].name;
+        const char *labels = HISTOGRAMS[i].labels;
+        const char *separator = (labels[0] != '\0') ? "," : "";
+        MetricsHistogramData *histogram = &sum->histograms[i];
+        if(i == 0 || strcmp(name, HISTOGRAMS[i - 1].name) != 0) {
+            fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, HISTOGRAMS[i].help, name);
+        }
+        uint64_t cumulative = 0;
+        int bucket = 0;
+        for(size_t j = 0; j < EXPORT_BUCKETS; j++) {
+            uint64_t bound_ns = (uint64_t)(EXPORT_BOUNDS[j] * 1e9);
+            while(bucket < METRICS_BUCKETS && bucket_upper(bucket) <= bound_ns + 1) {
+                cumulative += histogram->buckets[bucket++];
+            }
+            fprintf(out, "%s_bucket{%s%sle=\"%g\"} %lu\n", name, labels, separator, EXPORT_BOUNDS[j],
+                    (unsigned long) cumulative);
+        }
+        fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, separator, (unsigned long) histogram->count);
+        fprintf(out, labels[0] != '\0' ? "%s_sum{%s} %.9f\n" : "%s_sum%s %.9f\n", name, labels,
+                histogram->sum_ns / 1e9);
+        fprintf(out, labels[0] != '\0' ? "%s_count{%s} %lu\n" : "%s_count%s %lu\n", name, labels,
+                (unsigned long) histogram->count);
+    }
+    fclose(out);
+    free(sum);
+    return text;
+}
+
+// Print counters and the median and 99th percentile of each histogram,
+// in milliseconds, as one line
+void metrics_print(void) {
+    MetricsThread *sum = metrics_sum();
+    uint64_t hits = sum->counters[METRIC_CACHE_HITS];
+    uint64_t misses = sum->counters[METRIC_CACHE_MISSES];
+    uint64_t prefetch_used = sum->counters[METRIC_PREFETCH_USED];
+    uint64_t prefetch_wasted = sum->counters[METRIC_PREFETCH_WASTED];
+    printf("metrics requests=%lu hit_ratio=%.3f stale_served=%lu evictions_stale=%lu evictions_capacity=%lu "
+           "bytes_served=%lu origin_responses=%lu origin_failures=%lu dns_lookups=%lu tunnels=%lu tunnel_bytes=%lu "
+           "ranges_served=%lu range_fills=%lu peer_fetches=%lu peer_fallbacks=%lu "
+           "prefetches=%lu prefetch_accuracy=%.3f client_timeouts=%lu origin_timeouts=%lu shed=%lu",
+           (unsigned long) sum->counters[METRIC_REQUESTS],
+           (hits + misses > 0) ? (double) hits / (hits + misses) : 0.0,
+           (unsigned long) sum->counters[METRIC_STALE_SERVED],
+           (unsigned long) sum->counters[METRIC_EVICTIONS_STALE],
+           (unsigned long) sum->counters[METRIC_EVICTIONS_CAPACITY],
+           (unsigned long) sum->counters[METRIC_BYTES_SERVED],
+           (unsigned long) sum->counters[METRIC_ORIGIN_RESPONSES],
+           (unsigned long) sum->counters[METRIC_ORIGIN_FAILURES],
+           (unsigned long) sum->counters[METRIC_DNS_LOOKUPS],
+           (unsigned long) sum->counters[METRIC_TUNNELS],
+           (unsigned long) (sum->counters[METRIC_TUNNEL_BYTES_UP] + sum->counters[METRIC_TUNNEL_BYTES_DOWN]),
+           (unsigned long) sum->counters[METRIC_RANGES_SERVED],
+           (unsigned long) sum->counters[METRIC_RANGE_FILLS],
+           (unsigned long) sum->counters[METRIC_PEER_FETCHES],
+           (unsigned long) sum->counters[METRIC_PEER_FALLBACKS],
+           (unsigned long) sum->counters[METRIC_PREFETCHES],
+           (prefetch_used + prefetch_wasted > 0) ? (double) prefetch_used / (prefetch_used + prefetch_wasted) : 0.0,
+           (unsigned long) sum->counters[METRIC_CLIENT_TIMEOUTS],
+           (unsigned long) sum->counters[METRIC_ORIGIN_TIMEOUTS],
+           (unsigned long) sum->counters[METRIC_REQUESTS_SHED]);
+    for(int i = 0; i < METRIC_HISTOGRAMS; i++) {
+        printf(" %s_p50_ms=%.3f %s_p99_ms=%.3f", HISTOGRAMS[i].log_name,
+               histogram_quantile(&sum->histograms[i], 0.5) / 1e6, HISTOGRAMS[i].log_name,
+               histogram_quantile(&sum->histograms[i], 0.99) / 1e6);
+    }
+    printf("\n");
+    fflush(stdout);
+    free(sum);
+}
+
+//-------------------------------------------------------------------------------------------------
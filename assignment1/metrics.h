@@ -0,0 +1,101 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      metrics.h
+// Usage:       Header file for per-thread counters and latency histograms
+//*************************************************************************************************
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define METRICS_SUB_BITS 4                    // Each power of two split into 16 buckets
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_BITS 44                   // Values from 2^44 ns, about 5 hours, share a bucket
+#define METRICS_BUCKETS ((METRICS_MAX_BITS - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS)
+#define METRICS_PATH "/metrics"               // Answered by the proxy when requested in origin-form
+#define DEFAULT_METRICS_INTERVAL 60           // Seconds between metrics log lines
+
+// ----STRUCT--------------------------------------------------------------------------------------
+
+typedef enum MetricsCounter{
+    METRIC_REQUESTS,
+    METRIC_CACHE_HITS,
+    METRIC_CACHE_MISSES,
+    METRIC_STALE_SERVED,
+    METRIC_EVICTIONS_STALE,
+    METRIC_EVICTIONS_CAPACITY,
+    METRIC_BYTES_SERVED,
+    METRIC_ORIGIN_RESPONSES,
+    METRIC_ORIGIN_FAILURES,
+    METRIC_ORIGIN_BYTES,
+    METRIC_DNS_LOOKUPS,
+    METRIC_TUNNELS,
+    METRIC_TUNNEL_BYTES_UP,
+    METRIC_TUNNEL_BYTES_DOWN,
+    METRIC_RANGES_SERVED,
+    METRIC_RANGE_FILLS,
+    METRIC_PEER_FETCHES,
+    METRIC_PEER_FALLBACKS,
+    METRIC_PREFETCHES,
+    METRIC_PREFETCH_FETCHED,
+    METRIC_PREFETCH_USED,
+    METRIC_PREFETCH_WASTED,
+    METRIC_CLIENT_TIMEOUTS,
+    METRIC_ORIGIN_TIMEOUTS,
+    METRIC_REQUESTS_SHED,
+    METRIC_COUNTERS
+} MetricsCounter;
+
+typedef enum MetricsHistogram{
+    METRIC_CACHE_LOOKUP,       // Cache key built and checked with cache_check
+    METRIC_ORIGIN_CONNECT,     // connect until the socket is writable
+    METRIC_ORIGIN_FIRST_BYTE,  // Request sent until the first byte of the response
+    METRIC_ORIGIN_RESPONSE,    // Request sent until the response is complete
+    METRIC_CLIENT_HIT,         // Request received until the response is written
+    METRIC_CLIENT_MISS,
+    METRIC_DNS_LOOKUP,
+    METRIC_HISTOGRAMS
+} MetricsHistogram;
+
+// Latency histogram with log-linear buckets in the manner of HDR
+// histograms: each power of two of nanoseconds is split into
+// METRICS_SUB_BUCKETS equal buckets, so any value is recorded to within
+// a sixteenth with one shift and no search
+typedef struct MetricsHistogramData{
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t buckets[METRICS_BUCKETS];
+} MetricsHistogramData;
+
+// Metrics of one thread. Only the owning thread writes them, with relaxed
+// stores rather than locked adds, so recording costs no more than a plain
+// increment and threads never contend for a cache line. Readers sum every
+// thread's copy
+typedef struct MetricsThread{
+    struct MetricsThread *next;        // Every thread that has recorded anything
+    uint64_t counters[METRIC_COUNTERS];
+    MetricsHistogramData histograms[METRIC_HISTOGRAMS];
+} MetricsThread;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+#ifdef METRICS_DISABLED
+static inline uint64_t metrics_now(void) { return 0; }
+static inline void metrics_add(MetricsCounter counter, uint64_t value) { (void) counter; (void) value; }
+static inline void metrics_record(MetricsHistogram histogram, uint64_t start_ns) { (void) histogram; (void) start_ns; }
+#else
+uint64_t metrics_now(void);
+void metrics_add(MetricsCounter counter, uint64_t value);
+void metrics_record(MetricsHistogram histogram, uint64_t start_ns);
+#endif
+char *metrics_prometheus(size_t *size);
+void metrics_print(void);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,368 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      pool.c
+// Usage:       Implementation file for the size-class allocator behind cache entries and responses
+//*************************************************************************************************
+#define _GNU_SOURCE               // MAP_ANONYMOUS, and range initializers for the class table
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "pool.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define POOL_BLOCK_CLASS (POOL_CLASSES - 1)
+#define POOL_ARENA_SIZE ((size_t) POOL_ARENA_BLOCKS * POOL_BLOCK_SIZE)
+
+// Counters are written only by the thread owning them, so a relaxed store
+// is enough for pool_print_stats to read them from another thread
+#define POOL_COUNT(counter, delta) __atomic_store_n(&(counter), (counter) + (delta), __ATOMIC_RELAXED)
+
+static PoolClass classes[POOL_CLASSES] = {
+    [0 ... POOL_CLASSES - 1] = {PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0}
+};
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static PoolThreadCache *threads = NULL;
+static __thread PoolThreadCache *thread_cache = NULL;
+static uint64_t bytes_reserved = 0;        // Arenas taken from the system
+static uint64_t bytes_released = 0;        // Of which free and handed back to the kernel
+static uint64_t large_bytes = 0;           // Allocations left to malloc, still live
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+// Return the calling thread's cache, creating it on first use. Worker
+// threads live as long as the proxy, so caches are never torn down
+static PoolThreadCache *get_thread_cache(void) {
+    if(thread_cache == NULL) {
+        thread_cache = calloc(1, sizeof(PoolThreadCache));
+        pthread_mutex_lock(&threads_lock);
+        thread_cache->next = threads;
+        threads = thread_cache;
+        pthread_mutex_unlock(&threads_lock);
+    }
+    return thread_cache;
+}
+
+// Given size of at most one block, return index of the smallest class holding it
+static int class_index(size_t size) {
+    if(size <= (1 << POOL_MIN_CLASS_SHIFT)) {
+        return 0;
+    }
+    return 64 - __builtin_clzll(size - 1) - POOL_MIN_CLASS_SHIFT;
+}
+
+static size_t class_size(int index) {
+    return (size_t) 1 << (index + POOL_MIN_CLASS_SHIFT);
+}
+
+// Given size requested, return bytes actually set aside for it. Charging
+// this rather than the size requested keeps budgets honest about rounding
+size_t pool_size(size_t size) {
+    if(size > (size_t) POOL_BLOCK_SIZE) {
+        return size;
+    }
+    return class_size(class_index(size));
+}
+
+// Push object onto a free list
+static void push(void **list, void *object) {
+    *(void **) object = *list;
+    *list = object;
+}
+
+static void *pop(void **list) {
+    void *object = *list;
+    *list = *(void **) object;
+    return object;
+}
+
+// Given any address inside an arena, return the record of its block
+static PoolSlab *slab_of(void *object) {
+    uintptr_t base = (uintptr_t) object & ~(POOL_ARENA_SIZE - 1);
+    return &((PoolArena *) base)->slabs[((uintptr_t) object - base) / POOL_BLOCK_SIZE];
+}
+
+// Given record of a block, return the block
+static unsigned char *slab_block(PoolSlab *slab) {
+    uintptr_t base = (uintptr_t) slab & ~(POOL_ARENA_SIZE - 1);
+    return (unsigned char *) base + (slab - ((PoolArena *) base)->slabs) * POOL_BLOCK_SIZE;
+}
+
+// Reserve a new arena aligned to its size and give its blocks to the
+// thread. Return -1 if the system is out of memory
+static int new_arena(PoolThreadCache *cache) {
+    unsigned char *memory = mmap(NULL, 2 * POOL_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        return -1;
+    }
+    uintptr_t base = ((uintptr_t) memory + POOL_ARENA_SIZE - 1) & ~(POOL_ARENA_SIZE - 1);
+    size_t head = base - (uintptr_t) memory;
+    if(head > 0) {
+        munmap(memory, head);
+    }
+    munmap((unsigned char *) base + POOL_ARENA_SIZE, POOL_ARENA_SIZE - head);
+    __atomic_fetch_add(&bytes_reserved, POOL_ARENA_SIZE, __ATOMIC_RELAXED);
+
+    // The first block holds the records, which start out zeroed
+    for(int i = POOL_ARENA_BLOCKS - 1; i > 0; i--) {
+        push(&cache->free_list[POOL_BLOCK_CLASS], (unsigned char *) base + (size_t) i * POOL_BLOCK_SIZE);
+        cache->free_count[POOL_BLOCK_CLASS] += 1;
+    }
+    return 0;
+}
+
+// Add a free block to the shared list. Beyond the blocks retained, its
+// pages are handed back to the kernel, keeping only the first page that
+// holds the free list link
+static void release_block(unsigned char *block) {
+    PoolClass *class = &classes[POOL_BLOCK_CLASS];
+    PoolSlab *slab = slab_of(block);
+    pthread_mutex_lock(&class->lock);
+    if(class->free_count >= POOL_RETAINED_BLOCKS && !slab->released) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        madvise(block + page, POOL_BLOCK_SIZE - page, MADV_DONTNEED);
+        slab->released = true;
+        __atomic_fetch_add(&bytes_released, POOL_BLOCK_SIZE - page, __ATOMIC_RELAXED);
+    }
+    push(&class->free_list, block);
+    class->free_count += 1;
+    pthread_mutex_unlock(&class->lock);
+}
+
+// Return a free block, from the thread, the shared list or a new arena.
+// Set hit unless a new arena was needed. Return NULL if out of memory
+static unsigned char *take_block(PoolThreadCache *cache, bool *hit) {
+    void **list = &cache->free_list[POOL_BLOCK_CLASS];
+    *hit = true;
+    if(*list == NULL) {
+        PoolClass *class = &classes[POOL_BLOCK_CLASS];
+        pthread_mutex_lock(&class->lock);
+        while(class->free_list != NULL && cache->free_count[POOL_BLOCK_CLASS] < POOL_THREAD_CACHE / 2) {
+            push(list, pop(&class->free_list));
+            cache->free_count[POOL_BLOCK_CLASS] += 1;
+            class->free_count -= 1;
+        }
+        pthread_mutex_unlock(&class->lock);
+    }
+    if(*list == NULL) {
+        *hit = false;
+        if(new_arena(cache) < 0) {
+            return NULL;
+        }
+    }
+    cache->free_count[POOL_BLOCK_CLASS] -= 1;
+    unsigned char *block = pop(list);
+    PoolSlab *slab = slab_of(block);
+    if(slab->released) {
+        slab->released = false;
+        __atomic_fetch_sub(&bytes_released, POOL_BLOCK_SIZE - sysconf(_SC_PAGESIZE), __ATOMIC_RELAXED);
+    }
+    return block;
+}
+
+static void unlink_partial(PoolClass *class, PoolSlab *slab) {
+    if(slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    } else {
+        class->partial = slab->next;
+    }
+    if(slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+static void link_partial(PoolClass *class, PoolSlab *slab) {
+    slab->prev = NULL;
+    slab->next = class->partial;
+    if(class->partial != NULL) {
+        class->partial->prev = slab;
+    }
+    class->partial = slab;
+}
+
+// Move free objects of a slab to the thread until it holds half its
+// limit. Caller holds the class lock
+static void take_from_slab(PoolThreadCache *cache, int index, PoolClass *class, PoolSlab *slab) {
+    while(slab->free_count > 0 && cache->free_count[index] < POOL_THREAD_CACHE / 2) {
+        push(&cache->free_list[index], pop(&slab->free_list));
+        cache->free_count[index] += 1;
+        slab->free_count -= 1;
+    }
+    if(slab->free_count == 0) {
+        unlink_partial(class, slab);
+    }
+}
+
+// Return a free object of a class below a block, from the thread, a slab
+// with free objects, or a new slab. Set hit unless a new slab was carved.
+// Return NULL if out of memory
+static void *take(PoolThreadCache *cache, int index, bool *hit) {
+    void **list = &cache->free_list[index];
+    *hit = true;
+    if(*list == NULL) {
+        PoolClass *class = &classes[index];
+        pthread_mutex_lock(&class->lock);
+        while(class->partial != NULL && cache->free_count[index] < POOL_THREAD_CACHE / 2) {
+            take_from_slab(cache, index, class, class->partial);
+        }
+        pthread_mutex_unlock(&class->lock);
+    }
+    if(*list == NULL) {
+        *hit = false;
+        bool block_hit;
+        unsigned char *block = take_block(cache, &block_hit);
+        if(block == NULL) {
+            return NULL;
+        }
+        PoolSlab *slab = slab_of(block);
+        size_t object_size = class_size(index);
+        slab->capacity = POOL_BLOCK_SIZE / object_size;
+        slab->free_count = slab->capacity;
+        slab->free_list = NULL;
+        for(size_t offset = POOL_BLOCK_SIZE; offset > 0; offset -= object_size) {
+            push(&slab->free_list, block + offset - object_size);
+        }
+        PoolClass *class = &classes[index];
+        pthread_mutex_lock(&class->lock);
+        link_partial(class, slab);
+        take_from_slab(cache, index, class, slab);
+        pthread_mutex_unlock(&class->lock);
+    }
+    cache->free_count[index] -= 1;
+    return pop(list);
+}
+
+// Given size, return uninitialized memory for it from the pool. Sizes
+// beyond one block go to malloc. Return NULL if out of memory
+void *pool_alloc(size_t size) {
+    PoolThreadCache *cache = get_thread_cache();
+    POOL_COUNT(cache->allocations, 1);
+    if(size > (size_t) POOL_BLOCK_SIZE) {
+        void *object = malloc(size);
+        if(object != NULL) {
+            POOL_COUNT(cache->large_allocations, 1);
+            __atomic_fetch_add(&large_bytes, size, __ATOMIC_RELAXED);
+        }
+        return object;
+    }
+    int index = class_index(size);
+    bool hit;
+    void *object = (index == POOL_BLOCK_CLASS) ? take_block(cache, &hit) : take(cache, index, &hit);
+    if(object != NULL) {
+        POOL_COUNT(cache->hits, hit);
+        POOL_COUNT(cache->bytes_in_use, (int64_t) class_size(index));
+        POOL_COUNT(cache->bytes_requested, (int64_t) size);
+    }
+    return object;
+}
+
+// As pool_alloc, with the memory zeroed
+void *pool_calloc(size_t size) {
+    void *object = pool_alloc(size);
+    if(object != NULL) {
+        memset(object, 0, size);
+    }
+    return object;
+}
+
+// Hand half of a thread's overfull free list back. Objects return to their
+// slab, and a slab whose objects are all free becomes a free block again
+static void flush(PoolThreadCache *cache, int index) {
+    void **list = &cache->free_list[index];
+    cache->free_count[index] -= POOL_THREAD_CACHE / 2;
+    if(index == POOL_BLOCK_CLASS) {
+        for(int i = 0; i < POOL_THREAD_CACHE / 2; i++) {
+            release_block(pop(list));
+        }
+        return;
+    }
+    PoolClass *class = &classes[index];
+    pthread_mutex_lock(&class->lock);
+    for(int i = 0; i < POOL_THREAD_CACHE / 2; i++) {
+        void *object = pop(list);
+        PoolSlab *slab = slab_of(object);
+        push(&slab->free_list, object);
+        slab->free_count += 1;
+        if(slab->free_count == 1) {
+            link_partial(class, slab);
+        }
+        if(slab->free_count == slab->capacity) {
+            unlink_partial(class, slab);
+            release_block(slab_block(slab));
+        }
+    }
+    pthread_mutex_unlock(&class->lock);
+}
+
+// Given object from pool_alloc and the size it was allocated with, return
+// it to the calling thread's free list
+void pool_free(void *object, size_t size) {
+    if(object == NULL) {
+        return;
+    }
+    PoolThreadCache *cache = get_thread_cache();
+    if(size > (size_t) POOL_BLOCK_SIZE) {
+        __atomic_fetch_sub(&large_bytes, size, __ATOMIC_RELAXED);
+        free(object);
+        return;
+    }
+    int index = class_index(size);
+    POOL_COUNT(cache->bytes_in_use, -(int64_t) class_size(index));
+    POOL_COUNT(cache->bytes_requested, -(int64_t) size);
+    push(&cache->free_list[index], object);
+    cache->free_count[index] += 1;
+    if(cache->free_count[index] > POOL_THREAD_CACHE) {
+        flush(cache, index);
+    }
+}
+
+// Given NUL-terminated string, return a copy of it from the pool
+char *pool_strdup(const char *string) {
+    size_t size = strlen(string) + 1;
+    char *copy = pool_alloc(size);
+    if(copy != NULL) {
+        memcpy(copy, string, size);
+    }
+    return copy;
+}
+
+void pool_free_string(char *string) {
+    if(string != NULL) {
+        pool_free(string, strlen(string) + 1);
+    }
+}
+
+// Print allocator counters summed over every thread on a single line.
+// Fragmentation is the share of resident pool memory not holding requested
+// bytes, whether lost to rounding up to a size class, to arena records or
+// to free lists
+void pool_print_stats(void) {
+    int64_t in_use = 0, requested = 0;
+    uint64_t allocations = 0, hits = 0, large_allocations = 0;
+    pthread_mutex_lock(&threads_lock);
+    for(PoolThreadCache *cache = threads; cache != NULL; cache = cache->next) {
+        in_use += __atomic_load_n(&cache->bytes_in_use, __ATOMIC_RELAXED);
+        requested += __atomic_load_n(&cache->bytes_requested, __ATOMIC_RELAXED);
+        allocations += __atomic_load_n(&cache->allocations, __ATOMIC_RELAXED);
+        hits += __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+        large_allocations += __atomic_load_n(&cache->large_allocations, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&threads_lock);
+    uint64_t reserved = __atomic_load_n(&bytes_reserved, __ATOMIC_RELAXED);
+    uint64_t released = __atomic_load_n(&bytes_released, __ATOMIC_RELAXED);
+    uint64_t resident = reserved - released;
+    uint64_t pooled = allocations - large_allocations;
+    printf("pool bytes_reserved=%lu bytes_released=%lu bytes_in_use=%ld bytes_requested=%ld "
+           "large_bytes=%lu fragmentation=%.3f hit_rate=%.3f allocations=%lu large_allocations=%lu\n",
+           (unsigned long) reserved, (unsigned long) released, (long) in_use, (long) requested,
+           (unsigned long) __atomic_load_n(&large_bytes, __ATOMIC_RELAXED),
+           (resident > 0) ? 1.0 - (double) requested / resident : 0.0,
+           (pooled > 0) ? (double) hits / pooled : 0.0,
+           (unsigned long) allocations, (unsigned long) large_allocations);
+    fflush(stdout);
+}
+
+//-------------------------------------------------------------------------------------------------
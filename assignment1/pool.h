@@ -0,0 +1,82 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      pool.h
+// Usage:       Header file for the size-class allocator behind cache entries and responses
+//*************************************************************************************************
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define POOL_BLOCK_SIZE (64*1024)             // Response data blocks, also carved into slabs
+#define POOL_MIN_CLASS_SHIFT 5                // Smallest size class is 32 bytes
+#define POOL_CLASSES 12                       // Powers of two from 32 bytes to one block
+#define POOL_ARENA_BLOCKS 32                  // Blocks reserved from the system at a time,
+                                              // the first holding the arena's slab records
+#define POOL_THREAD_CACHE 32                  // Free objects of each class kept per thread
+#define POOL_RETAINED_BLOCKS 64               // Free blocks kept resident, the rest are
+                                              // handed back to the kernel until reused
+
+// ----STRUCT--------------------------------------------------------------------------------------
+
+// Record of one block of an arena. A block carved into objects of a size
+// class is a slab, and goes back to the free blocks once all its objects
+// are free, so memory left behind by one size class can serve another
+typedef struct PoolSlab{
+    struct PoolSlab *prev;             // Slabs of the class with free objects
+    struct PoolSlab *next;
+    void *free_list;
+    int free_count;
+    int capacity;
+    bool released;                     // Free block whose pages went back to the kernel
+} PoolSlab;
+
+// Arenas are aligned to their size, so the record of any object's block
+// is found from its address
+typedef struct PoolArena{
+    PoolSlab slabs[POOL_ARENA_BLOCKS];
+} PoolArena;
+
+// Shared state of one size class. Smaller classes keep the slabs that
+// have free objects; the block class keeps free blocks
+typedef struct PoolClass{
+    pthread_mutex_t lock;
+    PoolSlab *partial;
+    void *free_list;
+    size_t free_count;
+} PoolClass;
+
+// Free objects kept by one thread so most allocations take no lock, and
+// the thread's counters. Counters are only written by the owning thread;
+// objects freed on another thread are counted there, so only the sums
+// over every thread are meaningful
+typedef struct PoolThreadCache{
+    struct PoolThreadCache *next;      // Every thread that has used the pool
+    void *free_list[POOL_CLASSES];
+    int free_count[POOL_CLASSES];
+    int64_t bytes_in_use;              // Rounded up to the size class
+    int64_t bytes_requested;
+    uint64_t allocations;
+    uint64_t hits;                     // Served without carving new memory
+    uint64_t large_allocations;        // Beyond the largest class, left to malloc
+} PoolThreadCache;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+void *pool_alloc(size_t size);
+void *pool_calloc(size_t size);
+void pool_free(void *object, size_t size);
+char *pool_strdup(const char *string);
+void pool_free_string(char *string);
+size_t pool_size(size_t size);
+void pool_print_stats(void);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
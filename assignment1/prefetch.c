@@ -0,0 +1,529 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      prefetch.c
+// Usage:       Implementation file for prefetching the resources linked from cached HTML pages
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "prefetch.h"
+#include "fetch.h"
+#include "metrics.h"
+#include "worker.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+static size_t prefetch_budget = 0;             // Bytes prefetched but not yet used, 0 disables
+static int prefetch_concurrency = DEFAULT_PREFETCH_CONCURRENCY;
+static size_t prefetch_outstanding = 0;        // Cached prefetched bytes no client has asked for
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+// A prefetched entry freed before anyone asked for it was wasted
+static void settle_freed(CacheEntry *cache_entry) {
+    prefetch_settle(cache_entry, false);
+}
+
+// Given the most bytes of prefetched responses to hold before any client
+// asks for them, and prefetches each worker may have in flight, set the
+// limits. A budget of 0 turns prefetching off. Called before workers start
+void prefetch_configure(size_t budget_bytes, int concurrency) {
+    prefetch_budget = budget_bytes;
+    prefetch_concurrency = concurrency;
+    cache_entry_on_free(settle_freed);
+}
+
+bool prefetch_enabled(void) {
+    return prefetch_budget > 0;
+}
+
+void html_scanner_init(HtmlScanner *scanner, const char *page_url, bool chunked) {
+    memset(scanner, 0, sizeof(HtmlScanner));
+    scanner->state = HTML_TEXT;
+    scanner->chunked = chunked;
+    scanner->chunk_state = CHUNK_SIZE;
+    scanner->page_url = page_url;
+}
+
+void html_scanner_free(HtmlScanner *scanner) {
+    for(int i = 0; i < scanner->link_count; i++) {
+        free(scanner->links[i]);
+    }
+    scanner->link_count = 0;
+}
+
+// Given path of a resolved URL, from its first "/" to the end of the
+// string, remove "." and ".." segments in place before any query
+static void remove_dot_segments(char *path) {
+    char *query = path + strcspn(path, "?");
+    char *out = path;
+    char *in = path;
+    while(in < query) {
+        // Each pass copies or drops one "/segment"
+        char *next = in + 1;
+        while(next < query && *next != '/') {
+            next++;
+        }
+        size_t length = next - in;
+        if(length == 2 && in[1] == '.') {
+            if(next == query) {
+                *out++ = '/';
+            }
+        } else if(length == 3 && in[1] == '.' && in[2] == '.') {
+            while(out > path && *--out != '/') {
+            }
+            if(next == query) {
+                *out++ = '/';
+            }
+        } else {
+            memmove(out, in, length);
+            out += length;
+        }
+        in = next;
+    }
+    if(out == path) {
+        *out++ = '/';
+    }
+    memmove(out, query, strlen(query) + 1);
+}
+
+// Given page URL, a cache key, and a reference of length bytes found in
+// it, write the reference's cache key to url if it fits in capacity
+// bytes. References are resolved as a browser would: "&amp;" is decoded,
+// the fragment dropped and dot segments removed. Return false for
+// references to other origins or schemes, and for the page itself
+bool prefetch_resolve(const char *page_url, const char *reference, size_t length, char *url, size_t capacity) {
+    HttpField page_host, page_path;
+    int page_port;
+    if(!http_split_url(page_url, &page_host, &page_port, &page_path)) {
+        return false;
+    }
+    while(length > 0 && isspace((unsigned char) *reference)) {
+        reference++;
+        length--;
+    }
+    while(length > 0 && isspace((unsigned char) reference[length - 1])) {
+        length--;
+    }
+    char decoded[PREFETCH_URL_MAX_SIZE];
+    size_t decoded_length = 0;
+    for(size_t i = 0; i < length && reference[i] != '#'; i++) {
+        if(decoded_length == sizeof(decoded) - 1) {
+            return false;
+        }
+        decoded[decoded_length++] = reference[i];
+        if(reference[i] == '&' && length - i >= 5 && strncmp(reference + i, "&amp;", 5) == 0) {
+            i += 4;
+        }
+    }
+    decoded[decoded_length] = '\0';
+    if(decoded_length == 0) {
+        return false;
+    }
+
+    // A scheme ends at the first ":" that comes before any "/", "?" or "#"
+    const char *ref = decoded;
+    size_t scheme_length = strcspn(ref, ":/?");
+    if(ref[scheme_length] == ':') {
+        if(scheme_length != 4 || strncasecmp(ref, "http", 4) != 0) {
+            return false;
+        }
+        ref += 5;
+    }
+    const char *origin_end = page_url + page_path.offset;
+    size_t origin_length = origin_end - page_url;
+    char resolved[2 * PREFETCH_URL_MAX_SIZE];
+    if(strncmp(ref, "//", 2) == 0) {
+        char absolute[PREFETCH_URL_MAX_SIZE + 8];
+        snprintf(absolute, sizeof(absolute), "http:%s", ref);
+        HttpField host, path;
+        int port;
+        if(!http_split_url(absolute, &host, &port, &path) || port != page_port || host.length != page_host.length ||
+           strncasecmp(absolute + host.offset, page_url + page_host.offset, host.length) != 0) {
+            return false;
+        }
+        snprintf(resolved, sizeof(resolved), "%.*s%s", (int) origin_length, page_url,
+                 (path.length > 0) ? absolute + path.offset : "/");
+    } else if(ref != decoded) {
+        // "http:path" without an authority is relative to the page's origin
+        return false;
+    } else if(ref[0] == '/') {
+        snprintf(resolved, sizeof(resolved), "%.*s%s", (int) origin_length, page_url, ref);
+    } else {
+        // Relative to the page's directory, or for a bare query, the page
+        const char *page_query = origin_end + strcspn(origin_end, "?");
+        const char *base_end = page_query;
+        if(ref[0] != '?') {
+            while(base_end > origin_end && base_end[-1] != '/') {
+                base_end--;
+            }
+        }
+        snprintf(resolved, sizeof(resolved), "%.*s%s", (int)(base_end - page_url), page_url, ref);
+    }
+    remove_dot_segments(resolved + origin_length);
+    size_t resolved_length = strlen(resolved);
+    if(resolved_length + 1 > capacity || strcmp(resolved, page_url) == 0) {
+        return false;
+    }
+    memcpy(url, resolved, resolved_length + 1);
+    return true;
+}
+
+// Given the value of a wanted attribute, now complete, resolve it and add
+// it to the links unless it is already among them
+static void add_link(HtmlScanner *scanner) {
+    char url[PREFETCH_URL_MAX_SIZE];
+    if(scanner->value_length >= sizeof(scanner->value) ||
+       !prefetch_resolve(scanner->page_url, scanner->value, scanner->value_length, url, sizeof(url))) {
+        return;
+    }
+    uint64_t hash = url_hash(url);
+    for(int i = 0; i < scanner->link_count; i++) {
+        if(scanner->link_hashes[i] == hash && strcmp(scanner->links[i], url) == 0) {
+            return;
+        }
+    }
+    scanner->link_hashes[scanner->link_count] = hash;
+    scanner->links[scanner->link_count] = strdup(url);
+    scanner->link_count += 1;
+}
+
+// Append c, lower cased, to a tag or attribute name. Names too long to be
+// one the scanner wants are cut short, which keeps them from matching
+static void append_name(char *name, size_t *length, char c) {
+    if(*length < PREFETCH_TAG_MAX_SIZE - 1) {
+        name[(*length)++] = tolower((unsigned char) c);
+        name[*length] = '\0';
+    } else {
+        name[0] = '\0';
+    }
+}
+
+// The tag is over: script and style bodies are skipped as text, since
+// they may contain "<" without starting a tag
+static void end_tag(HtmlScanner *scanner) {
+    bool raw = strcmp(scanner->tag, "script") == 0 || strcmp(scanner->tag, "style") == 0;
+    scanner->state = raw ? HTML_RAW_TEXT : HTML_TEXT;
+}
+
+static void start_attribute(HtmlScanner *scanner, char c) {
+    scanner->attribute_length = 0;
+    scanner->attribute[0] = '\0';
+    append_name(scanner->attribute, &scanner->attribute_length, c);
+    scanner->state = HTML_ATTRIBUTE_NAME;
+}
+
+static void start_value(HtmlScanner *scanner) {
+    scanner->wanted = strcmp(scanner->attribute, "src") == 0 ||
+                      (strcmp(scanner->attribute, "href") == 0 && strcmp(scanner->tag, "link") == 0);
+    scanner->value_length = 0;
+    scanner->state = HTML_VALUE;
+}
+
+// Given the next size bytes of HTML, advance the tokenizer over them,
+// adding links as their values end. Text, which is most of a page, is
+// skipped to the next "<" with memchr
+static void scan_html(HtmlScanner *scanner, const unsigned char *data, size_t size) {
+    const unsigned char *end = data + size;
+    while(data < end && scanner->link_count < PREFETCH_MAX_LINKS) {
+        if(scanner->state == HTML_TEXT || scanner->state == HTML_RAW_TEXT) {
+            const unsigned char *lt = memchr(data, '<', end - data);
+            if(lt == NULL) {
+                return;
+            }
+            data = lt + 1;
+            if(scanner->state == HTML_TEXT) {
+                scanner->tag_length = 0;
+                scanner->tag[0] = '\0';
+                scanner->state = HTML_TAG_OPEN;
+            } else {
+                scanner->state = HTML_RAW_TEXT_LT;
+            }
+            continue;
+        }
+        char c = (char) *data++;
+        bool space = (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f');
+        switch(scanner->state) {
+            case HTML_TAG_OPEN:
+                if(c == '!') {
+                    scanner->dashes = 0;
+                    scanner->state = HTML_DECLARATION;
+                } else if(isalpha((unsigned char) c)) {
+                    append_name(scanner->tag, &scanner->tag_length, c);
+                    scanner->state = HTML_TAG_NAME;
+                } else {
+                    scanner->state = (c == '/' || c == '?') ? HTML_SKIP_TAG : HTML_TEXT;
+                }
+                break;
+            case HTML_TAG_NAME:
+                if(c == '>') {
+                    end_tag(scanner);
+                } else if(space || c == '/') {
+                    scanner->state = HTML_ATTRIBUTE_GAP;
+                } else {
+                    append_name(scanner->tag, &scanner->tag_length, c);
+                }
+                break;
+            case HTML_ATTRIBUTE_GAP:
+                if(c == '>') {
+                    end_tag(scanner);
+                } else if(!space && c != '/') {
+                    start_attribute(scanner, c);
+                }
+                break;
+            case HTML_ATTRIBUTE_NAME:
+                if(c == '>') {
+                    end_tag(scanner);
+                } else if(c == '=') {
+                    scanner->state = HTML_VALUE_START;
+                } else if(space || c == '/') {
+                    scanner->state = HTML_AFTER_ATTRIBUTE_NAME;
+                } else {
+                    append_name(scanner->attribute, &scanner->attribute_length, c);
+                }
+                break;
+            case HTML_AFTER_ATTRIBUTE_NAME:
+                if(c == '>') {
+                    end_tag(scanner);
+                } else if(c == '=') {
+                    scanner->state = HTML_VALUE_START;
+                } else if(!space && c != '/') {
+                    start_attribute(scanner, c);
+                }
+                break;
+            case HTML_VALUE_START:
+                if(c == '>') {
+                    end_tag(scanner);
+                } else if(!space) {
+                    start_value(scanner);
+                    scanner->quote = (c == '"' || c == '\'') ? c : '\0';
+                    if(scanner->quote == '\0') {
+                        data--;
+                    }
+                }
+                break;
+            case HTML_VALUE:
+                if(c == scanner->quote || (scanner->quote == '\0' && (space || c == '>'))) {
+                    if(scanner->wanted) {
+                        add_link(scanner);
+                    }
+                    if(c == '>') {
+                        end_tag(scanner);
+                    } else {
+                        scanner->state = HTML_ATTRIBUTE_GAP;
+                    }
+                } else if(scanner->wanted) {
+                    if(scanner->value_length < sizeof(scanner->value)) {
+                        scanner->value[scanner->value_length] = c;
+                    }
+                    scanner->value_length += (scanner->value_length < sizeof(scanner->value));
+                }
+                break;
+            case HTML_DECLARATION:
+                // Declarations such as <!DOCTYPE html> end at the first ">"
+                if(c == '-' && ++scanner->dashes == 2) {
+                    scanner->dashes = 0;
+                    scanner->state = HTML_COMMENT;
+                } else if(c != '-') {
+                    scanner->state = (c == '>') ? HTML_TEXT : HTML_SKIP_TAG;
+                }
+                break;
+            case HTML_COMMENT:
+                if(c == '>' && scanner->dashes >= 2) {
+                    scanner->state = HTML_TEXT;
+                }
+                scanner->dashes = (c == '-') ? scanner->dashes + 1 : 0;
+                break;
+            case HTML_SKIP_TAG:
+                if(c == '>') {
+                    scanner->state = HTML_TEXT;
+                }
+                break;
+            case HTML_RAW_TEXT_LT:
+                scanner->state = (c == '/') ? HTML_SKIP_TAG : HTML_RAW_TEXT;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Given the next size bytes of the body, pass the bytes of its chunks to
+// the tokenizer, or for a body that is not chunked, all of them
+void html_scanner_feed(HtmlScanner *scanner, const unsigned char *data, size_t size) {
+    if(!scanner->chunked) {
+        scan_html(scanner, data, size);
+        return;
+    }
+    const unsigned char *end = data + size;
+    while(data < end && scanner->chunk_state != CHUNK_DONE) {
+        switch(scanner->chunk_state) {
+            case CHUNK_SIZE:
+                if(isxdigit(*data)) {
+                    int digit = isdigit(*data) ? *data - '0' : (tolower(*data) - 'a' + 10);
+                    scanner->chunk_remaining = scanner->chunk_remaining * 16 + digit;
+                } else {
+                    scanner->chunk_state = CHUNK_EXTENSION;
+                    continue;
+                }
+                data++;
+                break;
+            case CHUNK_EXTENSION:
+                if(*data++ == '\n') {
+                    scanner->chunk_state = (scanner->chunk_remaining > 0) ? CHUNK_DATA : CHUNK_DONE;
+                }
+                break;
+            case CHUNK_DATA: {
+                size_t n = (size_t)(end - data);
+                if(n > scanner->chunk_remaining) {
+                    n = scanner->chunk_remaining;
+                }
+                scan_html(scanner, data, n);
+                data += n;
+                scanner->chunk_remaining -= n;
+                if(scanner->chunk_remaining == 0) {
+                    scanner->chunk_state = CHUNK_DATA_END;
+                }
+                break;
+            }
+            case CHUNK_DATA_END:
+                if(*data++ == '\n') {
+                    scanner->chunk_state = CHUNK_SIZE;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Start queued links on worker while it has prefetch slots free and the
+// budget is not spent. Sizes are only known once responses arrive, so the
+// budget may be overshot by the prefetches in flight. A link already cached
+// fresh or being fetched is dropped without using a slot. Links left once
+// the budget is spent are dropped too, as by the time it frees they are
+// likely to have been asked for
+static void start_queued(Worker *worker) {
+    while(worker->prefetch_queue != NULL && worker->prefetches_in_flight < prefetch_concurrency) {
+        PrefetchLink *link = worker->prefetch_queue;
+        worker->prefetch_queue = link->next;
+        worker->prefetch_queued -= 1;
+        if(__atomic_load_n(&prefetch_outstanding, __ATOMIC_RELAXED) < prefetch_budget) {
+            // A prefetch that fails at once finishes before this returns
+            worker->prefetches_in_flight += 1;
+            if(fetch_prefetch(worker->fetches, worker, link->url, link->request, link->request_size)) {
+                metrics_add(METRIC_PREFETCHES, 1);
+            } else {
+                worker->prefetches_in_flight -= 1;
+            }
+        }
+        free(link->url);
+        free(link->request);
+        free(link);
+    }
+    if(worker->prefetch_queue == NULL) {
+        worker->prefetch_queue_tail = NULL;
+    }
+}
+
+// Given a complete 200 response to a client's request that has just been
+// cached, prefetch the same-origin resources it links to if it is HTML.
+// Runs on the fetch's worker, so the links go on that worker's queue
+void prefetch_scan(Fetch *page) {
+    if(!prefetch_enabled() || page->prefetch || page->range != NULL || page->header.status != 200) {
+        return;
+    }
+    size_t head_size;
+    const char *head = (const char *) buffer_head(page->response, &head_size);
+    size_t type_length;
+    const char *type = http_header_value(head, page->header.length, "Content-Type", &type_length);
+    if(type == NULL || type_length < 9 || strncasecmp(type, "text/html", 9) != 0) {
+        return;
+    }
+
+    HtmlScanner *scanner = malloc(sizeof(HtmlScanner));
+    html_scanner_init(scanner, page->url, page->header.chunked);
+    struct iovec iov[64];
+    size_t offset = page->header.length;
+    while(offset < page->response->size && scanner->link_count < PREFETCH_MAX_LINKS) {
+        int count = buffer_iovec(page->response, offset, page->response->size, iov, 64);
+        if(count == 0) {
+            break;
+        }
+        for(int i = 0; i < count; i++) {
+            html_scanner_feed(scanner, iov[i].iov_base, iov[i].iov_len);
+            offset += iov[i].iov_len;
+        }
+    }
+
+    Worker *worker = page->worker;
+    for(int i = 0; i < scanner->link_count && worker->prefetch_queued < PREFETCH_QUEUE_MAX; i++) {
+        PrefetchLink *link = malloc(sizeof(PrefetchLink));
+        link->next = NULL;
+        link->url = scanner->links[i];
+        scanner->links[i] = NULL;
+        link->request = malloc(page->request_size);
+        memcpy(link->request, page->request, page->request_size);
+        link->request_size = page->request_size;
+        if(worker->prefetch_queue_tail != NULL) {
+            worker->prefetch_queue_tail->next = link;
+        } else {
+            worker->prefetch_queue = link;
+        }
+        worker->prefetch_queue_tail = link;
+        worker->prefetch_queued += 1;
+    }
+    html_scanner_free(scanner);
+    free(scanner);
+    start_queued(worker);
+}
+
+// A prefetch running on worker has finished, so start the next
+void prefetch_finished(Worker *worker) {
+    worker->prefetches_in_flight -= 1;
+    start_queued(worker);
+}
+
+// Given the entry a prefetch has just cached, and whether a client joined
+// the fetch while it ran, count its bytes. Unread entries are marked so
+// their first hit, or their eviction unread, settles the bytes as used or
+// wasted. Caller holds the fetch lock, so the entry is not yet in the cache
+void prefetch_cached(CacheEntry *cache_entry, bool read) {
+    metrics_add(METRIC_PREFETCH_FETCHED, cache_entry->server_response_size);
+    if(read) {
+        metrics_add(METRIC_PREFETCH_USED, cache_entry->server_response_size);
+    } else {
+        cache_entry->prefetched = true;
+        __atomic_fetch_add(&prefetch_outstanding, cache_entry->server_response_size, __ATOMIC_RELAXED);
+    }
+}
+
+// Given an entry that may hold prefetched bytes nobody has asked for yet,
+// count them as used or wasted and release them from the budget. Only the
+// first call for an entry counts them
+void prefetch_settle(CacheEntry *cache_entry, bool used) {
+    if(!__atomic_load_n(&cache_entry->prefetched, __ATOMIC_RELAXED) ||
+       !__atomic_exchange_n(&cache_entry->prefetched, false, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    __atomic_fetch_sub(&prefetch_outstanding, cache_entry->server_response_size, __ATOMIC_RELAXED);
+    metrics_add(used ? METRIC_PREFETCH_USED : METRIC_PREFETCH_WASTED, cache_entry->server_response_size);
+}
+
+// Drop the links still queued on a worker that has stopped
+void prefetch_worker_free(Worker *worker) {
+    while(worker->prefetch_queue != NULL) {
+        PrefetchLink *link = worker->prefetch_queue;
+        worker->prefetch_queue = link->next;
+        free(link->url);
+        free(link->request);
+        free(link);
+    }
+    worker->prefetch_queue_tail = NULL;
+    worker->prefetch_queued = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,104 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      prefetch.h
+// Usage:       Header file for prefetching the resources linked from cached HTML pages
+//*************************************************************************************************
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cache_entry.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define PREFETCH_MAX_LINKS 64                 // References taken from one page
+#define PREFETCH_URL_MAX_SIZE 2048            // Longer references are skipped
+#define PREFETCH_QUEUE_MAX 256                // Links a worker holds until a prefetch slot frees
+#define PREFETCH_TAG_MAX_SIZE 16              // Longer tag and attribute names never match
+#define DEFAULT_PREFETCH_CONCURRENCY 16       // Prefetches in flight per worker
+
+// ----STRUCT--------------------------------------------------------------------------------------
+struct Fetch;
+struct Worker;
+
+// A link found in a page, waiting on its worker's queue for a free slot.
+// The page's upstream request is kept as the template for asking for it
+typedef struct PrefetchLink{
+    struct PrefetchLink *next;
+    char *url;
+    char *request;
+    size_t request_size;
+} PrefetchLink;
+
+typedef enum HtmlScanState{
+    HTML_TEXT,
+    HTML_TAG_OPEN,             // After "<"
+    HTML_TAG_NAME,
+    HTML_ATTRIBUTE_GAP,        // Between attributes
+    HTML_ATTRIBUTE_NAME,
+    HTML_AFTER_ATTRIBUTE_NAME, // Name ended by a space, "=" may still follow
+    HTML_VALUE_START,
+    HTML_VALUE,                // Quoted with quote, else unquoted
+    HTML_DECLARATION,          // After "<!", a comment if "--" follows
+    HTML_COMMENT,
+    HTML_SKIP_TAG,             // End tags and declarations, up to their ">"
+    HTML_RAW_TEXT,             // Script and style bodies, up to the next end tag
+    HTML_RAW_TEXT_LT
+} HtmlScanState;
+
+typedef enum ChunkScanState{
+    CHUNK_SIZE,
+    CHUNK_EXTENSION,           // Rest of the size line
+    CHUNK_DATA,
+    CHUNK_DATA_END,            // The "\r\n" after the data
+    CHUNK_DONE
+} ChunkScanState;
+
+// Streaming tokenizer for the links in an HTML body. Bytes are fed in the
+// pieces the body is stored in, with no copy of the page, and only the
+// names of tags and attributes and the value of a wanted attribute are
+// kept between pieces. A chunked body is decoded on the way in
+typedef struct HtmlScanner{
+    HtmlScanState state;
+    char tag[PREFETCH_TAG_MAX_SIZE];
+    size_t tag_length;
+    char attribute[PREFETCH_TAG_MAX_SIZE];
+    size_t attribute_length;
+    char quote;
+    bool wanted;               // Value is a src, or the href of a link tag
+    int dashes;                // Run of "-" opening or ending a comment
+    char value[PREFETCH_URL_MAX_SIZE];
+    size_t value_length;       // Past the end once a value is too long
+
+    bool chunked;
+    ChunkScanState chunk_state;
+    size_t chunk_remaining;
+
+    // Links found so far, resolved against the page
+    const char *page_url;
+    char *links[PREFETCH_MAX_LINKS];
+    uint64_t link_hashes[PREFETCH_MAX_LINKS];
+    int link_count;
+} HtmlScanner;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+void prefetch_configure(size_t budget_bytes, int concurrency);
+bool prefetch_enabled(void);
+void html_scanner_init(HtmlScanner *scanner, const char *page_url, bool chunked);
+void html_scanner_feed(HtmlScanner *scanner, const unsigned char *data, size_t size);
+void html_scanner_free(HtmlScanner *scanner);
+bool prefetch_resolve(const char *page_url, const char *reference, size_t length, char *url, size_t capacity);
+void prefetch_scan(struct Fetch *page);
+void prefetch_finished(struct Worker *worker);
+void prefetch_cached(CacheEntry *cache_entry, bool read);
+void prefetch_settle(CacheEntry *cache_entry, bool used);
+void prefetch_worker_free(struct Worker *worker);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
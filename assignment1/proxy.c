@@ -7,210 +7,294 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
 #include <unistd.h>
-#include <sys/types.h>  // For socket        
-#include <sys/socket.h> 
-#include <netinet/in.h> // Provides sockaddr_in struct
-#include <netdb.h>      // Provides hostent struct
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
 #include <stdbool.h>
 
 #include "cache.h"       
 #include "cache_entry.h" 
+#include "connection.h"
+#include "worker.h"
+#include "pool.h"
+#include "disk_cache.h"
+#include "metrics.h"
+#include "cluster.h"
+#include "prefetch.h"
+#include "event_loop.h"
 
 // ----GLOBAL VARIABLES----------------------------------------------------------------------------
-#define DEFAULT_SERVER_PORT 80
-#define BUFFER_MAX_SIZE 10*1024*1024  // Confirm size
-#define HTTP_HEADER_MAX_SIZE 2000
 
-#define INITIAL_BUFFER_SIZE 1024*1024  
-#define BUFFER_INCREMENT_FACTOR 4
 
 //----FUNCTIONS------------------------------------------------------------------------------------
-unsigned char *read_stream(int socket, size_t *total_size) {
-    size_t buffer_size = (size_t) INITIAL_BUFFER_SIZE;
-    unsigned char *buffer = malloc(buffer_size);
-    size_t bytes_read = 0;
-    *total_size = 0;
-
-    while(bytes_read = read(socket, buffer + *total_size, buffer_size - *total_size)){
-        *total_size += bytes_read;
-
-        // If buffer is full, expand it by BUFFER_INCREMENT_FACTOR
-        if(*total_size == buffer_size) {
-            buffer_size = buffer_size * BUFFER_INCREMENT_FACTOR;
-            unsigned char *temp = realloc(buffer, buffer_size);
-            if (temp == NULL) {
-                perror("Failed to expand buffer");
-                free(buffer);
-                return NULL;
-            }
-            buffer = temp;
-        }
+// Raise the open file limit to its hard maximum so
+// thousands of client and origin sockets can be open at once
+void raise_file_limit(void) {
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
     }
-    return buffer;
 }
 
-// Check whether request is cached and fresh.
-// If so, return response from cache. Else, 
-// retrieve from server, cache, and return copy of response
-unsigned char *proxy_request(int server_socket, char* buffer, char* url, Cache* cache, size_t *server_response_size) { 
-    // Write request to server
-    write(server_socket, buffer, strlen(buffer));
-    // Read response from server and insert into cache
-    unsigned char *server_response = read_stream(server_socket, server_response_size);
-    cache_insert(cache, url, server_response, server_response_size);
-    // Return copy of response
-    unsigned char *server_response_copy = malloc(*server_response_size);
-    memcpy(server_response_copy, server_response, *server_response_size);
-    return server_response_copy;
+// Given size string with optional K, M or G suffix, return size in bytes
+size_t parse_size(const char *text) {
+    char *suffix;
+    size_t size = strtoull(text, &suffix, 10);
+    switch(*suffix) {
+        case 'k': case 'K': return size * 1024;
+        case 'm': case 'M': return size * 1024 * 1024;
+        case 'g': case 'G': return size * 1024 * 1024 * 1024;
+        default:            return size;
+    }
 }
 
+// Given comma-separated seconds, any of them with a fraction, store the
+// first count of them in milliseconds, leaving any not given as they were.
+// Return -1 if one of them is not a number of seconds
+int parse_seconds(const char *text, unsigned int *milliseconds, int count) {
+    for(int i = 0; i < count && *text != '\0'; i++) {
+        char *end;
+        double seconds = strtod(text, &end);
+        if(end == text || seconds < 0 || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        milliseconds[i] = (unsigned int) (seconds * 1000 + 0.5);
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return 0;
+}
 
+// Given limit on fetches in flight, optionally followed by a comma and a
+// size limit on the response bytes they hold, store them. Return -1 if the
+// limit is not a number
+int parse_limits(const char *text, int *max_fetches, size_t *max_buffered) {
+    char *end;
+    long fetches = strtol(text, &end, 10);
+    if(end == text || fetches < 0 || (*end != ',' && *end != '\0')) {
+        return -1;
+    }
+    *max_fetches = (int) fetches;
+    if(*end == ',') {
+        *max_buffered = parse_size(end + 1);
+    }
+    return 0;
+}
+
+void print_usage(char *program) {
+    printf("Usage: %s [-w workers] [-m cache_bytes] [-P lru|gdsf|tinylfu] [-O max_object_percent] [-U max_origin_connections]\n"
+           "       [-H hosts_file] [-N nameserver[:port]] [-D cache_directory] [-M disk_bytes]\n"
+           "       [-I metrics_interval_seconds] [-C cluster_file [-S self_host:port]]\n"
+           "       [-F prefetch_budget_bytes [-f prefetches_per_worker]] [-E epoll|uring]\n"
+           "       [-T read_seconds[,connect_seconds[,request_seconds]]] [-L max_fetches[,max_buffered_bytes]] <port>\n",
+           program);
+}
 
 //----MAIN-----------------------------------------------------------------------------------------
 
 int main(int argc, char *argv[]) {
     // Declare variables
     int PROXY_PORT;
-    int proxy_listening_socket, client_socket;
-    struct sockaddr_in proxy_addr, client_addr; // Struct for handling internet addresses
-    socklen_t client_addr_size = sizeof(client_addr);
-
-    char* buffer = malloc((size_t) BUFFER_MAX_SIZE);
-    Cache* cache = cache_create();
+    int n_workers = 1;
+    size_t cache_bytes = (size_t) DEFAULT_CACHE_BYTES;
+    CachePolicy cache_policy = CACHE_POLICY_GDSF;
+    int max_object_percent = DEFAULT_MAX_OBJECT_PERCENT;
+    int max_origin_connections = DEFAULT_MAX_ORIGIN_CONNECTIONS;
+    const char *hosts_file = DEFAULT_HOSTS_FILE;
+    const char *nameserver = NULL;
+    const char *disk_directory = NULL;
+    size_t disk_bytes = (size_t) DEFAULT_DISK_BYTES;
+    int metrics_interval = DEFAULT_METRICS_INTERVAL;
+    const char *cluster_file = NULL;
+    const char *cluster_self = NULL;
+    size_t prefetch_budget = 0;
+    int prefetch_concurrency = DEFAULT_PREFETCH_CONCURRENCY;
+    EventLoopBackend backend = EVENT_LOOP_EPOLL;
+    unsigned int timeouts[3] = {DEFAULT_READ_TIMEOUT_MS, DEFAULT_CONNECT_TIMEOUT_MS, DEFAULT_REQUEST_TIMEOUT_MS};
+    int max_fetches = DEFAULT_MAX_FETCHES;
+    size_t max_buffered = (size_t) DEFAULT_MAX_BUFFERED_BYTES;
+    Worker *workers[MAX_WORKERS];
 
-    unsigned char *server_response;
-    size_t server_response_size;
-
-    // Get port number from argv
-    if(argc != 2) {
-        printf("Usage: %s <port>\n", argv[0]);
-        return -1;
+    // Get options and port number from argv
+    int option;
+    while((option = getopt(argc, argv, "w:m:P:O:U:H:N:D:M:I:C:S:F:f:E:T:L:")) != -1) {
+        switch(option) {
+            case 'w':
+                n_workers = atoi(optarg);
+                break;
+            case 'm':
+                cache_bytes = parse_size(optarg);
+                break;
+            case 'P':
+                if(cache_policy_from_name(optarg, &cache_policy) < 0) {
+                    print_usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'O':
+                max_object_percent = atoi(optarg);
+                break;
+            case 'U':
+                max_origin_connections = atoi(optarg);
+                break;
+            case 'H':
+                hosts_file = optarg;
+                break;
+            case 'N':
+                nameserver = optarg;
+                break;
+            case 'D':
+                disk_directory = optarg;
+                break;
+            case 'M':
+                disk_bytes = parse_size(optarg);
+                break;
+            case 'I':
+                metrics_interval = atoi(optarg);
+                break;
+            case 'C':
+                cluster_file = optarg;
+                break;
+            case 'S':
+                cluster_self = optarg;
+                break;
+            case 'F':
+                prefetch_budget = parse_size(optarg);
+                break;
+            case 'f':
+                prefetch_concurrency = atoi(optarg);
+                break;
+            case 'E':
+                if(event_loop_backend_from_name(optarg, &backend) < 0) {
+                    print_usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'T':
+                if(parse_seconds(optarg, timeouts, 3) < 0) {
+                    print_usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'L':
+                if(parse_limits(optarg, &max_fetches, &max_buffered) < 0) {
+                    print_usage(argv[0]);
+                    return -1;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
     }
-    PROXY_PORT = atoi(argv[1]);
-
-    // Create listening socket
-    proxy_listening_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if(proxy_listening_socket < 0) {
-        perror("Error creating listening socket");
+    if(optind != argc - 1 || n_workers < 1 || n_workers > MAX_WORKERS || cache_bytes == 0 ||
+       max_object_percent < 0 || max_object_percent > 100 || max_origin_connections < 0 || disk_bytes == 0 ||
+       metrics_interval < 0 || prefetch_concurrency < 1) {
+        print_usage(argv[0]);
         return -1;
     }
+    PROXY_PORT = atoi(argv[optind]);
 
-    // Initialize fields of struct for proxy server address
-    memset(&proxy_addr, 0, sizeof(proxy_addr)); // Set structure to 0's, ensuring sin_zero is all zeros
-    proxy_addr.sin_family = AF_INET;            // Set address family to IPv4
-    proxy_addr.sin_addr.s_addr = INADDR_ANY;    // Set IP address to all IP addresses of machine
-    proxy_addr.sin_port = htons(PROXY_PORT);    // Set port number
-
-    // Set socket options to allow reuse of the address (fixes "address already in use" bug)
-    int opt = 1;
-    if (setsockopt(proxy_listening_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        perror("Error setting socket options");
-        close(proxy_listening_socket);
-        return -1;
-    }   
-
-    // Bind socket to IP address and port (specificied in proxy_addr)
-    if(bind(proxy_listening_socket, (struct sockaddr *) &proxy_addr, sizeof(proxy_addr)) < 0 ){
-        perror("Error binding socket");
-        return -1;
-    }
+    // Clients that disconnect mid-response must not kill the proxy
+    signal(SIGPIPE, SIG_IGN);
+    raise_file_limit();
 
-    // Listen for incoming connections requests on "listening socket"
-    listen(proxy_listening_socket, 10);
-    printf("Listening for incoming connection requests on port %d...\n\n", PROXY_PORT);
+    // Block control signals before starting workers, so every thread inherits
+    // the mask and the signals are only delivered to sigwait below
+    sigset_t control_signals;
+    sigemptyset(&control_signals);
+    sigaddset(&control_signals, SIGUSR1);
+    sigaddset(&control_signals, SIGINT);
+    sigaddset(&control_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &control_signals, NULL);
 
-    while(1) {
-        // Yield CPU and await connection request. Upon reception,
-        // bind to dedicated socket
-        client_socket = accept(proxy_listening_socket, (struct sockaddr *) &client_addr, &client_addr_size);
-        if(client_socket  < 0){
-            perror("Error creating connection socket");
+    // Start workers. Each one serves its share of client and origin
+    // sockets from its own event loop without blocking
+    Cache *cache = cache_create(cache_bytes, cache_policy, max_object_percent);
+    DiskCache *disk = NULL;
+    if(disk_directory != NULL) {
+        disk = disk_cache_open(disk_directory, disk_bytes);
+        if(disk == NULL) {
+            printf("Error opening disk cache in %s\n", disk_directory);
             return -1;
         }
-    
-        // Read contents from client connection into buffer
-        memset(buffer, 0, (size_t) BUFFER_MAX_SIZE);
-        int bytes_read = read(client_socket, buffer, (size_t) (BUFFER_MAX_SIZE - 1));
-        if(bytes_read < 0) {
-            perror("Error reading from connection socket");
+        cache_attach_disk(cache, disk);
+    }
+    // Peers listed in the cluster file share their caches. This proxy is
+    // named as its peers know it, by default 127.0.0.1 and its own port
+    Cluster *cluster = NULL;
+    if(cluster_file != NULL) {
+        char self[CLUSTER_HOSTNAME_MAX_SIZE + 8];
+        if(cluster_self == NULL) {
+            snprintf(self, sizeof(self), "127.0.0.1:%d", PROXY_PORT);
+            cluster_self = self;
+        }
+        cluster = cluster_load(cluster_file, cluster_self);
+        if(cluster == NULL) {
+            print_usage(argv[0]);
             return -1;
         }
-
-        // Parse contents of client request into HTTP request components
-        char method[HTTP_HEADER_MAX_SIZE], url[HTTP_HEADER_MAX_SIZE];
-        sscanf(buffer, "%s %s", method, url);
-
-        // Confirm request is GET request (as per project specs)
-        if (strncmp(method, "GET", 3) != 0) {
-            perror("Proxy server only accepts 'GET' requests");
-            close(client_socket);
-            continue;
+    }
+    FetchTable *fetches = fetch_table_create(max_origin_connections, cluster);
+    // Clients get the read timeout to finish sending a request and the
+    // request timeout to be sent the response; origins the connect timeout
+    // and then the read timeout between bytes. Misses that would start a
+    // fetch past the limits are answered 503 straight away
+    connection_configure(timeouts[0], timeouts[2]);
+    fetch_table_configure(fetches, timeouts[1], timeouts[0], max_fetches, max_buffered);
+    // Links in cached pages are fetched ahead of the client while the
+    // prefetched bytes nobody has used yet fit the budget
+    prefetch_configure(prefetch_budget, prefetch_concurrency);
+    Resolver *resolver = resolver_create(hosts_file, nameserver);
+    if(resolver == NULL) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    // Workers wait for their sockets with epoll, or submit their accepts,
+    // receives and closes to an io_uring and wait for the completions
+    event_loop_configure(backend);
+    for(int i = 0; i < n_workers; i++) {
+        workers[i] = worker_create(i, PROXY_PORT, cache, fetches, resolver);
+        if(workers[i] == NULL || worker_start(workers[i]) != 0) {
+            printf("Error starting worker %d\n", i);
+            return -1;
         }
+    }
+    printf("Listening for incoming connection requests on port %d with %d worker(s)...\n\n",
+           PROXY_PORT, n_workers);
 
-        // Check whether request is present in cache. Return true if present
-        // and fresh. If present and stale, evict and return false.
-        // If not present, return false
-        bool cache_hit = cache_check(cache, url);
-        if(cache_hit) {
-            server_response_size = 0;
-            server_response = cache_retrieval(cache, url, &server_response_size);
-        } else {
-            // Get the hostname, path, and port number (if present) from URL
-            int SERVER_PORT = DEFAULT_SERVER_PORT;
-            char hostname[HTTP_HEADER_MAX_SIZE], path[HTTP_HEADER_MAX_SIZE];
-            int n_objects_assigned = sscanf(url, "http://%[^:/]%*[:]%d%[^\n]", hostname, &SERVER_PORT, path);
-            // If parsing failed to assign 3 objects, port is not present in URL.
-            // Parse again, this time excluding port
-            if(n_objects_assigned < 3) {
-                sscanf(url, "http://%[^/]%[^\n]", hostname, path);
-            }
-
-            // Get server information
-            struct hostent* server = gethostbyname(hostname);    // Lookup IP address of host using DNS
-            if(server == NULL) {
-                perror("Unable to retrieve server information\n");
-                close(client_socket);
-                continue;
-            }
-
-            // Create socket for server
-            int server_socket = socket(AF_INET, SOCK_STREAM, 0);
-            if(server_socket  < 0){
-                perror("Error creating connection socket");
-                return -1;
-            }
-
-            // Create struct for server address
-            struct sockaddr_in server_addr;
-            memset(&server_addr, 0, sizeof(server_addr)); // Set structure to 0's, ensuring sin_zero is all zeros
-            server_addr.sin_family = AF_INET;             // Set address family to IPv4
-            server_addr.sin_port = htons(SERVER_PORT);    // Set server port to port associated with web servers (80)
-            memcpy(&server_addr.sin_addr.s_addr, server->h_addr_list[0], server->h_length);
-
-            // Connect to server
-            if(connect(server_socket, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
-                perror("Unable to connect to server");
-                close(client_socket);
-                close(server_socket);
-                continue;
+    // SIGUSR1 prints cache, disk, fetch, resolver, allocator and latency counters.
+    // The metrics line is also printed every metrics_interval seconds unless it
+    // is 0. SIGINT and SIGTERM stop the proxy, after the disk tier has written
+    // what is queued
+    struct timespec interval = {metrics_interval, 0};
+    while(1) {
+        int signal_number = (metrics_interval > 0) ? sigtimedwait(&control_signals, NULL, &interval)
+                                                   : sigwaitinfo(&control_signals, NULL);
+        if(signal_number < 0) {
+            if(errno == EAGAIN) {
+                metrics_print();
             }
-
-            // Send request to server, add response to cache, and return copy 
-            // of response to client
-            server_response_size = 0;
-            server_response = proxy_request(server_socket, buffer, url, cache, &server_response_size);
-
-            close(server_socket);
+            continue;
         }
-        write(client_socket, server_response, server_response_size);
-        free(server_response);
-        // Close connection with both client and server
-        close(client_socket);
+        if(signal_number != SIGUSR1) {
+            break;
+        }
+        cache_print_stats(cache);
+        if(disk != NULL) {
+            disk_cache_print_stats(disk);
+        }
+        fetch_table_print_stats(fetches);
+        resolver_print_stats(resolver);
+        pool_print_stats();
+        metrics_print();
+    }
+    if(disk != NULL) {
+        disk_cache_close(disk);
     }
-    close(proxy_listening_socket);
-    cache_free(cache);
-    free(buffer);
     return 0;
 }
 
@@ -0,0 +1,601 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      resolver.c
+// Usage:       Implementation file for asynchronous, cached resolution of origin hostnames
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "resolver.h"
+#include "cache.h"
+#include "metrics.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define DNS_PORT 53
+#define DNS_PACKET_MAX_SIZE 1232
+#define DNS_HEADER_SIZE 12
+#define DNS_TYPE_A 1
+#define DNS_TYPE_SOA 6
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+#define DNS_RCODE_NXDOMAIN 3
+
+// Outcome of asking the name server for one record type
+typedef struct DnsAnswer{
+    bool answered;
+    int rcode;
+    int count;
+    struct sockaddr_storage address[RESOLVER_MAX_ADDRESSES];
+    uint32_t ttl;                  // Smallest TTL of the addresses, or negative TTL
+} DnsAnswer;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+static void *resolver_main(void *arg);
+
+static time_t now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Given text address, store it in addresses. Return false if the text is
+// not a numeric IPv4 or IPv6 address
+static bool add_numeric_address(ResolverAddresses *addresses, const char *text) {
+    struct sockaddr_storage address;
+    memset(&address, 0, sizeof(address));
+    struct sockaddr_in *ipv4 = (struct sockaddr_in *) &address;
+    struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *) &address;
+    int slot = addresses->count;
+    if(inet_pton(AF_INET, text, &ipv4->sin_addr) == 1) {
+        ipv4->sin_family = AF_INET;
+        // Keep IPv4 addresses ahead of IPv6 ones
+        slot = addresses->ipv4_count;
+        if(addresses->count < RESOLVER_MAX_ADDRESSES && slot != addresses->count) {
+            addresses->address[addresses->count] = addresses->address[slot];
+            addresses->length[addresses->count] = addresses->length[slot];
+        }
+    } else if(inet_pton(AF_INET6, text, &ipv6->sin6_addr) == 1) {
+        ipv6->sin6_family = AF_INET6;
+    } else {
+        return false;
+    }
+    if(slot == RESOLVER_MAX_ADDRESSES) {
+        return true;
+    }
+    addresses->address[slot] = address;
+    addresses->length[slot] = (address.ss_family == AF_INET) ? sizeof(struct sockaddr_in) :
+                                                                sizeof(struct sockaddr_in6);
+    addresses->ipv4_count += (address.ss_family == AF_INET);
+    addresses->count += (addresses->count < RESOLVER_MAX_ADDRESSES);
+    return true;
+}
+
+// Given path of a hosts file, return its entries. A missing file is
+// treated as empty
+static HostsEntry *load_hosts(const char *path) {
+    HostsEntry *hosts = NULL;
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        return NULL;
+    }
+    char line[1024];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        char *comment = strchr(line, '#');
+        if(comment != NULL) {
+            *comment = '\0';
+        }
+        char *save;
+        char *address = strtok_r(line, " \t\r\n", &save);
+        char *name;
+        while(address != NULL && (name = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+            HostsEntry *entry = hosts;
+            while(entry != NULL && strcasecmp(entry->hostname, name) != 0) {
+                entry = entry->next;
+            }
+            if(entry == NULL) {
+                entry = calloc(1, sizeof(HostsEntry));
+                entry->hostname = strdup(name);
+                for(char *c = entry->hostname; *c != '\0'; c++) {
+                    *c = tolower((unsigned char) *c);
+                }
+                entry->next = hosts;
+                hosts = entry;
+            }
+            add_numeric_address(&entry->addresses, address);
+        }
+    }
+    fclose(file);
+    return hosts;
+}
+
+// Given "address" or "address:port" of a name server, or NULL to use the
+// first one in resolv.conf, store its socket address in resolver.
+// Return -1 if no usable name server is found
+static int set_nameserver(Resolver *resolver, const char *nameserver) {
+    char text[INET6_ADDRSTRLEN + 8] = "127.0.0.1";
+    if(nameserver != NULL) {
+        snprintf(text, sizeof(text), "%s", nameserver);
+    } else {
+        FILE *file = fopen(DEFAULT_RESOLV_CONF, "r");
+        char line[512];
+        while(file != NULL && fgets(line, sizeof(line), file) != NULL) {
+            if(sscanf(line, "nameserver %45s", text) == 1) {
+                break;
+            }
+        }
+        if(file != NULL) {
+            fclose(file);
+        }
+    }
+
+    // A single colon separates the port of an IPv4 address
+    int port = DNS_PORT;
+    char *colon = strchr(text, ':');
+    if(colon != NULL && strchr(colon + 1, ':') == NULL) {
+        *colon = '\0';
+        port = atoi(colon + 1);
+    }
+    struct sockaddr_in *ipv4 = (struct sockaddr_in *) &resolver->nameserver;
+    struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *) &resolver->nameserver;
+    memset(&resolver->nameserver, 0, sizeof(resolver->nameserver));
+    if(inet_pton(AF_INET, text, &ipv4->sin_addr) == 1) {
+        ipv4->sin_family = AF_INET;
+        ipv4->sin_port = htons(port);
+        resolver->nameserver_length = sizeof(struct sockaddr_in);
+    } else if(inet_pton(AF_INET6, text, &ipv6->sin6_addr) == 1) {
+        ipv6->sin6_family = AF_INET6;
+        ipv6->sin6_port = htons(port);
+        resolver->nameserver_length = sizeof(struct sockaddr_in6);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Given hosts file and name server ("address[:port]", or NULL for the one
+// in resolv.conf), create resolver and start its threads
+Resolver *resolver_create(const char *hosts_file, const char *nameserver) {
+    Resolver *resolver = calloc(1, sizeof(Resolver));
+    if(set_nameserver(resolver, nameserver) < 0) {
+        printf("Invalid name server address\n");
+        free(resolver);
+        return NULL;
+    }
+    resolver->hosts = load_hosts(hosts_file);
+    pthread_mutex_init(&resolver->lock, NULL);
+    pthread_cond_init(&resolver->work, NULL);
+    for(int i = 0; i < RESOLVER_THREADS; i++) {
+        pthread_create(&resolver->threads[i], NULL, resolver_main, resolver);
+    }
+    return resolver;
+}
+
+void resolver_print_stats(Resolver *resolver) {
+    pthread_mutex_lock(&resolver->lock);
+    uint64_t misses = resolver->misses;
+    printf("resolver hits=%lu negative_hits=%lu misses=%lu coalesced=%lu failures=%lu "
+           "lookup_avg_ms=%.2f lookup_max_ms=%.2f\n",
+           (unsigned long) __atomic_load_n(&resolver->hits, __ATOMIC_RELAXED),
+           (unsigned long) resolver->negative_hits,
+           (unsigned long) misses, (unsigned long) resolver->coalesced,
+           (unsigned long) resolver->failures,
+           misses ? resolver->lookup_ns / (double) misses / 1e6 : 0.0,
+           resolver->lookup_max_ns / 1e6);
+    pthread_mutex_unlock(&resolver->lock);
+    fflush(stdout);
+}
+
+void resolver_mailbox_init(ResolverMailbox *mailbox, int notify_fd) {
+    pthread_mutex_init(&mailbox->lock, NULL);
+    mailbox->completed = NULL;
+    mailbox->notify_fd = notify_fd;
+}
+
+void resolver_mailbox_destroy(ResolverMailbox *mailbox) {
+    pthread_mutex_destroy(&mailbox->lock);
+}
+
+// Run the callbacks of every query completed since the mailbox was last
+// drained. Called on the thread that owns the mailbox
+void resolver_mailbox_drain(ResolverMailbox *mailbox) {
+    pthread_mutex_lock(&mailbox->lock);
+    ResolverQuery *query = mailbox->completed;
+    mailbox->completed = NULL;
+    pthread_mutex_unlock(&mailbox->lock);
+    while(query != NULL) {
+        ResolverQuery *next = query->next;
+        query->callback(query);
+        query = next;
+    }
+}
+
+// Hand completed query to the thread that asked for it
+static void deliver(ResolverQuery *query) {
+    ResolverMailbox *mailbox = query->mailbox;
+    pthread_mutex_lock(&mailbox->lock);
+    query->next = mailbox->completed;
+    mailbox->completed = query;
+    pthread_mutex_unlock(&mailbox->lock);
+    uint64_t count = 1;
+    if(write(mailbox->notify_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("Error notifying resolver mailbox");
+    }
+}
+
+// Given hostname, store its lower-case form without a trailing dot in
+// name. Return false if it is too long to be a DNS name
+static bool normalize_hostname(const char *hostname, char *name) {
+    size_t length = strlen(hostname);
+    if(length > 0 && hostname[length - 1] == '.') {
+        length -= 1;
+    }
+    if(length == 0 || length >= RESOLVER_HOSTNAME_MAX_SIZE) {
+        return false;
+    }
+    for(size_t i = 0; i < length; i++) {
+        name[i] = tolower((unsigned char) hostname[i]);
+    }
+    name[length] = '\0';
+    return true;
+}
+
+// Walk bucket, dropping expired entries, and return the entry for name if
+// there is one. Caller holds the resolver lock
+static ResolverEntry *sweep_bucket(Resolver *resolver, size_t bucket, const char *name, uint64_t hash,
+                                   time_t now) {
+    ResolverEntry **link = &resolver->buckets[bucket];
+    ResolverEntry *found = NULL;
+    while(*link != NULL) {
+        ResolverEntry *entry = *link;
+        if(!entry->pending && entry->expires <= now) {
+            *link = entry->next;
+            resolver->entries -= 1;
+            free(entry);
+            continue;
+        }
+        if(name != NULL && entry->hash == hash && strcmp(entry->hostname, name) == 0) {
+            found = entry;
+        }
+        link = &entry->next;
+    }
+    return found;
+}
+
+// Given hostname, answer from a numeric address, the hosts file or the
+// cache, storing the result in query. Otherwise queue a lookup and return
+// RESOLVER_PENDING; query's callback then runs on its mailbox thread once
+// the answer is in. Queries for a name already being looked up share the
+// lookup in flight
+ResolverStatus resolver_lookup(Resolver *resolver, const char *hostname, ResolverQuery *query) {
+    ResolverAddresses *addresses = &query->addresses;
+    memset(addresses, 0, sizeof(*addresses));
+    char name[RESOLVER_HOSTNAME_MAX_SIZE];
+    if(add_numeric_address(addresses, hostname)) {
+        return query->status = RESOLVER_FOUND;
+    }
+    if(!normalize_hostname(hostname, name)) {
+        return query->status = RESOLVER_NOT_FOUND;
+    }
+    for(HostsEntry *host = resolver->hosts; host != NULL; host = host->next) {
+        if(strcmp(host->hostname, name) == 0) {
+            *addresses = host->addresses;
+            __atomic_fetch_add(&resolver->hits, 1, __ATOMIC_RELAXED);
+            return query->status = RESOLVER_FOUND;
+        }
+    }
+
+    uint64_t hash = url_hash(name);
+    pthread_mutex_lock(&resolver->lock);
+    time_t now = now_seconds();
+    size_t bucket = hash & (RESOLVER_TABLE_SIZE - 1);
+    ResolverEntry *entry = sweep_bucket(resolver, bucket, name, hash, now);
+    if(entry != NULL && !entry->pending) {
+        *addresses = entry->addresses;
+        query->status = entry->status;
+        __atomic_fetch_add(&resolver->hits, 1, __ATOMIC_RELAXED);
+        resolver->negative_hits += (entry->status == RESOLVER_NOT_FOUND);
+        pthread_mutex_unlock(&resolver->lock);
+        return query->status;
+    }
+    if(entry != NULL) {
+        resolver->coalesced += 1;
+    } else {
+        // Expired entries are otherwise only dropped when their bucket is
+        // next looked at
+        if(resolver->entries >= RESOLVER_MAX_ENTRIES) {
+            for(size_t i = 0; i < RESOLVER_TABLE_SIZE; i++) {
+                sweep_bucket(resolver, i, NULL, 0, now);
+            }
+        }
+        entry = calloc(1, sizeof(ResolverEntry));
+        strcpy(entry->hostname, name);
+        entry->hash = hash;
+        entry->pending = true;
+        entry->next = resolver->buckets[bucket];
+        resolver->buckets[bucket] = entry;
+        resolver->entries += 1;
+        if(resolver->queue_tail != NULL) {
+            resolver->queue_tail->queue_next = entry;
+        } else {
+            resolver->queue_head = entry;
+        }
+        resolver->queue_tail = entry;
+        pthread_cond_signal(&resolver->work);
+    }
+    // The answer may be delivered as soon as the lock is dropped
+    query->status = RESOLVER_PENDING;
+    query->next = entry->waiters;
+    entry->waiters = query;
+    pthread_mutex_unlock(&resolver->lock);
+    return RESOLVER_PENDING;
+}
+
+// Given hostname, record type and id, build DNS query in packet. Return
+// its size, or 0 if the hostname cannot be encoded
+static size_t build_query(unsigned char *packet, uint16_t id, const char *hostname, uint16_t type) {
+    memset(packet, 0, DNS_HEADER_SIZE);
+    packet[0] = id >> 8;
+    packet[1] = id & 0xff;
+    packet[2] = 0x01;              // Recursion desired
+    packet[5] = 1;                 // One question
+    size_t size = DNS_HEADER_SIZE;
+    const char *label = hostname;
+    while(*label != '\0') {
+        const char *dot = strchr(label, '.');
+        size_t length = (dot != NULL) ? (size_t)(dot - label) : strlen(label);
+        if(length == 0 || length > 63 || size + length + 6 > DNS_PACKET_MAX_SIZE) {
+            return 0;
+        }
+        packet[size++] = length;
+        memcpy(packet + size, label, length);
+        size += length;
+        label += length + (dot != NULL);
+    }
+    packet[size++] = 0;
+    packet[size++] = type >> 8;
+    packet[size++] = type & 0xff;
+    packet[size++] = 0;
+    packet[size++] = DNS_CLASS_IN;
+    return size;
+}
+
+// Given offset of a possibly compressed name in packet, return offset just
+// past it, or 0 if the packet is truncated
+static size_t skip_name(const unsigned char *packet, size_t size, size_t offset) {
+    while(offset < size) {
+        unsigned char length = packet[offset];
+        if((length & 0xc0) == 0xc0) {
+            return (offset + 2 <= size) ? offset + 2 : 0;
+        }
+        if(length == 0) {
+            return offset + 1;
+        }
+        offset += 1 + length;
+    }
+    return 0;
+}
+
+static uint32_t read_u32(const unsigned char *data) {
+    return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+}
+
+// Given response to the query with id and record type, store its
+// addresses and TTL in answer. Every address record in the answer section
+// is taken, which covers the target of a CNAME chain. A negative answer
+// is cached for the SOA minimum, capped by RESOLVER_NEGATIVE_TTL. Return
+// false if the packet is not a response to the query
+static bool parse_response(const unsigned char *packet, size_t size, uint16_t id, uint16_t type,
+                           DnsAnswer *answer) {
+    if(size < DNS_HEADER_SIZE || ((packet[0] << 8) | packet[1]) != id || (packet[2] & 0x80) == 0) {
+        return false;
+    }
+    int questions = (packet[4] << 8) | packet[5];
+    int answers = (packet[6] << 8) | packet[7];
+    int authorities = (packet[8] << 8) | packet[9];
+    answer->answered = true;
+    answer->rcode = packet[3] & 0x0f;
+    answer->count = 0;
+    answer->ttl = RESOLVER_NEGATIVE_TTL;
+
+    size_t offset = DNS_HEADER_SIZE;
+    for(int i = 0; i < questions && offset != 0; i++) {
+        offset = skip_name(packet, size, offset);
+        offset = (offset != 0 && offset + 4 <= size) ? offset + 4 : 0;
+    }
+    uint32_t min_ttl = UINT32_MAX;
+    for(int i = 0; i < answers + authorities && offset != 0; i++) {
+        offset = skip_name(packet, size, offset);
+        if(offset == 0 || offset + 10 > size) {
+            break;
+        }
+        uint16_t record_type = (packet[offset] << 8) | packet[offset + 1];
+        uint16_t record_class = (packet[offset + 2] << 8) | packet[offset + 3];
+        uint32_t ttl = read_u32(packet + offset + 4);
+        uint16_t length = (packet[offset + 8] << 8) | packet[offset + 9];
+        const unsigned char *data = packet + offset + 10;
+        offset += 10 + length;
+        if(offset > size || record_class != DNS_CLASS_IN) {
+            continue;
+        }
+        if(i < answers && record_type == type && answer->count < RESOLVER_MAX_ADDRESSES &&
+           length == ((type == DNS_TYPE_A) ? 4 : 16)) {
+            struct sockaddr_storage *address = &answer->address[answer->count++];
+            memset(address, 0, sizeof(*address));
+            if(type == DNS_TYPE_A) {
+                ((struct sockaddr_in *) address)->sin_family = AF_INET;
+                memcpy(&((struct sockaddr_in *) address)->sin_addr, data, 4);
+            } else {
+                ((struct sockaddr_in6 *) address)->sin6_family = AF_INET6;
+                memcpy(&((struct sockaddr_in6 *) address)->sin6_addr, data, 16);
+            }
+            min_ttl = (ttl < min_ttl) ? ttl : min_ttl;
+        } else if(i >= answers && record_type == DNS_TYPE_SOA) {
+            // Minimum is the last field, after two names and four counters
+            size_t soa = skip_name(packet, offset, data - packet);
+            soa = (soa != 0) ? skip_name(packet, offset, soa) : 0;
+            if(soa != 0 && soa + 20 <= offset) {
+                uint32_t minimum = read_u32(packet + soa + 16);
+                uint32_t negative_ttl = (ttl < minimum) ? ttl : minimum;
+                if(negative_ttl < answer->ttl) {
+                    answer->ttl = negative_ttl;
+                }
+            }
+        }
+    }
+    if(answer->count > 0) {
+        answer->ttl = min_ttl;
+    }
+    return true;
+}
+
+// Ask the name server for the A and AAAA records of hostname, storing
+// the addresses found in addresses. Return seconds the answer may be
+// cached for
+static time_t query_nameserver(Resolver *resolver, const char *hostname, ResolverAddresses *addresses) {
+    static const uint16_t types[2] = {DNS_TYPE_A, DNS_TYPE_AAAA};
+    DnsAnswer answers[2];
+    memset(answers, 0, sizeof(answers));
+    unsigned char packet[DNS_PACKET_MAX_SIZE];
+
+    int dns_socket = socket(resolver->nameserver.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(dns_socket < 0 ||
+       connect(dns_socket, (struct sockaddr *) &resolver->nameserver, resolver->nameserver_length) < 0) {
+        perror("Error connecting to name server");
+        if(dns_socket >= 0) {
+            close(dns_socket);
+        }
+        return RESOLVER_FAILURE_TTL;
+    }
+
+    // Both queries go out together and are retried until each is answered
+    for(int attempt = 0; attempt < RESOLVER_ATTEMPTS && !(answers[0].answered && answers[1].answered);
+        attempt++) {
+        uint16_t ids[2];
+        if(getrandom(ids, sizeof(ids), 0) != sizeof(ids)) {
+            ids[0] = rand();
+            ids[1] = rand();
+        }
+        for(int i = 0; i < 2; i++) {
+            size_t size = build_query(packet, ids[i], hostname, types[i]);
+            if(size == 0) {
+                close(dns_socket);
+                return RESOLVER_NEGATIVE_TTL;
+            }
+            if(!answers[i].answered && send(dns_socket, packet, size, 0) < 0) {
+                perror("Error sending DNS query");
+            }
+        }
+        uint64_t deadline = now_ns() + (uint64_t) RESOLVER_TIMEOUT_MS * 1000000;
+        while(!(answers[0].answered && answers[1].answered)) {
+            uint64_t now = now_ns();
+            if(now >= deadline) {
+                break;
+            }
+            struct pollfd ready = {dns_socket, POLLIN, 0};
+            if(poll(&ready, 1, (deadline - now) / 1000000 + 1) <= 0) {
+                continue;
+            }
+            ssize_t size = recv(dns_socket, packet, sizeof(packet), 0);
+            for(int i = 0; i < 2 && size > 0; i++) {
+                if(!answers[i].answered) {
+                    parse_response(packet, size, ids[i], types[i], &answers[i]);
+                }
+            }
+        }
+    }
+    close(dns_socket);
+
+    // IPv4 addresses first. Failures are only cached briefly, since the
+    // name server may recover
+    time_t ttl = RESOLVER_MAX_TTL;
+    bool negative = true;
+    for(int i = 0; i < 2; i++) {
+        for(int j = 0; j < answers[i].count && addresses->count < RESOLVER_MAX_ADDRESSES; j++) {
+            addresses->address[addresses->count] = answers[i].address[j];
+            addresses->length[addresses->count] = (types[i] == DNS_TYPE_A) ?
+                                                  sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+            addresses->count += 1;
+            addresses->ipv4_count += (types[i] == DNS_TYPE_A);
+        }
+        if(answers[i].count > 0 && answers[i].ttl < (uint32_t) ttl) {
+            ttl = answers[i].ttl;
+        }
+        negative &= answers[i].answered && (answers[i].rcode == 0 || answers[i].rcode == DNS_RCODE_NXDOMAIN);
+    }
+    if(addresses->count == 0 && !negative) {
+        ttl = RESOLVER_FAILURE_TTL;
+    } else if(addresses->count == 0) {
+        ttl = (answers[0].ttl < answers[1].ttl) ? answers[0].ttl : answers[1].ttl;
+    }
+    return (ttl < RESOLVER_MIN_TTL) ? RESOLVER_MIN_TTL : ttl;
+}
+
+// Resolver thread. Takes queued names one at a time, asks the name server
+// without holding the lock, then caches the answer and hands it to every
+// query waiting on it
+static void *resolver_main(void *arg) {
+    Resolver *resolver = arg;
+    pthread_mutex_lock(&resolver->lock);
+    while(1) {
+        while(resolver->queue_head == NULL) {
+            pthread_cond_wait(&resolver->work, &resolver->lock);
+        }
+        ResolverEntry *entry = resolver->queue_head;
+        resolver->queue_head = entry->queue_next;
+        if(resolver->queue_head == NULL) {
+            resolver->queue_tail = NULL;
+        }
+        resolver->misses += 1;
+        pthread_mutex_unlock(&resolver->lock);
+
+        ResolverAddresses addresses;
+        memset(&addresses, 0, sizeof(addresses));
+        uint64_t start = now_ns();
+        time_t ttl = query_nameserver(resolver, entry->hostname, &addresses);
+        uint64_t elapsed = now_ns() - start;
+        metrics_add(METRIC_DNS_LOOKUPS, 1);
+        metrics_record(METRIC_DNS_LOOKUP, start);
+
+        pthread_mutex_lock(&resolver->lock);
+        resolver->lookup_ns += elapsed;
+        if(elapsed > resolver->lookup_max_ns) {
+            resolver->lookup_max_ns = elapsed;
+        }
+        resolver->failures += (addresses.count == 0);
+        ResolverStatus status = (addresses.count > 0) ? RESOLVER_FOUND : RESOLVER_NOT_FOUND;
+        entry->addresses = addresses;
+        entry->status = status;
+        entry->expires = now_seconds() + ttl;
+        entry->pending = false;
+        ResolverQuery *query = entry->waiters;
+        entry->waiters = NULL;
+        pthread_mutex_unlock(&resolver->lock);
+        while(query != NULL) {
+            ResolverQuery *next = query->next;
+            query->addresses = addresses;
+            query->status = status;
+            deliver(query);
+            query = next;
+        }
+        pthread_mutex_lock(&resolver->lock);
+    }
+    return NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,125 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      resolver.h
+// Usage:       Header file for asynchronous, cached resolution of origin hostnames
+//*************************************************************************************************
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define RESOLVER_MAX_ADDRESSES 8             // Addresses kept per hostname
+#define RESOLVER_TABLE_SIZE 1024             // Cache buckets, power of two
+#define RESOLVER_MAX_ENTRIES 16384           // Names cached before expired ones are swept
+#define RESOLVER_THREADS 2                   // Lookups that can wait on DNS at once
+#define RESOLVER_HOSTNAME_MAX_SIZE 256
+#define RESOLVER_MIN_TTL 1                   // Seconds, so a zero TTL still coalesces lookups
+#define RESOLVER_MAX_TTL 3600
+#define RESOLVER_NEGATIVE_TTL 30             // Cap on caching names that do not exist
+#define RESOLVER_FAILURE_TTL 5               // Caching of timeouts and server failures
+#define RESOLVER_TIMEOUT_MS 1000             // Per attempt
+#define RESOLVER_ATTEMPTS 2
+#define DEFAULT_HOSTS_FILE "/etc/hosts"
+#define DEFAULT_RESOLV_CONF "/etc/resolv.conf"
+
+// ----STRUCT--------------------------------------------------------------------------------------
+struct ResolverQuery;
+
+typedef enum ResolverStatus{
+    RESOLVER_FOUND,
+    RESOLVER_NOT_FOUND,
+    RESOLVER_PENDING               // Answer is delivered later through the query's mailbox
+} ResolverStatus;
+
+// Addresses of one hostname. IPv4 addresses come first, since origins
+// are not assumed to be reachable over IPv6
+typedef struct ResolverAddresses{
+    int count;
+    int ipv4_count;
+    struct sockaddr_storage address[RESOLVER_MAX_ADDRESSES];
+    socklen_t length[RESOLVER_MAX_ADDRESSES];
+} ResolverAddresses;
+
+// Completed lookups are handed back to the thread that asked for them
+// through its mailbox. Writing to notify_fd wakes that thread, which then
+// calls resolver_mailbox_drain from its event loop
+typedef struct ResolverMailbox{
+    pthread_mutex_t lock;
+    struct ResolverQuery *completed;
+    int notify_fd;
+} ResolverMailbox;
+
+// A lookup waiting for DNS, embedded in whatever asked for it. The
+// callback runs on the mailbox's thread with status and addresses set
+typedef struct ResolverQuery{
+    struct ResolverQuery *next;
+    ResolverMailbox *mailbox;
+    void (*callback)(struct ResolverQuery *query);
+    void *context;
+    ResolverStatus status;
+    ResolverAddresses addresses;
+} ResolverQuery;
+
+// Cached answer for one hostname. Pending entries carry the queries
+// waiting on the lookup in flight for them
+typedef struct ResolverEntry{
+    struct ResolverEntry *next;            // Bucket chain
+    struct ResolverEntry *queue_next;      // Entries waiting for a resolver thread
+    char hostname[RESOLVER_HOSTNAME_MAX_SIZE];
+    uint64_t hash;
+    bool pending;
+    time_t expires;
+    ResolverStatus status;
+    ResolverAddresses addresses;
+    ResolverQuery *waiters;
+} ResolverEntry;
+
+typedef struct HostsEntry{
+    struct HostsEntry *next;
+    char *hostname;
+    ResolverAddresses addresses;
+} HostsEntry;
+
+// Shared by every worker. Hostnames are answered from the hosts file or
+// the cache straight away, otherwise a resolver thread asks the name
+// server while the worker carries on serving other requests
+typedef struct Resolver{
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    ResolverEntry *buckets[RESOLVER_TABLE_SIZE];
+    int entries;
+    ResolverEntry *queue_head;
+    ResolverEntry *queue_tail;
+    pthread_t threads[RESOLVER_THREADS];
+    HostsEntry *hosts;
+    struct sockaddr_storage nameserver;
+    socklen_t nameserver_length;
+
+    uint64_t hits;                 // Answered from the hosts file or cache
+    uint64_t negative_hits;        // Of which cached as not found
+    uint64_t misses;               // Sent to the name server
+    uint64_t coalesced;            // Waited on a lookup already in flight
+    uint64_t failures;             // Lookups that found no address
+    uint64_t lookup_ns;            // Total and worst time spent on lookups
+    uint64_t lookup_max_ns;
+} Resolver;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+Resolver *resolver_create(const char *hosts_file, const char *nameserver);
+ResolverStatus resolver_lookup(Resolver *resolver, const char *hostname, ResolverQuery *query);
+void resolver_print_stats(Resolver *resolver);
+void resolver_mailbox_init(ResolverMailbox *mailbox, int notify_fd);
+void resolver_mailbox_drain(ResolverMailbox *mailbox);
+void resolver_mailbox_destroy(ResolverMailbox *mailbox);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,115 @@
+#!/bin/bash
+
+# Test request coalescing by firing 1,000 simultaneous requests for one
+# URL through the proxy at a local origin that counts the requests it
+# serves. The origin delays its response so every request arrives while
+# the first fetch is still in flight. Exactly one origin fetch must happen,
+# and every client must receive the full response. Then check that clients
+# which half-close their connection once the request is sent, as scripted
+# clients and nc -N do, still receive the whole response to a miss and to
+# a hit. Last, on io_uring, check that a client too slow to take its miss
+# as fast as the origin sends it still receives it intact: the send that
+# waits on it when the fetch completes may still point into the last chunk
+# of the response, and another miss then reuses the memory it is freed from.
+
+PROXY_PORT=9120
+ORIGIN_PORT=8080
+URL="http://127.0.0.1:${ORIGIN_PORT}/size/100000?delay=1000"
+HALF_CLOSE_URL="http://127.0.0.1:${ORIGIN_PORT}/size/100000?delay=200&object=half_close"
+URING_PROXY_PORT=9121
+SLOW_READER_SIZE=3175728
+SLOW_READER_URL="http://127.0.0.1:${ORIGIN_PORT}/size/${SLOW_READER_SIZE}?stall=500"
+
+# Build proxy and test tools
+make -s a.out tools || exit 1
+
+./bench/origin -p $ORIGIN_PORT &
+origin_pid=$!
+./a.out -w 4 $PROXY_PORT > /dev/null &
+proxy_pid=$!
+./a.out -E uring -w 1 -O 100 $URING_PROXY_PORT > /dev/null &
+uring_proxy_pid=$!
+sleep 1
+
+echo "Testing request coalescing..."
+result=$(./bench/loadgen -p $PROXY_PORT -c 1000 -n 1000 "$URL")
+fetches=$(curl -sS "http://127.0.0.1:${ORIGIN_PORT}/count")
+
+echo "Testing half-closed clients..."
+half_closed=$(python3 - $PROXY_PORT "$HALF_CLOSE_URL" <<'EOF'
+import socket, sys
+served = 0
+for attempt in ("miss", "hit"):
+    client = socket.create_connection(("127.0.0.1", int(sys.argv[1])), timeout=10)
+    client.sendall(("GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n" % sys.argv[2]).encode())
+    client.shutdown(socket.SHUT_WR)
+    response = b""
+    while True:
+        data = client.recv(65536)
+        if not data:
+            break
+        response += data
+    head, _, body = response.partition(b"\r\n\r\n")
+    if head.startswith(b"HTTP/1.1 200") and len(body) == 100000:
+        served += 1
+    client.close()
+print(served)
+EOF
+)
+
+echo "Testing a slow reader on io_uring..."
+slow_reader=$(python3 - $URING_PROXY_PORT "$SLOW_READER_URL" $SLOW_READER_SIZE <<'EOF'
+import socket, sys, time
+port, url, size = int(sys.argv[1]), sys.argv[2], int(sys.argv[3])
+client = socket.socket()
+client.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+client.connect(("127.0.0.1", port))
+client.settimeout(10)
+client.sendall(("GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n" % url).encode())
+# Read nothing until the fetch has completed, then have another miss
+# allocate on the same worker before reading the response
+time.sleep(1.5)
+other = socket.create_connection(("127.0.0.1", port), timeout=10)
+other.sendall(("GET %s&object=other HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n" % url).encode())
+while other.recv(65536):
+    pass
+client.shutdown(socket.SHUT_WR)
+response = b""
+while True:
+    data = client.recv(65536)
+    if not data:
+        break
+    response += data
+head, _, body = response.partition(b"\r\n\r\n")
+expected = bytes(ord("a") + i % 26 for i in range(size))
+print("intact" if head.startswith(b"HTTP/1.1 200") and body == expected else "corrupt")
+EOF
+)
+
+echo "Stopping proxy server..."
+kill $proxy_pid $uring_proxy_pid $origin_pid
+
+echo "$result"
+echo "origin_fetches=${fetches}"
+echo "half_closed_served=${half_closed}"
+echo "slow_reader=${slow_reader}"
+status=0
+if echo "$result" | grep -q "requests=1000 errors=0 " && [ "$fetches" = "1" ]; then
+    echo "Coalescing: Success"
+else
+    echo "Coalescing: Failure"
+    status=1
+fi
+if [ "$half_closed" = "2" ]; then
+    echo "Half-close: Success"
+else
+    echo "Half-close: Failure"
+    status=1
+fi
+if [ "$slow_reader" = "intact" ]; then
+    echo "Slow reader: Success"
+else
+    echo "Slow reader: Failure"
+    status=1
+fi
+exit $status
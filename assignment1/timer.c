@@ -0,0 +1,135 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      timer.c
+// Usage:       Implementation file for the hierarchical timer wheel behind per-connection deadlines
+//*************************************************************************************************
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "timer.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define TIMER_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_LEVEL_SHIFT(level) (TIMER_WHEEL_BITS * (level))
+// Furthest a timer can be set ahead, in ticks: every slot of the top level
+// but the current one, so a top level slot never holds two rounds at once
+#define TIMER_MAX_TICKS ((uint64_t) TIMER_SLOT_MASK << TIMER_LEVEL_SHIFT(TIMER_WHEEL_LEVELS - 1))
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+static uint64_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void timer_wheel_init(TimerWheel *wheel) {
+    memset(wheel, 0, sizeof(TimerWheel));
+    wheel->started_ms = monotonic_ms();
+}
+
+void timer_init(Timer *timer, TimerHandler handler, void *context) {
+    memset(timer, 0, sizeof(Timer));
+    timer->handler = handler;
+    timer->context = context;
+}
+
+bool timer_pending(const Timer *timer) {
+    return timer->slot != NULL;
+}
+
+// Given a duration, return it in ticks, rounded up
+uint64_t timer_ticks(unsigned int milliseconds) {
+    return (milliseconds + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+}
+
+// Put timer in the lowest level whose current span holds its tick. Its
+// slot there is always ahead of the level's current one, so the timer is
+// moved down, or fired, exactly when the wheel reaches it. Anything past
+// the span of the level below the top goes in the top level
+static void place(TimerWheel *wheel, Timer *timer) {
+    int level = 0;
+    while(level < TIMER_WHEEL_LEVELS - 1 &&
+          (timer->expires >> TIMER_LEVEL_SHIFT(level + 1)) != (wheel->now >> TIMER_LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+    Timer **slot = &wheel->slots[level][(timer->expires >> TIMER_LEVEL_SHIFT(level)) & TIMER_SLOT_MASK];
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if(*slot != NULL) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+}
+
+// Take timer out of its slot
+static void unlink_timer(Timer *timer) {
+    if(timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        *timer->slot = timer->next;
+    }
+    if(timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    timer->slot = NULL;
+}
+
+// Fire timer once the given time has passed, replacing any time it was
+// set to before. Deadlines are kept to within a tick, counted from the
+// last tick the wheel reached, so setting one reads no clock
+void timer_set(TimerWheel *wheel, Timer *timer, unsigned int milliseconds) {
+    if(timer->slot != NULL) {
+        unlink_timer(timer);
+    }
+    uint64_t ticks = timer_ticks(milliseconds);
+    if(ticks == 0) {
+        ticks = 1;
+    } else if(ticks > TIMER_MAX_TICKS) {
+        ticks = TIMER_MAX_TICKS;
+    }
+    timer->expires = wheel->now + ticks;
+    place(wheel, timer);
+}
+
+void timer_cancel(Timer *timer) {
+    if(timer->slot != NULL) {
+        unlink_timer(timer);
+    }
+}
+
+// Move the timers of a slot in a level above the first to the levels below
+static void cascade(TimerWheel *wheel, int level, int index) {
+    Timer *timer = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+    while(timer != NULL) {
+        Timer *next = timer->next;
+        place(wheel, timer);
+        timer = next;
+    }
+}
+
+// Fire every timer due by now, a tick at a time. Handlers may set or
+// cancel any timer, themselves included
+void timer_wheel_advance(TimerWheel *wheel) {
+    uint64_t target = (monotonic_ms() - wheel->started_ms) / TIMER_TICK_MS;
+    while(wheel->now < target) {
+        wheel->now += 1;
+        for(int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if((wheel->now & (((uint64_t) 1 << TIMER_LEVEL_SHIFT(level)) - 1)) == 0) {
+                cascade(wheel, level, (wheel->now >> TIMER_LEVEL_SHIFT(level)) & TIMER_SLOT_MASK);
+            }
+        }
+        Timer **slot = &wheel->slots[0][wheel->now & TIMER_SLOT_MASK];
+        while(*slot != NULL) {
+            Timer *timer = *slot;
+            unlink_timer(timer);
+            timer->handler(timer);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
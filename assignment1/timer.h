@@ -0,0 +1,59 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      timer.h
+// Usage:       Header file for the hierarchical timer wheel behind per-connection deadlines
+//*************************************************************************************************
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define TIMER_TICK_MS 100                     // Resolution of every deadline
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4                  // 64^4 ticks, longer deadlines are cut to that
+
+// ----STRUCT--------------------------------------------------------------------------------------
+struct Timer;
+
+typedef void (*TimerHandler)(struct Timer *timer);
+
+// A deadline embedded in whatever it guards, so setting and cancelling
+// one allocates nothing. A timer is in at most one slot of the wheel
+typedef struct Timer{
+    struct Timer *prev;
+    struct Timer *next;
+    struct Timer **slot;       // Head of the slot list holding the timer, NULL if not set
+    uint64_t expires;          // Tick the timer fires on
+    TimerHandler handler;
+    void *context;
+} Timer;
+
+// Each worker keeps its own wheel, advanced from the worker's tick timer.
+// Level 0 has a slot for each of the next 64 ticks; each level above
+// covers 64 times the span of the one below, and its timers are moved
+// down a level as the wheel reaches their slot. Setting, resetting and
+// cancelling a timer are constant time however many are pending
+typedef struct TimerWheel{
+    uint64_t now;              // Last tick whose timers have fired
+    uint64_t started_ms;       // Monotonic clock at tick 0
+    Timer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} TimerWheel;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+void timer_wheel_init(TimerWheel *wheel);
+void timer_wheel_advance(TimerWheel *wheel);
+void timer_init(Timer *timer, TimerHandler handler, void *context);
+void timer_set(TimerWheel *wheel, Timer *timer, unsigned int milliseconds);
+void timer_cancel(Timer *timer);
+bool timer_pending(const Timer *timer);
+uint64_t timer_ticks(unsigned int milliseconds);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
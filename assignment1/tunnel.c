@@ -0,0 +1,371 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      tunnel.c
+// Usage:       Implementation file for CONNECT tunnels relaying bytes between client and origin
+//*************************************************************************************************
+#define _GNU_SOURCE               // splice, F_SETPIPE_SZ
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "tunnel.h"
+#include "metrics.h"
+#include "worker.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+static void handle_tunnel_event(EventSource *source, uint32_t events);
+static void handle_resolved(ResolverQuery *query);
+static void relay(Tunnel *tunnel);
+
+// Given direction of a tunnel, set up its pipe. Return -1 on failure
+static int pipe_init(TunnelPipe *pipe_state) {
+#ifdef TUNNEL_COPY
+    pipe_state->data = malloc(TUNNEL_COPY_SIZE);
+    pipe_state->capacity = TUNNEL_COPY_SIZE;
+#else
+    if(pipe2(pipe_state->fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        pipe_state->fds[0] = pipe_state->fds[1] = -1;
+        return -1;
+    }
+    // A larger pipe moves more per splice() call. Unprivileged processes
+    // may be refused, leaving the default
+    fcntl(pipe_state->fds[1], F_SETPIPE_SZ, TUNNEL_PIPE_SIZE);
+    int capacity = fcntl(pipe_state->fds[1], F_GETPIPE_SZ);
+    pipe_state->capacity = (capacity > 0) ? (size_t) capacity : 65536;
+#endif
+    return 0;
+}
+
+static void pipe_free(TunnelPipe *pipe_state) {
+#ifdef TUNNEL_COPY
+    free(pipe_state->data);
+    pipe_state->data = NULL;
+#else
+    for(int i = 0; i < 2; i++) {
+        if(pipe_state->fds[i] >= 0) {
+            close(pipe_state->fds[i]);
+            pipe_state->fds[i] = -1;
+        }
+    }
+#endif
+}
+
+// Given direction and its source socket, move what the socket has into
+// the pipe, as far as there is room. Return bytes moved, 0 at end of
+// stream, or -1 with errno set
+static ssize_t pipe_fill(TunnelPipe *pipe_state, int fd) {
+    size_t room = pipe_state->capacity - pipe_state->buffered;
+#ifdef TUNNEL_COPY
+    // What a short write left behind moves to the front, so a read of no
+    // room is never mistaken for the end of the stream
+    memmove(pipe_state->data, pipe_state->data + pipe_state->start, pipe_state->buffered);
+    pipe_state->start = 0;
+    return read(fd, pipe_state->data + pipe_state->buffered, room);
+#else
+    return splice(fd, NULL, pipe_state->fds[1], NULL, room, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#endif
+}
+
+// Given direction and its destination socket, write out what the pipe
+// holds. Return bytes moved, or -1 with errno set
+static ssize_t pipe_drain(TunnelPipe *pipe_state, int fd) {
+#ifdef TUNNEL_COPY
+    ssize_t n = write(fd, pipe_state->data + pipe_state->start, pipe_state->buffered);
+    if(n > 0) {
+        pipe_state->start += n;
+    }
+    return n;
+#else
+    return splice(pipe_state->fds[0], NULL, fd, NULL, pipe_state->buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#endif
+}
+
+// Given worker, client socket taken from its connection, origin host and
+// port from the CONNECT request and any bytes the client sent after the
+// request, start the tunnel by looking up the origin. Return NULL if it
+// cannot be set up, in which case the client socket has been closed
+Tunnel *tunnel_create(Worker *worker, int client_socket, const char *hostname, size_t hostname_length,
+                      int port, const char *early_data, size_t early_size) {
+    Tunnel *tunnel = calloc(1, sizeof(Tunnel));
+    tunnel->worker = worker;
+    tunnel->loop = worker->loop;
+    tunnel->client.fd = client_socket;
+    tunnel->client.handler = handle_tunnel_event;
+    tunnel->client.context = tunnel;
+    tunnel->origin.fd = -1;
+    tunnel->origin.handler = handle_tunnel_event;
+    tunnel->origin.context = tunnel;
+    tunnel->port = port;
+    tunnel->active_since = monotonic_seconds();
+#ifndef TUNNEL_COPY
+    tunnel->up.fds[0] = tunnel->up.fds[1] = tunnel->down.fds[0] = tunnel->down.fds[1] = -1;
+#endif
+    // Nothing is read from the client until the origin is connected, but a
+    // client going away is noticed
+    if(hostname_length >= sizeof(tunnel->hostname) || pipe_init(&tunnel->up) < 0 ||
+       pipe_init(&tunnel->down) < 0 || event_loop_add(tunnel->loop, &tunnel->client, EPOLLRDHUP) < 0) {
+        pipe_free(&tunnel->up);
+        pipe_free(&tunnel->down);
+        close(client_socket);
+        free(tunnel);
+        return NULL;
+    }
+    memcpy(tunnel->hostname, hostname, hostname_length);
+    tunnel->hostname[hostname_length] = '\0';
+    if(early_size > 0) {
+        tunnel->early_data = malloc(early_size);
+        memcpy(tunnel->early_data, early_data, early_size);
+        tunnel->early_size = early_size;
+    }
+
+    tunnel->next = worker->tunnels;
+    if(worker->tunnels != NULL) {
+        worker->tunnels->prev = tunnel;
+    }
+    worker->tunnels = tunnel;
+
+    tunnel->state = TUNNEL_RESOLVING;
+    tunnel->query.mailbox = &worker->resolved;
+    tunnel->query.callback = handle_resolved;
+    tunnel->query.context = tunnel;
+    if(resolver_lookup(worker->upstream->resolver, tunnel->hostname, &tunnel->query) != RESOLVER_PENDING) {
+        handle_resolved(&tunnel->query);
+    }
+    return tunnel;
+}
+
+// Close both sockets and release the tunnel. A tunnel whose lookup is
+// still in flight is only freed once the answer arrives
+void tunnel_close(Tunnel *tunnel) {
+    if(tunnel->state == TUNNEL_CLOSED) {
+        return;
+    }
+    bool resolving = (tunnel->state == TUNNEL_RESOLVING);
+    tunnel->state = TUNNEL_CLOSED;
+    EventSource *sources[2] = {&tunnel->client, &tunnel->origin};
+    for(int i = 0; i < 2; i++) {
+        if(sources[i]->fd >= 0) {
+            event_loop_close(tunnel->loop, sources[i]);
+            sources[i]->fd = -1;
+        }
+    }
+    pipe_free(&tunnel->up);
+    pipe_free(&tunnel->down);
+    free(tunnel->early_data);
+    tunnel->early_data = NULL;
+
+    Worker *worker = tunnel->worker;
+    if(tunnel->prev != NULL) {
+        tunnel->prev->next = tunnel->next;
+    } else {
+        worker->tunnels = tunnel->next;
+    }
+    if(tunnel->next != NULL) {
+        tunnel->next->prev = tunnel->prev;
+    }
+    if(!resolving) {
+        event_loop_defer_free(tunnel->loop, tunnel);
+    }
+}
+
+// Tell the client the origin could not be reached, and close the tunnel
+static void fail_tunnel(Tunnel *tunnel) {
+    if(write(tunnel->client.fd, TUNNEL_BAD_GATEWAY, strlen(TUNNEL_BAD_GATEWAY)) < 0) {
+        // The client is closed either way
+    }
+    tunnel_close(tunnel);
+}
+
+// The origin's name has been looked up. Connect to the first of its
+// addresses that accepts a connect attempt; completion is signalled by the
+// socket becoming writable
+static void handle_resolved(ResolverQuery *query) {
+    Tunnel *tunnel = query->context;
+    if(tunnel->state == TUNNEL_CLOSED) {
+        event_loop_defer_free(tunnel->loop, tunnel);
+        return;
+    }
+    ResolverAddresses *addresses = &query->addresses;
+    int candidates = (addresses->ipv4_count > 0) ? addresses->ipv4_count : addresses->count;
+    int origin_socket = -1;
+    for(int i = 0; query->status == RESOLVER_FOUND && i < candidates && origin_socket < 0; i++) {
+        struct sockaddr_storage origin_addr = addresses->address[i];
+        if(origin_addr.ss_family == AF_INET) {
+            ((struct sockaddr_in *) &origin_addr)->sin_port = htons(tunnel->port);
+        } else {
+            ((struct sockaddr_in6 *) &origin_addr)->sin6_port = htons(tunnel->port);
+        }
+        origin_socket = socket(origin_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if(origin_socket >= 0 && connect(origin_socket, (struct sockaddr *) &origin_addr, addresses->length[i]) < 0 &&
+           errno != EINPROGRESS) {
+            close(origin_socket);
+            origin_socket = -1;
+        }
+    }
+    tunnel->state = TUNNEL_CONNECTING;
+    if(origin_socket < 0) {
+        fail_tunnel(tunnel);
+        return;
+    }
+    tunnel->origin.fd = origin_socket;
+    if(event_loop_add(tunnel->loop, &tunnel->origin, EPOLLOUT) < 0) {
+        perror("Error registering origin socket");
+        fail_tunnel(tunnel);
+    }
+}
+
+// Check outcome of the connect. Once connected, the client is told the
+// tunnel is established and relaying starts with the bytes the client
+// sent early
+static void finish_connecting(Tunnel *tunnel) {
+    int error = 0;
+    socklen_t error_size = sizeof(error);
+    getsockopt(tunnel->origin.fd, SOL_SOCKET, SO_ERROR, &error, &error_size);
+    if(error != 0) {
+        fail_tunnel(tunnel);
+        return;
+    }
+    int opt = 1;
+    setsockopt(tunnel->origin.fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    // The reply is tiny and the client's socket empty, so it goes in one write
+    size_t reply_size = strlen(TUNNEL_ESTABLISHED);
+    if(write(tunnel->client.fd, TUNNEL_ESTABLISHED, reply_size) != (ssize_t) reply_size) {
+        tunnel_close(tunnel);
+        return;
+    }
+    tunnel->state = TUNNEL_OPEN;
+    metrics_add(METRIC_TUNNELS, 1);
+    relay(tunnel);
+}
+
+// Given direction and its source and destination sockets, move bytes
+// until neither side can make progress. Once the source has shut down and
+// everything has been written, shut the destination for writing so the
+// other end sees the close. Return bytes moved, or -1 if either socket failed
+static ssize_t relay_direction(TunnelPipe *pipe_state, int from, int to) {
+    ssize_t moved = 0;
+    pipe_state->blocked = false;
+    while(!pipe_state->shut) {
+        bool progress = false;
+        if(!pipe_state->eof && pipe_state->buffered < pipe_state->capacity) {
+            ssize_t n = pipe_fill(pipe_state, from);
+            if(n > 0) {
+                pipe_state->buffered += n;
+                progress = true;
+            } else if(n == 0) {
+                pipe_state->eof = true;
+            } else if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+        }
+        if(pipe_state->buffered > 0) {
+            ssize_t n = pipe_drain(pipe_state, to);
+            if(n > 0) {
+                pipe_state->buffered -= n;
+                pipe_state->bytes += n;
+                moved += n;
+                progress = true;
+            } else if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            } else {
+                pipe_state->blocked = true;
+            }
+        }
+        if(pipe_state->eof && pipe_state->buffered == 0) {
+            shutdown(to, SHUT_WR);
+            pipe_state->shut = true;
+        }
+        if(!progress) {
+            break;
+        }
+    }
+    return moved;
+}
+
+// Relay both directions of an open tunnel. A direction whose destination
+// is full stops reading its source until the destination drains, so a
+// fast sender cannot make the loop spin. The tunnel closes once both
+// directions have been relayed to the end
+static void relay(Tunnel *tunnel) {
+    // Bytes the client sent with its CONNECT request go to the origin first
+    while(tunnel->early_sent < tunnel->early_size) {
+        ssize_t n = write(tunnel->origin.fd, tunnel->early_data + tunnel->early_sent,
+                          tunnel->early_size - tunnel->early_sent);
+        if(n < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                event_loop_modify(tunnel->loop, &tunnel->origin, EPOLLOUT);
+                event_loop_modify(tunnel->loop, &tunnel->client, 0);
+                return;
+            }
+            tunnel_close(tunnel);
+            return;
+        }
+        tunnel->early_sent += n;
+        tunnel->up.bytes += n;
+        metrics_add(METRIC_TUNNEL_BYTES_UP, n);
+    }
+
+    ssize_t up = relay_direction(&tunnel->up, tunnel->client.fd, tunnel->origin.fd);
+    ssize_t down = (up >= 0) ? relay_direction(&tunnel->down, tunnel->origin.fd, tunnel->client.fd) : -1;
+    if(up > 0 || down > 0) {
+        tunnel->active_since = monotonic_seconds();
+        metrics_add(METRIC_TUNNEL_BYTES_UP, (up > 0) ? up : 0);
+        metrics_add(METRIC_TUNNEL_BYTES_DOWN, (down > 0) ? down : 0);
+    }
+    if(up < 0 || down < 0 || (tunnel->up.shut && tunnel->down.shut)) {
+        tunnel_close(tunnel);
+        return;
+    }
+    uint32_t client_events = (!tunnel->up.eof && !tunnel->up.blocked) ? EPOLLIN : 0;
+    uint32_t origin_events = (!tunnel->down.eof && !tunnel->down.blocked) ? EPOLLIN : 0;
+    origin_events |= tunnel->up.blocked ? EPOLLOUT : 0;
+    client_events |= tunnel->down.blocked ? EPOLLOUT : 0;
+    event_loop_modify(tunnel->loop, &tunnel->client, client_events);
+    event_loop_modify(tunnel->loop, &tunnel->origin, origin_events);
+}
+
+// Dispatch readiness of either socket to the tunnel's current state
+static void handle_tunnel_event(EventSource *source, uint32_t events) {
+    Tunnel *tunnel = source->context;
+    if(tunnel->state == TUNNEL_CLOSED) {
+        return;
+    }
+    // A refused connect is reported as an error, and answered with a 502
+    if(tunnel->state == TUNNEL_CONNECTING && source == &tunnel->origin) {
+        finish_connecting(tunnel);
+    } else if(events & EPOLLERR) {
+        tunnel_close(tunnel);
+    } else if(tunnel->state == TUNNEL_OPEN) {
+        relay(tunnel);
+    } else if(events & (EPOLLHUP | EPOLLRDHUP)) {
+        // Client went away before the tunnel was established
+        tunnel_close(tunnel);
+    }
+}
+
+// Close tunnels of the worker that have carried nothing for longer than
+// the idle timeout, or are still waiting for their origin after it
+void tunnel_sweep(Worker *worker) {
+    time_t now = monotonic_seconds();
+    Tunnel *tunnel = worker->tunnels;
+    while(tunnel != NULL) {
+        Tunnel *next = tunnel->next;
+        if(now - tunnel->active_since >= TUNNEL_IDLE_TIMEOUT) {
+            tunnel_close(tunnel);
+        }
+        tunnel = next;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,88 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      tunnel.h
+// Usage:       Header file for CONNECT tunnels relaying bytes between client and origin
+//*************************************************************************************************
+#ifndef TUNNEL_H
+#define TUNNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "event_loop.h"
+#include "resolver.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define TUNNEL_PIPE_SIZE (1024*1024)  // Asked of each pipe; the kernel may grant less
+#define TUNNEL_COPY_SIZE (64*1024)    // Buffer of each direction when built with TUNNEL_COPY
+#define TUNNEL_IDLE_TIMEOUT 300       // Seconds a tunnel may carry nothing in either direction
+#define TUNNEL_ESTABLISHED "HTTP/1.1 200 Connection Established\r\n\r\n"
+#define TUNNEL_BAD_GATEWAY "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+
+// ----STRUCT--------------------------------------------------------------------------------------
+struct Worker;
+
+typedef enum TunnelState{
+    TUNNEL_RESOLVING,
+    TUNNEL_CONNECTING,
+    TUNNEL_OPEN,
+    TUNNEL_CLOSED
+} TunnelState;
+
+// One direction of a tunnel. Bytes read from the source socket wait in a
+// pipe until written to the other socket, so with splice() they move
+// between the sockets without being copied through the proxy. Built with
+// TUNNEL_COPY, a plain buffer takes the place of the pipe for comparison
+typedef struct TunnelPipe{
+#ifdef TUNNEL_COPY
+    char *data;
+    size_t start;
+#else
+    int fds[2];
+#endif
+    size_t capacity;
+    size_t buffered;           // Bytes read from the source not yet written on
+    bool eof;                  // Source has shut its sending side
+    bool blocked;              // Destination socket is full; reading waits for it
+    bool shut;                 // Everything relayed and the destination shut for writing
+    uint64_t bytes;            // Relayed in this direction
+} TunnelPipe;
+
+// A client connection turned into a byte stream to an origin by CONNECT.
+// The origin's name is looked up and connected to, the client told the
+// tunnel is established, and from then on bytes are relayed both ways
+// until both sides have shut down, either fails, or nothing moves for
+// TUNNEL_IDLE_TIMEOUT seconds
+typedef struct Tunnel{
+    struct Tunnel *prev;       // Tunnels of the worker
+    struct Tunnel *next;
+    struct Worker *worker;
+    EventLoop *loop;
+    TunnelState state;
+    EventSource client;
+    EventSource origin;
+    char hostname[RESOLVER_HOSTNAME_MAX_SIZE];
+    int port;
+    ResolverQuery query;
+    char *early_data;          // Sent by the client after CONNECT, before the reply
+    size_t early_size;
+    size_t early_sent;
+    TunnelPipe up;             // Client to origin
+    TunnelPipe down;           // Origin to client
+    time_t active_since;       // Bytes last moved, for the idle timeout
+} Tunnel;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+Tunnel *tunnel_create(struct Worker *worker, int client_socket, const char *hostname, size_t hostname_length,
+                      int port, const char *early_data, size_t early_size);
+void tunnel_close(Tunnel *tunnel);
+void tunnel_sweep(struct Worker *worker);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,357 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      upstream.c
+// Usage:       Implementation file for per-worker pools of persistent origin connections
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "upstream.h"
+#include "fetch.h"
+#include "metrics.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+static void handle_upstream_event(EventSource *source, uint32_t events);
+static void handle_resolved(ResolverQuery *query);
+
+// Return seconds on a clock that never jumps backwards
+time_t monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+// Given worker's event loop, the shared fetch table for counters, the
+// resolver with the worker's mailbox for its answers and the connection
+// limit per origin, create empty pool
+UpstreamPool *upstream_pool_create(EventLoop *loop, struct FetchTable *table, Resolver *resolver,
+                                   ResolverMailbox *mailbox, int max_connections) {
+    UpstreamPool *pool = calloc(1, sizeof(UpstreamPool));
+    pool->loop = loop;
+    pool->table = table;
+    pool->resolver = resolver;
+    pool->mailbox = mailbox;
+    pool->max_connections = max_connections;
+    return pool;
+}
+
+static void close_connection(UpstreamPool *pool, UpstreamConnection *conn) {
+    event_loop_close(pool->loop, &conn->source);
+    conn->origin->connections -= 1;
+    event_loop_defer_free(pool->loop, conn);
+}
+
+// Remove connection from its origin's idle list
+static void idle_remove(UpstreamConnection *conn) {
+    UpstreamOrigin *origin = conn->origin;
+    if(conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        origin->idle = conn->next;
+    }
+    if(conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+}
+
+// Only called once the worker has stopped, when no fetch is running
+void upstream_pool_free(UpstreamPool *pool) {
+    for(int i = 0; i < UPSTREAM_TABLE_SIZE; i++) {
+        UpstreamOrigin *origin = pool->buckets[i];
+        while(origin != NULL) {
+            UpstreamOrigin *next = origin->next;
+            while(origin->idle != NULL) {
+                UpstreamConnection *conn = origin->idle;
+                idle_remove(conn);
+                close_connection(pool, conn);
+            }
+            free(origin->hostname);
+            free(origin);
+            origin = next;
+        }
+    }
+    free(pool);
+}
+
+static size_t origin_bucket(const char *hostname, int port) {
+    return (url_hash(hostname) ^ (uint64_t) port) & (UPSTREAM_TABLE_SIZE - 1);
+}
+
+// Given hostname and port, return the pool's record for the origin,
+// creating it if this is the first connection to it
+static UpstreamOrigin *find_origin(UpstreamPool *pool, const char *hostname, int port) {
+    size_t bucket = origin_bucket(hostname, port);
+    for(UpstreamOrigin *origin = pool->buckets[bucket]; origin != NULL; origin = origin->next) {
+        if(origin->port == port && strcmp(origin->hostname, hostname) == 0) {
+            return origin;
+        }
+    }
+    UpstreamOrigin *origin = calloc(1, sizeof(UpstreamOrigin));
+    origin->pool = pool;
+    origin->hostname = strdup(hostname);
+    origin->port = port;
+    origin->query.mailbox = pool->mailbox;
+    origin->query.callback = handle_resolved;
+    origin->query.context = origin;
+    origin->next = pool->buckets[bucket];
+    pool->buckets[bucket] = origin;
+    return origin;
+}
+
+// Given addresses of origin, begin a non-blocking connect to the next one
+// in turn, skipping any that fail straight away. IPv6 addresses are only
+// used when there are no IPv4 ones. Return the new connection, or NULL if
+// the origin cannot be reached
+static UpstreamConnection *open_connection(UpstreamPool *pool, UpstreamOrigin *origin,
+                                           ResolverAddresses *addresses) {
+    int candidates = (addresses->ipv4_count > 0) ? addresses->ipv4_count : addresses->count;
+    int server_socket = -1;
+    for(int attempt = 0; attempt < candidates && server_socket < 0; attempt++) {
+        int i = origin->next_address++ % candidates;
+        struct sockaddr_storage server_addr = addresses->address[i];
+        if(server_addr.ss_family == AF_INET) {
+            ((struct sockaddr_in *) &server_addr)->sin_port = htons(origin->port);
+        } else {
+            ((struct sockaddr_in6 *) &server_addr)->sin6_port = htons(origin->port);
+        }
+
+        // Create socket for server
+        server_socket = socket(server_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if(server_socket < 0) {
+            perror("Error creating connection socket");
+            return NULL;
+        }
+        // Requests are written whole, so there is nothing for Nagle's algorithm
+        // to coalesce, only a delayed ACK to wait for on a reused connection
+        int opt = 1;
+        setsockopt(server_socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        // Connect to server. Completion is signalled by the socket becoming writable
+        if(connect(server_socket, (struct sockaddr *) &server_addr, addresses->length[i]) < 0 &&
+           errno != EINPROGRESS) {
+            perror("Unable to connect to server");
+            close(server_socket);
+            server_socket = -1;
+        }
+    }
+    if(server_socket < 0) {
+        return NULL;
+    }
+    UpstreamConnection *conn = calloc(1, sizeof(UpstreamConnection));
+    conn->pool = pool;
+    conn->origin = origin;
+    conn->connect_started = metrics_now();
+    conn->source.fd = server_socket;
+    conn->source.handler = handle_upstream_event;
+    conn->source.context = conn;
+    if(event_loop_add(pool->loop, &conn->source, EPOLLOUT) < 0) {
+        perror("Error registering server socket");
+        close(server_socket);
+        free(conn);
+        return NULL;
+    }
+    origin->connections += 1;
+    __atomic_fetch_add(&pool->table->connections_opened, 1, __ATOMIC_RELAXED);
+    return conn;
+}
+
+// Add fetch to the end of origin's queue
+static void enqueue(UpstreamOrigin *origin, struct Fetch *fetch) {
+    fetch->queue_next = NULL;
+    if(origin->queue_tail != NULL) {
+        origin->queue_tail->queue_next = fetch;
+    } else {
+        origin->queue_head = fetch;
+    }
+    origin->queue_tail = fetch;
+}
+
+// Return true if another connection to origin may be opened
+static bool below_limit(UpstreamPool *pool, UpstreamOrigin *origin) {
+    return pool->max_connections == 0 || origin->connections < pool->max_connections;
+}
+
+// Remove and return the first fetch queued for a connection to origin
+static struct Fetch *dequeue(UpstreamOrigin *origin) {
+    struct Fetch *fetch = origin->queue_head;
+    if(fetch != NULL) {
+        origin->queue_head = fetch->queue_next;
+        if(origin->queue_head == NULL) {
+            origin->queue_tail = NULL;
+        }
+    }
+    return fetch;
+}
+
+// Open connections for the fetches queued on origin, as far as its limit
+// allows. The hostname is looked up first unless answered is set, in which
+// case the answer just delivered to the origin's query is used. A lookup
+// that has to wait for DNS leaves the fetches queued until it completes.
+// Fetches fail if the origin has no address or cannot be reached
+static void serve_queue(UpstreamPool *pool, UpstreamOrigin *origin, bool answered) {
+    while(origin->queue_head != NULL && !origin->resolving && below_limit(pool, origin)) {
+        if(!answered) {
+            answered = true;
+            if(resolver_lookup(pool->resolver, origin->hostname, &origin->query) == RESOLVER_PENDING) {
+                origin->resolving = true;
+                return;
+            }
+        }
+        struct Fetch *fetch = dequeue(origin);
+        UpstreamConnection *conn = NULL;
+        if(origin->query.status == RESOLVER_FOUND) {
+            conn = open_connection(pool, origin, &origin->query.addresses);
+        }
+        if(conn == NULL) {
+            fetch_fail(fetch);
+            continue;
+        }
+        conn->fetch = fetch;
+        fetch_attach(fetch, conn);
+    }
+}
+
+// The lookup of an origin's hostname has completed
+static void handle_resolved(ResolverQuery *query) {
+    UpstreamOrigin *origin = query->context;
+    origin->resolving = false;
+    serve_queue(origin->pool, origin, true);
+}
+
+// Given fetch with its origin hostname and port set, hand it an idle
+// connection to the origin, or a new one if the origin is below its
+// connection limit. Otherwise queue the fetch until a connection is
+// released or the origin's address has been looked up. Return -1 if a
+// new connection could not be opened
+int upstream_acquire(UpstreamPool *pool, struct Fetch *fetch) {
+    UpstreamOrigin *origin = find_origin(pool, fetch->hostname, fetch->server_port);
+    UpstreamConnection *conn = origin->idle;
+    if(conn != NULL) {
+        idle_remove(conn);
+        __atomic_fetch_add(&pool->table->connections_reused, 1, __ATOMIC_RELAXED);
+        conn->fetch = fetch;
+        fetch_attach(fetch, conn);
+        return 0;
+    }
+    if(origin->resolving || !below_limit(pool, origin)) {
+        enqueue(origin, fetch);
+        return 0;
+    }
+    ResolverStatus status = resolver_lookup(pool->resolver, origin->hostname, &origin->query);
+    if(status == RESOLVER_PENDING) {
+        origin->resolving = true;
+        enqueue(origin, fetch);
+        return 0;
+    }
+    conn = (status == RESOLVER_FOUND) ? open_connection(pool, origin, &origin->query.addresses) : NULL;
+    if(conn == NULL) {
+        return -1;
+    }
+    conn->fetch = fetch;
+    fetch_attach(fetch, conn);
+    return 0;
+}
+
+// Given fetch queued for a connection to its origin, take it out of the
+// queue, as it has given up waiting
+void upstream_cancel(UpstreamPool *pool, struct Fetch *fetch) {
+    UpstreamOrigin *origin = find_origin(pool, fetch->hostname, fetch->server_port);
+    struct Fetch *previous = NULL;
+    struct Fetch **link = &origin->queue_head;
+    while(*link != NULL && *link != fetch) {
+        previous = *link;
+        link = &(*link)->queue_next;
+    }
+    if(*link == NULL) {
+        return;
+    }
+    *link = fetch->queue_next;
+    if(origin->queue_tail == fetch) {
+        origin->queue_tail = previous;
+    }
+}
+
+// Given connection a fetch has finished with, keep it for the next request
+// to the origin if the response left it reusable, otherwise close it. A
+// fetch queued for the origin takes the connection, or its place
+void upstream_release(UpstreamPool *pool, UpstreamConnection *conn, bool reusable) {
+    UpstreamOrigin *origin = conn->origin;
+    conn->fetch = NULL;
+    if(reusable && pool->max_connections > 0) {
+        conn->requests += 1;
+        struct Fetch *fetch = dequeue(origin);
+        if(fetch != NULL) {
+            __atomic_fetch_add(&pool->table->connections_reused, 1, __ATOMIC_RELAXED);
+            conn->fetch = fetch;
+            fetch_attach(fetch, conn);
+            return;
+        }
+        conn->idle_since = monotonic_seconds();
+        conn->prev = NULL;
+        conn->next = origin->idle;
+        if(origin->idle != NULL) {
+            origin->idle->prev = conn;
+        }
+        origin->idle = conn;
+        event_loop_modify(pool->loop, &conn->source, EPOLLIN | EPOLLRDHUP);
+        return;
+    }
+
+    close_connection(pool, conn);
+    serve_queue(pool, origin, false);
+}
+
+// Dispatch readiness of an origin socket to the fetch using it. Idle
+// connections should stay silent until the next request is sent
+static void handle_upstream_event(EventSource *source, uint32_t events) {
+    UpstreamConnection *conn = source->context;
+    if(conn->fetch != NULL) {
+        fetch_handle_upstream_event(conn->fetch, events);
+        return;
+    }
+    (void) events;
+    idle_remove(conn);
+    close_connection(conn->pool, conn);
+}
+
+// Close connections that have been idle for longer than the timeout, and
+// forget origins left with no connections
+void upstream_pool_sweep(UpstreamPool *pool) {
+    time_t now = monotonic_seconds();
+    for(int i = 0; i < UPSTREAM_TABLE_SIZE; i++) {
+        UpstreamOrigin **link = &pool->buckets[i];
+        while(*link != NULL) {
+            UpstreamOrigin *origin = *link;
+            UpstreamConnection *conn = origin->idle;
+            while(conn != NULL) {
+                UpstreamConnection *next = conn->next;
+                if(now - conn->idle_since >= UPSTREAM_IDLE_TIMEOUT) {
+                    idle_remove(conn);
+                    close_connection(pool, conn);
+                }
+                conn = next;
+            }
+            if(origin->connections == 0 && origin->queue_head == NULL && !origin->resolving) {
+                *link = origin->next;
+                free(origin->hostname);
+                free(origin);
+            } else {
+                link = &origin->next;
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,86 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      upstream.h
+// Usage:       Header file for per-worker pools of persistent origin connections
+//*************************************************************************************************
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "event_loop.h"
+#include "resolver.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define UPSTREAM_TABLE_SIZE 256               // Origin buckets per pool, power of two
+#define DEFAULT_MAX_ORIGIN_CONNECTIONS 32     // Per origin and worker, 0 disables keep-alive
+#define UPSTREAM_IDLE_TIMEOUT 15              // Seconds an idle connection is kept open
+
+// ----STRUCT--------------------------------------------------------------------------------------
+struct Fetch;
+struct FetchTable;
+struct UpstreamOrigin;
+struct UpstreamPool;
+
+// A connection to an origin. While a fetch is using it, events on the
+// socket are passed to the fetch; while idle, any event means the origin
+// closed it or broke protocol, so it is dropped
+typedef struct UpstreamConnection{
+    struct UpstreamConnection *prev;   // Idle list of the origin
+    struct UpstreamConnection *next;
+    struct UpstreamPool *pool;
+    struct UpstreamOrigin *origin;
+    struct Fetch *fetch;
+    EventSource source;
+    bool connected;
+    uint64_t connect_started;          // For the connect latency
+    unsigned long requests;            // Responses completed on the connection
+    time_t idle_since;
+} UpstreamConnection;
+
+// Connections to one host and port. Fetches beyond the connection limit
+// queue here until a connection is released, as do fetches waiting for
+// the hostname to be looked up
+typedef struct UpstreamOrigin{
+    struct UpstreamOrigin *next;       // Pool bucket chain
+    struct UpstreamPool *pool;
+    char *hostname;
+    int port;
+    ResolverQuery query;               // Most recent lookup of the hostname
+    bool resolving;
+    unsigned int next_address;         // Spreads new connections over the addresses
+    UpstreamConnection *idle;          // Most recently used first
+    int connections;                   // Open connections, idle or in use
+    struct Fetch *queue_head;
+    struct Fetch *queue_tail;
+} UpstreamOrigin;
+
+// Each worker keeps its own pool, so connections are only ever used from
+// the worker's event loop and need no locking
+typedef struct UpstreamPool{
+    EventLoop *loop;
+    struct FetchTable *table;
+    Resolver *resolver;
+    ResolverMailbox *mailbox;          // Where lookups of the worker are answered
+    UpstreamOrigin *buckets[UPSTREAM_TABLE_SIZE];
+    int max_connections;
+} UpstreamPool;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+UpstreamPool *upstream_pool_create(EventLoop *loop, struct FetchTable *table, Resolver *resolver,
+                                   ResolverMailbox *mailbox, int max_connections);
+void upstream_pool_free(UpstreamPool *pool);
+int upstream_acquire(UpstreamPool *pool, struct Fetch *fetch);
+void upstream_cancel(UpstreamPool *pool, struct Fetch *fetch);
+void upstream_release(UpstreamPool *pool, UpstreamConnection *conn, bool reusable);
+void upstream_pool_sweep(UpstreamPool *pool);
+time_t monotonic_seconds(void);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
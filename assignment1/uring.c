@@ -0,0 +1,580 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      uring.c
+// Usage:       Implementation file for the io_uring backend of the event loop
+//*************************************************************************************************
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define URING_KIND_BITS 3
+#define URING_CHAIN_MAX 5                     // Cancellations of a source's requests and its close
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static uint64_t user_data(UringKind kind, int slot, uint32_t tag) {
+    return ((uint64_t) tag << 32) | ((uint64_t) slot << URING_KIND_BITS) | kind;
+}
+
+// Return true if the kernel can run the event loop on a ring: it has
+// io_uring and does not refuse it to this process
+bool uring_available(void) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = uring_setup(2, &params);
+    if(fd < 0) {
+        return false;
+    }
+    close(fd);
+    return (params.features & IORING_FEAT_NODROP) != 0;
+}
+
+// Create the ring, asking for completions to be posted only when the loop
+// waits for them, then for them to be posted at the next system call, then
+// as they happen, as far as the kernel supports. The ring starts disabled
+// so the thread running the loop, not the one creating it, is the one
+// submitting
+static int create_ring(Uring *ring, struct io_uring_params *params) {
+    unsigned setups[3] = {IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN, IORING_SETUP_COOP_TASKRUN, 0};
+    for(int i = 0; i < 3; i++) {
+        memset(params, 0, sizeof(*params));
+        params->flags = setups[i] | IORING_SETUP_R_DISABLED | IORING_SETUP_CQSIZE;
+        params->cq_entries = 2 * URING_ENTRIES;
+        ring->fd = uring_setup(URING_ENTRIES, params);
+        if(ring->fd >= 0) {
+            ring->enable_on_run = true;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Map the submission and completion queues, which share one mapping on
+// kernels that support it
+static int map_ring(Uring *ring, struct io_uring_params *params) {
+    ring->sq_map_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    bool single_map = (params->features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single_map && ring->cq_map_size > ring->sq_map_size) {
+        ring->sq_map_size = ring->cq_map_size;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        return -1;
+    }
+    if(single_map) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            return -1;
+        }
+    }
+    ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return -1;
+    }
+    char *sq = ring->sq_map;
+    char *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + params->sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params->sq_off.tail);
+    ring->sq_array = (unsigned *)(sq + params->sq_off.array);
+    ring->sq_mask = *(unsigned *)(sq + params->sq_off.ring_mask);
+    ring->sq_entries = params->sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + params->cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params->cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+    // Submission slots are always used in ring order
+    for(unsigned i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+    return 0;
+}
+
+// Hand buffer back to the kernel for the next receive to fill
+static void recycle_buffer(Uring *ring, uint16_t id) {
+    struct io_uring_buf *buffer = &ring->buffers->bufs[ring->buffer_tail & (URING_BUFFERS - 1)];
+    buffer->addr = (uint64_t)(uintptr_t)(ring->buffer_memory + (size_t) id * URING_BUFFER_SIZE);
+    buffer->len = URING_BUFFER_SIZE;
+    buffer->bid = id;
+    ring->buffer_tail += 1;
+    __atomic_store_n(&ring->buffers->tail, ring->buffer_tail, __ATOMIC_RELEASE);
+}
+
+// Register the receive buffers as a ring the kernel picks from itself, so
+// no buffer is tied up by a socket with nothing to read
+static int register_buffers(Uring *ring) {
+    size_t ring_size = URING_BUFFERS * sizeof(struct io_uring_buf);
+    ring->buffers = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring->buffers == MAP_FAILED) {
+        ring->buffers = NULL;
+        return -1;
+    }
+    ring->buffer_memory = malloc((size_t) URING_BUFFERS * URING_BUFFER_SIZE);
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t) ring->buffers;
+    registration.ring_entries = URING_BUFFERS;
+    registration.bgid = URING_BUFFER_GROUP;
+    if(uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        return -1;
+    }
+    for(int i = 0; i < URING_BUFFERS; i++) {
+        recycle_buffer(ring, (uint16_t) i);
+    }
+    return 0;
+}
+
+// Create ring with its receive buffers. Return NULL if the kernel lacks
+// any of the features the loop relies on
+Uring *uring_create(void) {
+    Uring *ring = calloc(1, sizeof(Uring));
+    struct io_uring_params params;
+    if(create_ring(ring, &params) < 0) {
+        free(ring);
+        return NULL;
+    }
+    if(map_ring(ring, &params) < 0 || register_buffers(ring) < 0) {
+        uring_free(ring);
+        return NULL;
+    }
+    ring->slot_capacity = 64;
+    ring->slot_count = 1;
+    ring->slots = calloc(ring->slot_capacity, sizeof(UringSlot));
+    ring->next_tag = 1;
+    return ring;
+}
+
+void uring_free(Uring *ring) {
+    if(ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if(ring->cq_map != NULL && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if(ring->sq_map != NULL) {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    close(ring->fd);
+    if(ring->buffers != NULL) {
+        munmap(ring->buffers, URING_BUFFERS * sizeof(struct io_uring_buf));
+    }
+    free(ring->buffer_memory);
+    free(ring->slots);
+    free(ring->dirty);
+    free(ring->starved);
+    free(ring);
+}
+
+// Hand queued requests to the kernel, optionally waiting for a completion.
+// Return -1 on failure, with errno set
+static int submit(Uring *ring, bool wait) {
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    int result = uring_enter(ring->fd, ring->to_submit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+    ring->to_submit = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    return (result < 0) ? -1 : 0;
+}
+
+// Return number of submission slots free for new requests
+static unsigned sq_space(Uring *ring) {
+    return ring->sq_entries - (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE));
+}
+
+// Return a cleared submission slot for a new request, submitting what is
+// queued first if the queue is full. Return NULL if it stays full
+static struct io_uring_sqe *next_sqe(Uring *ring, unsigned needed) {
+    if(sq_space(ring) < needed && submit(ring, false) < 0 && errno != EINTR && errno != EAGAIN &&
+       errno != EBUSY) {
+        perror("Error submitting to io_uring");
+    }
+    if(sq_space(ring) < needed) {
+        return NULL;
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_local_tail += 1;
+    ring->to_submit += 1;
+    return sqe;
+}
+
+static uint32_t new_tag(Uring *ring) {
+    uint32_t tag = ring->next_tag++;
+    if(ring->next_tag == 0) {
+        ring->next_tag = 1;
+    }
+    return tag;
+}
+
+// Mark slot to have its requests rearmed before the loop next waits
+static void mark_dirty(Uring *ring, int index) {
+    UringSlot *slot = &ring->slots[index];
+    if(slot->dirty) {
+        return;
+    }
+    if(ring->dirty_count == ring->dirty_capacity) {
+        ring->dirty_capacity = (ring->dirty_capacity == 0) ? 64 : ring->dirty_capacity * 2;
+        ring->dirty = realloc(ring->dirty, ring->dirty_capacity * sizeof(int));
+    }
+    ring->dirty[ring->dirty_count++] = index;
+    slot->dirty = true;
+}
+
+// Hold back the accept of listener slot until the batch after next
+static void starve(Uring *ring, int index) {
+    if(ring->starved_count == ring->starved_capacity) {
+        ring->starved_capacity = (ring->starved_capacity == 0) ? 4 : ring->starved_capacity * 2;
+        ring->starved = realloc(ring->starved, ring->starved_capacity * sizeof(int));
+    }
+    ring->starved[ring->starved_count++] = index;
+}
+
+// Queue cancellation of the request with the given user data. Its own
+// completion is only posted if nothing was found to cancel
+static bool queue_cancel(Uring *ring, uint64_t target, unsigned flags) {
+    struct io_uring_sqe *sqe = next_sqe(ring, 1);
+    if(sqe == NULL) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS | flags;
+    sqe->user_data = user_data(URING_INTERNAL, 0, 0);
+    return true;
+}
+
+// Queue the requests a source's mask calls for and that are not already
+// in flight. A listener with an accept handler gets a multishot accept,
+// and a source with a receive handler watching for input gets a receive
+// into a buffer from the ring. Anything else the mask asks for, or all of
+// it, is a one-shot poll
+static void arm(Uring *ring, int index) {
+    UringSlot *slot = &ring->slots[index];
+    EventSource *source = slot->source;
+    if(source->accepted != NULL) {
+        if(slot->accept_tag == 0) {
+            struct io_uring_sqe *sqe = next_sqe(ring, 1);
+            if(sqe == NULL) {
+                return;
+            }
+            slot->accept_tag = new_tag(ring);
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = source->fd;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->user_data = user_data(URING_ACCEPT, index, slot->accept_tag);
+        }
+        return;
+    }
+    if(source->receive != NULL && !slot->receive_done && (source->events & EPOLLIN) && slot->recv_tag == 0) {
+        struct io_uring_sqe *sqe = next_sqe(ring, 1);
+        if(sqe != NULL) {
+            slot->recv_tag = new_tag(ring);
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = source->fd;
+            sqe->len = URING_BUFFER_SIZE;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUFFER_GROUP;
+            sqe->user_data = user_data(URING_RECV, index, slot->recv_tag);
+        }
+    }
+    // A receive in flight reports input and the end of it itself
+    bool receiving = (slot->recv_tag != 0);
+    uint32_t poll_events = source->events;
+    if(receiving) {
+        poll_events &= ~(uint32_t)(EPOLLIN | EPOLLRDHUP);
+    }
+    if(slot->poll_tag != 0 && slot->poll_events != poll_events) {
+        queue_cancel(ring, user_data(URING_POLL, index, slot->poll_tag), 0);
+        slot->poll_tag = 0;
+    }
+    // Errors and hangups are reported even for an empty mask, as by epoll
+    if(slot->poll_tag == 0 && (poll_events != 0 || !receiving)) {
+        struct io_uring_sqe *sqe = next_sqe(ring, 1);
+        if(sqe == NULL) {
+            return;
+        }
+        slot->poll_tag = new_tag(ring);
+        slot->poll_events = poll_events;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = source->fd;
+        sqe->poll32_events = poll_events;
+        sqe->user_data = user_data(URING_POLL, index, slot->poll_tag);
+    }
+}
+
+// Register source, whose requests are queued when the loop next waits
+void uring_add(Uring *ring, EventSource *source) {
+    int index = ring->free_slot;
+    if(index != 0) {
+        ring->free_slot = ring->slots[index].next_free;
+    } else {
+        if(ring->slot_count == ring->slot_capacity) {
+            ring->slots = realloc(ring->slots, 2 * ring->slot_capacity * sizeof(UringSlot));
+            memset(ring->slots + ring->slot_capacity, 0, ring->slot_capacity * sizeof(UringSlot));
+            ring->slot_capacity *= 2;
+        }
+        index = ring->slot_count++;
+    }
+    UringSlot *slot = &ring->slots[index];
+    bool dirty = slot->dirty;
+    memset(slot, 0, sizeof(*slot));
+    slot->dirty = dirty;
+    slot->source = source;
+    source->slot = index;
+    mark_dirty(ring, index);
+}
+
+// The source's mask has changed. Requests are brought in line with it when
+// the loop next waits, so masks changed several times in a batch cost one
+// change of requests
+void uring_modify(Uring *ring, EventSource *source) {
+    mark_dirty(ring, source->slot);
+}
+
+// Queue a send of the message on source, whose completion is handed to its
+// send handler. Only one send is in flight for a source at a time. The
+// message need only last until submitted, the memory it points to until
+// the send completes. Return false if the send could not be queued
+bool uring_send(Uring *ring, EventSource *source, const struct msghdr *message) {
+    int index = source->slot;
+    UringSlot *slot = &ring->slots[index];
+    struct io_uring_sqe *sqe = next_sqe(ring, 1);
+    if(sqe == NULL) {
+        return false;
+    }
+    slot->send_tag = new_tag(ring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = source->fd;
+    sqe->addr = (uint64_t)(uintptr_t) message;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data(URING_SEND, index, slot->send_tag);
+    return true;
+}
+
+// Free slot for reuse by a source added later
+static void free_slot(Uring *ring, int index) {
+    UringSlot *slot = &ring->slots[index];
+    slot->source = NULL;
+    slot->removed = false;
+    slot->next_free = ring->free_slot;
+    ring->free_slot = index;
+}
+
+// Deregister source, cancelling its requests in flight, and close its
+// descriptor if asked. The close is linked after the cancellations, so it
+// runs once they have, whether or not they found anything to cancel, and
+// costs no system call of its own
+void uring_remove(Uring *ring, EventSource *source, bool close_fd) {
+    int index = source->slot;
+    UringSlot *slot = &ring->slots[index];
+    uint64_t in_flight[4];
+    int count = 0;
+    if(slot->poll_tag != 0) {
+        in_flight[count++] = user_data(URING_POLL, index, slot->poll_tag);
+    }
+    if(slot->recv_tag != 0) {
+        in_flight[count++] = user_data(URING_RECV, index, slot->recv_tag);
+    }
+    if(slot->accept_tag != 0) {
+        in_flight[count++] = user_data(URING_ACCEPT, index, slot->accept_tag);
+    }
+    if(slot->send_tag != 0) {
+        in_flight[count++] = user_data(URING_SEND, index, slot->send_tag);
+    }
+    bool linked = close_fd && sq_space(ring) >= URING_CHAIN_MAX;
+    for(int i = 0; i < count; i++) {
+        queue_cancel(ring, in_flight[i], linked ? IOSQE_IO_HARDLINK : 0);
+    }
+    if(close_fd) {
+        struct io_uring_sqe *sqe = linked ? next_sqe(ring, 1) : NULL;
+        if(sqe != NULL) {
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = source->fd;
+            sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+            sqe->user_data = user_data(URING_INTERNAL, 0, 0);
+        } else {
+            close(source->fd);
+        }
+    }
+    slot->poll_tag = 0;
+    slot->recv_tag = 0;
+    slot->accept_tag = 0;
+    if(slot->send_tag != 0) {
+        slot->removed = true;
+    } else {
+        free_slot(ring, index);
+    }
+    source->slot = 0;
+}
+
+// Given completion, return the slot it belongs to, or NULL if its source
+// has been removed or the request it answers has been replaced
+static UringSlot *completed_slot(Uring *ring, uint64_t data, UringKind kind) {
+    int index = (int)((uint32_t) data >> URING_KIND_BITS);
+    uint32_t tag = (uint32_t)(data >> 32);
+    if(index <= 0 || index >= ring->slot_count) {
+        return NULL;
+    }
+    UringSlot *slot = &ring->slots[index];
+    uint32_t current = (kind == URING_POLL) ? slot->poll_tag : (kind == URING_RECV) ? slot->recv_tag :
+                       (kind == URING_ACCEPT) ? slot->accept_tag : slot->send_tag;
+    if(slot->source == NULL || current != tag) {
+        return NULL;
+    }
+    return slot;
+}
+
+// Dispatch a completion to its source's handler. Sources are only touched
+// through their slot, which a handler earlier in the batch may have freed
+static void dispatch(Uring *ring, struct io_uring_cqe *cqe) {
+    UringKind kind = (UringKind)(cqe->user_data & ((1 << URING_KIND_BITS) - 1));
+    int index = (int)((uint32_t) cqe->user_data >> URING_KIND_BITS);
+    UringSlot *slot = completed_slot(ring, cqe->user_data, kind);
+    bool has_buffer = (cqe->flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t buffer = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    if(slot == NULL) {
+        // Keep the buffer of a stale receive, and never leak a client
+        // accepted for a listener since removed
+        if(has_buffer) {
+            recycle_buffer(ring, buffer);
+        }
+        if(kind == URING_ACCEPT && cqe->res >= 0) {
+            close(cqe->res);
+        }
+        return;
+    }
+    EventSource *source = slot->source;
+    switch(kind) {
+        case URING_POLL: {
+            slot->poll_tag = 0;
+            mark_dirty(ring, index);
+            uint32_t events = (cqe->res < 0) ? EPOLLERR : (uint32_t) cqe->res;
+            events &= source->events | EPOLLERR | EPOLLHUP;
+            if(events != 0) {
+                source->handler(source, events);
+            }
+            break;
+        }
+        case URING_RECV:
+            slot->recv_tag = 0;
+            mark_dirty(ring, index);
+            if(cqe->res > 0) {
+                source->receive(source, ring->buffer_memory + (size_t) buffer * URING_BUFFER_SIZE, cqe->res);
+            } else if(cqe->res != -ENOBUFS) {
+                slot->receive_done = true;
+                source->receive(source, NULL, cqe->res);
+            }
+            if(has_buffer) {
+                recycle_buffer(ring, buffer);
+            }
+            break;
+        case URING_SEND:
+            slot->send_tag = 0;
+            if(slot->removed) {
+                free_slot(ring, index);
+            }
+            source->sent(source, cqe->res);
+            break;
+        case URING_ACCEPT:
+            if(cqe->res == -EMFILE || cqe->res == -ENFILE) {
+                // The ring takes a descriptor before looking for a client,
+                // so accepting again at once would fail at once, waiting
+                // client or not. Wait for the next batch, which a closed
+                // connection or the worker's tick brings soon enough
+                if(!(cqe->flags & IORING_CQE_F_MORE)) {
+                    slot->accept_tag = 0;
+                    starve(ring, index);
+                }
+                event_loop_refuse_pending(source);
+                break;
+            }
+            if(!(cqe->flags & IORING_CQE_F_MORE)) {
+                slot->accept_tag = 0;
+                mark_dirty(ring, index);
+            }
+            if(cqe->res >= 0) {
+                source->accepted(source, cqe->res);
+            } else if(cqe->res != -ECANCELED) {
+                errno = -cqe->res;
+                perror("Error accepting connection");
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Queue the requests of every source changed since the loop last waited,
+// submit them and wait for at least one completion, then dispatch every
+// completion posted. Return -1 if the ring failed
+int uring_wait(Uring *ring) {
+    if(ring->enable_on_run) {
+        if(uring_register(ring->fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) < 0) {
+            perror("Error enabling io_uring");
+            return -1;
+        }
+        ring->enable_on_run = false;
+    }
+    for(int i = 0; i < ring->dirty_count; i++) {
+        int index = ring->dirty[i];
+        ring->slots[index].dirty = false;
+        if(ring->slots[index].source != NULL && !ring->slots[index].removed) {
+            arm(ring, index);
+        }
+    }
+    ring->dirty_count = 0;
+    int starved = ring->starved_count;
+    if(submit(ring, true) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        perror("Error waiting for io_uring completions");
+        return -1;
+    }
+    unsigned head = *ring->cq_head;
+    while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe cqe = ring->cqes[head & ring->cq_mask];
+        head += 1;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        dispatch(ring, &cqe);
+    }
+    if(starved > 0) {
+        for(int i = 0; i < starved; i++) {
+            mark_dirty(ring, ring->starved[i]);
+        }
+        ring->starved_count -= starved;
+        memmove(ring->starved, ring->starved + starved, ring->starved_count * sizeof(int));
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
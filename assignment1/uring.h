@@ -0,0 +1,112 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      uring.h
+// Usage:       Header file for the io_uring backend of the event loop
+//*************************************************************************************************
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+#include "event_loop.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define URING_ENTRIES 4096                    // Submission queue slots, completions get twice as many
+#define URING_BUFFERS 512                     // Provided receive buffers, power of two
+#define URING_BUFFER_SIZE 4096
+#define URING_BUFFER_GROUP 0
+
+// ----STRUCT--------------------------------------------------------------------------------------
+
+// Kind of request a completion answers, in the low bits of its user data
+typedef enum UringKind{
+    URING_INTERNAL,            // Cancellations and closes, whose results are not needed
+    URING_POLL,
+    URING_RECV,
+    URING_ACCEPT,
+    URING_SEND
+} UringKind;
+
+// A source registered with the ring. Completions carry the slot and the
+// tag of the request they answer rather than a pointer to the source, so
+// one arriving after its source was removed, or after the request was
+// replaced, is recognised and dropped. Tags are never reused. A source
+// removed with a send in flight keeps its slot until the send completes,
+// as the send reads memory the source's owner must keep until then
+typedef struct UringSlot{
+    EventSource *source;       // NULL once removed
+    bool removed;              // Removed, but waiting for its send to complete
+    uint32_t poll_tag;         // Requests in flight for the source, 0 if none
+    uint32_t poll_events;      // Mask the poll in flight was armed with
+    uint32_t recv_tag;
+    uint32_t accept_tag;
+    uint32_t send_tag;
+    bool receive_done;         // End of stream or an error received, so never rearmed
+    bool dirty;                // Listed to be rearmed before the next wait
+    int next_free;
+} UringSlot;
+
+// One io_uring instance per event loop, set up with raw system calls.
+// Readiness is asked for with one-shot polls rearmed after each dispatch,
+// as level-triggered epoll would report it, but the polls, the receives
+// and the cancellations for a whole batch go to the kernel with the same
+// io_uring_enter that waits for the next batch
+typedef struct Uring{
+    int fd;
+    bool enable_on_run;        // Created disabled, to be enabled by the thread submitting
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;    // Past the last request queued, published before entering
+    unsigned to_submit;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Receive buffers the kernel picks from, returned as soon as read
+    struct io_uring_buf_ring *buffers;
+    char *buffer_memory;
+    uint16_t buffer_tail;
+
+    UringSlot *slots;          // Slot 0 is never used, so 0 means unregistered
+    int slot_count;
+    int slot_capacity;
+    int free_slot;
+    int *dirty;
+    int dirty_count;
+    int dirty_capacity;
+    int *starved;              // Listeners out of descriptors, rearmed after the next batch
+    int starved_count;
+    int starved_capacity;
+    uint32_t next_tag;
+} Uring;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+bool uring_available(void);
+Uring *uring_create(void);
+void uring_free(Uring *ring);
+void uring_add(Uring *ring, EventSource *source);
+void uring_modify(Uring *ring, EventSource *source);
+void uring_remove(Uring *ring, EventSource *source, bool close_fd);
+bool uring_send(Uring *ring, EventSource *source, const struct msghdr *message);
+int uring_wait(Uring *ring);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------
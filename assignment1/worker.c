@@ -0,0 +1,231 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      worker.c
+// Usage:       Implementation file for worker threads
+//*************************************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+
+#include "worker.h"
+#include "connection.h"
+#include "prefetch.h"
+#include "tunnel.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+// Create non-blocking listening socket bound to port. SO_REUSEPORT lets
+// every worker bind its own socket to the same port
+int create_listening_socket(int port) {
+    struct sockaddr_in proxy_addr; // Struct for handling internet addresses
+
+    // Create listening socket
+    int proxy_listening_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(proxy_listening_socket < 0) {
+        perror("Error creating listening socket");
+        return -1;
+    }
+
+    // Initialize fields of struct for proxy server address
+    memset(&proxy_addr, 0, sizeof(proxy_addr)); // Set structure to 0's, ensuring sin_zero is all zeros
+    proxy_addr.sin_family = AF_INET;            // Set address family to IPv4
+    proxy_addr.sin_addr.s_addr = INADDR_ANY;    // Set IP address to all IP addresses of machine
+    proxy_addr.sin_port = htons(port);          // Set port number
+
+    // Set socket options to allow reuse of the address (fixes "address already in use" bug)
+    // and to let each worker bind its own listening socket to the port
+    int opt = 1;
+    if(setsockopt(proxy_listening_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+       setsockopt(proxy_listening_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("Error setting socket options");
+        close(proxy_listening_socket);
+        return -1;
+    }
+
+    // Bind socket to IP address and port (specificied in proxy_addr)
+    if(bind(proxy_listening_socket, (struct sockaddr *) &proxy_addr, sizeof(proxy_addr)) < 0 ){
+        perror("Error binding socket");
+        close(proxy_listening_socket);
+        return -1;
+    }
+
+    // Listen for incoming connections requests on "listening socket"
+    if(listen(proxy_listening_socket, LISTEN_BACKLOG) < 0) {
+        perror("Error listening on socket");
+        close(proxy_listening_socket);
+        return -1;
+    }
+    return proxy_listening_socket;
+}
+
+// Hand each new client socket to its own connection state machine
+static void accept_client(EventSource *source, int client_socket) {
+    Worker *worker = source->context;
+    connection_create(worker, client_socket);
+}
+
+// Wake worker from another thread so it serves its waiting connections
+void worker_notify(Worker *worker) {
+    uint64_t count = 1;
+    if(write(worker->notify.fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("Error notifying worker");
+    }
+}
+
+// Give every connection waiting on a fetch the chance to write whatever
+// has arrived since it last ran. Connections may close, and so leave the
+// list, while it is being walked
+void worker_process_waiting(Worker *worker) {
+    Connection *conn = worker->waiting;
+    while(conn != NULL) {
+        Connection *next = conn->waiting_next;
+        connection_fetch_progress(conn);
+        conn = next;
+    }
+}
+
+void worker_add_waiting(Worker *worker, Connection *conn) {
+    conn->waiting_prev = NULL;
+    conn->waiting_next = worker->waiting;
+    if(worker->waiting != NULL) {
+        worker->waiting->waiting_prev = conn;
+    }
+    worker->waiting = conn;
+}
+
+void worker_remove_waiting(Worker *worker, Connection *conn) {
+    if(conn->waiting_prev != NULL) {
+        conn->waiting_prev->waiting_next = conn->waiting_next;
+    } else {
+        worker->waiting = conn->waiting_next;
+    }
+    if(conn->waiting_next != NULL) {
+        conn->waiting_next->waiting_prev = conn->waiting_prev;
+    }
+}
+
+// Drain the notify eventfd, connect to origins whose addresses have been
+// looked up, resume fetches whose readers have caught up and serve
+// waiting connections
+static void handle_notify(EventSource *source, uint32_t events) {
+    Worker *worker = source->context;
+    uint64_t count;
+    (void) events;
+    if(read(source->fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("Error reading worker notification");
+    }
+    resolver_mailbox_drain(&worker->resolved);
+    Fetch *fetch = worker->fetches_owned;
+    while(fetch != NULL) {
+        Fetch *next = fetch->worker_next;
+        fetch_resume_requested(fetch);
+        fetch = next;
+    }
+    worker_process_waiting(worker);
+}
+
+// Drain the tick timerfd and fire the deadlines that have passed
+static void handle_tick(EventSource *source, uint32_t events) {
+    Worker *worker = source->context;
+    uint64_t expirations;
+    (void) events;
+    if(read(source->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        perror("Error reading worker timer");
+    }
+    timer_wheel_advance(&worker->timers);
+}
+
+// Close origin connections and tunnels idle for too long, and come back
+// for the next sweep
+static void sweep_idle(Timer *timer) {
+    Worker *worker = timer->context;
+    upstream_pool_sweep(worker->upstream);
+    tunnel_sweep(worker);
+    timer_set(&worker->timers, timer, WORKER_SWEEP_INTERVAL_MS);
+}
+
+// Given worker id, port, shared cache, table of fetches in flight and
+// resolver, create worker with its own event loop and listening socket
+Worker *worker_create(int id, int port, Cache *cache, FetchTable *fetches, Resolver *resolver) {
+    Worker *worker = calloc(1, sizeof(Worker));
+    worker->id = id;
+    worker->cache = cache;
+    worker->fetches = fetches;
+    worker->loop = event_loop_create();
+    if(worker->loop == NULL) {
+        free(worker);
+        return NULL;
+    }
+    worker->notify.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    worker->notify.handler = handle_notify;
+    worker->notify.context = worker;
+    resolver_mailbox_init(&worker->resolved, worker->notify.fd);
+    worker->upstream = upstream_pool_create(worker->loop, fetches, resolver, &worker->resolved,
+                                            fetches->max_origin_connections);
+    struct itimerspec interval = {{0, TIMER_TICK_MS * 1000000}, {0, TIMER_TICK_MS * 1000000}};
+    timer_wheel_init(&worker->timers);
+    timer_init(&worker->sweep, sweep_idle, worker);
+    timer_set(&worker->timers, &worker->sweep, WORKER_SWEEP_INTERVAL_MS);
+    worker->tick.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    worker->tick.handler = handle_tick;
+    worker->tick.context = worker;
+    worker->listener.fd = create_listening_socket(port);
+    worker->listener.accepted = accept_client;
+    worker->listener.refusal = SERVICE_UNAVAILABLE;
+    worker->listener.context = worker;
+    if(worker->notify.fd < 0 || worker->tick.fd < 0 || worker->listener.fd < 0 ||
+       timerfd_settime(worker->tick.fd, 0, &interval, NULL) < 0 ||
+       event_loop_add(worker->loop, &worker->notify, EPOLLIN) < 0 ||
+       event_loop_add(worker->loop, &worker->tick, EPOLLIN) < 0 ||
+       event_loop_add(worker->loop, &worker->listener, EPOLLIN) < 0) {
+        worker_free(worker);
+        return NULL;
+    }
+    fetches->workers[id] = worker;
+    return worker;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    event_loop_run(worker->loop);
+    return NULL;
+}
+
+// Run the worker's event loop on a new thread
+int worker_start(Worker *worker) {
+    return pthread_create(&worker->thread, NULL, worker_main, worker);
+}
+
+void worker_join(Worker *worker) {
+    pthread_join(worker->thread, NULL);
+}
+
+void worker_free(Worker *worker) {
+    if(worker->listener.fd >= 0) {
+        close(worker->listener.fd);
+    }
+    if(worker->notify.fd >= 0) {
+        close(worker->notify.fd);
+    }
+    if(worker->tick.fd >= 0) {
+        close(worker->tick.fd);
+    }
+    upstream_pool_free(worker->upstream);
+    prefetch_worker_free(worker);
+    resolver_mailbox_destroy(&worker->resolved);
+    event_loop_free(worker->loop);
+    free(worker);
+}
+
+//-------------------------------------------------------------------------------------------------
@@ -0,0 +1,73 @@
+//----HEADER---------------------------------------------------------------------------------------
+// Author:      Sam Rolfe
+// Date:        October 2026
+// Script:      worker.h
+// Usage:       Header file for worker threads
+//*************************************************************************************************
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <pthread.h>
+
+#include "cache.h"
+#include "event_loop.h"
+#include "fetch.h"
+#include "upstream.h"
+#include "resolver.h"
+#include "timer.h"
+
+// ----GLOBAL VARIABLES----------------------------------------------------------------------------
+#define LISTEN_BACKLOG 4096
+#define MAX_WORKERS 64
+#define WORKER_SWEEP_INTERVAL_MS 1000 // Between sweeps of idle origin connections and tunnels
+
+// ----STRUCT--------------------------------------------------------------------------------------
+struct Connection;
+struct Tunnel;
+
+// Each worker runs its own event loop on its own thread with its own
+// SO_REUSEPORT listening socket, so the kernel spreads incoming
+// connections across workers. The cache and the table of fetches in
+// flight are the only shared state. Fetches running on other workers wake
+// this one through its notify eventfd when connections waiting on them
+// have more of the response to write. Origin connections are kept open
+// between requests in a pool private to the worker. Deadlines of the
+// worker's connections and fetches are kept on its own timer wheel
+typedef struct Worker{
+    int id;
+    pthread_t thread;
+    EventLoop *loop;
+    Cache *cache;
+    FetchTable *fetches;
+    EventSource listener;
+    EventSource notify;
+    EventSource tick;              // Advances the timer wheel every TIMER_TICK_MS
+    TimerWheel timers;
+    Timer sweep;                   // Closes idle origin connections and tunnels
+    UpstreamPool *upstream;        // Connections to origins, used only by this worker
+    ResolverMailbox resolved;      // Hostname lookups answered for this worker
+    struct Connection *waiting;    // Connections streaming a fetch
+    Fetch *fetches_owned;          // Fetches running on this worker
+    struct Tunnel *tunnels;        // CONNECT tunnels relaying for this worker's clients
+    struct PrefetchLink *prefetch_queue;      // Links found in pages, waiting for a slot
+    struct PrefetchLink *prefetch_queue_tail;
+    int prefetch_queued;
+    int prefetches_in_flight;      // Prefetches running on this worker
+} Worker;
+
+//----FUNCTIONS------------------------------------------------------------------------------------
+
+int create_listening_socket(int port);
+Worker *worker_create(int id, int port, Cache *cache, FetchTable *fetches, Resolver *resolver);
+int worker_start(Worker *worker);
+void worker_join(Worker *worker);
+void worker_free(Worker *worker);
+void worker_notify(Worker *worker);
+void worker_process_waiting(Worker *worker);
+void worker_add_waiting(Worker *worker, struct Connection *conn);
+void worker_remove_waiting(Worker *worker, struct Connection *conn);
+
+//----MAIN-----------------------------------------------------------------------------------------
+
+#endif
+//-------------------------------------------------------------------------------------------------